@@ -24,7 +24,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), shape_version_(0) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -73,6 +73,12 @@ class Blob {
   }
   inline int num_axes() const { return shape_.size(); }
   inline int count() const { return count_; }
+  /**
+   * @brief A counter that changes whenever the shape of the blob changes or
+   *        it starts sharing the memory of another blob, so that Layer%s can
+   *        tell whether they need to reshape again.
+   */
+  inline size_t shape_version() const { return shape_version_; }
 
   /**
    * @brief Compute the volume of a slice; i.e., the product of dimensions
@@ -226,6 +232,28 @@ class Blob {
   Dtype* mutable_gpu_data();
   Dtype* mutable_cpu_diff();
   Dtype* mutable_gpu_diff();
+  /**
+   * @brief Returns the data in half precision, for float blobs only. The copy
+   *        is kept until the data is handed out writable, or widened after
+   *        CompactDataToHalf().
+   */
+  const uint16_t* cpu_half_data() const;
+  /**
+   * @brief Keeps only the half precision copy of the data, halving its
+   *        memory, until the data is read at full precision again.
+   */
+  void CompactDataToHalf();
+  /**
+   * @brief Drops the data if only its half precision copy is kept, rather
+   *        than widening it just to overwrite it.
+   */
+  inline void DiscardHalfData() {
+    if (data_at_half()) { data_->discard_half(); }
+  }
+  /// @brief Whether only the half precision copy of the data is up to date.
+  inline bool data_at_half() const {
+    return data_ && data_->head() == SyncedMemory::HEAD_AT_HALF;
+  }
   void Update();
   void FromProto(const BlobProto& proto, bool reshape = true);
   void ToProto(BlobProto* proto, bool write_diff = false) const;
@@ -262,6 +290,14 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to a SyncedMemory that may be shared with
+   *        other Blob%s of different shapes, e.g. by Net's memory planner.
+   *
+   * The memory must be large enough for the current capacity of this Blob.
+   * A later Reshape beyond that capacity gives the Blob its own memory again.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& memory);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -272,6 +308,7 @@ class Blob {
   vector<int> shape_;
   int count_;
   int capacity_;
+  size_t shape_version_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
@@ -0,0 +1,69 @@
+#ifndef CAFFE_INFERENCE_SESSION_HPP_
+#define CAFFE_INFERENCE_SESSION_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief Serves one TEST-phase model to many threads while holding its
+ *        parameters only once.
+ *
+ * The session owns a Net with the trained weights. Every thread that runs
+ * the model creates its own context with CreateContext(): a Net with private
+ * layers, activations and scratch buffers that uses the parameter blobs of
+ * the session, and the weights its layers derive from them (e.g. Winograd
+ * transformed or INT8 quantized filters), without allocating or filling any
+ * of its own. Contexts may run concurrently, but a single context must only
+ * be used by one thread at a time.
+ *
+ * Load the weights before creating the first context; from then on they are
+ * treated as immutable.
+ */
+template <typename Dtype>
+class InferenceSession {
+ public:
+  explicit InferenceSession(const NetParameter& param);
+  InferenceSession(const string& param_file, const string& trained_file);
+
+  /// @brief Loads the weights. Must be called before CreateContext().
+  void CopyTrainedLayersFrom(const string& trained_filename);
+  void CopyTrainedLayersFrom(const NetParameter& param);
+
+  /**
+   * @brief Creates an execution context for the calling thread, sharing the
+   *        parameters of the session. May be called from any thread.
+   */
+  shared_ptr<Net<Dtype> > CreateContext();
+
+  /// @brief The Net holding the parameters shared by all contexts.
+  inline const Net<Dtype>& net() const { return *net_; }
+
+ protected:
+  void Init(const NetParameter& param);
+  // Makes sure the parameter memory and the weights the layers derive from
+  // it are allocated and up to date on the device, so that concurrent
+  // readers never have to synchronize them.
+  void Freeze();
+
+  NetParameter param_;
+  shared_ptr<Net<Dtype> > net_;
+  shared_ptr<boost::mutex> mutex_;
+  bool frozen_;
+
+  DISABLE_COPY_AND_ASSIGN(InferenceSession);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INFERENCE_SESSION_HPP_
@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -19,6 +20,8 @@ namespace boost { class mutex; }
 
 namespace caffe {
 
+template <typename Dtype> class Epilogue;
+
 /**
  * @brief An interface for the units of computation which can be composed into a
  *        Net.
@@ -70,6 +73,7 @@ class Layer {
     CheckBlobCounts(bottom, top);
     LayerSetUp(bottom, top);
     Reshape(bottom, top);
+    RecordReshape(bottom, top);
     SetLossWeights(top);
   }
 
@@ -294,6 +298,55 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward may skip Reshape when no bottom or top blob
+   *        changed its shape_version() since the last Reshape.
+   *
+   * Layers whose Reshape depends on anything but the shapes of their blobs,
+   * e.g. on the bottom data, should return false.
+   */
+  virtual inline bool AllowSkipReshape() const { return true; }
+
+  /**
+   * @brief Return whether Forward_cpu computes from blobs_[0] in half
+   *        precision when only that copy is kept, see
+   *        Blob::CompactDataToHalf(), rather than widening it again.
+   */
+  virtual inline bool ReadsHalfWeights() const { return false; }
+
+  /**
+   * @brief Brings the copies Forward_cpu derives from the weights (e.g.
+   *        transformed or quantized weights) up to date. Forward does this
+   *        by itself; calling it first leaves Forward only reading them.
+   */
+  virtual void UpdateWeightCaches() {}
+
+  /**
+   * @brief Makes the layer read the derived weights of other instead of its
+   *        own. Other must have the same type and parameters, its caches
+   *        must be up to date and the two layers must share their blobs.
+   *        May be called before SetUp.
+   */
+  virtual void ShareWeightCaches(const Layer& other) {}
+
+  /**
+   * @brief Return whether Forward_cpu applies the epilogue set with
+   *        set_epilogue() to top[0].
+   */
+  virtual inline bool AllowEpilogue() const { return false; }
+  /**
+   * @brief Fuses an element-wise activation into the layer, to be applied to
+   *        top[0] at the end of Forward_cpu. Only for layers returning true
+   *        from AllowEpilogue(); the Net then skips the activation layer.
+   */
+  inline void set_epilogue(const shared_ptr<Epilogue<Dtype> >& epilogue) {
+    CHECK(AllowEpilogue()) << type() << " Layer cannot apply an epilogue.";
+    epilogue_ = epilogue;
+  }
+  inline const shared_ptr<Epilogue<Dtype> >& epilogue() const {
+    return epilogue_;
+  }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -331,6 +384,13 @@ class Layer {
    *  the objective function. */
   vector<Dtype> loss_;
 
+  /** The bottom and top blobs of the last Reshape, with their shape versions
+   *  at that time. */
+  vector<pair<const Blob<Dtype>*, size_t> > reshape_versions_;
+
+  /** The activation fused into Forward_cpu, if any. */
+  shared_ptr<Epilogue<Dtype> > epilogue_;
+
   /** @brief Using the CPU device, compute the layer output. */
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) = 0;
@@ -427,6 +487,35 @@ class Layer {
     }
   }
 
+  /** Whether the blobs changed since the last Reshape, see AllowSkipReshape. */
+  inline bool NeedsReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) const {
+    if (!AllowSkipReshape() ||
+        reshape_versions_.size() != bottom.size() + top.size()) {
+      return true;
+    }
+    for (int i = 0; i < reshape_versions_.size(); ++i) {
+      const Blob<Dtype>* blob =
+          (i < bottom.size()) ? bottom[i] : top[i - bottom.size()];
+      if (reshape_versions_[i].first != blob ||
+          reshape_versions_[i].second != blob->shape_version()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /** Remembers the blobs and their shape versions after a Reshape. */
+  inline void RecordReshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    reshape_versions_.resize(bottom.size() + top.size());
+    for (int i = 0; i < reshape_versions_.size(); ++i) {
+      const Blob<Dtype>* blob =
+          (i < bottom.size()) ? bottom[i] : top[i - bottom.size()];
+      reshape_versions_[i] = make_pair(blob, blob->shape_version());
+    }
+  }
+
  private:
   /** Whether this layer is actually shared by other nets*/
   bool is_shared_;
@@ -453,7 +542,10 @@ inline Dtype Layer<Dtype>::Forward(const vector<Blob<Dtype>*>& bottom,
   // Lock during forward to ensure sequential forward
   Lock();
   Dtype loss = 0;
-  Reshape(bottom, top);
+  if (NeedsReshape(bottom, top)) {
+    Reshape(bottom, top);
+    RecordReshape(bottom, top);
+  }
   switch (Caffe::mode()) {
   case Caffe::CPU:
     Forward_cpu(bottom, top);
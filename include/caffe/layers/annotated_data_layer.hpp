@@ -12,6 +12,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -30,12 +31,39 @@ class AnnotatedDataLayer : public BasePrefetchingDataLayer<Dtype> {
 
  protected:
   virtual void load_batch(Batch<Dtype>* batch);
+  /**
+   * @brief Samples, crops and transforms the item_id-th datum of the batch
+   *        being loaded into its place in the batch, using transformer and
+   *        the scratch blob transformed.
+   */
+  void TransformItem(const int item_id, DataTransformer<Dtype>* transformer,
+      Blob<Dtype>* transformed);
+  /**
+   * @brief TransformItem on a transform thread: reseeds the random streams
+   *        of the thread from the seed of the item.
+   */
+  void TransformTask(const int item_id, const int thread_id);
 
   DataReader<AnnotatedDatum> reader_;
   bool has_anno_type_;
   AnnotatedDatum_AnnotationType anno_type_;
   vector<BatchSampler> batch_samplers_;
   string label_map_file_;
+
+  // The transform threads and their transformers and scratch blobs; thread 0
+  // is the prefetch thread itself.
+  shared_ptr<ThreadPool> transform_pool_;
+  vector<shared_ptr<DataTransformer<Dtype> > > thread_transformers_;
+  vector<shared_ptr<Blob<Dtype> > > thread_transformed_data_;
+  // Draws the seeds of the items.
+  shared_ptr<Caffe::RNG> seed_rng_;
+  // The batch being loaded, shared with the transform threads.
+  Batch<Dtype>* batch_;
+  Dtype* batch_data_;
+  Dtype* batch_label_;
+  vector<AnnotatedDatum*> batch_datums_;
+  vector<unsigned int> batch_seeds_;
+  vector<vector<AnnotationGroup> > batch_annotations_;
 };
 
 }  // namespace caffe
@@ -34,12 +34,21 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   // we just called weight_cpu_gemm with the same input.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
+  // forward_cpu_gemm with the weights in half precision.
+  void forward_cpu_gemm_half(const Dtype* input, const uint16_t* weights,
+      Dtype* output);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
       Dtype* output);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
       weights);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
+  // Convolves a single group of a single image, using col_buff as the im2col
+  // scratch for that group (kernel_dim x out spatial dim). Unlike
+  // forward_cpu_gemm this does not touch col_buffer_, so CPU engines can run
+  // several images and groups at once with their own buffers.
+  void forward_cpu_gemm_group(const Dtype* input, const Dtype* weights,
+      Dtype* output, int group, Dtype* col_buff);
 
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
@@ -51,6 +51,25 @@ class Batch {
   Blob<Dtype> data_, label_;
 };
 
+/**
+ * @brief Counters of how well the prefetch thread of a layer keeps ahead of
+ *        its Forward calls.
+ */
+struct PrefetchStats {
+  PrefetchStats() : batches(0), stalls(0), stall_ms(0), occupancy(0) {}
+  // The batches Forward took from the ring.
+  int batches;
+  // The batches Forward had to wait for, and the total time it waited.
+  int stalls;
+  double stall_ms;
+  // The sum over batches of the number of batches ready when Forward came.
+  double occupancy;
+
+  inline double mean_occupancy() const {
+    return batches > 0 ? occupancy / batches : 0;
+  }
+};
+
 template <typename Dtype>
 class BasePrefetchingDataLayer :
     public BaseDataLayer<Dtype>, public InternalThread {
@@ -67,16 +86,31 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
-  // Prefetches batches (asynchronously if to GPU memory)
-  static const int PREFETCH_COUNT = 3;
+  inline const PrefetchStats& prefetch_stats() const {
+    return prefetch_stats_;
+  }
 
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  // Takes the next loaded batch, waiting for the prefetch thread if needed,
+  // and returns the batch held by the tops in zero copy mode to the ring.
+  Batch<Dtype>* PopBatch();
+
+  // The depth of the ring unless data_param().prefetch() is set.
+  static const int PREFETCH_COUNT = 3;
 
-  Batch<Dtype> prefetch_[PREFETCH_COUNT];
+  // Prefetches batches (asynchronously if to GPU memory) into a ring of
+  // data_param().prefetch() batches, or PREFETCH_COUNT.
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // With data_param().zero_copy(), the tops point into the batch of the last
+  // Forward instead of holding a copy of it, so that batch stays out of the
+  // ring until the next Forward.
+  bool zero_copy_;
+  Batch<Dtype>* prefetch_current_;
+  PrefetchStats prefetch_stats_;
 
   Blob<Dtype> transformed_data_;
 };
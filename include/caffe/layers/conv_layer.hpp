@@ -58,13 +58,18 @@ class ConvolutionLayer : public BaseConvolutionLayer<Dtype> {
    *  first group and input channels 3-4 and output channels 5-8 into the second
    *  group.
    *  - bias_term (\b optional, default true). Whether to have a bias.
-   *  - engine: convolution has CAFFE (matrix multiplication) and CUDNN (library
-   *    kernels + stream parallelism) engines.
+   *  - engine: convolution has CAFFE (matrix multiplication), PARALLEL
+   *    (matrix multiplication over the CPU thread pool), IMPLICIT_GEMM (tiled
+   *    matrix multiplication without a full column buffer), WINOGRAD (fast
+   *    3x3 convolution on CPU) and CUDNN (library kernels + stream
+   *    parallelism) engines.
    */
   explicit ConvolutionLayer(const LayerParameter& param)
       : BaseConvolutionLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "Convolution"; }
+  virtual inline bool AllowEpilogue() const { return true; }
+  virtual inline bool ReadsHalfWeights() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -0,0 +1,51 @@
+#ifndef CAFFE_DEPTHWISE_CONV_LAYER_HPP_
+#define CAFFE_DEPTHWISE_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Direct CPU implementation of depthwise ConvolutionLayer%s, i.e. of
+ *        2D convolutions with as many groups as input channels. Falls back to
+ *        ConvolutionLayer for other convolutions, the backward pass and GPU
+ *        mode.
+ *
+ * The im2col + GEMM path runs one degenerate GEMM per channel. This engine
+ * instead slides each filter over its input plane: every output row is
+ * accumulated one filter tap at a time over the range of outputs for which
+ * the tap falls inside the input, so the inner loops have no bounds checks
+ * and vectorize. Handles any kernel size, stride, dilation, padding and
+ * channel multiplier (num_output / channels); the output planes are spread
+ * over the global ThreadPool. Selected with engine: DEPTHWISE, and by
+ * default for grouped convolutions running on the CAFFE engine.
+ */
+template <typename Dtype>
+class DepthwiseConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DepthwiseConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual inline bool ReadsHalfWeights() const { return false; }
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  void forward_task(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, const Epilogue<Dtype>* epilogue, Dtype* top_data,
+      int task_id, int thread_id);
+
+  bool use_depthwise_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DEPTHWISE_CONV_LAYER_HPP_
@@ -110,6 +110,27 @@ class DetectionOutputLayer : public Layer<Dtype> {
   Blob<Dtype> bbox_preds_;
   Blob<Dtype> bbox_permute_;
   Blob<Dtype> conf_permute_;
+
+  // Tasks of Forward_cpu, run on the global ThreadPool. Each one only writes
+  // the slots of its own (image, class) or image, so the output does not
+  // depend on the number of threads.
+  void decode_task(const Dtype* loc_data, int task_id, int thread_id);
+  void nms_task(const Dtype* conf_data, int task_id, int thread_id);
+  void keep_top_k_task(const Dtype* conf_data, int image, int thread_id);
+
+  // Scratch space of Forward_cpu, kept across calls so that the steady state
+  // does not allocate.
+  vector<float> prior_bboxes_;     // num_priors x 4
+  vector<float> prior_variances_;  // num_priors x 4
+  vector<float> decode_bboxes_;    // num x num_loc_classes x num_priors x 4
+  vector<float> decode_sizes_;     // num x num_loc_classes x num_priors
+  vector<vector<int> > indices_;   // num x num_classes kept prior indices
+  vector<int> num_kept_;           // num
+  // One per thread of the pool.
+  vector<vector<float> > class_scores_;
+  vector<vector<pair<float, int> > > score_index_;
+  vector<vector<float> > kept_bboxes_;
+  vector<vector<pair<float, pair<int, int> > > > score_index_pairs_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,51 @@
+#ifndef CAFFE_IMPLICIT_GEMM_CONV_LAYER_HPP_
+#define CAFFE_IMPLICIT_GEMM_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief CPU ConvolutionLayer that never materializes the full im2col buffer.
+ *        Falls back to ConvolutionLayer for N-D inputs, the backward pass and
+ *        GPU mode.
+ *
+ * The output positions of every image and group are cut into tiles whose
+ * column matrix fits in a small, cache sized buffer. Each tile is im2col'ed,
+ * multiplied with the filters and written to the top together with the bias,
+ * so the forward scratch memory no longer grows with the spatial size of the
+ * layer. Tiles are spread over the global ThreadPool, every thread owning one
+ * column and one output tile buffer.
+ */
+template <typename Dtype>
+class ImplicitGemmConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit ImplicitGemmConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual inline bool ReadsHalfWeights() const { return false; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  void forward_task(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, const Epilogue<Dtype>* epilogue, Dtype* top_data,
+      int task_id, int thread_id);
+
+  /// @brief The number of output positions handled by one tile.
+  int tile_size_;
+  int num_tiles_;
+  /// @brief Per pool thread im2col tile and output tile buffers.
+  vector<shared_ptr<Blob<Dtype> > > col_tiles_;
+  vector<shared_ptr<Blob<Dtype> > > output_tiles_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_IMPLICIT_GEMM_CONV_LAYER_HPP_
@@ -0,0 +1,61 @@
+#ifndef CAFFE_INT8_CONV_LAYER_HPP_
+#define CAFFE_INT8_CONV_LAYER_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Post-training quantized CPU ConvolutionLayer. Falls back to
+ *        ConvolutionLayer for N-D inputs, the backward pass and GPU mode.
+ *
+ * The filters are quantized to int8 with one scale per output channel, and
+ * each bottom with the scale given by its calibrated range in
+ * quantization_param (or by its own range, if there is none). Like the
+ * IMPLICIT_GEMM engine, the output positions are cut into cache sized tiles,
+ * spread over the global ThreadPool; every tile gathers the int8 input patch
+ * of each of its positions into a row, takes the int32 dot products of these
+ * rows with the filters, and writes them back to the top scaled to floating
+ * point, together with the bias.
+ */
+template <typename Dtype>
+class Int8ConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit Int8ConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param),
+        weights_(new QuantizedWeights<Dtype>()) {}
+  virtual inline bool ReadsHalfWeights() const { return false; }
+  virtual void UpdateWeightCaches();
+  virtual void ShareWeightCaches(const Layer<Dtype>& other);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  void forward_task(const Dtype input_scale, const Dtype* bias,
+      const Epilogue<Dtype>* epilogue, Dtype* top_data, int task_id,
+      int thread_id);
+
+  shared_ptr<QuantizedWeights<Dtype> > weights_;
+  /// @brief The quantized bottom being convolved.
+  vector<int16_t> input_;
+  /// @brief The number of output positions handled by one tile.
+  int tile_size_;
+  int num_tiles_;
+  /// @brief Per pool thread patch row and int32 product tile buffers.
+  vector<vector<int16_t> > row_tiles_;
+  vector<vector<int32_t> > product_tiles_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INT8_CONV_LAYER_HPP_
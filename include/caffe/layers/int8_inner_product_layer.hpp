@@ -0,0 +1,56 @@
+#ifndef CAFFE_INT8_INNER_PRODUCT_LAYER_HPP_
+#define CAFFE_INT8_INNER_PRODUCT_LAYER_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Post-training quantized CPU InnerProductLayer. Falls back to
+ *        InnerProductLayer for the backward pass and GPU mode.
+ *
+ * The weights are quantized to int8 with one scale per output, and the
+ * bottom with the scale given by its calibrated range in quantization_param
+ * (or by its own range, if there is none). Blocks of outputs small enough for
+ * their weights to stay in cache are spread over the global ThreadPool, and
+ * the int32 dot products are scaled back to floating point.
+ */
+template <typename Dtype>
+class Int8InnerProductLayer : public InnerProductLayer<Dtype> {
+ public:
+  explicit Int8InnerProductLayer(const LayerParameter& param)
+      : InnerProductLayer<Dtype>(param),
+        weights_(new QuantizedWeights<Dtype>()) {}
+  virtual inline bool ReadsHalfWeights() const { return false; }
+  virtual void UpdateWeightCaches();
+  virtual void ShareWeightCaches(const Layer<Dtype>& other);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  void forward_task(const Dtype input_scale, const Dtype* bias,
+      Dtype* top_data, int task_id, int thread_id);
+
+  shared_ptr<QuantizedWeights<Dtype> > weights_;
+  /// @brief The quantized bottom.
+  vector<int16_t> input_;
+  /// @brief The number of outputs handled by one task.
+  int block_size_;
+  int num_blocks_;
+  /// @brief Per pool thread int32 product buffers.
+  vector<vector<int32_t> > product_blocks_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_INT8_INNER_PRODUCT_LAYER_HPP_
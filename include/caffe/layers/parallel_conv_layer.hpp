@@ -0,0 +1,46 @@
+#ifndef CAFFE_PARALLEL_CONV_LAYER_HPP_
+#define CAFFE_PARALLEL_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Multi-threaded CPU implementation of ConvolutionLayer.
+ *        Falls back to ConvolutionLayer for the backward pass and GPU mode.
+ *
+ * The forward pass splits the (image, group) pairs of the batch across the
+ * global ThreadPool. Every thread owns an im2col buffer of a single group, so
+ * the scratch memory grows with the thread count instead of the batch size.
+ * Selected with engine: PARALLEL in the ConvolutionParameter.
+ */
+template <typename Dtype>
+class ParallelConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit ParallelConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual inline bool ReadsHalfWeights() const { return false; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  void forward_task(const Dtype* bottom_data, const Dtype* weight,
+      const Epilogue<Dtype>* epilogue, Dtype* top_data, int task_id,
+      int thread_id);
+  void bias_task(const Dtype* bias, const Epilogue<Dtype>* epilogue,
+      Dtype* top_data, int n, int thread_id);
+
+  /// @brief One im2col buffer per pool thread.
+  vector<shared_ptr<Blob<Dtype> > > col_buffers_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_PARALLEL_CONV_LAYER_HPP_
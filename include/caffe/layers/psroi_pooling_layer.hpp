@@ -58,6 +58,14 @@ class PSROIPoolingLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  // The CPU passes run on the global ThreadPool: forward over (ROI, output
+  // channel) pairs, backward over output channels.
+  void forward_task(const Dtype* bottom_data, const Dtype* bottom_rois,
+    Dtype* top_data, int* mapping_channel, int task_id, int thread_id);
+  void backward_task(const Dtype* top_diff, const int* mapping_channel,
+    const int num_rois, const Dtype* bottom_rois, Dtype* bottom_diff,
+    int ctop, int thread_id);
+
   Dtype spatial_scale_;
   int output_dim_;
   int group_size_;
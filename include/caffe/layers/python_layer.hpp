@@ -39,6 +39,8 @@ class PythonLayer : public Layer<Dtype> {
   }
 
   virtual inline const char* type() const { return "Python"; }
+  // The Python reshape may depend on more than the blob shapes.
+  virtual inline bool AllowSkipReshape() const { return false; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -0,0 +1,70 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd F(2x2, 3x3) CPU implementation of ConvolutionLayer.
+ *        Falls back to ConvolutionLayer for other filter shapes, the backward
+ *        pass and GPU mode.
+ *
+ * Every 2x2 output tile is computed from a 4x4 input tile with 16 instead of
+ * 36 multiplications: the input tiles and filters are moved to the Winograd
+ * domain, multiplied there as 16 independent GEMMs over the channels, and the
+ * products are transformed back. The filters are transformed at setup and
+ * again only when their memory was written to or replaced (e.g. by loading
+ * weights or a solver update), which Forward checks from the version of the
+ * SyncedMemory without reading the filters. Handles 2D, 3x3, stride 1,
+ * non-dilated filters with any padding and group; blocks of tiles run on the
+ * global ThreadPool.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), use_winograd_(false),
+        transformed_weights_(new Blob<Dtype>()), cached_version_(-1) {}
+  virtual inline bool ReadsHalfWeights() const { return false; }
+  virtual void UpdateWeightCaches();
+  virtual void ShareWeightCaches(const Layer<Dtype>& other);
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Updates transformed_weights_ if the filters may have changed.
+  void TransformWeights();
+  void forward_task(const Dtype* bottom_data, const Dtype* bias,
+      const Epilogue<Dtype>* epilogue, Dtype* top_data, int task_id,
+      int thread_id);
+
+  bool use_winograd_;
+  int tiles_h_, tiles_w_;
+  /// @brief The number of tiles transformed and multiplied at once.
+  int block_size_;
+  int num_blocks_;
+  /// @brief Filters in the Winograd domain: group x 16 x out x in channels.
+  shared_ptr<Blob<Dtype> > transformed_weights_;
+  /// @brief The memory and version of the filters transformed_weights_ was
+  ///        computed from.
+  shared_ptr<SyncedMemory> cached_memory_;
+  int cached_version_;
+  /// @brief Per pool thread transformed input and product buffers.
+  vector<shared_ptr<Blob<Dtype> > > input_buffers_;
+  vector<shared_ptr<Blob<Dtype> > > product_buffers_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
@@ -23,7 +23,14 @@ namespace caffe {
 template <typename Dtype>
 class Net {
  public:
-  explicit Net(const NetParameter& param, const Net* root_net = NULL);
+  /**
+   * @param param_net if given, a net built from the same param whose layers
+   *        lend theirs their parameter blobs and derived weights, so that
+   *        this net neither allocates nor fills its own. See
+   *        InferenceSession.
+   */
+  explicit Net(const NetParameter& param, const Net* root_net = NULL,
+      const Net* param_net = NULL);
   explicit Net(const string& param_file, Phase phase,
       const int level = 0, const vector<string>* stages = NULL,
       const Net* root_net = NULL);
@@ -75,6 +82,10 @@ class Net {
    * provided during the forward pass.
    */
   void Backward();
+  /**
+   * Invokes the callbacks for every learnable param as soon as no layer left
+   * between start and end adds to its diff, see diff_ready_params().
+   */
   void BackwardFromTo(int start, int end);
   void BackwardFrom(int start);
   void BackwardTo(int end);
@@ -107,8 +118,23 @@ class Net {
   /**
    * @brief For an already initialized net, implicitly copies (i.e., using no
    *        additional memory) the pre-trained layers from another Net.
+   *        The layers removed by NetParameter.fold_batch_norm are folded
+   *        into copies of the weights of their targets instead.
    */
   void ShareTrainedLayersWith(const Net* other);
+  /**
+   * @brief Keeps only a half precision copy of the weights of the layers that
+   *        compute from it, see NetParameter.half_weights. Loading weights
+   *        does this; call it again after writing them in another way.
+   */
+  void CompactHalfWeights();
+  /**
+   * @brief For an already initialized net, copies the weights of the layers
+   *        of another net into its own memory, e.g. to test a consistent
+   *        snapshot of a net being trained, folding those of the layers
+   *        removed by NetParameter.fold_batch_norm.
+   */
+  void CopyTrainedLayersFrom(const Net* other);
   // For an already initialized net, CopyTrainedLayersFrom() copies the already
   // trained layers from another net parameter instance.
   /**
@@ -120,10 +146,19 @@ class Net {
   void CopyTrainedLayersFrom(const string trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string trained_filename);
   void CopyTrainedLayersFromHDF5(const string trained_filename);
+  void CopyTrainedLayersFromMapped(const string trained_filename);
   /// @brief Writes the net to a proto.
   void ToProto(NetParameter* param, bool write_diff = false) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
+  /**
+   * @brief Writes the weights to a mapped weights file: a NetParameter
+   *        header whose blobs only carry shapes and offsets, followed by the
+   *        raw data of the blobs. Loading maps the file and copies each blob
+   *        once, and the size is not bound by the 2 GB limit of protocol
+   *        buffers. CopyTrainedLayersFrom() recognizes these files.
+   */
+  void ToMapped(const string& filename) const;
 
   /// @brief returns the network name.
   inline const string& name() const { return name_; }
@@ -170,6 +205,13 @@ class Net {
   inline const vector<vector<bool> >& bottom_need_backward() const {
     return bottom_need_backward_;
   }
+  /**
+   * @brief returns whether each layer is applied as the epilogue of another
+   *        one, and so is skipped by Forward in CPU mode.
+   */
+  inline const vector<bool>& layer_fused() const {
+    return layer_fused_;
+  }
   inline const vector<Dtype>& blob_loss_weights() const {
     return blob_loss_weights_;
   }
@@ -222,6 +264,31 @@ class Net {
 
   void set_debug_info(const bool value) { debug_info_ = value; }
 
+  /**
+   * @brief Invoked during the backward pass for each learnable param once its
+   *        diff is complete, so that e.g. the reduction of the gradients of
+   *        the top layers overlaps the backward pass of the bottom ones.
+   */
+  class Callback {
+   protected:
+    virtual void on_diff_ready(int param_id) = 0;
+
+    template <typename T>
+    friend class Net;
+  };
+  const vector<Callback*>& callbacks() const { return callbacks_; }
+  void add_callback(Callback* value) {
+    callbacks_.push_back(value);
+  }
+  /**
+   * @brief returns, for each layer, the ids of the learnable params whose
+   *        diffs are complete once its backward pass is done: those of which
+   *        it is the lowest layer to own or share them.
+   */
+  inline const vector<vector<int> >& diff_ready_params() const {
+    return diff_ready_params_;
+  }
+
   // Helpers for Init.
   /**
    * @brief Remove layers that the user specified should be excluded given the current
@@ -247,6 +314,49 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Lets intermediate blobs whose lifetimes do not overlap share their
+   *        data memory. Only used in the TEST phase, see
+   *        NetParameter.optimize_memory.
+   */
+  void PlanMemory(const NetParameter& param);
+
+  /**
+   * @brief Finds after which layer each top of the layers with half_top can
+   *        be kept in half precision. Only used in the TEST phase, see
+   *        LayerParameter.half_top.
+   */
+  void PlanHalfTops();
+
+  /**
+   * @brief Turns the in-place activations following Convolution,
+   *        InnerProduct and Eltwise layers into epilogues of those layers.
+   *        Only used in the TEST phase, see NetParameter.fuse_activations.
+   */
+  void FuseActivations();
+
+  /**
+   * @brief Moves the Convolution and InnerProduct layers left to the DEFAULT
+   *        engine, except for grouped convolutions, to the INT8 engine. Only
+   *        used in the TEST phase, see NetParameter.quantize.
+   */
+  static void QuantizeLayers(NetParameter* param);
+
+  /**
+   * @brief Applies the trained weights of the layers removed by
+   *        NetParameter.fold_batch_norm to the layers they were folded into,
+   *        for the targets whose weights were copied from the same source.
+   */
+  void FoldTrainedLayers(
+      const map<string, vector<shared_ptr<Blob<Dtype> > > >& folded_blobs,
+      const set<string>& copied_layers);
+  /**
+   * @brief Shares or copies the weights of the layers of other, and folds
+   *        those of the layers removed by NetParameter.fold_batch_norm into
+   *        their targets, whose weights are always copied.
+   */
+  void ShareOrCopyTrainedLayersFrom(const Net* other, bool share);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
@@ -263,6 +373,7 @@ class Net {
   vector<string> layer_names_;
   map<string, int> layer_names_index_;
   vector<bool> layer_need_backward_;
+  vector<bool> layer_fused_;
   /// @brief the blobs storing intermediate results between the layer.
   vector<shared_ptr<Blob<Dtype> > > blobs_;
   vector<string> blob_names_;
@@ -301,18 +412,34 @@ class Net {
    * and learnable_params_[learnable_param_ids_[i]] gives its owner.
    */
   vector<int> learnable_param_ids_;
+  /// the learnable_params_ whose diffs are complete after each layer
+  vector<vector<int> > diff_ready_params_;
   /// the learning rate multipliers for learnable_params_
   vector<float> params_lr_;
   vector<bool> has_params_lr_;
   /// the weight decay multipliers for learnable_params_
   vector<float> params_weight_decay_;
   vector<bool> has_params_decay_;
+  /// The layers removed by fold_batch_norm, in net order, with the name of
+  /// the layer each of them is folded into.
+  vector<pair<string, LayerParameter> > folded_layers_;
+  /// Whether to keep the weights in half precision, see half_weights.
+  bool half_weights_;
+  /// The blobs to keep in half precision once each layer has run.
+  vector<vector<int> > half_top_ids_;
+  /// The blobs kept in half precision that each layer overwrites, dropped
+  /// before it runs rather than widened.
+  vector<vector<int> > half_discard_ids_;
   /// The bytes of memory used by this net
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Invoked as the diffs of the learnable params are complete
+  vector<Callback*> callbacks_;
   /// The root net that actually holds the shared layers in data parallelism
   const Net* const root_net_;
+  /// The net whose parameters this net uses, if any
+  const Net* const param_net_;
   DISABLE_COPY_AND_ASSIGN(Net);
 };
 
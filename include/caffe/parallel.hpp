@@ -14,6 +14,12 @@
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
 
+/**
+ Forward declare boost::barrier and boost::mutex instead of including
+ boost/thread.hpp to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class barrier; class mutex; }
+
 namespace caffe {
 
 // Represents a net parameters. Once a net is created, its parameter buffers can
@@ -23,6 +29,7 @@ template<typename Dtype>
 class Params {
  public:
   explicit Params(shared_ptr<Solver<Dtype> > root_solver);
+  explicit Params(const vector<Blob<Dtype>*>& params);
   virtual ~Params() {
   }
 
@@ -59,6 +66,23 @@ class GPUParams : public Params<Dtype> {
   using Params<Dtype>::diff_;
 };
 
+// Params stored in host memory, for the fused CPU updates of SGDSolver and
+// the replicas of CPUSync.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(const vector<Blob<Dtype>*>& params);
+  virtual ~CPUParams();
+
+  void configure(const vector<Blob<Dtype>*>& params) const;
+
+ protected:
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+  bool use_cuda_;
+};
+
 class DevicePair {
  public:
   DevicePair(int parent, int device)
@@ -116,6 +140,56 @@ class P2PSync : public GPUParams<Dtype>, public Solver<Dtype>::Callback,
   using Params<Dtype>::diff_;
 };
 
+// Synchronous data parallelism between threads of the CPU. Every replica
+// runs a solver on its own thread, with its own copy of the parameters, on its
+// share of the data. The gradients of a param are summed into the root as soon
+// as every replica has completed them, overlapping the backward pass of the
+// layers below. The sums run in rank order, so that a run does not depend on
+// how the threads are scheduled. Layers shared between the nets, e.g.
+// HDF5Data, still hand out their batches in the order they are asked.
+template<typename Dtype>
+class CPUSync : public CPUParams<Dtype>, public Solver<Dtype>::Callback,
+    public InternalThread {
+ public:
+  explicit CPUSync(shared_ptr<Solver<Dtype> > root_solver,
+                   CPUSync<Dtype>* root, int rank);
+  virtual ~CPUSync() {}
+
+  inline const shared_ptr<Solver<Dtype> >& solver() const {
+    return solver_;
+  }
+  inline int rank() const { return rank_; }
+
+  // Runs the root solver on the current thread and threads - 1 replicas.
+  // Caffe::solver_count() must have been set to threads before the root
+  // solver was created, for the data readers to split the data.
+  void Run(int threads);
+
+ protected:
+  void on_start();
+  void on_diff_ready(int param_id);
+  void on_gradients_ready();
+
+  void InternalThreadEntry();
+
+  CPUSync<Dtype>* root_;
+  const int rank_;
+  const int initial_iter_;
+  shared_ptr<Solver<Dtype> > solver_;
+  // On the root: the replicas by rank, the barrier they step through, the
+  // offsets of the params in the buffers and how many replicas completed the
+  // diff of each param.
+  vector<CPUSync<Dtype>*> replicas_;
+  shared_ptr<boost::barrier> barrier_;
+  vector<int> offsets_;
+  vector<int> diff_ready_counts_;
+  shared_ptr<boost::mutex> mutex_;
+
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
 }  // namespace caffe
 
 #endif
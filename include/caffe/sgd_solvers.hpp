@@ -5,9 +5,12 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+template <typename Dtype> class CPUParams;
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
@@ -31,7 +34,19 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
   virtual void ClipGradients();
+  /**
+   * @brief Updates the elements [begin, end) of a learnable param in a single
+   *        pass: folds Normalize and Regularize into the gradient, updates
+   *        the history, leaves the update in the diff like
+   *        ComputeUpdateValue and subtracts it from the data like
+   *        Net::Update. Used by ApplyUpdate in CPU mode with fused_update.
+   */
+  virtual void FusedUpdate(int param_id, int begin, int end);
+  void FusedApplyUpdate(Dtype rate);
+  void FusedUpdateTask(int task_id, int thread_id);
   virtual void SnapshotSolverState(const string& model_filename);
+  virtual void SnapshotSolverStateToProto(const string& model_filename,
+      SolverState* state);
   virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
   virtual void SnapshotSolverStateToHDF5(const string& model_filename);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
@@ -42,6 +57,35 @@ class SGDSolver : public Solver<Dtype> {
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
 
+  // The state of a learnable param during a fused update, gathered before
+  // the tasks run: its buffers, the factors folding Normalize and Regularize
+  // into the gradient, and its learning rate.
+  struct FusedParam {
+    Dtype* data;
+    Dtype* diff;
+    Dtype scale;
+    Dtype l2;
+    Dtype l1;
+    Dtype rate;
+
+    inline Dtype gradient(int i) const {
+      return scale * diff[i] + l2 * data[i] + l1 * caffe_sign(data[i]);
+    }
+  };
+  // A range of the elements of a param, the unit of work of the fused update.
+  struct FusedChunk {
+    int param_id;
+    int begin;
+    int end;
+  };
+  // With fused_update on a single solver, the learnable params live in
+  // arena_.
+  shared_ptr<CPUParams<Dtype> > arena_;
+  vector<FusedChunk> fused_chunks_;
+  vector<FusedParam> fused_params_;
+  // The cpu data of history_.
+  vector<Dtype*> fused_history_;
+
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
 
@@ -56,6 +100,7 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +116,7 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +137,7 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +162,7 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +187,7 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void FusedUpdate(int param_id, int begin, int end);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -7,6 +7,12 @@
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
 
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
 namespace caffe {
 
 /**
@@ -38,7 +44,7 @@ typedef boost::function<SolverAction::Enum()> ActionCallback;
  * given the current state of the Net parameters.
  */
 template <typename Dtype>
-class Solver {
+class Solver : protected Net<Dtype>::Callback {
  public:
   explicit Solver(const SolverParameter& param,
       const Solver* root_solver = NULL);
@@ -66,7 +72,16 @@ class Solver {
   // function that produces a SolverState protocol buffer that needs to be
   // written to disk together with the learned net.
   void Snapshot();
-  virtual ~Solver() {}
+  // Blocks until the snapshot being written in the background, if any, is on
+  // disk.
+  void WaitForSnapshot();
+  // Blocks until the test pass running in the background, if any, is done,
+  // or interrupts it.
+  void WaitForTest(bool interrupt = false);
+  virtual ~Solver() {
+    WaitForTest(true);
+    WaitForSnapshot();
+  }
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
   inline const vector<shared_ptr<Net<Dtype> > >& test_nets() {
@@ -78,6 +93,10 @@ class Solver {
   class Callback {
    protected:
     virtual void on_start() = 0;
+    // Invoked during the backward pass that completes the gradients, i.e. the
+    // last of the iter_size ones, as soon as the diff of the learnable param
+    // param_id is complete, from the top of the net down.
+    virtual void on_diff_ready(int param_id) {}
     virtual void on_gradients_ready() = 0;
 
     template <typename T>
@@ -85,6 +104,9 @@ class Solver {
   };
   const vector<Callback*>& callbacks() const { return callbacks_; }
   void add_callback(Callback* value) {
+    if (callbacks_.empty()) {
+      net_->add_callback(this);
+    }
     callbacks_.push_back(value);
   }
 
@@ -100,15 +122,31 @@ class Solver {
   string SnapshotFilename(const string extension);
   string SnapshotToBinaryProto();
   string SnapshotToHDF5();
+  string SnapshotToMapped();
+  // Stages the net and the solver state, and writes them on snapshot_thread_.
+  void SnapshotAsync();
   // The test routine
   void TestAll();
+  // Copies the weights to the test nets and tests them on test_thread_.
+  void TestAllAsync();
+  void TestAllEntry(Caffe::Brew mode, int device);
+  void Test(const int test_net_id);
   void TestClassification(const int test_net_id = 0);
   void TestDetection(const int test_net_id = 0);
+  // Whether the test pass must stop, taking the snapshots requested meanwhile
+  // unless it runs in the background.
+  bool TestInterrupted();
   virtual void SnapshotSolverState(const string& model_filename) = 0;
+  // Fills state for SnapshotAsync; solvers with state to snapshot must
+  // implement it to support snapshot_async.
+  virtual void SnapshotSolverStateToProto(const string& model_filename,
+      SolverState* state);
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
   void DisplayOutputBlobs(const int net_id);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
+  // Relays the diffs completed by the net to the callbacks.
+  void on_diff_ready(int param_id);
 
   SolverParameter param_;
   int iter_;
@@ -116,6 +154,8 @@ class Solver {
   shared_ptr<Net<Dtype> > net_;
   vector<shared_ptr<Net<Dtype> > > test_nets_;
   vector<Callback*> callbacks_;
+  // Whether the running backward pass completes the gradients.
+  bool relay_diff_ready_;
   vector<Dtype> losses_;
   Dtype smoothed_loss_;
 
@@ -130,6 +170,14 @@ class Solver {
   // True iff a request to stop early was received.
   bool requested_early_exit_;
 
+  // Writes the snapshot files staged by SnapshotAsync.
+  shared_ptr<boost::thread> snapshot_thread_;
+  // Runs the test pass started by TestAllAsync, on the weights of
+  // iteration tested_iter_.
+  shared_ptr<boost::thread> test_thread_;
+  bool testing_async_;
+  int tested_iter_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
@@ -1,6 +1,7 @@
 #ifndef CAFFE_SYNCEDMEM_HPP_
 #define CAFFE_SYNCEDMEM_HPP_
 
+#include <stdint.h>
 #include <cstdlib>
 
 #include "caffe/common.hpp"
@@ -45,13 +46,13 @@ inline void CaffeFreeHost(void* ptr, bool use_cuda) {
 class SyncedMemory {
  public:
   SyncedMemory()
-      : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-        own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+      : cpu_ptr_(NULL), gpu_ptr_(NULL), half_ptr_(NULL), size_(0),
+        head_(UNINITIALIZED), own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+        own_gpu_data_(false), gpu_device_(-1), version_(0), half_version_(-1) {}
   explicit SyncedMemory(size_t size)
-      : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-        own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
-        gpu_device_(-1) {}
+      : cpu_ptr_(NULL), gpu_ptr_(NULL), half_ptr_(NULL), size_(size),
+        head_(UNINITIALIZED), own_cpu_data_(false), cpu_malloc_use_cuda_(false),
+        own_gpu_data_(false), gpu_device_(-1), version_(0), half_version_(-1) {}
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -59,9 +60,33 @@ class SyncedMemory {
   void set_gpu_data(void* data);
   void* mutable_cpu_data();
   void* mutable_gpu_data();
-  enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
+  /**
+   * @brief Returns the data, which must be float, in half precision. The copy
+   *        is converted again only after the data was handed out writable.
+   */
+  const uint16_t* half_data();
+  /**
+   * @brief Frees the host copy of the float data and keeps the half precision
+   *        one only, until the next cpu_data() or the like widens it again
+   *        and frees the half precision one instead.
+   */
+  void compact_to_half();
+  /**
+   * @brief Drops the data kept in half precision only, without widening it,
+   *        e.g. because it is about to be overwritten. The next access sees
+   *        uninitialized memory.
+   */
+  void discard_half();
+  // HEAD_AT_HALF: only the half precision copy of the data is up to date.
+  enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED,
+                    HEAD_AT_HALF };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
+  /**
+   * @brief Counts the calls that handed out writable data, so that caches of
+   *        values derived from the data can tell whether it may have changed.
+   */
+  int version() const { return version_; }
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -72,12 +97,16 @@ class SyncedMemory {
   void to_gpu();
   void* cpu_ptr_;
   void* gpu_ptr_;
+  uint16_t* half_ptr_;
   size_t size_;
   SyncedHead head_;
   bool own_cpu_data_;
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int gpu_device_;
+  int version_;
+  // The version_ half_ptr_ was converted from.
+  int half_version_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
@@ -439,6 +439,42 @@ void ApplyNMSFast(const Dtype* bboxes, const Dtype* scores, const int num,
       const float score_threshold, const float nms_threshold,
       const float eta, const int top_k, vector<int>* indices);
 
+// Flat (structure of arrays) counterparts of DecodeBBoxes, JaccardOverlap and
+// ApplyNMSFast on NormalizedBBox, working on [xmin, ymin, xmax, ymax] float
+// boxes with precomputed sizes. They give bit-identical results and do not
+// allocate once their output buffers have grown to the largest input.
+//
+// Decode the predictions of num_priors boxes.
+//    loc_data: the location predictions; those of prior i start at
+//      loc_data + i * loc_step.
+//    prior_bboxes, prior_variances: 4 floats per prior.
+//    decode_bboxes: 4 floats per prior.
+//    decode_sizes: the size of each decoded box, as BBoxSize computes it.
+template <typename Dtype>
+void DecodeBBoxesFlat(const Dtype* loc_data, const int loc_step,
+    const float* prior_bboxes, const float* prior_variances,
+    const int num_priors, const CodeType code_type,
+    const bool variance_encoded_in_target, const bool clip_bbox,
+    float* decode_bboxes, float* decode_sizes);
+
+// Compute the jaccard (intersection over union IoU) overlap of two flat boxes
+// with the given sizes.
+float JaccardOverlapFlat(const float* bbox1, const float bbox1_size,
+    const float* bbox2, const float bbox2_size);
+
+// Do non maximum suppression on flat boxes, see ApplyNMSFast. The overlaps
+// of each candidate with all kept boxes are computed at once by iou_block.
+//    bboxes, sizes: num decoded boxes and their sizes.
+//    scores: num corresponding confidences.
+//    score_index_vec: scratch space for the sorted candidates.
+//    kept_bboxes: scratch space for the kept boxes and their overlaps.
+//    indices: the kept indices of bboxes after nms.
+void ApplyNMSFastFlat(const float* bboxes, const float* sizes,
+      const float* scores, const int num, const float score_threshold,
+      const float nms_threshold, const float eta, const int top_k,
+      vector<pair<float, int> >* score_index_vec, vector<float>* kept_bboxes,
+      vector<int>* indices);
+
 // Compute cumsum of a set of pairs.
 void CumSum(const vector<pair<float, int> >& pairs, vector<int>* cumsum);
 
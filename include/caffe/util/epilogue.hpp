@@ -0,0 +1,83 @@
+#ifndef CAFFE_UTIL_EPILOGUE_HPP_
+#define CAFFE_UTIL_EPILOGUE_HPP_
+
+#include <algorithm>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief An element-wise activation fused into the layer producing its input.
+ *
+ * Convolution, InnerProduct and Eltwise layers apply their epilogue to top[0]
+ * at the end of Forward_cpu, while the output is still in cache, instead of
+ * leaving it to a separate in-place activation layer. The values computed are
+ * exactly those of the Forward_cpu of the ReLU, ReLU6, HardSwish, HardSigmoid
+ * or PReLU layer the epilogue is made from.
+ */
+template <typename Dtype>
+class Epilogue {
+ public:
+  /// @brief Returns whether layer is an activation that can be fused.
+  static bool CanFuse(const Layer<Dtype>& layer);
+
+  /**
+   * @brief Makes the epilogue of an activation layer. The parameters of the
+   *        layer are read when the epilogue is applied, so they may be loaded
+   *        afterwards.
+   */
+  explicit Epilogue(Layer<Dtype>* layer);
+
+  /// @brief The activation of x, which belongs to the given channel.
+  inline Dtype Apply(const Dtype x, const int channel) const {
+    switch (type_) {
+    case RELU:
+      return std::max(x, Dtype(0)) + negative_slope_ * std::min(x, Dtype(0));
+    case RELU6:
+      return std::min(std::max(x, Dtype(0))
+          + negative_slope_ * std::min(x, Dtype(0)), threshold_);
+    case HARDSWISH:
+      return x * (std::max(Dtype(0),
+          std::min(Dtype(1), x / Dtype(6.0) + Dtype(0.5))));
+    case HARDSIGMOID:
+      return std::max(Dtype(0), std::min(Dtype(1), (x * alpha_ + beta_)));
+    default:
+      return std::max(x, Dtype(0)) + slope_->cpu_data()[
+          channel_shared_ ? 0 : channel] * std::min(x, Dtype(0));
+    }
+  }
+
+  /**
+   * @brief Applies the activation in place to the values [begin, end) of
+   *        data, which is laid out as ... x channels x dim.
+   */
+  void Apply(Dtype* data, const int begin, const int end, const int channels,
+      const int dim) const;
+
+  /// @brief The type of the activation layer.
+  inline const char* type() const { return layer_type_; }
+
+ protected:
+  enum Type { RELU, RELU6, HARDSWISH, HARDSIGMOID, PRELU };
+
+  Type type_;
+  const char* layer_type_;
+  /// ReLU and ReLU6
+  Dtype negative_slope_;
+  Dtype threshold_;
+  /// HardSigmoid, in the precision of its parameters.
+  float alpha_;
+  float beta_;
+  /// PReLU
+  shared_ptr<Blob<Dtype> > slope_;
+  bool channel_shared_;
+
+  DISABLE_COPY_AND_ASSIGN(Epilogue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_EPILOGUE_HPP_
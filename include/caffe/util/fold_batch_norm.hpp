@@ -0,0 +1,40 @@
+#ifndef _CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
+#define _CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+// Copy NetParameters without the BatchNorm, BN, BatchNormKyle, Scale and
+// Bias layers that can be folded into the Convolution or InnerProduct layer
+// producing their input, i.e. whose per-channel affine transform can be
+// applied to the weights and bias of that layer. The targets get a bias term
+// if they had none. For every removed layer, in net order, folded_layers
+// receives the name of its target and its LayerParameter.
+void FoldBatchNormLayers(const NetParameter& param,
+    NetParameter* param_folded,
+    vector<pair<string, LayerParameter> >* folded_layers);
+
+// Computes the per-channel transform y = scale * x + shift that the TEST
+// phase Forward of a layer removed by FoldBatchNormLayers applies, given its
+// trained blobs.
+template <typename Dtype>
+void GetFoldedTransform(const LayerParameter& param,
+    const vector<shared_ptr<Blob<Dtype> > >& blobs,
+    vector<Dtype>* scale, vector<Dtype>* shift);
+
+// Applies a per-channel transform to the output of a Convolution or
+// InnerProduct layer by rescaling its weights and bias.
+template <typename Dtype>
+void FoldTransformIntoLayer(const vector<Dtype>& scale,
+    const vector<Dtype>& shift, Layer<Dtype>* layer);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_FOLD_BATCH_NORM_HPP_
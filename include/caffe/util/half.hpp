@@ -0,0 +1,43 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+// Converts x[0], ..., x[n - 1] to IEEE 754 half precision, rounding to the
+// nearest even value; values too large for half precision become infinite.
+// Uses the F16C instructions when the build targets them.
+template <typename Dtype>
+void caffe_cpu_float2half(const int n, const Dtype* x, uint16_t* y);
+
+// Converts the half precision values x[0], ..., x[n - 1] back, exactly.
+template <typename Dtype>
+void caffe_cpu_half2float(const int n, const uint16_t* x, Dtype* y);
+
+// C = alpha * A * B + beta * C like caffe_cpu_gemm, where the M x K matrix A
+// is held in half precision and widened a few rows at a time, so that no full
+// precision copy of it is needed.
+template <typename Dtype>
+void caffe_cpu_gemm_half_a(const int M, const int N, const int K,
+    const Dtype alpha, const uint16_t* A, const Dtype* B, const Dtype beta,
+    Dtype* C);
+
+// C = alpha * A * op(B) + beta * C like caffe_cpu_gemm, where B is held in
+// half precision and widened a tile at a time.
+template <typename Dtype>
+void caffe_cpu_gemm_half_b(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype alpha, const Dtype* A,
+    const uint16_t* B, const Dtype beta, Dtype* C);
+
+// Stores the data of every blob of the layers of param in half precision,
+// i.e. as BlobProto.half_data, halving the size of a .caffemodel.
+void ConvertBlobsToHalf(NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
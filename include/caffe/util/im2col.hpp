@@ -16,6 +16,16 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_col);
 
+// Like im2col_cpu, but only fills the columns of the output positions
+// [col_begin, col_begin + col_count) in row-major order, so the result is a
+// (channels * kernel_h * kernel_w) x col_count matrix.
+template <typename Dtype>
+void im2col_range_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h,
+    const int stride_w, const int dilation_h, const int dilation_w,
+    const int col_begin, const int col_count, Dtype* data_col);
+
 template <typename Dtype>
 void im2col_v2_cpu(const Dtype* data_im, const int channels,
     const int height, const int width, const int kernel_h, const int kernel_w,
@@ -134,6 +134,25 @@ inline void WriteProtoToBinaryFile(
   WriteProtoToBinaryFile(proto, filename.c_str());
 }
 
+/**
+ * @brief A read-only memory mapping of a whole regular file, which lives as
+ *        long as the object.
+ */
+class MappedFile {
+ public:
+  explicit MappedFile(const string& filename);
+  ~MappedFile();
+
+  inline const char* data() const { return data_; }
+  inline size_t size() const { return size_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+
+  DISABLE_COPY_AND_ASSIGN(MappedFile);
+};
+
 bool ReadFileToDatum(const string& filename, const int label, Datum* datum);
 
 inline bool ReadFileToDatum(const string& filename, Datum* datum) {
@@ -7,6 +7,27 @@
 
 namespace caffe {
 
+/**
+ * @brief Computes the intersection over union of box against n boxes whose
+ *        coordinates are stored as separate arrays, so that the loop runs
+ *        on SIMD lanes.
+ *
+ * offset is added to the extent of every box: 0 for normalized coordinates,
+ * 1 for pixel coordinates where [x1, x2] covers x2 - x1 + 1 pixels. areas are
+ * the precomputed areas of the boxes. Boxes that do not overlap get 0.
+ */
+template <typename Dtype>
+void iou_block(const Dtype box[], const Dtype box_area, const int n,
+               const Dtype x1[], const Dtype y1[],
+               const Dtype x2[], const Dtype y2[],
+               const Dtype areas[], const Dtype offset,
+               Dtype ious[]);
+
+/**
+ * @brief Greedy NMS of num_boxes boxes [x1, y1, x2, y2, score] sorted by
+ *        decreasing score. Each kept box suppresses all later boxes in one
+ *        iou_block pass, and suppressed boxes are tracked in a bitmask.
+ */
 template <typename Dtype>
 void nms_cpu(const int num_boxes,
              const Dtype boxes[],
@@ -0,0 +1,160 @@
+#ifndef CAFFE_UTIL_PROFILER_HPP_
+#define CAFFE_UTIL_PROFILER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layer.hpp"
+
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
+namespace caffe {
+
+/**
+ * @brief Collects timed events from any thread of the process, e.g. the
+ *        layers run by `caffe time` and the data prefetch threads, into a
+ *        trace that chrome://tracing displays as one row per thread.
+ *
+ * Recording is off until Enable(true); a disabled profiler drops events,
+ * so instrumented code costs one branch when nobody is profiling.
+ */
+class Profiler {
+ public:
+  /// @brief The process-wide profiler.
+  static Profiler& Global();
+
+  void Enable(bool enabled);
+  /// @brief Safe to call from any thread without taking the lock.
+  inline bool enabled() const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  /// @brief Drops the events recorded so far.
+  void Clear();
+
+  /// @brief The microseconds since the profiler was created, on a
+  ///        monotonic clock.
+  double Now() const;
+  /**
+   * @brief Records an event of the calling thread that started at
+   *        start_us, as given by Now(), and lasted duration_us.
+   */
+  void AddEvent(const string& name, const string& category,
+      double start_us, double duration_us);
+  /// @brief Names the calling thread in the trace.
+  void SetThreadName(const string& name);
+
+  /// @brief Writes the recorded events in the Chrome trace event format.
+  void WriteChromeTrace(const string& filename) const;
+
+  inline int num_events() const { return events_.size(); }
+
+ protected:
+  Profiler();
+  // The index of the calling thread; requires mutex_ to be held.
+  int ThreadIndex();
+
+  struct Event {
+    string name;
+    string category;
+    double start_us;
+    double duration_us;
+    int thread;
+  };
+
+  std::atomic<bool> enabled_;
+  std::chrono::steady_clock::time_point origin_;
+  shared_ptr<boost::mutex> mutex_;
+  vector<Event> events_;
+  std::map<string, int> thread_indices_;
+  vector<string> thread_names_;
+
+  DISABLE_COPY_AND_ASSIGN(Profiler);
+};
+
+/**
+ * @brief Records the lifetime of the scope as an event of the global
+ *        profiler, if it is enabled when the scope is entered.
+ */
+class ProfileScope {
+ public:
+  ProfileScope(const string& name, const string& category);
+  ~ProfileScope();
+
+ private:
+  bool enabled_;
+  string name_;
+  string category_;
+  double start_us_;
+
+  DISABLE_COPY_AND_ASSIGN(ProfileScope);
+};
+
+/**
+ * @brief An estimate of the work of one forward pass of a layer: the
+ *        floating point operations, counting a multiply-add as two, and the
+ *        bytes of the bottoms and parameters it reads and of the tops it
+ *        writes. Layers that only share or alias memory, e.g. Split and
+ *        Reshape, cost nothing.
+ */
+struct LayerCost {
+  LayerCost() : flops(0), bytes_read(0), bytes_written(0) {}
+  double flops;
+  double bytes_read;
+  double bytes_written;
+
+  inline double bytes() const { return bytes_read + bytes_written; }
+  /// @brief FLOPs per byte moved, which places the layer on a roofline.
+  inline double intensity() const {
+    return bytes() > 0 ? flops / bytes() : 0;
+  }
+};
+
+template <typename Dtype>
+LayerCost EstimateForwardCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top);
+
+/// @brief The timing and the estimated cost of a layer of a net.
+struct LayerProfile {
+  LayerProfile() : forward_ms(0), backward_ms(0), fused(false) {}
+  string name;
+  string type;
+  // Average per iteration.
+  double forward_ms;
+  double backward_ms;
+  // Whether the forward pass was fused into the preceding layer.
+  bool fused;
+  LayerCost cost;
+
+  inline double gflops_per_second() const {
+    return forward_ms > 0 ? cost.flops / forward_ms / 1e6 : 0;
+  }
+};
+
+/**
+ * @brief Writes layers as JSON, in decreasing order of forward time, with
+ *        their achieved GFLOP/s and arithmetic intensity. With positive peak
+ *        figures of the machine, each layer also gets the bound of the
+ *        roofline at its intensity and which of the two limits it, unless
+ *        it does no arithmetic.
+ */
+void WriteLayerProfiles(const vector<LayerProfile>& layers,
+    const double peak_gflops, const double peak_gbps,
+    const string& filename);
+
+/// @brief Logs the layers that take the most forward time, like
+///        WriteLayerProfiles, with their share of the total.
+void LogLayerProfiles(const vector<LayerProfile>& layers,
+    const double peak_gflops, const double peak_gbps, const int max_layers);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PROFILER_HPP_
@@ -0,0 +1,84 @@
+#ifndef CAFFE_UTIL_QUANTIZE_HPP_
+#define CAFFE_UTIL_QUANTIZE_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/syncedmem.hpp"
+
+namespace caffe {
+
+// Returns the largest absolute value of x[0], ..., x[n - 1].
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x);
+
+// The factor mapping values of magnitude up to range onto [-127, 127].
+template <typename Dtype>
+inline Dtype QuantizationScale(const Dtype range) {
+  return range > 0 ? Dtype(127) / range : Dtype(1);
+}
+
+// y = x * scale, rounded to the nearest integer and saturated to
+// [-127, 127]. The values are int8 but stored as int16, the operand type of
+// caffe_cpu_gemm_s16.
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int16_t* y);
+
+// C = A * B^T for the row-major M x K matrix A and N x K matrix B of int8
+// values stored as int16, summed in int32. Every entry is a dot product of
+// two contiguous rows, which the compiler vectorizes with multiply-adds of
+// int16 pairs (pmaddwd) that int8 operands would first have to widen to.
+// Blocks of four rows of A and two of B reuse every value loaded.
+void caffe_cpu_gemm_s16(const int M, const int N, const int K,
+    const int16_t* A, const int16_t* B, int32_t* C);
+
+/**
+ * @brief An int8 copy of a weight matrix, stored as int16, with one
+ *        symmetric scale per output row, used by the INT8 engines. The copy
+ *        is cached and only recomputed when the weights may have changed,
+ *        i.e. when their memory was written to or replaced (e.g. by loading
+ *        weights).
+ */
+template <typename Dtype>
+class QuantizedWeights {
+ public:
+  QuantizedWeights() : cached_version_(-1) {}
+
+  /**
+   * @brief Quantizes weights, seen as a rows x (count / rows) matrix, or as
+   *        a (count / rows) x rows matrix that is transposed first.
+   */
+  void Update(const Blob<Dtype>& weights, const int rows,
+      const bool transpose);
+
+  /// @brief The rows x (count / rows) quantized weights.
+  inline const int16_t* data() const { return &data_[0]; }
+  /// @brief The value of one unit of each row of data().
+  inline const Dtype* scales() const { return &scales_[0]; }
+
+ protected:
+  vector<int16_t> data_;
+  vector<Dtype> scales_;
+  /// @brief The memory and version of the weights data_ was computed from.
+  shared_ptr<SyncedMemory> cached_memory_;
+  int cached_version_;
+
+  DISABLE_COPY_AND_ASSIGN(QuantizedWeights);
+};
+
+// Runs iterations forward passes of net and stores the largest absolute
+// value seen in each bottom of its Convolution and InnerProduct layers in the
+// quantization_param of the layers of the same name in param.
+template <typename Dtype>
+void CalibrateQuantization(Net<Dtype>* net, const int iterations,
+    NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZE_HPP_
@@ -0,0 +1,83 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+/**
+ Forward declare boost::thread instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class thread; }
+
+namespace caffe {
+
+/**
+ * @brief A fixed-size pool of CPU worker threads for data-parallel loops.
+ *
+ * Run() spreads the tasks [0, num_tasks) over the workers and the calling
+ * thread, and only returns once all of them have finished. Every task also
+ * receives the index of the thread executing it, in [0, num_threads()), so
+ * that callers can keep one scratch buffer per thread. A Run() issued from
+ * inside a task executes serially on that thread, so parallel code may nest.
+ * Run() calls from different threads take turns on the workers, except on a
+ * pool of one thread, where each runs inline on its caller.
+ */
+class ThreadPool {
+ public:
+  typedef boost::function<void(int task_id, int thread_id)> Task;
+
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  void Run(int num_tasks, const Task& task);
+
+  inline int num_threads() const { return num_threads_; }
+
+  /// @brief The process-wide pool shared by the CPU engines.
+  static ThreadPool& Global();
+  /**
+   * @brief Resizes the global pool. A value <= 0 selects the number of
+   *        hardware threads. Must not be called while the pool is running.
+   */
+  static void SetGlobalThreads(int num_threads);
+
+ protected:
+  void WorkerEntry(int thread_id);
+  // Executes pending tasks of the current run until none are left.
+  void Drain(int thread_id);
+
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  int num_threads_;
+  vector<shared_ptr<boost::thread> > workers_;
+  shared_ptr<sync> sync_;
+
+  // State of the current run, guarded by sync_.
+  const Task* task_;
+  int num_tasks_;
+  int next_task_;
+  int done_tasks_;
+  int generation_;
+  bool stop_;
+
+DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+/**
+ * @brief memcpy that splits copies of several megabytes over the global
+ *        pool, so that more than one core pulls the source from memory, e.g.
+ *        from a freshly mapped file.
+ */
+void ParallelMemcpy(void* dst, const void* src, size_t bytes);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -1,13 +1,35 @@
+#include <algorithm>
 #include <climits>
+#include <cstring>
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
+namespace {
+
+// Copies the values of a proto field into a blob in one pass, spread over
+// the global pool when no conversion is needed, as big nets load this way.
+template <typename Dtype, typename SourceType>
+void CopyProtoValues(
+    const google::protobuf::RepeatedField<SourceType>& values,
+    Dtype* target) {
+  if (sizeof(Dtype) == sizeof(SourceType)) {
+    ParallelMemcpy(target, values.data(), values.size() * sizeof(Dtype));
+  } else {
+    std::copy(values.begin(), values.end(), target);
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
     const int width) {
@@ -22,6 +44,10 @@ void Blob<Dtype>::Reshape(const int num, const int channels, const int height,
 template <typename Dtype>
 void Blob<Dtype>::Reshape(const vector<int>& shape) {
   CHECK_LE(shape.size(), kMaxBlobAxes);
+  if (shape_data_ && shape == shape_) {
+    return;
+  }
+  ++shape_version_;
   count_ = 1;
   shape_.resize(shape.size());
   if (!shape_data_ || shape_data_->size() < shape.size() * sizeof(int)) {
@@ -63,14 +89,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), shape_version_(0) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), shape_version_(0) {
   Reshape(shape);
 }
 
@@ -92,6 +118,30 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
   data_->set_cpu_data(data);
 }
 
+// Half precision storage holds float data only.
+template <typename Dtype>
+const uint16_t* Blob<Dtype>::cpu_half_data() const {
+  LOG(FATAL) << "Only float blobs can be kept in half precision.";
+  return NULL;
+}
+
+template <>
+const uint16_t* Blob<float>::cpu_half_data() const {
+  CHECK(data_);
+  return data_->half_data();
+}
+
+template <typename Dtype>
+void Blob<Dtype>::CompactDataToHalf() {
+  LOG(FATAL) << "Only float blobs can be kept in half precision.";
+}
+
+template <>
+void Blob<float>::CompactDataToHalf() {
+  CHECK(data_);
+  data_->compact_to_half();
+}
+
 template <typename Dtype>
 const Dtype* Blob<Dtype>::gpu_data() const {
   CHECK(data_);
@@ -137,13 +187,29 @@ Dtype* Blob<Dtype>::mutable_gpu_diff() {
 template <typename Dtype>
 void Blob<Dtype>::ShareData(const Blob& other) {
   CHECK_EQ(count_, other.count());
-  data_ = other.data();
+  if (data_ != other.data()) {
+    data_ = other.data();
+    ++shape_version_;
+  }
 }
 
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
-  diff_ = other.diff();
+  if (diff_ != other.diff()) {
+    diff_ = other.diff();
+    ++shape_version_;
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK(memory);
+  CHECK_GE(memory->size(), capacity_ * sizeof(Dtype));
+  if (data_ != memory) {
+    data_ = memory;
+    ++shape_version_;
+  }
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -157,6 +223,7 @@ template <typename Dtype>
 void Blob<Dtype>::Update() {
   // We will perform update based on where the data is located.
   switch (data_->head()) {
+  case SyncedMemory::HEAD_AT_HALF:
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
     caffe_axpy<Dtype>(count_, Dtype(-1),
@@ -198,6 +265,7 @@ template <typename Dtype>
 Dtype Blob<Dtype>::asum_data() const {
   if (!data_) { return 0; }
   switch (data_->head()) {
+  case SyncedMemory::HEAD_AT_HALF:
   case SyncedMemory::HEAD_AT_CPU:
     return caffe_cpu_asum(count_, cpu_data());
   case SyncedMemory::HEAD_AT_GPU:
@@ -280,6 +348,7 @@ Dtype Blob<Dtype>::sumsq_data() const {
   const Dtype* data;
   if (!data_) { return 0; }
   switch (data_->head()) {
+  case SyncedMemory::HEAD_AT_HALF:
   case SyncedMemory::HEAD_AT_CPU:
     data = cpu_data();
     sumsq = caffe_cpu_dot(count_, data, data);
@@ -360,6 +429,7 @@ void Blob<Dtype>::scale_data(Dtype scale_factor) {
   Dtype* data;
   if (!data_) { return; }
   switch (data_->head()) {
+  case SyncedMemory::HEAD_AT_HALF:
   case SyncedMemory::HEAD_AT_CPU:
     data = mutable_cpu_data();
     caffe_scal(count_, scale_factor, data);
@@ -499,29 +569,26 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.has_half_data()) {
+    const string& half_data = proto.half_data();
+    CHECK_EQ(count_ * sizeof(uint16_t), half_data.size());
+    // Copy out first, as the bytes of the string need not be aligned.
+    vector<uint16_t> half(count_);
+    memcpy(half.data(), half_data.data(), half_data.size());
+    caffe_cpu_half2float(count_, half.data(), data_vec);
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
-    for (int i = 0; i < count_; ++i) {
-      data_vec[i] = proto.double_data(i);
-    }
+    CopyProtoValues(proto.double_data(), data_vec);
   } else {
     CHECK_EQ(count_, proto.data_size());
-    for (int i = 0; i < count_; ++i) {
-      data_vec[i] = proto.data(i);
-    }
+    CopyProtoValues(proto.data(), data_vec);
   }
   if (proto.double_diff_size() > 0) {
     CHECK_EQ(count_, proto.double_diff_size());
-    Dtype* diff_vec = mutable_cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      diff_vec[i] = proto.double_diff(i);
-    }
+    CopyProtoValues(proto.double_diff(), mutable_cpu_diff());
   } else if (proto.diff_size() > 0) {
     CHECK_EQ(count_, proto.diff_size());
-    Dtype* diff_vec = mutable_cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      diff_vec[i] = proto.diff(i);
-    }
+    CopyProtoValues(proto.diff(), mutable_cpu_diff());
   }
 }
 
@@ -533,15 +600,16 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_double_data();
   proto->clear_double_diff();
-  const double* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_double_data(data_vec[i]);
-  }
+  proto->clear_half_data();
+  // Copy in one go rather than value by value, as snapshots stage whole
+  // nets this way.
+  proto->mutable_double_data()->Resize(count_, 0);
+  caffe_copy(count_, cpu_data(),
+      proto->mutable_double_data()->mutable_data());
   if (write_diff) {
-    const double* diff_vec = cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      proto->add_double_diff(diff_vec[i]);
-    }
+    proto->mutable_double_diff()->Resize(count_, 0);
+    caffe_copy(count_, cpu_diff(),
+        proto->mutable_double_diff()->mutable_data());
   }
 }
 
@@ -553,15 +621,12 @@ void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
   }
   proto->clear_data();
   proto->clear_diff();
-  const float* data_vec = cpu_data();
-  for (int i = 0; i < count_; ++i) {
-    proto->add_data(data_vec[i]);
-  }
+  proto->clear_half_data();
+  proto->mutable_data()->Resize(count_, 0);
+  caffe_copy(count_, cpu_data(), proto->mutable_data()->mutable_data());
   if (write_diff) {
-    const float* diff_vec = cpu_diff();
-    for (int i = 0; i < count_; ++i) {
-      proto->add_diff(diff_vec[i]);
-    }
+    proto->mutable_diff()->Resize(count_, 0);
+    caffe_copy(count_, cpu_diff(), proto->mutable_diff()->mutable_data());
   }
 }
 
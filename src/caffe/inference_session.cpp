@@ -0,0 +1,80 @@
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/inference_session.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+InferenceSession<Dtype>::InferenceSession(const NetParameter& param) {
+  Init(param);
+}
+
+template <typename Dtype>
+InferenceSession<Dtype>::InferenceSession(const string& param_file,
+    const string& trained_file) {
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(param_file, &param);
+  Init(param);
+  CopyTrainedLayersFrom(trained_file);
+}
+
+template <typename Dtype>
+void InferenceSession<Dtype>::Init(const NetParameter& param) {
+  param_.CopyFrom(param);
+  param_.mutable_state()->set_phase(TEST);
+  net_.reset(new Net<Dtype>(param_));
+  mutex_.reset(new boost::mutex());
+  frozen_ = false;
+}
+
+template <typename Dtype>
+void InferenceSession<Dtype>::CopyTrainedLayersFrom(
+    const string& trained_filename) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  CHECK(!frozen_) << "Cannot load weights once contexts have been created.";
+  net_->CopyTrainedLayersFrom(trained_filename);
+}
+
+template <typename Dtype>
+void InferenceSession<Dtype>::CopyTrainedLayersFrom(
+    const NetParameter& param) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  CHECK(!frozen_) << "Cannot load weights once contexts have been created.";
+  net_->CopyTrainedLayersFrom(param);
+}
+
+template <typename Dtype>
+void InferenceSession<Dtype>::Freeze() {
+  const vector<shared_ptr<Blob<Dtype> > >& params = net_->params();
+  for (int i = 0; i < params.size(); ++i) {
+    // Weights kept in half precision are only read as such.
+    if (params[i]->data_at_half()) { continue; }
+    params[i]->cpu_data();
+    if (Caffe::mode() == Caffe::GPU) {
+      params[i]->gpu_data();
+    }
+  }
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    layers[i]->UpdateWeightCaches();
+  }
+  frozen_ = true;
+}
+
+template <typename Dtype>
+shared_ptr<Net<Dtype> > InferenceSession<Dtype>::CreateContext() {
+  {
+    boost::mutex::scoped_lock lock(*mutex_);
+    if (!frozen_) {
+      Freeze();
+    }
+  }
+  return shared_ptr<Net<Dtype> >(new Net<Dtype>(param_, NULL, net_.get()));
+}
+
+INSTANTIATE_CLASS(InferenceSession);
+
+}  // namespace caffe
@@ -8,12 +8,19 @@
 #include "caffe/layer.hpp"
 #include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/depthwise_conv_layer.hpp"
+#include "caffe/layers/implicit_gemm_conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/int8_conv_layer.hpp"
+#include "caffe/layers/int8_inner_product_layer.hpp"
 #include "caffe/layers/lrn_layer.hpp"
+#include "caffe/layers/parallel_conv_layer.hpp"
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/layers/relu_layer.hpp"
 #include "caffe/layers/sigmoid_layer.hpp"
 #include "caffe/layers/softmax_layer.hpp"
 #include "caffe/layers/tanh_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
 #include "caffe/layers/batch_norm_layer.hpp"
 //#include "caffe/util/insert_inceptions.hpp"
 #include "caffe/layers/resize_layer.hpp"
@@ -57,9 +64,26 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
       engine = ConvolutionParameter_Engine_CUDNN;
     }
 #endif
+    if (engine == ConvolutionParameter_Engine_CAFFE && conv_param.group() > 1) {
+      engine = ConvolutionParameter_Engine_DEPTHWISE;
+    }
   }
   if (engine == ConvolutionParameter_Engine_CAFFE) {
     return shared_ptr<Layer<Dtype> >(new ConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_PARALLEL) {
+    return shared_ptr<Layer<Dtype> >(
+        new ParallelConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_IMPLICIT_GEMM) {
+    return shared_ptr<Layer<Dtype> >(
+        new ImplicitGemmConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_WINOGRAD) {
+    return shared_ptr<Layer<Dtype> >(
+        new WinogradConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_DEPTHWISE) {
+    return shared_ptr<Layer<Dtype> >(
+        new DepthwiseConvolutionLayer<Dtype>(param));
+  } else if (engine == ConvolutionParameter_Engine_INT8) {
+    return shared_ptr<Layer<Dtype> >(new Int8ConvolutionLayer<Dtype>(param));
 #ifdef USE_CUDNN
   } else if (engine == ConvolutionParameter_Engine_CUDNN) {
     if (use_dilation) {
@@ -76,6 +100,24 @@ shared_ptr<Layer<Dtype> > GetConvolutionLayer(
 REGISTER_LAYER_CREATOR(Convolution, GetConvolutionLayer);
 // REGISTER_LAYER_CREATOR(Inception, InsertInceptions);
 
+// Get inner product layer according to engine.
+template <typename Dtype>
+shared_ptr<Layer<Dtype> > GetInnerProductLayer(const LayerParameter& param) {
+  InnerProductParameter_Engine engine = param.inner_product_param().engine();
+  if (engine == InnerProductParameter_Engine_DEFAULT) {
+    engine = InnerProductParameter_Engine_CAFFE;
+  }
+  if (engine == InnerProductParameter_Engine_CAFFE) {
+    return shared_ptr<Layer<Dtype> >(new InnerProductLayer<Dtype>(param));
+  } else if (engine == InnerProductParameter_Engine_INT8) {
+    return shared_ptr<Layer<Dtype> >(new Int8InnerProductLayer<Dtype>(param));
+  } else {
+    LOG(FATAL) << "Layer " << param.name() << " has unknown engine.";
+  }
+}
+
+REGISTER_LAYER_CREATOR(InnerProduct, GetInnerProductLayer);
+
 // Get pooling layer according to engine.
 template <typename Dtype>
 shared_ptr<Layer<Dtype> > GetPoolingLayer(const LayerParameter& param) {
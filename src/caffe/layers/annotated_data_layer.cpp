@@ -3,13 +3,15 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <boost/bind.hpp>
+
 #include <algorithm>
-#include <map>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/annotated_data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/rng.hpp"
 #include "caffe/util/sampler.hpp"
 
 namespace caffe {
@@ -17,7 +19,7 @@ namespace caffe {
 template <typename Dtype>
 AnnotatedDataLayer<Dtype>::AnnotatedDataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    reader_(param) {
+    reader_(param), batch_(NULL), batch_data_(NULL), batch_label_(NULL) {
 }
 
 template <typename Dtype>
@@ -46,8 +48,8 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
-  for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-    this->prefetch_[i].data_.Reshape(top_shape);
+  for (int i = 0; i < this->prefetch_.size(); ++i) {
+    this->prefetch_[i]->data_.Reshape(top_shape);
   }
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
@@ -85,8 +87,22 @@ void AnnotatedDataLayer<Dtype>::DataLayerSetUp(
       label_shape[0] = batch_size;
     }
     top[1]->Reshape(label_shape);
-    for (int i = 0; i < this->PREFETCH_COUNT; ++i) {
-      this->prefetch_[i].label_.Reshape(label_shape);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->label_.Reshape(label_shape);
+    }
+  }
+  const int transform_threads =
+      this->layer_param_.data_param().transform_threads();
+  CHECK_GT(transform_threads, 0) << "transform_threads must be positive.";
+  if (transform_threads > 1) {
+    LOG(INFO) << "Transforming with " << transform_threads << " threads";
+    transform_pool_.reset(new ThreadPool(transform_threads));
+    seed_rng_.reset(new Caffe::RNG(caffe_rng_rand()));
+    for (int i = 0; i < transform_threads; ++i) {
+      thread_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+          new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+      thread_transformed_data_.push_back(
+          shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
     }
   }
 }
@@ -110,84 +126,58 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   vector<int> top_shape =
       this->data_transformer_->InferBlobShape(anno_datum.datum());
   this->transformed_data_.Reshape(top_shape);
+  for (int i = 0; i < thread_transformed_data_.size(); ++i) {
+    thread_transformed_data_[i]->Reshape(top_shape);
+  }
   // Reshape batch according to the batch_size.
   top_shape[0] = batch_size;
   batch->data_.Reshape(top_shape);
 
-  Dtype* top_data = batch->data_.mutable_cpu_data();
-  Dtype* top_label = NULL;  // suppress warnings about uninitialized variables
+  batch_ = batch;
+  batch_data_ = batch->data_.mutable_cpu_data();
+  batch_label_ = NULL;
   if (this->output_labels_ && !has_anno_type_) {
-    top_label = batch->label_.mutable_cpu_data();
+    batch_label_ = batch->label_.mutable_cpu_data();
   }
 
-  // Store transformed annotation.
-  map<int, vector<AnnotationGroup> > all_anno;
-  int num_bboxes = 0;
-
+  // Read the whole batch first, so that its items can be transformed in any
+  // order.
+  batch_datums_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     timer.Start();
-    // get a anno_datum
-    AnnotatedDatum& anno_datum = *(reader_.full().pop("Waiting for data"));
+    batch_datums_[item_id] = reader_.full().pop("Waiting for data");
     read_time += timer.MicroSeconds();
-    timer.Start();
-    AnnotatedDatum sampled_datum;
-    if (batch_samplers_.size() > 0) {
-      // Generate sampled bboxes from anno_datum.
-      vector<NormalizedBBox> sampled_bboxes;
-      GenerateBatchSamples(anno_datum, batch_samplers_, &sampled_bboxes);
-      if (sampled_bboxes.size() > 0) {
-        // Randomly pick a sampled bbox and crop the anno_datum.
-        int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
-        this->data_transformer_->CropImage(anno_datum, sampled_bboxes[rand_idx],
-                                           &sampled_datum);
-      } else {
-        sampled_datum.CopyFrom(anno_datum);
-      }
-    } else {
-      sampled_datum.CopyFrom(anno_datum);
+  }
+  batch_annotations_.resize(batch_size);
+  timer.Start();
+  if (transform_pool_) {
+    rng_t* seed_rng = static_cast<rng_t*>(seed_rng_->generator());
+    batch_seeds_.resize(batch_size);
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      batch_seeds_[item_id] = (*seed_rng)();
     }
-    // Apply data transformations (mirror, scale, crop...)
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    vector<AnnotationGroup> transformed_anno_vec;
-    if (this->output_labels_) {
-      if (has_anno_type_) {
-        // Make sure all data have same annotation type.
-        CHECK(sampled_datum.has_type()) << "Some datum misses AnnotationType.";
-        CHECK_EQ(anno_type_, sampled_datum.type()) <<
-            "Different AnnotationType.";
-        // Transform datum and annotation_group at the same time
-        transformed_anno_vec.clear();
-        this->data_transformer_->Transform(sampled_datum,
-                                           &(this->transformed_data_),
-                                           &transformed_anno_vec);
-        if (anno_type_ == AnnotatedDatum_AnnotationType_BBOX) {
-          // Count the number of bboxes.
-          for (int g = 0; g < transformed_anno_vec.size(); ++g) {
-            num_bboxes += transformed_anno_vec[g].annotation_size();
-          }
-        } else {
-          LOG(FATAL) << "Unknown annotation type.";
-        }
-        all_anno[item_id] = transformed_anno_vec;
-      } else {
-        this->data_transformer_->Transform(sampled_datum.datum(),
-                                           &(this->transformed_data_));
-        // Otherwise, store the label from datum.
-        CHECK(sampled_datum.datum().has_label()) << "Cannot find any label.";
-        top_label[item_id] = sampled_datum.datum().label();
-      }
-    } else {
-      this->data_transformer_->Transform(sampled_datum.datum(),
-                                         &(this->transformed_data_));
+    transform_pool_->Run(batch_size, boost::bind(
+        &AnnotatedDataLayer<Dtype>::TransformTask, this, _1, _2));
+  } else {
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      TransformItem(item_id, this->data_transformer_.get(),
+          &this->transformed_data_);
     }
-    trans_time += timer.MicroSeconds();
-
-    reader_.free().push(const_cast<AnnotatedDatum*>(&anno_datum));
+  }
+  trans_time += timer.MicroSeconds();
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    reader_.free().push(batch_datums_[item_id]);
   }
 
   // Store "rich" annotation if needed.
   if (this->output_labels_ && has_anno_type_) {
+    int num_bboxes = 0;
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      const vector<AnnotationGroup>& anno_vec = batch_annotations_[item_id];
+      for (int g = 0; g < anno_vec.size(); ++g) {
+        num_bboxes += anno_vec[g].annotation_size();
+      }
+    }
     vector<int> label_shape(4);
     if (anno_type_ == AnnotatedDatum_AnnotationType_BBOX) {
       label_shape[0] = 1;
@@ -202,10 +192,11 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
         // Reshape the label and store the annotation.
         label_shape[2] = num_bboxes;
         batch->label_.Reshape(label_shape);
-        top_label = batch->label_.mutable_cpu_data();
+        Dtype* top_label = batch->label_.mutable_cpu_data();
         int idx = 0;
         for (int item_id = 0; item_id < batch_size; ++item_id) {
-          const vector<AnnotationGroup>& anno_vec = all_anno[item_id];
+          const vector<AnnotationGroup>& anno_vec =
+              batch_annotations_[item_id];
           for (int g = 0; g < anno_vec.size(); ++g) {
             const AnnotationGroup& anno_group = anno_vec[g];
             for (int a = 0; a < anno_group.annotation_size(); ++a) {
@@ -234,6 +225,67 @@ void AnnotatedDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+template<typename Dtype>
+void AnnotatedDataLayer<Dtype>::TransformItem(const int item_id,
+    DataTransformer<Dtype>* transformer, Blob<Dtype>* transformed) {
+  const AnnotatedDatum& anno_datum = *batch_datums_[item_id];
+  AnnotatedDatum sampled_datum;
+  if (batch_samplers_.size() > 0) {
+    // Generate sampled bboxes from anno_datum.
+    vector<NormalizedBBox> sampled_bboxes;
+    GenerateBatchSamples(anno_datum, batch_samplers_, &sampled_bboxes);
+    if (sampled_bboxes.size() > 0) {
+      // Randomly pick a sampled bbox and crop the anno_datum.
+      int rand_idx = caffe_rng_rand() % sampled_bboxes.size();
+      transformer->CropImage(anno_datum, sampled_bboxes[rand_idx],
+                             &sampled_datum);
+    } else {
+      sampled_datum.CopyFrom(anno_datum);
+    }
+  } else {
+    sampled_datum.CopyFrom(anno_datum);
+  }
+  // Apply data transformations (mirror, scale, crop...)
+  int offset = batch_->data_.offset(item_id);
+  transformed->set_cpu_data(batch_data_ + offset);
+  vector<AnnotationGroup>& transformed_anno_vec =
+      batch_annotations_[item_id];
+  transformed_anno_vec.clear();
+  if (this->output_labels_) {
+    if (has_anno_type_) {
+      // Make sure all data have same annotation type.
+      CHECK(sampled_datum.has_type()) << "Some datum misses AnnotationType.";
+      CHECK_EQ(anno_type_, sampled_datum.type()) <<
+          "Different AnnotationType.";
+      if (anno_type_ != AnnotatedDatum_AnnotationType_BBOX) {
+        LOG(FATAL) << "Unknown annotation type.";
+      }
+      // Transform datum and annotation_group at the same time
+      transformer->Transform(sampled_datum, transformed,
+                             &transformed_anno_vec);
+    } else {
+      transformer->Transform(sampled_datum.datum(), transformed);
+      // Otherwise, store the label from datum.
+      CHECK(sampled_datum.datum().has_label()) << "Cannot find any label.";
+      batch_label_[item_id] = sampled_datum.datum().label();
+    }
+  } else {
+    transformer->Transform(sampled_datum.datum(), transformed);
+  }
+}
+
+template<typename Dtype>
+void AnnotatedDataLayer<Dtype>::TransformTask(const int item_id,
+    const int thread_id) {
+  // The random draws of the sampler, CropImage and the transformer only
+  // depend on the seed of the item, not on the thread it runs on.
+  Caffe::set_random_seed(batch_seeds_[item_id]);
+  DataTransformer<Dtype>* transformer = thread_transformers_[thread_id].get();
+  transformer->InitRand();
+  TransformItem(item_id, transformer,
+      thread_transformed_data_[thread_id].get());
+}
+
 INSTANTIATE_CLASS(AnnotatedDataLayer);
 REGISTER_LAYER_CLASS(AnnotatedData);
 
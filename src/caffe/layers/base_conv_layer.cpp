@@ -3,6 +3,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
 
@@ -271,6 +272,58 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_half(const Dtype* input,
+    const uint16_t* weights, Dtype* output) {
+  const Dtype* col_buff = input;
+  if (!is_1x1_) {
+    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+    col_buff = col_buffer_.cpu_data();
+  }
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_half_a<Dtype>(conv_out_channels_ / group_,
+        conv_out_spatial_dim_, kernel_dim_,
+        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
+        (Dtype)0., output + output_offset_ * g);
+  }
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_gemm_group(const Dtype* input,
+    const Dtype* weights, Dtype* output, int group, Dtype* col_buff) {
+  const Dtype* group_col_buff = input + col_offset_ * group;
+  if (!is_1x1_) {
+    const int* conv_input_shape_data = conv_input_shape_.cpu_data();
+    int input_spatial_dim = 1;
+    for (int i = 0; i < num_spatial_axes_; ++i) {
+      input_spatial_dim *= conv_input_shape_data[i + 1];
+    }
+    const int group_channels = conv_in_channels_ / group_;
+    const Dtype* group_input =
+        input + group * group_channels * input_spatial_dim;
+    if (!force_nd_im2col_ && num_spatial_axes_ == 2) {
+      im2col_cpu(group_input, group_channels,
+          conv_input_shape_data[1], conv_input_shape_data[2],
+          kernel_shape_.cpu_data()[0], kernel_shape_.cpu_data()[1],
+          pad_.cpu_data()[0], pad_.cpu_data()[1],
+          stride_.cpu_data()[0], stride_.cpu_data()[1],
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
+    } else {
+      vector<int> group_col_shape(col_buffer_shape_);
+      group_col_shape[0] = kernel_dim_;
+      im2col_nd_cpu(group_input, num_spatial_axes_,
+          conv_input_shape_data, group_col_shape.data(),
+          kernel_shape_.cpu_data(), pad_.cpu_data(), stride_.cpu_data(),
+          dilation_.cpu_data(), col_buff);
+    }
+    group_col_buff = col_buff;
+  }
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
+      group_, conv_out_spatial_dim_, kernel_dim_,
+      (Dtype)1., weights + weight_offset_ * group, group_col_buff,
+      (Dtype)0., output + output_offset_ * group);
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
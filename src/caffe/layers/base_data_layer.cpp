@@ -8,6 +8,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/profiler.hpp"
 
 namespace caffe {
 
@@ -36,9 +37,15 @@ template <typename Dtype>
 BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
-      prefetch_free_(), prefetch_full_() {
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_free_.push(&prefetch_[i]);
+      prefetch_(param.data_param().has_prefetch() ?
+          param.data_param().prefetch() : PREFETCH_COUNT),
+      prefetch_free_(), prefetch_full_(),
+      zero_copy_(param.data_param().zero_copy()),
+      prefetch_current_(NULL) {
+  CHECK_GT(prefetch_.size(), 0) << "prefetch must be positive.";
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_free_.push(prefetch_[i].get());
   }
 }
 
@@ -50,18 +57,18 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
-  for (int i = 0; i < PREFETCH_COUNT; ++i) {
-    prefetch_[i].data_.mutable_cpu_data();
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->data_.mutable_cpu_data();
     if (this->output_labels_) {
-      prefetch_[i].label_.mutable_cpu_data();
+      prefetch_[i]->label_.mutable_cpu_data();
     }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
-    for (int i = 0; i < PREFETCH_COUNT; ++i) {
-      prefetch_[i].data_.mutable_gpu_data();
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->data_.mutable_gpu_data();
       if (this->output_labels_) {
-        prefetch_[i].label_.mutable_gpu_data();
+        prefetch_[i]->label_.mutable_gpu_data();
       }
     }
   }
@@ -81,10 +88,14 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
   }
 #endif
 
+  Profiler::Global().SetThreadName("prefetch " + this->layer_param_.name());
   try {
     while (!must_stop()) {
       Batch<Dtype>* batch = prefetch_free_.pop();
-      load_batch(batch);
+      {
+        ProfileScope scope(this->layer_param_.name(), "prefetch");
+        load_batch(batch);
+      }
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
         batch->data_.data().get()->async_gpu_push(stream);
@@ -103,25 +114,63 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #endif
 }
 
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::PopBatch() {
+  if (prefetch_current_) {
+#ifndef CPU_ONLY
+    if (Caffe::mode() == Caffe::GPU) {
+      // The kernels of the last iteration may still read the batch.
+      CUDA_CHECK(cudaStreamSynchronize(cudaStreamDefault));
+    }
+#endif
+    prefetch_free_.push(prefetch_current_);
+    prefetch_current_ = NULL;
+  }
+  ++prefetch_stats_.batches;
+  prefetch_stats_.occupancy += prefetch_full_.size();
+  Batch<Dtype>* batch;
+  if (!prefetch_full_.try_pop(&batch)) {
+    // Time spent here is time the prefetch thread fell behind.
+    ProfileScope scope(this->layer_param_.name(), "prefetch wait");
+    const double start_us = Profiler::Global().Now();
+    batch = prefetch_full_.pop("Data layer prefetch queue empty");
+    ++prefetch_stats_.stalls;
+    prefetch_stats_.stall_ms += (Profiler::Global().Now() - start_us) / 1000;
+  }
+  return batch;
+}
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = PopBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
-  // Copy the data
-  caffe_copy(batch->data_.count(), batch->data_.cpu_data(),
-             top[0]->mutable_cpu_data());
-  DLOG(INFO) << "Prefetch copied";
+  if (zero_copy_) {
+    top[0]->set_cpu_data(batch->data_.mutable_cpu_data());
+  } else {
+    // Copy the data
+    caffe_copy(batch->data_.count(), batch->data_.cpu_data(),
+               top[0]->mutable_cpu_data());
+    DLOG(INFO) << "Prefetch copied";
+  }
   if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(batch->label_);
-    // Copy the labels.
-    caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
-        top[1]->mutable_cpu_data());
+    if (zero_copy_) {
+      top[1]->set_cpu_data(batch->label_.mutable_cpu_data());
+    } else {
+      // Copy the labels.
+      caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
+          top[1]->mutable_cpu_data());
+    }
   }
 
-  prefetch_free_.push(batch);
+  if (zero_copy_) {
+    prefetch_current_ = batch;
+  } else {
+    prefetch_free_.push(batch);
+  }
 }
 
 #ifdef CPU_ONLY
@@ -7,18 +7,34 @@ namespace caffe {
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
-  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  Batch<Dtype>* batch = PopBatch();
   // Reshape to loaded data.
   top[0]->ReshapeLike(batch->data_);
-  // Copy the data
-  caffe_copy(batch->data_.count(), batch->data_.gpu_data(),
-      top[0]->mutable_gpu_data());
+  if (zero_copy_) {
+    // gpu_data() leaves the batch synced, so that the prefetch thread can
+    // overwrite it on the host without copying it back first.
+    top[0]->data()->set_gpu_data(const_cast<Dtype*>(batch->data_.gpu_data()));
+  } else {
+    // Copy the data
+    caffe_copy(batch->data_.count(), batch->data_.gpu_data(),
+        top[0]->mutable_gpu_data());
+  }
   if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(batch->label_);
-    // Copy the labels.
-    caffe_copy(batch->label_.count(), batch->label_.gpu_data(),
-        top[1]->mutable_gpu_data());
+    if (zero_copy_) {
+      top[1]->data()->set_gpu_data(
+          const_cast<Dtype*>(batch->label_.gpu_data()));
+    } else {
+      // Copy the labels.
+      caffe_copy(batch->label_.count(), batch->label_.gpu_data(),
+          top[1]->mutable_gpu_data());
+    }
+  }
+  if (zero_copy_) {
+    // PopBatch synchronizes before the batch goes back to the ring.
+    prefetch_current_ = batch;
+    return;
   }
   // Ensure the copy is synchronous wrt the host, so that the next batch isn't
   // copied in meanwhile.
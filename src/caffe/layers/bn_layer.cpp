@@ -315,5 +315,6 @@ STUB_GPU(BNLayer);
 #endif
 
 INSTANTIATE_CLASS(BNLayer);
+REGISTER_LAYER_CLASS(BN);
 
 }  // namespace caffe
@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/util/epilogue.hpp"
 
 namespace caffe {
 
@@ -24,17 +25,30 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const Dtype* weight = this->blobs_[0]->cpu_data();
+  // Weights kept in half precision only are widened a tile at a time.
+  const bool half = this->blobs_[0]->data_at_half();
+  const uint16_t* half_weight = half ? this->blobs_[0]->cpu_half_data() : NULL;
+  const Dtype* weight = half ? NULL : this->blobs_[0]->cpu_data();
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
     for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
+      if (half) {
+        this->forward_cpu_gemm_half(bottom_data + n * this->bottom_dim_,
+            half_weight, top_data + n * this->top_dim_);
+      } else {
+        this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+            top_data + n * this->top_dim_);
+      }
       if (this->bias_term_) {
         const Dtype* bias = this->blobs_[1]->cpu_data();
         this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
       }
+      if (this->epilogue_ && i == 0) {
+        this->epilogue_->Apply(top_data, n * this->top_dim_,
+            (n + 1) * this->top_dim_, this->num_output_,
+            this->out_spatial_dim_);
+      }
     }
   }
 }
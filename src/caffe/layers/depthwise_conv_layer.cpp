@@ -0,0 +1,114 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/depthwise_conv_layer.hpp"
+#include "caffe/util/epilogue.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  use_depthwise_ = this->num_spatial_axes_ == 2 &&
+      this->group_ == this->channels_;
+  if (!use_depthwise_ && this->layer_param_.convolution_param().engine() ==
+      ConvolutionParameter_Engine_DEPTHWISE) {
+    LOG(INFO) << "Depthwise convolution only supports 2D filters with as "
+        << "many groups as channels; layer " << this->layer_param_.name()
+        << " uses the CAFFE engine.";
+  }
+}
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_depthwise_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  ThreadPool& pool = ThreadPool::Global();
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    const Epilogue<Dtype>* epilogue = i == 0 ? this->epilogue_.get() : NULL;
+    pool.Run(this->num_ * this->num_output_,
+        boost::bind(&DepthwiseConvolutionLayer<Dtype>::forward_task, this,
+            bottom_data, weight, bias, epilogue, top_data, _1, _2));
+  }
+}
+
+template <typename Dtype>
+void DepthwiseConvolutionLayer<Dtype>::forward_task(const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, const Epilogue<Dtype>* epilogue,
+    Dtype* top_data, int task_id, int thread_id) {
+  // One output plane, computed from input channel o / (num_output / channels)
+  // with filter o.
+  const int n = task_id / this->num_output_;
+  const int o = task_id % this->num_output_;
+  const int c = o / (this->num_output_ / this->channels_);
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int stride_h = this->stride_.cpu_data()[0];
+  const int stride_w = this->stride_.cpu_data()[1];
+  const int dilation_h = this->dilation_.cpu_data()[0];
+  const int dilation_w = this->dilation_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  const Dtype* input = bottom_data + n * this->bottom_dim_ +
+      c * height * width;
+  const Dtype* filter = weight + o * kernel_h * kernel_w;
+  Dtype* image = top_data + n * this->top_dim_;
+  const Dtype bias_value = bias ? bias[o] : Dtype(0);
+  for (int y = 0; y < output_h; ++y) {
+    const int row_begin = (o * output_h + y) * output_w;
+    Dtype* output = image + row_begin;
+    std::fill(output, output + output_w, Dtype(0));
+    for (int i = 0; i < kernel_h; ++i) {
+      const int h = y * stride_h - pad_h + i * dilation_h;
+      if (h < 0 || h >= height) { continue; }
+      const Dtype* input_row = input + h * width;
+      for (int j = 0; j < kernel_w; ++j) {
+        const Dtype w = filter[i * kernel_w + j];
+        // The outputs x for which 0 <= x * stride_w + offset < width.
+        const int offset = j * dilation_w - pad_w;
+        const int x_begin =
+            offset >= 0 ? 0 : (stride_w - 1 - offset) / stride_w;
+        const int x_end = offset >= width ? 0 :
+            std::min(output_w, (width - 1 - offset) / stride_w + 1);
+        if (stride_w == 1) {
+          const Dtype* shifted = input_row + offset;
+          for (int x = x_begin; x < x_end; ++x) {
+            output[x] += w * shifted[x];
+          }
+        } else {
+          for (int x = x_begin; x < x_end; ++x) {
+            output[x] += w * input_row[x * stride_w + offset];
+          }
+        }
+      }
+    }
+    if (bias) {
+      for (int x = 0; x < output_w; ++x) {
+        output[x] += bias_value;
+      }
+    }
+    if (epilogue) {
+      epilogue->Apply(image, row_begin, row_begin + output_w,
+          this->num_output_, output_h * output_w);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(DepthwiseConvolutionLayer);
+
+}  // namespace caffe
@@ -5,10 +5,12 @@
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/filesystem.hpp"
 #include "boost/foreach.hpp"
 
 #include "caffe/layers/detection_output_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -190,103 +192,40 @@ void DetectionOutputLayer<Dtype>::Forward_cpu(
   const Dtype* conf_data = bottom[1]->cpu_data();
   const Dtype* prior_data = bottom[2]->cpu_data();
   const int num = bottom[0]->num();
-
-  // Retrieve all location predictions.
-  vector<LabelBBox> all_loc_preds;
-  GetLocPredictions(loc_data, num, num_priors_, num_loc_classes_,
-                    share_location_, &all_loc_preds);
-
-  // Retrieve all confidences.
-  vector<map<int, vector<float> > > all_conf_scores;
-  GetConfidenceScores(conf_data, num, num_priors_, num_classes_,
-                      &all_conf_scores);
+  ThreadPool& pool = ThreadPool::Global();
 
   // Retrieve all prior bboxes. It is same within a batch since we assume all
   // images in a batch are of same dimension.
-  vector<NormalizedBBox> prior_bboxes;
-  vector<vector<float> > prior_variances;
-  GetPriorBBoxes(prior_data, num_priors_, &prior_bboxes, &prior_variances);
+  prior_bboxes_.resize(num_priors_ * 4);
+  prior_variances_.resize(num_priors_ * 4);
+  for (int i = 0; i < num_priors_ * 4; ++i) {
+    prior_bboxes_[i] = prior_data[i];
+    prior_variances_[i] = prior_data[num_priors_ * 4 + i];
+  }
 
   // Decode all loc predictions to bboxes.
-  vector<LabelBBox> all_decode_bboxes;
-  const bool clip_bbox = false;
-  DecodeBBoxesAll(all_loc_preds, prior_bboxes, prior_variances, num,
-                  share_location_, num_loc_classes_, background_label_id_,
-                  code_type_, variance_encoded_in_target_, clip_bbox,
-                  &all_decode_bboxes);
+  decode_bboxes_.resize(num * num_loc_classes_ * num_priors_ * 4);
+  decode_sizes_.resize(num * num_loc_classes_ * num_priors_);
+  pool.Run(num * num_loc_classes_,
+      boost::bind(&DetectionOutputLayer<Dtype>::decode_task, this,
+          loc_data, _1, _2));
 
+  // Do nms for every class of every image, then keep the top k per image.
+  indices_.resize(num * num_classes_);
+  num_kept_.resize(num);
+  class_scores_.resize(pool.num_threads());
+  score_index_.resize(pool.num_threads());
+  kept_bboxes_.resize(pool.num_threads());
+  score_index_pairs_.resize(pool.num_threads());
+  pool.Run(num * num_classes_,
+      boost::bind(&DetectionOutputLayer<Dtype>::nms_task, this,
+          conf_data, _1, _2));
+  pool.Run(num,
+      boost::bind(&DetectionOutputLayer<Dtype>::keep_top_k_task, this,
+          conf_data, _1, _2));
   int num_kept = 0;
-  vector<map<int, vector<int> > > all_indices;
   for (int i = 0; i < num; ++i) {
-    const LabelBBox& decode_bboxes = all_decode_bboxes[i];
-    const map<int, vector<float> >& conf_scores = all_conf_scores[i];
-    map<int, vector<int> > indices;
-    int num_det = 0;
-    for (int c = 0; c < num_classes_; ++c) {
-      if (c == background_label_id_) {
-        // Ignore background class.
-        continue;
-      }
-      if (conf_scores.find(c) == conf_scores.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find confidence predictions for label " << c;
-      }
-      const vector<float>& scores = conf_scores.find(c)->second;
-      int label = share_location_ ? -1 : c;
-      if (decode_bboxes.find(label) == decode_bboxes.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find location predictions for label " << label;
-        continue;
-      }
-      const vector<NormalizedBBox>& bboxes = decode_bboxes.find(label)->second;
-	  if(need_nms_) {
-        ApplyNMSFast(bboxes, scores, confidence_threshold_, nms_threshold_, eta_,
-            top_k_, &(indices[c]));
-	  } else {
-	  	CHECK_EQ(bboxes.size(), scores.size())
-				<< "bboxes and scores have different size.";
-		indices[c].resize(scores.size(), 0);
-		for(size_t ind_i = 0; ind_i < scores.size(); ++ind_i) 
-		  indices[c][ind_i] = ind_i;
-	  }
-      num_det += indices[c].size();
-    }
-    if (keep_top_k_ > -1 && num_det > keep_top_k_) {
-      vector<pair<float, pair<int, int> > > score_index_pairs;
-      for (map<int, vector<int> >::iterator it = indices.begin();
-           it != indices.end(); ++it) {
-        int label = it->first;
-        const vector<int>& label_indices = it->second;
-        if (conf_scores.find(label) == conf_scores.end()) {
-          // Something bad happened for current label.
-          LOG(FATAL) << "Could not find location predictions for " << label;
-          continue;
-        }
-        const vector<float>& scores = conf_scores.find(label)->second;
-        for (int j = 0; j < label_indices.size(); ++j) {
-          int idx = label_indices[j];
-          CHECK_LT(idx, scores.size());
-          score_index_pairs.push_back(std::make_pair(
-                  scores[idx], std::make_pair(label, idx)));
-        }
-      }
-      // Keep top k results per image.
-      std::sort(score_index_pairs.begin(), score_index_pairs.end(),
-                SortScorePairDescend<pair<int, int> >);
-      score_index_pairs.resize(keep_top_k_);
-      // Store the new indices.
-      map<int, vector<int> > new_indices;
-      for (int j = 0; j < score_index_pairs.size(); ++j) {
-        int label = score_index_pairs[j].second.first;
-        int idx = score_index_pairs[j].second.second;
-        new_indices[label].push_back(idx);
-      }
-      all_indices.push_back(new_indices);
-      num_kept += keep_top_k_;
-    } else {
-      all_indices.push_back(indices);
-      num_kept += num_det;
-    }
+    num_kept += num_kept_[i];
   }
 
   vector<int> top_shape(2, 1);
@@ -310,172 +249,26 @@ void DetectionOutputLayer<Dtype>::Forward_cpu(
   }
 
   int count = 0;
-  boost::filesystem::path output_directory(output_directory_);
   for (int i = 0; i < num; ++i) {
-    const map<int, vector<float> >& conf_scores = all_conf_scores[i];
-    const LabelBBox& decode_bboxes = all_decode_bboxes[i];
-    for (map<int, vector<int> >::iterator it = all_indices[i].begin();
-         it != all_indices[i].end(); ++it) {
-      int label = it->first;
-      if (conf_scores.find(label) == conf_scores.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find confidence predictions for " << label;
-        continue;
-      }
-      const vector<float>& scores = conf_scores.find(label)->second;
-      int loc_label = share_location_ ? -1 : label;
-      if (decode_bboxes.find(loc_label) == decode_bboxes.end()) {
-        // Something bad happened if there are no predictions for current label.
-        LOG(FATAL) << "Could not find location predictions for " << loc_label;
-        continue;
-      }
-      const vector<NormalizedBBox>& bboxes =
-          decode_bboxes.find(loc_label)->second;
-      vector<int>& indices = it->second;
-	  /*
-      if (need_save_) {
-        CHECK(label_to_name_.find(label) != label_to_name_.end())
-          << "Cannot find label: " << label << " in the label map.";
-        CHECK_LT(name_count_, names_.size());
-      }
-	  */
+    const Dtype* image_conf = conf_data + i * num_priors_ * num_classes_;
+    for (int label = 0; label < num_classes_; ++label) {
+      const vector<int>& indices = indices_[i * num_classes_ + label];
+      const int offset = (i * num_loc_classes_ +
+          (share_location_ ? 0 : label)) * num_priors_;
+      const float* bboxes = &decode_bboxes_[offset * 4];
       for (int j = 0; j < indices.size(); ++j) {
         int idx = indices[j];
         top_data[count * 7] = i;
         top_data[count * 7 + 1] = label;
-        top_data[count * 7 + 2] = scores[idx];
-        const NormalizedBBox& bbox = bboxes[idx];
-        top_data[count * 7 + 3] = bbox.xmin();
-        top_data[count * 7 + 4] = bbox.ymin();
-        top_data[count * 7 + 5] = bbox.xmax();
-        top_data[count * 7 + 6] = bbox.ymax();
-		/*
-        if (need_save_) {
-          NormalizedBBox out_bbox;
-          OutputBBox(bbox, sizes_[name_count_], has_resize_, resize_param_,
-                     &out_bbox);
-          float score = top_data[count * 7 + 2];
-          float xmin = out_bbox.xmin();
-          float ymin = out_bbox.ymin();
-          float xmax = out_bbox.xmax();
-          float ymax = out_bbox.ymax();
-          ptree pt_xmin, pt_ymin, pt_width, pt_height;
-          pt_xmin.put<float>("", round(xmin * 100) / 100.);
-          pt_ymin.put<float>("", round(ymin * 100) / 100.);
-          pt_width.put<float>("", round((xmax - xmin) * 100) / 100.);
-          pt_height.put<float>("", round((ymax - ymin) * 100) / 100.);
-
-          ptree cur_bbox;
-          cur_bbox.push_back(std::make_pair("", pt_xmin));
-          cur_bbox.push_back(std::make_pair("", pt_ymin));
-          cur_bbox.push_back(std::make_pair("", pt_width));
-          cur_bbox.push_back(std::make_pair("", pt_height));
-
-          ptree cur_det;
-          cur_det.put("image_id", names_[name_count_]);
-          if (output_format_ == "ILSVRC") {
-            cur_det.put<int>("category_id", label);
-          } else {
-            cur_det.put("category_id", label_to_name_[label].c_str());
-          }
-          cur_det.add_child("bbox", cur_bbox);
-          cur_det.put<float>("score", score);
-
-          detections_.push_back(std::make_pair("", cur_det));
-        }
-		*/
+        top_data[count * 7 + 2] =
+            static_cast<float>(image_conf[idx * num_classes_ + label]);
+        top_data[count * 7 + 3] = bboxes[idx * 4];
+        top_data[count * 7 + 4] = bboxes[idx * 4 + 1];
+        top_data[count * 7 + 5] = bboxes[idx * 4 + 2];
+        top_data[count * 7 + 6] = bboxes[idx * 4 + 3];
         ++count;
       }
     }
-	/*
-    if (need_save_) {
-      ++name_count_;
-      if (name_count_ % num_test_image_ == 0) {
-        if (output_format_ == "VOC") {
-          map<string, std::ofstream*> outfiles;
-          for (int c = 0; c < num_classes_; ++c) {
-            if (c == background_label_id_) {
-              continue;
-            }
-            string label_name = label_to_name_[c];
-            boost::filesystem::path file(
-                output_name_prefix_ + label_name + ".txt");
-            boost::filesystem::path out_file = output_directory / file;
-            outfiles[label_name] = new std::ofstream(out_file.string().c_str(),
-                std::ofstream::out);
-          }
-          BOOST_FOREACH(ptree::value_type &det, detections_.get_child("")) {
-            ptree pt = det.second;
-            string label_name = pt.get<string>("category_id");
-            if (outfiles.find(label_name) == outfiles.end()) {
-              std::cout << "Cannot find " << label_name << std::endl;
-              continue;
-            }
-            string image_name = pt.get<string>("image_id");
-            float score = pt.get<float>("score");
-            vector<int> bbox;
-            BOOST_FOREACH(ptree::value_type &elem, pt.get_child("bbox")) {
-              bbox.push_back(static_cast<int>(elem.second.get_value<float>()));
-            }
-            *(outfiles[label_name]) << image_name;
-            *(outfiles[label_name]) << " " << score;
-            *(outfiles[label_name]) << " " << bbox[0] << " " << bbox[1];
-            *(outfiles[label_name]) << " " << bbox[0] + bbox[2];
-            *(outfiles[label_name]) << " " << bbox[1] + bbox[3];
-            *(outfiles[label_name]) << std::endl;
-          }
-          for (int c = 0; c < num_classes_; ++c) {
-            if (c == background_label_id_) {
-              continue;
-            }
-            string label_name = label_to_name_[c];
-            outfiles[label_name]->flush();
-            outfiles[label_name]->close();
-            delete outfiles[label_name];
-          }
-        } else if (output_format_ == "COCO") {
-          boost::filesystem::path output_directory(output_directory_);
-          boost::filesystem::path file(output_name_prefix_ + ".json");
-          boost::filesystem::path out_file = output_directory / file;
-          std::ofstream outfile;
-          outfile.open(out_file.string().c_str(), std::ofstream::out);
-
-          boost::regex exp("\"(null|true|false|-?[0-9]+(\\.[0-9]+)?)\"");
-          ptree output;
-          output.add_child("detections", detections_);
-          std::stringstream ss;
-          write_json(ss, output);
-          std::string rv = boost::regex_replace(ss.str(), exp, "$1");
-          outfile << rv.substr(rv.find("["), rv.rfind("]") - rv.find("["))
-              << std::endl << "]" << std::endl;
-        } else if (output_format_ == "ILSVRC") {
-          boost::filesystem::path output_directory(output_directory_);
-          boost::filesystem::path file(output_name_prefix_ + ".txt");
-          boost::filesystem::path out_file = output_directory / file;
-          std::ofstream outfile;
-          outfile.open(out_file.string().c_str(), std::ofstream::out);
-
-          BOOST_FOREACH(ptree::value_type &det, detections_.get_child("")) {
-            ptree pt = det.second;
-            int label = pt.get<int>("category_id");
-            string image_name = pt.get<string>("image_id");
-            float score = pt.get<float>("score");
-            vector<int> bbox;
-            BOOST_FOREACH(ptree::value_type &elem, pt.get_child("bbox")) {
-              bbox.push_back(static_cast<int>(elem.second.get_value<float>()));
-            }
-            outfile << image_name << " " << label << " " << score;
-            outfile << " " << bbox[0] << " " << bbox[1];
-            outfile << " " << bbox[0] + bbox[2];
-            outfile << " " << bbox[1] + bbox[3];
-            outfile << std::endl;
-          }
-        }
-        name_count_ = 0;
-        detections_.clear();
-      }
-    }
-	*/
   }
   if (visualize_) {
 #ifdef USE_OPENCV
@@ -488,6 +281,94 @@ void DetectionOutputLayer<Dtype>::Forward_cpu(
   }
 }
 
+template <typename Dtype>
+void DetectionOutputLayer<Dtype>::decode_task(const Dtype* loc_data,
+    int task_id, int thread_id) {
+  const int i = task_id / num_loc_classes_;
+  const int c = task_id % num_loc_classes_;
+  if (!share_location_ && c == background_label_id_) {
+    // Ignore background class.
+    return;
+  }
+  const bool clip_bbox = false;
+  const int offset = task_id * num_priors_;
+  DecodeBBoxesFlat(loc_data + (i * num_priors_ * num_loc_classes_ + c) * 4,
+      num_loc_classes_ * 4, &prior_bboxes_[0], &prior_variances_[0],
+      num_priors_, code_type_, variance_encoded_in_target_, clip_bbox,
+      &decode_bboxes_[offset * 4], &decode_sizes_[offset]);
+}
+
+template <typename Dtype>
+void DetectionOutputLayer<Dtype>::nms_task(const Dtype* conf_data,
+    int task_id, int thread_id) {
+  const int i = task_id / num_classes_;
+  const int c = task_id % num_classes_;
+  vector<int>& indices = indices_[task_id];
+  indices.clear();
+  if (c == background_label_id_) {
+    // Ignore background class.
+    return;
+  }
+  if (!need_nms_) {
+    indices.resize(num_priors_);
+    for (int p = 0; p < num_priors_; ++p) {
+      indices[p] = p;
+    }
+    return;
+  }
+  // Gather the confidences of the class contiguously.
+  vector<float>& scores = class_scores_[thread_id];
+  scores.resize(num_priors_);
+  const Dtype* image_conf = conf_data + i * num_priors_ * num_classes_;
+  for (int p = 0; p < num_priors_; ++p) {
+    scores[p] = image_conf[p * num_classes_ + c];
+  }
+  const int offset =
+      (i * num_loc_classes_ + (share_location_ ? 0 : c)) * num_priors_;
+  ApplyNMSFastFlat(&decode_bboxes_[offset * 4], &decode_sizes_[offset],
+      &scores[0], num_priors_, confidence_threshold_, nms_threshold_, eta_,
+      top_k_, &score_index_[thread_id], &kept_bboxes_[thread_id], &indices);
+}
+
+template <typename Dtype>
+void DetectionOutputLayer<Dtype>::keep_top_k_task(const Dtype* conf_data,
+    int image, int thread_id) {
+  vector<int>* indices = &indices_[image * num_classes_];
+  int num_det = 0;
+  for (int c = 0; c < num_classes_; ++c) {
+    num_det += indices[c].size();
+  }
+  if (keep_top_k_ > -1 && num_det > keep_top_k_) {
+    const Dtype* image_conf = conf_data + image * num_priors_ * num_classes_;
+    vector<pair<float, pair<int, int> > >& score_index_pairs =
+        score_index_pairs_[thread_id];
+    score_index_pairs.clear();
+    for (int c = 0; c < num_classes_; ++c) {
+      for (int j = 0; j < indices[c].size(); ++j) {
+        int idx = indices[c][j];
+        score_index_pairs.push_back(std::make_pair(
+                static_cast<float>(image_conf[idx * num_classes_ + c]),
+                std::make_pair(c, idx)));
+      }
+    }
+    // Keep top k results per image.
+    std::sort(score_index_pairs.begin(), score_index_pairs.end(),
+              SortScorePairDescend<pair<int, int> >);
+    score_index_pairs.resize(keep_top_k_);
+    // Store the new indices.
+    for (int c = 0; c < num_classes_; ++c) {
+      indices[c].clear();
+    }
+    for (int j = 0; j < score_index_pairs.size(); ++j) {
+      int label = score_index_pairs[j].second.first;
+      int idx = score_index_pairs[j].second.second;
+      indices[label].push_back(idx);
+    }
+    num_det = keep_top_k_;
+  }
+  num_kept_[image] = num_det;
+}
+
 #ifdef CPU_ONLY
 STUB_GPU_FORWARD(DetectionOutputLayer, Forward);
 #endif
@@ -1,11 +1,18 @@
+#include <algorithm>
 #include <cfloat>
 #include <vector>
 
 #include "caffe/layers/eltwise_layer.hpp"
+#include "caffe/util/epilogue.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
+// Outputs computed at a time when an epilogue is fused. A multiple of the
+// SIMD width, so that the BLAS kernels treat every block as they treat the
+// whole output.
+static const int kEpilogueBlockSize = 4096;
+
 template <typename Dtype>
 void EltwiseLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -49,50 +56,64 @@ void EltwiseLayer<Dtype>::Forward_cpu(
   const Dtype* bottom_data_b = NULL;
   const int count = top[0]->count();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  switch (op_) {
-  case EltwiseParameter_EltwiseOp_PROD:
-    caffe_mul(count, bottom[0]->cpu_data(), bottom[1]->cpu_data(), top_data);
-    for (int i = 2; i < bottom.size(); ++i) {
-      caffe_mul(count, top_data, bottom[i]->cpu_data(), top_data);
-    }
-    break;
-  case EltwiseParameter_EltwiseOp_SUM:
-    caffe_set(count, Dtype(0), top_data);
-    // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
-    for (int i = 0; i < bottom.size(); ++i) {
-      caffe_axpy(count, coeffs_[i], bottom[i]->cpu_data(), top_data);
-    }
-    break;
-  case EltwiseParameter_EltwiseOp_MAX:
-    // Initialize
-    mask = max_idx_.mutable_cpu_data();
-    caffe_set(count, -1, mask);
-    caffe_set(count, Dtype(-FLT_MAX), top_data);
-    // bottom 0 & 1
-    bottom_data_a = bottom[0]->cpu_data();
-    bottom_data_b = bottom[1]->cpu_data();
-    for (int idx = 0; idx < count; ++idx) {
-      if (bottom_data_a[idx] > bottom_data_b[idx]) {
-        top_data[idx] = bottom_data_a[idx];  // maxval
-        mask[idx] = 0;  // maxid
-      } else {
-        top_data[idx] = bottom_data_b[idx];  // maxval
-        mask[idx] = 1;  // maxid
+  // With an epilogue, compute the output in blocks that stay in cache until
+  // the activation is applied.
+  const int block_size = this->epilogue_ ? kEpilogueBlockSize : count;
+  for (int begin = 0; begin < count; begin += block_size) {
+    const int n = std::min(block_size, count - begin);
+    Dtype* top_block = top_data + begin;
+    switch (op_) {
+    case EltwiseParameter_EltwiseOp_PROD:
+      caffe_mul(n, bottom[0]->cpu_data() + begin,
+          bottom[1]->cpu_data() + begin, top_block);
+      for (int i = 2; i < bottom.size(); ++i) {
+        caffe_mul(n, top_block, bottom[i]->cpu_data() + begin, top_block);
       }
-    }
-    // bottom 2++
-    for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
-      bottom_data_b = bottom[blob_idx]->cpu_data();
-      for (int idx = 0; idx < count; ++idx) {
-        if (bottom_data_b[idx] > top_data[idx]) {
-          top_data[idx] = bottom_data_b[idx];  // maxval
-          mask[idx] = blob_idx;  // maxid
+      break;
+    case EltwiseParameter_EltwiseOp_SUM:
+      caffe_set(n, Dtype(0), top_block);
+      // TODO(shelhamer) does BLAS optimize to sum for coeff = 1?
+      for (int i = 0; i < bottom.size(); ++i) {
+        caffe_axpy(n, coeffs_[i], bottom[i]->cpu_data() + begin, top_block);
+      }
+      break;
+    case EltwiseParameter_EltwiseOp_MAX:
+      // Initialize
+      mask = max_idx_.mutable_cpu_data() + begin;
+      caffe_set(n, -1, mask);
+      caffe_set(n, Dtype(-FLT_MAX), top_block);
+      // bottom 0 & 1
+      bottom_data_a = bottom[0]->cpu_data() + begin;
+      bottom_data_b = bottom[1]->cpu_data() + begin;
+      for (int idx = 0; idx < n; ++idx) {
+        if (bottom_data_a[idx] > bottom_data_b[idx]) {
+          top_block[idx] = bottom_data_a[idx];  // maxval
+          mask[idx] = 0;  // maxid
+        } else {
+          top_block[idx] = bottom_data_b[idx];  // maxval
+          mask[idx] = 1;  // maxid
         }
       }
+      // bottom 2++
+      for (int blob_idx = 2; blob_idx < bottom.size(); ++blob_idx) {
+        bottom_data_b = bottom[blob_idx]->cpu_data() + begin;
+        for (int idx = 0; idx < n; ++idx) {
+          if (bottom_data_b[idx] > top_block[idx]) {
+            top_block[idx] = bottom_data_b[idx];  // maxval
+            mask[idx] = blob_idx;  // maxid
+          }
+        }
+      }
+      break;
+    default:
+      LOG(FATAL) << "Unknown elementwise operation.";
+    }
+    if (this->epilogue_) {
+      const bool has_channels = top[0]->num_axes() > 1;
+      this->epilogue_->Apply(top_data, begin, begin + n,
+          has_channels ? top[0]->shape(1) : 1,
+          has_channels ? top[0]->count(2) : 1);
     }
-    break;
-  default:
-    LOG(FATAL) << "Unknown elementwise operation.";
   }
 }
 
@@ -0,0 +1,106 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/implicit_gemm_conv_layer.hpp"
+#include "caffe/util/epilogue.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// Upper bound on the size of one column tile; small enough to stay in the
+// L2 cache of a core while it is multiplied with the filters.
+static const int kColTileBytes = 1 << 20;
+
+template <typename Dtype>
+void ImplicitGemmConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (this->num_spatial_axes_ != 2 || this->force_nd_im2col_ ||
+      this->is_1x1_) {
+    // 1x1 convolutions need no column buffer in the first place.
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const int out_channels = this->num_output_ / this->group_;
+  tile_size_ = std::max<int>(1, kColTileBytes / sizeof(Dtype) / kernel_dim);
+  tile_size_ = std::min(tile_size_, this->out_spatial_dim_);
+  num_tiles_ = (this->out_spatial_dim_ + tile_size_ - 1) / tile_size_;
+  ThreadPool& pool = ThreadPool::Global();
+  col_tiles_.resize(pool.num_threads());
+  output_tiles_.resize(pool.num_threads());
+  for (int i = 0; i < pool.num_threads(); ++i) {
+    if (!col_tiles_[i]) {
+      col_tiles_[i].reset(new Blob<Dtype>());
+      output_tiles_[i].reset(new Blob<Dtype>());
+    }
+    col_tiles_[i]->Reshape(vector<int>(1, kernel_dim * tile_size_));
+    output_tiles_[i]->Reshape(vector<int>(1, out_channels * tile_size_));
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    const Epilogue<Dtype>* epilogue = i == 0 ? this->epilogue_.get() : NULL;
+    pool.Run(this->num_ * this->group_ * num_tiles_,
+        boost::bind(&ImplicitGemmConvolutionLayer<Dtype>::forward_task, this,
+            bottom_data, weight, bias, epilogue, top_data, _1, _2));
+  }
+}
+
+template <typename Dtype>
+void ImplicitGemmConvolutionLayer<Dtype>::forward_task(
+    const Dtype* bottom_data, const Dtype* weight, const Dtype* bias,
+    const Epilogue<Dtype>* epilogue, Dtype* top_data, int task_id,
+    int thread_id) {
+  const int tile = task_id % num_tiles_;
+  const int g = task_id / num_tiles_ % this->group_;
+  const int n = task_id / num_tiles_ / this->group_;
+  const int col_begin = tile * tile_size_;
+  const int col_count =
+      std::min(tile_size_, this->out_spatial_dim_ - col_begin);
+  const int* input_shape = this->conv_input_shape_.cpu_data();
+  const int in_channels = this->channels_ / this->group_;
+  const int out_channels = this->num_output_ / this->group_;
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const int* kernel_shape = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  Dtype* col_tile = col_tiles_[thread_id]->mutable_cpu_data();
+  Dtype* output_tile = output_tiles_[thread_id]->mutable_cpu_data();
+  im2col_range_cpu(bottom_data + n * this->bottom_dim_ +
+      g * in_channels * input_shape[1] * input_shape[2],
+      in_channels, input_shape[1], input_shape[2],
+      kernel_shape[0], kernel_shape[1], pad[0], pad[1],
+      stride[0], stride[1], dilation[0], dilation[1],
+      col_begin, col_count, col_tile);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_channels, col_count,
+      kernel_dim, (Dtype)1., weight + this->weight_offset_ * g, col_tile,
+      (Dtype)0., output_tile);
+  // Scatter the tile into the top rows of this group, adding the bias and
+  // applying the epilogue.
+  Dtype* image = top_data + n * this->top_dim_;
+  for (int o = 0; o < out_channels; ++o) {
+    const int c = g * out_channels + o;
+    const Dtype bias_value = bias ? bias[c] : Dtype(0);
+    const Dtype* src = output_tile + o * col_count;
+    const int begin = c * this->out_spatial_dim_ + col_begin;
+    Dtype* dst = image + begin;
+    for (int j = 0; j < col_count; ++j) {
+      dst[j] = src[j] + bias_value;
+    }
+    if (epilogue) {
+      epilogue->Apply(image, begin, begin + col_count, this->num_output_,
+          this->out_spatial_dim_);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(ImplicitGemmConvolutionLayer);
+
+}  // namespace caffe
@@ -0,0 +1,147 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/int8_conv_layer.hpp"
+#include "caffe/util/epilogue.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// Upper bound on the size of the patch rows of one tile, so that they stay
+// in the L2 cache of a core while they are multiplied with the filters.
+static const int kRowTileBytes = 1 << 18;
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::UpdateWeightCaches() {
+  if (this->num_spatial_axes_ == 2 && !this->force_nd_im2col_) {
+    weights_->Update(*this->blobs_[0], this->num_output_, false);
+  }
+}
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::ShareWeightCaches(
+    const Layer<Dtype>& other) {
+  const Int8ConvolutionLayer<Dtype>* source =
+      dynamic_cast<const Int8ConvolutionLayer<Dtype>*>(&other);
+  CHECK(source) << "Cannot share the weights of a " << other.type()
+      << " layer.";
+  weights_ = source->weights_;
+}
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (this->num_spatial_axes_ != 2 || this->force_nd_im2col_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  UpdateWeightCaches();
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const int out_channels = this->num_output_ / this->group_;
+  tile_size_ = std::max(1,
+      kRowTileBytes / static_cast<int>(kernel_dim * sizeof(int16_t)));
+  tile_size_ = std::min(tile_size_, this->out_spatial_dim_);
+  num_tiles_ = (this->out_spatial_dim_ + tile_size_ - 1) / tile_size_;
+  ThreadPool& pool = ThreadPool::Global();
+  row_tiles_.resize(pool.num_threads());
+  product_tiles_.resize(pool.num_threads());
+  for (int i = 0; i < pool.num_threads(); ++i) {
+    row_tiles_[i].resize(kernel_dim * tile_size_);
+    product_tiles_[i].resize(out_channels * tile_size_);
+  }
+  const QuantizationParameter& quantization_param =
+      this->layer_param_.quantization_param();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const int count = bottom[i]->count();
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    const Dtype range = i < quantization_param.bottom_range_size() ?
+        Dtype(quantization_param.bottom_range(i)) :
+        caffe_cpu_amax(count, bottom_data);
+    const Dtype scale = QuantizationScale(range);
+    input_.resize(count);
+    caffe_cpu_quantize(count, scale, bottom_data, &input_[0]);
+    const Epilogue<Dtype>* epilogue = i == 0 ? this->epilogue_.get() : NULL;
+    pool.Run(this->num_ * this->group_ * num_tiles_,
+        boost::bind(&Int8ConvolutionLayer<Dtype>::forward_task, this,
+            scale, bias, epilogue, top[i]->mutable_cpu_data(), _1, _2));
+  }
+}
+
+template <typename Dtype>
+void Int8ConvolutionLayer<Dtype>::forward_task(const Dtype input_scale,
+    const Dtype* bias, const Epilogue<Dtype>* epilogue, Dtype* top_data,
+    int task_id, int thread_id) {
+  const int tile = task_id % num_tiles_;
+  const int g = task_id / num_tiles_ % this->group_;
+  const int n = task_id / num_tiles_ / this->group_;
+  const int col_begin = tile * tile_size_;
+  const int col_count =
+      std::min(tile_size_, this->out_spatial_dim_ - col_begin);
+  const int* input_shape = this->conv_input_shape_.cpu_data();
+  const int height = input_shape[1];
+  const int width = input_shape[2];
+  const int in_channels = this->channels_ / this->group_;
+  const int out_channels = this->num_output_ / this->group_;
+  const int kernel_dim = this->blobs_[0]->count(1);
+  const int kernel_h = this->kernel_shape_.cpu_data()[0];
+  const int kernel_w = this->kernel_shape_.cpu_data()[1];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int stride_h = this->stride_.cpu_data()[0];
+  const int stride_w = this->stride_.cpu_data()[1];
+  const int dilation_h = this->dilation_.cpu_data()[0];
+  const int dilation_w = this->dilation_.cpu_data()[1];
+  const int output_w = this->output_shape_[1];
+  const int16_t* input = &input_[0] + n * this->bottom_dim_ +
+      g * in_channels * height * width;
+  // Gather the patch of every output position of the tile into a row.
+  int16_t* rows = &row_tiles_[thread_id][0];
+  for (int p = 0; p < col_count; ++p) {
+    const int y = (col_begin + p) / output_w;
+    const int x = (col_begin + p) % output_w;
+    int16_t* row = rows + p * kernel_dim;
+    for (int c = 0; c < in_channels; ++c) {
+      const int16_t* channel = input + c * height * width;
+      for (int i = 0; i < kernel_h; ++i) {
+        const int h = y * stride_h - pad_h + i * dilation_h;
+        if (h < 0 || h >= height) {
+          std::fill(row, row + kernel_w, int16_t(0));
+          row += kernel_w;
+          continue;
+        }
+        for (int j = 0; j < kernel_w; ++j) {
+          const int w = x * stride_w - pad_w + j * dilation_w;
+          *row++ = (w >= 0 && w < width) ? channel[h * width + w] : 0;
+        }
+      }
+    }
+  }
+  int32_t* products = &product_tiles_[thread_id][0];
+  caffe_cpu_gemm_s16(out_channels, col_count, kernel_dim,
+      weights_->data() + g * out_channels * kernel_dim, rows, products);
+  // Scale the products back and scatter them into the top rows of this
+  // group, adding the bias and applying the epilogue.
+  Dtype* image = top_data + n * this->top_dim_;
+  for (int o = 0; o < out_channels; ++o) {
+    const int c = g * out_channels + o;
+    const Dtype scale = weights_->scales()[c] / input_scale;
+    const Dtype bias_value = bias ? bias[c] : Dtype(0);
+    const int32_t* src = products + o * col_count;
+    const int begin = c * this->out_spatial_dim_ + col_begin;
+    Dtype* dst = image + begin;
+    for (int j = 0; j < col_count; ++j) {
+      dst[j] = src[j] * scale + bias_value;
+    }
+    if (epilogue) {
+      epilogue->Apply(image, begin, begin + col_count, this->num_output_,
+          this->out_spatial_dim_);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(Int8ConvolutionLayer);
+
+}  // namespace caffe
@@ -0,0 +1,86 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/int8_inner_product_layer.hpp"
+#include "caffe/util/epilogue.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// Upper bound on the size of the weights of one block of outputs.
+static const int kWeightBlockBytes = 1 << 16;
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::UpdateWeightCaches() {
+  weights_->Update(*this->blobs_[0], this->N_, this->transpose_);
+}
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::ShareWeightCaches(
+    const Layer<Dtype>& other) {
+  const Int8InnerProductLayer<Dtype>* source =
+      dynamic_cast<const Int8InnerProductLayer<Dtype>*>(&other);
+  CHECK(source) << "Cannot share the weights of a " << other.type()
+      << " layer.";
+  weights_ = source->weights_;
+}
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  UpdateWeightCaches();
+  block_size_ = std::min(this->N_, std::max(1,
+      kWeightBlockBytes / static_cast<int>(this->K_ * sizeof(int16_t))));
+  num_blocks_ = (this->N_ + block_size_ - 1) / block_size_;
+  ThreadPool& pool = ThreadPool::Global();
+  product_blocks_.resize(pool.num_threads());
+  for (int i = 0; i < pool.num_threads(); ++i) {
+    product_blocks_[i].resize(block_size_);
+  }
+  const QuantizationParameter& quantization_param =
+      this->layer_param_.quantization_param();
+  const int count = bottom[0]->count();
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  const Dtype range = quantization_param.bottom_range_size() > 0 ?
+      Dtype(quantization_param.bottom_range(0)) :
+      caffe_cpu_amax(count, bottom_data);
+  const Dtype scale = QuantizationScale(range);
+  input_.resize(count);
+  caffe_cpu_quantize(count, scale, bottom_data, &input_[0]);
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  pool.Run(num_blocks_ * this->M_,
+      boost::bind(&Int8InnerProductLayer<Dtype>::forward_task, this,
+          scale, bias, top[0]->mutable_cpu_data(), _1, _2));
+}
+
+template <typename Dtype>
+void Int8InnerProductLayer<Dtype>::forward_task(const Dtype input_scale,
+    const Dtype* bias, Dtype* top_data, int task_id, int thread_id) {
+  // Consecutive tasks share their block of weights.
+  const int m = task_id % this->M_;
+  const int block = task_id / this->M_;
+  const int n_begin = block * block_size_;
+  const int n_count = std::min(block_size_, this->N_ - n_begin);
+  int32_t* products = &product_blocks_[thread_id][0];
+  // The weights as the rows of A, so that each input value loaded serves
+  // four outputs.
+  caffe_cpu_gemm_s16(n_count, 1, this->K_,
+      weights_->data() + n_begin * this->K_, &input_[0] + m * this->K_,
+      products);
+  const Dtype* weight_scales = weights_->scales() + n_begin;
+  const int begin = m * this->N_ + n_begin;
+  Dtype* dst = top_data + begin;
+  for (int j = 0; j < n_count; ++j) {
+    dst[j] = products[j] * (weight_scales[j] / input_scale) +
+        (bias ? bias[n_begin + j] : Dtype(0));
+  }
+  if (this->epilogue_) {
+    this->epilogue_->Apply(top_data, begin, begin + n_count, this->N_, 1);
+  }
+}
+
+INSTANTIATE_CLASS(Int8InnerProductLayer);
+
+}  // namespace caffe
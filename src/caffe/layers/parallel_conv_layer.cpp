@@ -0,0 +1,75 @@
+#include <boost/bind.hpp>
+
+#include <vector>
+
+#include "caffe/layers/parallel_conv_layer.hpp"
+#include "caffe/util/epilogue.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void ParallelConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ThreadPool& pool = ThreadPool::Global();
+  if (!this->is_1x1_) {
+    // Sized for one group: kernel_dim x conv_out_spatial_dim.
+    vector<int> col_shape(1, this->blobs_[0]->count(1) *
+        top[0]->count(this->channel_axis_ + 1));
+    col_buffers_.resize(pool.num_threads());
+    for (int i = 0; i < col_buffers_.size(); ++i) {
+      if (!col_buffers_[i]) {
+        col_buffers_[i].reset(new Blob<Dtype>());
+      }
+      col_buffers_[i]->Reshape(col_shape);
+    }
+  }
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    // The epilogue follows the last write of each output: the bias, if any.
+    const Epilogue<Dtype>* epilogue = i == 0 ? this->epilogue_.get() : NULL;
+    pool.Run(this->num_ * this->group_,
+        boost::bind(&ParallelConvolutionLayer<Dtype>::forward_task, this,
+            bottom_data, weight, this->bias_term_ ? NULL : epilogue,
+            top_data, _1, _2));
+    if (this->bias_term_) {
+      const Dtype* bias = this->blobs_[1]->cpu_data();
+      pool.Run(this->num_,
+          boost::bind(&ParallelConvolutionLayer<Dtype>::bias_task, this,
+              bias, epilogue, top_data, _1, _2));
+    }
+  }
+}
+
+template <typename Dtype>
+void ParallelConvolutionLayer<Dtype>::forward_task(const Dtype* bottom_data,
+    const Dtype* weight, const Epilogue<Dtype>* epilogue, Dtype* top_data,
+    int task_id, int thread_id) {
+  const int n = task_id / this->group_;
+  const int g = task_id % this->group_;
+  Dtype* col_buff = this->is_1x1_ ? NULL :
+      col_buffers_[thread_id]->mutable_cpu_data();
+  this->forward_cpu_gemm_group(bottom_data + n * this->bottom_dim_, weight,
+      top_data + n * this->top_dim_, g, col_buff);
+  if (epilogue) {
+    const int group_dim = this->top_dim_ / this->group_;
+    epilogue->Apply(top_data + n * this->top_dim_, g * group_dim,
+        (g + 1) * group_dim, this->num_output_, this->out_spatial_dim_);
+  }
+}
+
+template <typename Dtype>
+void ParallelConvolutionLayer<Dtype>::bias_task(const Dtype* bias,
+    const Epilogue<Dtype>* epilogue, Dtype* top_data, int n, int thread_id) {
+  this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+  if (epilogue) {
+    epilogue->Apply(top_data + n * this->top_dim_, 0, this->top_dim_,
+        this->num_output_, this->out_spatial_dim_);
+  }
+}
+
+INSTANTIATE_CLASS(ParallelConvolutionLayer);
+
+}  // namespace caffe
@@ -3,13 +3,18 @@
 // Written by Yi Li
 // ------------------------------------------------------------------
 
+#include <boost/bind.hpp>
+
 #include <cfloat>
+#include <cmath>
 
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "caffe/layers/psroi_pooling_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 using std::max;
 using std::min;
@@ -50,17 +55,145 @@ namespace caffe {
       bottom[1]->num(), output_dim_, pooled_height_, pooled_width_);
   }
 
+  // Computes the [start, end) input window of bin (ph, pw) of a ROI the same
+  // way as the GPU kernels.
+  template <typename Dtype>
+  static void PSROIBin(const Dtype* roi, const Dtype spatial_scale,
+    const int height, const int width,
+    const int pooled_height, const int pooled_width,
+    const int ph, const int pw,
+    int* hstart, int* hend, int* wstart, int* wend) {
+    Dtype roi_start_w = static_cast<Dtype>(round(roi[1])) * spatial_scale;
+    Dtype roi_start_h = static_cast<Dtype>(round(roi[2])) * spatial_scale;
+    Dtype roi_end_w = static_cast<Dtype>(round(roi[3]) + 1.) * spatial_scale;
+    Dtype roi_end_h = static_cast<Dtype>(round(roi[4]) + 1.) * spatial_scale;
+
+    // Force too small ROIs to be 1x1
+    Dtype roi_width = max(roi_end_w - roi_start_w, Dtype(0.1));  // avoid 0
+    Dtype roi_height = max(roi_end_h - roi_start_h, Dtype(0.1));
+
+    // Compute w and h at bottom
+    Dtype bin_size_h = roi_height / static_cast<Dtype>(pooled_height);
+    Dtype bin_size_w = roi_width / static_cast<Dtype>(pooled_width);
+
+    *hstart = floor(static_cast<Dtype>(ph) * bin_size_h + roi_start_h);
+    *wstart = floor(static_cast<Dtype>(pw) * bin_size_w + roi_start_w);
+    *hend = ceil(static_cast<Dtype>(ph + 1) * bin_size_h + roi_start_h);
+    *wend = ceil(static_cast<Dtype>(pw + 1) * bin_size_w + roi_start_w);
+    // Add roi offsets and clip to input boundaries
+    *hstart = min(max(*hstart, 0), height);
+    *hend = min(max(*hend, 0), height);
+    *wstart = min(max(*wstart, 0), width);
+    *wend = min(max(*wend, 0), width);
+  }
+
   template <typename Dtype>
   void PSROIPoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
-    NOT_IMPLEMENTED;
+    const Dtype* bottom_data = bottom[0]->cpu_data();
+    const Dtype* bottom_rois = bottom[1]->cpu_data();
+    Dtype* top_data = top[0]->mutable_cpu_data();
+    int* mapping_channel_ptr = mapping_channel_.mutable_cpu_data();
+    // Every (ROI, output channel) pair is written by a single task.
+    ThreadPool::Global().Run(top[0]->num() * output_dim_,
+      boost::bind(&PSROIPoolingLayer<Dtype>::forward_task, this,
+        bottom_data, bottom_rois, top_data, mapping_channel_ptr, _1, _2));
+  }
+
+  template <typename Dtype>
+  void PSROIPoolingLayer<Dtype>::forward_task(const Dtype* bottom_data,
+    const Dtype* bottom_rois, Dtype* top_data, int* mapping_channel,
+    int task_id, int thread_id) {
+    // The output is in order (n, ctop, ph, pw)
+    const int n = task_id / output_dim_;
+    const int ctop = task_id % output_dim_;
+    const Dtype* roi = bottom_rois + n * 5;
+    const int roi_batch_ind = roi[0];
+    const int offset = task_id * pooled_height_ * pooled_width_;
+    top_data += offset;
+    mapping_channel += offset;
+    for (int ph = 0; ph < pooled_height_; ++ph) {
+      for (int pw = 0; pw < pooled_width_; ++pw) {
+        int hstart, hend, wstart, wend;
+        PSROIBin(roi, spatial_scale_, height_, width_, pooled_height_,
+          pooled_width_, ph, pw, &hstart, &hend, &wstart, &wend);
+        bool is_empty = (hend <= hstart) || (wend <= wstart);
+
+        int gw = pw;
+        int gh = ph;
+        int c = (ctop*group_size_ + gh)*group_size_ + gw;
+
+        const Dtype* data = bottom_data +
+          (roi_batch_ind * channels_ + c) * height_ * width_;
+        Dtype out_sum = 0;
+        for (int h = hstart; h < hend; ++h) {
+          for (int w = wstart; w < wend; ++w) {
+            out_sum += data[h*width_ + w];
+          }
+        }
+
+        Dtype bin_area = (hend - hstart)*(wend - wstart);
+        const int index = ph * pooled_width_ + pw;
+        top_data[index] = is_empty? 0. : out_sum/bin_area;
+        mapping_channel[index] = c;
+      }
+    }
   }
 
   template <typename Dtype>
   void PSROIPoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
-    NOT_IMPLEMENTED;
+    if (!propagate_down[0]) {
+      return;
+    }
+
+    const Dtype* bottom_rois = bottom[1]->cpu_data();
+    const Dtype* top_diff = top[0]->cpu_diff();
+    Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+    const int* mapping_channel_ptr = mapping_channel_.cpu_data();
+    caffe_set(bottom[1]->count(), Dtype(0), bottom[1]->mutable_cpu_diff());
+    caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+    // The input channels of different output channels are disjoint, so each
+    // task owns its part of bottom_diff and accumulates the ROIs in order.
+    ThreadPool::Global().Run(output_dim_,
+      boost::bind(&PSROIPoolingLayer<Dtype>::backward_task, this,
+        top_diff, mapping_channel_ptr, top[0]->num(), bottom_rois,
+        bottom_diff, _1, _2));
   }
+
+  template <typename Dtype>
+  void PSROIPoolingLayer<Dtype>::backward_task(const Dtype* top_diff,
+    const int* mapping_channel, const int num_rois, const Dtype* bottom_rois,
+    Dtype* bottom_diff, int ctop, int thread_id) {
+    for (int n = 0; n < num_rois; ++n) {
+      const Dtype* roi = bottom_rois + n * 5;
+      const int roi_batch_ind = roi[0];
+      const int offset =
+        (n * output_dim_ + ctop) * pooled_height_ * pooled_width_;
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          int hstart, hend, wstart, wend;
+          PSROIBin(roi, spatial_scale_, height_, width_, pooled_height_,
+            pooled_width_, ph, pw, &hstart, &hend, &wstart, &wend);
+          bool is_empty = (hend <= hstart) || (wend <= wstart);
+
+          // Compute c at bottom
+          const int index = offset + ph * pooled_width_ + pw;
+          int c = mapping_channel[index];
+          Dtype* offset_bottom_diff = bottom_diff +
+            (roi_batch_ind * channels_ + c) * height_ * width_;
+          Dtype bin_area = (hend - hstart)*(wend - wstart);
+          Dtype diff_val = is_empty ? 0. : top_diff[index] / bin_area;
+          for (int h = hstart; h < hend; ++h) {
+            for (int w = wstart; w < wend; ++w) {
+              offset_bottom_diff[h*width_ + w] += diff_val;
+            }
+          }
+        }
+      }
+    }
+  }
+
 #ifdef CPU_ONLY
   STUB_GPU(PSROIPoolingLayer);
 #endif
@@ -0,0 +1,239 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/epilogue.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+// Upper bound on the per thread Winograd domain buffers of one block.
+static const int kBlockBytes = 1 << 21;
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  use_winograd_ = this->num_spatial_axes_ == 2;
+  for (int i = 0; use_winograd_ && i < this->num_spatial_axes_; ++i) {
+    use_winograd_ = this->kernel_shape_.cpu_data()[i] == 3 &&
+        this->stride_.cpu_data()[i] == 1 &&
+        this->dilation_.cpu_data()[i] == 1;
+  }
+  if (!use_winograd_) {
+    LOG(INFO) << "Winograd convolution only supports 2D 3x3 filters with "
+        << "stride 1 and no dilation; layer " << this->layer_param_.name()
+        << " uses the CAFFE engine.";
+    return;
+  }
+  TransformWeights();
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::UpdateWeightCaches() {
+  if (use_winograd_) {
+    TransformWeights();
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::ShareWeightCaches(
+    const Layer<Dtype>& other) {
+  const WinogradConvolutionLayer<Dtype>* source =
+      dynamic_cast<const WinogradConvolutionLayer<Dtype>*>(&other);
+  CHECK(source) << "Cannot share the weights of a " << other.type()
+      << " layer.";
+  transformed_weights_ = source->transformed_weights_;
+  cached_memory_ = source->cached_memory_;
+  cached_version_ = source->cached_version_;
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::TransformWeights() {
+  const Blob<Dtype>& weights = *this->blobs_[0];
+  if (cached_memory_ == weights.data() &&
+      cached_version_ == weights.data()->version()) {
+    return;
+  }
+  const int out_channels = this->num_output_ / this->group_;
+  const int in_channels = this->channels_ / this->group_;
+  vector<int> shape(4);
+  shape[0] = this->group_;
+  shape[1] = 16;
+  shape[2] = out_channels;
+  shape[3] = in_channels;
+  transformed_weights_->Reshape(shape);
+  const Dtype* g = weights.cpu_data();
+  Dtype* u = transformed_weights_->mutable_cpu_data();
+  const int matrix_size = out_channels * in_channels;
+  for (int group = 0; group < this->group_; ++group) {
+    for (int o = 0; o < out_channels; ++o) {
+      for (int c = 0; c < in_channels; ++c, g += 9) {
+        // U = G g G^T with G = [1 0 0; .5 .5 .5; .5 -.5 .5; 0 0 1].
+        Dtype t[4][3];
+        for (int j = 0; j < 3; ++j) {
+          t[0][j] = g[j];
+          t[1][j] = (g[j] + g[3 + j] + g[6 + j]) / 2;
+          t[2][j] = (g[j] - g[3 + j] + g[6 + j]) / 2;
+          t[3][j] = g[6 + j];
+        }
+        Dtype* dst = u + group * 16 * matrix_size + o * in_channels + c;
+        for (int i = 0; i < 4; ++i) {
+          dst[(i * 4 + 0) * matrix_size] = t[i][0];
+          dst[(i * 4 + 1) * matrix_size] = (t[i][0] + t[i][1] + t[i][2]) / 2;
+          dst[(i * 4 + 2) * matrix_size] = (t[i][0] - t[i][1] + t[i][2]) / 2;
+          dst[(i * 4 + 3) * matrix_size] = t[i][2];
+        }
+      }
+    }
+  }
+  cached_memory_ = weights.data();
+  cached_version_ = cached_memory_->version();
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!use_winograd_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  TransformWeights();
+  const int out_channels = this->num_output_ / this->group_;
+  const int in_channels = this->channels_ / this->group_;
+  tiles_h_ = (this->output_shape_[0] + 1) / 2;
+  tiles_w_ = (this->output_shape_[1] + 1) / 2;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  block_size_ = std::max<int>(1, kBlockBytes / sizeof(Dtype) / 16 /
+      (in_channels + out_channels));
+  block_size_ = std::min(block_size_, num_tiles);
+  num_blocks_ = (num_tiles + block_size_ - 1) / block_size_;
+  ThreadPool& pool = ThreadPool::Global();
+  input_buffers_.resize(pool.num_threads());
+  product_buffers_.resize(pool.num_threads());
+  for (int i = 0; i < pool.num_threads(); ++i) {
+    if (!input_buffers_[i]) {
+      input_buffers_[i].reset(new Blob<Dtype>());
+      product_buffers_[i].reset(new Blob<Dtype>());
+    }
+    input_buffers_[i]->Reshape(vector<int>(1, 16 * in_channels * block_size_));
+    product_buffers_[i]->Reshape(
+        vector<int>(1, 16 * out_channels * block_size_));
+  }
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    const Dtype* bottom_data = bottom[i]->cpu_data();
+    Dtype* top_data = top[i]->mutable_cpu_data();
+    const Epilogue<Dtype>* epilogue = i == 0 ? this->epilogue_.get() : NULL;
+    pool.Run(this->num_ * this->group_ * num_blocks_,
+        boost::bind(&WinogradConvolutionLayer<Dtype>::forward_task, this,
+            bottom_data, bias, epilogue, top_data, _1, _2));
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::forward_task(const Dtype* bottom_data,
+    const Dtype* bias, const Epilogue<Dtype>* epilogue, Dtype* top_data,
+    int task_id, int thread_id) {
+  const int block = task_id % num_blocks_;
+  const int g = task_id / num_blocks_ % this->group_;
+  const int n = task_id / num_blocks_ / this->group_;
+  const int num_tiles = tiles_h_ * tiles_w_;
+  const int tile_begin = block * block_size_;
+  const int count = std::min(block_size_, num_tiles - tile_begin);
+  const int in_channels = this->channels_ / this->group_;
+  const int out_channels = this->num_output_ / this->group_;
+  const int height = this->conv_input_shape_.cpu_data()[1];
+  const int width = this->conv_input_shape_.cpu_data()[2];
+  const int pad_h = this->pad_.cpu_data()[0];
+  const int pad_w = this->pad_.cpu_data()[1];
+  const int output_h = this->output_shape_[0];
+  const int output_w = this->output_shape_[1];
+  Dtype* v = input_buffers_[thread_id]->mutable_cpu_data();
+  Dtype* m = product_buffers_[thread_id]->mutable_cpu_data();
+  // Input transform V = B^T d B, stored as 16 matrices of channels x tiles.
+  const Dtype* input = bottom_data + n * this->bottom_dim_ +
+      g * in_channels * height * width;
+  for (int c = 0; c < in_channels; ++c) {
+    const Dtype* plane = input + c * height * width;
+    for (int j = 0; j < count; ++j) {
+      const int tile = tile_begin + j;
+      const int h0 = tile / tiles_w_ * 2 - pad_h;
+      const int w0 = tile % tiles_w_ * 2 - pad_w;
+      Dtype d[4][4];
+      for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+          const int h = h0 + y;
+          const int w = w0 + x;
+          d[y][x] = (h >= 0 && h < height && w >= 0 && w < width) ?
+              plane[h * width + w] : Dtype(0);
+        }
+      }
+      Dtype t[4][4];
+      for (int x = 0; x < 4; ++x) {
+        t[0][x] = d[0][x] - d[2][x];
+        t[1][x] = d[1][x] + d[2][x];
+        t[2][x] = d[2][x] - d[1][x];
+        t[3][x] = d[1][x] - d[3][x];
+      }
+      Dtype* dst = v + c * count + j;
+      const int stride = in_channels * count;
+      for (int y = 0; y < 4; ++y) {
+        dst[(y * 4 + 0) * stride] = t[y][0] - t[y][2];
+        dst[(y * 4 + 1) * stride] = t[y][1] + t[y][2];
+        dst[(y * 4 + 2) * stride] = t[y][2] - t[y][1];
+        dst[(y * 4 + 3) * stride] = t[y][1] - t[y][3];
+      }
+    }
+  }
+  // Element-wise products in the Winograd domain, summed over channels.
+  const Dtype* u = transformed_weights_->cpu_data() +
+      g * 16 * out_channels * in_channels;
+  for (int xi = 0; xi < 16; ++xi) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, out_channels, count,
+        in_channels, (Dtype)1., u + xi * out_channels * in_channels,
+        v + xi * in_channels * count, (Dtype)0.,
+        m + xi * out_channels * count);
+  }
+  // Output transform Y = A^T M A with A^T = [1 1 1 0; 0 1 -1 -1].
+  Dtype* output = top_data + n * this->top_dim_ +
+      g * out_channels * output_h * output_w;
+  const int stride = out_channels * count;
+  for (int o = 0; o < out_channels; ++o) {
+    const int c = g * out_channels + o;
+    const Dtype bias_value = bias ? bias[c] : Dtype(0);
+    Dtype* plane = output + o * output_h * output_w;
+    for (int j = 0; j < count; ++j) {
+      const Dtype* src = m + o * count + j;
+      Dtype t[2][4];
+      for (int x = 0; x < 4; ++x) {
+        t[0][x] = src[x * stride] + src[(4 + x) * stride] +
+            src[(8 + x) * stride];
+        t[1][x] = src[(4 + x) * stride] - src[(8 + x) * stride] -
+            src[(12 + x) * stride];
+      }
+      const int tile = tile_begin + j;
+      const int h0 = tile / tiles_w_ * 2;
+      const int w0 = tile % tiles_w_ * 2;
+      for (int y = 0; y < 2 && h0 + y < output_h; ++y) {
+        Dtype y0 = t[y][0] + t[y][1] + t[y][2] + bias_value;
+        Dtype y1 = t[y][1] - t[y][2] - t[y][3] + bias_value;
+        if (epilogue) {
+          y0 = epilogue->Apply(y0, c);
+          y1 = epilogue->Apply(y1, c);
+        }
+        plane[(h0 + y) * output_w + w0] = y0;
+        if (w0 + 1 < output_w) {
+          plane[(h0 + y) * output_w + w0 + 1] = y1;
+        }
+      }
+    }
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
@@ -1,4 +1,7 @@
+#include <sys/stat.h>
+
 #include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <set>
 #include <string>
@@ -6,6 +9,7 @@
 #include <vector>
 
 #include <cstdio>
+#include <cstring>
 
 #include "hdf5.h"
 
@@ -14,10 +18,14 @@
 #include "caffe/net.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/epilogue.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/insert_splits.hpp"
 //#include "caffe/util/insert_inceptions.hpp"
+#include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -25,8 +33,9 @@
 namespace caffe {
 
 template <typename Dtype>
-Net<Dtype>::Net(const NetParameter& param, const Net* root_net)
-    : root_net_(root_net) {
+Net<Dtype>::Net(const NetParameter& param, const Net* root_net,
+    const Net* param_net)
+    : root_net_(root_net), param_net_(param_net) {
   Init(param);
 }
 /*template <typename Dtype>
@@ -42,7 +51,7 @@ template <typename Dtype>
 Net<Dtype>::Net(const string& param_file, Phase phase,
     const int level, const vector<string>* stages,
     const Net* root_net)
-    : root_net_(root_net) {
+    : root_net_(root_net), param_net_(NULL) {
   NetParameter param;
 
   ReadNetParamsFromTextFileOrDie(param_file, &param);
@@ -58,7 +67,7 @@ Net<Dtype>::Net(const string& param_file, Phase phase,
 }
 template <typename Dtype>
 Net<Dtype>::Net(const string & param_name, string& param_content, Phase phase, const Net* root_net)
-  : root_net_(root_net) {
+  : root_net_(root_net), param_net_(NULL) {
   NetParameter param;
   ReadNetParamsFromTextMemoryOrDie(param_name, param_content, &param);
   param.mutable_state()->set_phase(phase);
@@ -85,9 +94,33 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   DLOG_IF(INFO, Caffe::root_solver())
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
-  // Create a copy of filtered_param with splits added where necessary.
+  if (filtered_param.quantize()) {
+    if (phase_ == TEST) {
+      QuantizeLayers(&filtered_param);
+    } else {
+      LOG(WARNING) << "Ignoring quantize for net " << filtered_param.name()
+          << ", as it is only supported in the TEST phase.";
+    }
+  }
+  // Create a copy of filtered_param with splits added where necessary,
+  // after dropping the layers that can be folded into the weights.
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  folded_layers_.clear();
+  if (filtered_param.fold_batch_norm() && phase_ == TEST) {
+    NetParameter folded_param;
+    FoldBatchNormLayers(filtered_param, &folded_param, &folded_layers_);
+    LOG_IF(INFO, Caffe::root_solver()) << "Folded " << folded_layers_.size()
+        << " normalization layers into the weights of net "
+        << filtered_param.name();
+    InsertSplits(folded_param, &param);
+  } else {
+    if (filtered_param.fold_batch_norm()) {
+      LOG(WARNING) << "Ignoring fold_batch_norm for net "
+          << filtered_param.name()
+          << ", as it is only supported in the TEST phase.";
+    }
+    InsertSplits(filtered_param, &param);
+  }
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -123,6 +156,14 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_.push_back(LayerRegistry<Dtype>::CreateLayer(layer_param));
     }
+    Layer<Dtype>* param_layer = NULL;
+    if (param_net_ && param_net_->has_layer(layer_param.name())) {
+      // Hand the layer the parameters before SetUp, which then skips
+      // allocating and filling its own.
+      param_layer = param_net_->layer_by_name(layer_param.name()).get();
+      layers_[layer_id]->blobs() = param_layer->blobs();
+      layers_[layer_id]->ShareWeightCaches(*param_layer);
+    }
     layer_names_.push_back(layer_param.name());
     DLOG_IF(INFO, Caffe::root_solver())
         << "Creating Layer " << layer_param.name();
@@ -174,6 +215,18 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     } else {
       layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
     }
+    if (param_layer) {
+      // Layers that set up their parameters regardless still share the data.
+      vector<shared_ptr<Blob<Dtype> > >& layer_blobs =
+          layers_[layer_id]->blobs();
+      CHECK_EQ(layer_blobs.size(), param_layer->blobs().size())
+          << "Incompatible number of blobs for layer " << layer_param.name();
+      for (int j = 0; j < layer_blobs.size(); ++j) {
+        if (layer_blobs[j] != param_layer->blobs()[j]) {
+          layer_blobs[j]->ShareData(*param_layer->blobs()[j]);
+        }
+      }
+    }
     DLOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
     for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -306,7 +359,65 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  // The backward pass runs from the top, so the diff of a learnable param is
+  // complete after the lowest layer that owns or shares it.
+  vector<int> ready_layer(learnable_params_.size(), layers_.size());
+  for (int i = 0; i < params_.size(); ++i) {
+    int& layer_id = ready_layer[learnable_param_ids_[i]];
+    layer_id = std::min(layer_id, param_layer_indices_[i].first);
+  }
+  diff_ready_params_.assign(layers_.size(), vector<int>());
+  for (int i = 0; i < ready_layer.size(); ++i) {
+    diff_ready_params_[ready_layer[i]].push_back(i);
+  }
+  if (param.optimize_memory()) {
+    if (phase_ == TEST) {
+      PlanMemory(param);
+    } else {
+      LOG(WARNING) << "Ignoring optimize_memory for net " << name_
+          << ", as it is only supported in the TEST phase.";
+    }
+  }
+  layer_fused_.assign(layers_.size(), false);
+  if (param.fuse_activations()) {
+    if (phase_ == TEST) {
+      FuseActivations();
+    } else {
+      LOG(WARNING) << "Ignoring fuse_activations for net " << name_
+          << ", as it is only supported in the TEST phase.";
+    }
+  }
+  half_top_ids_.assign(layers_.size(), vector<int>());
+  half_discard_ids_.assign(layers_.size(), vector<int>());
+  bool half_top = false;
+  for (int i = 0; i < layers_.size(); ++i) {
+    half_top = half_top || layers_[i]->layer_param().half_top();
+  }
+  if (half_top) {
+    if (phase_ == TEST && !param.optimize_memory()) {
+      PlanHalfTops();
+    } else {
+      LOG(WARNING) << "Ignoring half_top for net " << name_
+          << ", as it is only supported in the TEST phase without "
+          << "optimize_memory.";
+    }
+  }
+  half_weights_ = param.half_weights() && phase_ == TEST;
+  LOG_IF(WARNING, param.half_weights() && phase_ != TEST)
+      << "Ignoring half_weights for net " << name_
+      << ", as it is only supported in the TEST phase.";
   debug_info_ = param.debug_info();
+  // Fold the weights the removed layers come with, if any. The weights of
+  // param_net_ are folded and compacted already, and may be in use.
+  if (param_net_ == NULL) {
+    for (int i = 0; i < folded_layers_.size(); ++i) {
+      if (folded_layers_[i].second.blobs_size() > 0) {
+        CopyTrainedLayersFrom(filtered_param);
+        break;
+      }
+    }
+    CompactHalfWeights();
+  }
   DLOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -406,6 +517,297 @@ bool Net<Dtype>::StateMeetsRule(const NetState& state,
   return true;
 }
 
+namespace {
+
+// Whether layers of the type may point their tops at the memory of their
+// bottoms in Forward.
+bool MayAliasBottoms(const string& type) {
+  return type == "Split" || type == "Flatten" || type == "Reshape" ||
+      type == "Concat" || type == "Slice" || type == "Permute";
+}
+
+}  // namespace
+
+// Helper for Net::Init: assign the data of intermediate blobs to a pool of
+// shared memory regions, based on the last layer that uses each blob.
+template <typename Dtype>
+void Net<Dtype>::PlanMemory(const NetParameter& param) {
+  const int num_layers = layers_.size();
+  const int num_blobs = blobs_.size();
+  // Net inputs and outputs and the requested blobs keep their own memory, as
+  // do the tops of layers without bottoms, which may point them at memory
+  // outside the net (e.g. MemoryData).
+  vector<bool> planned(num_blobs, true);
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    planned[net_input_blob_indices_[i]] = false;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    planned[net_output_blob_indices_[i]] = false;
+  }
+  for (int i = 0; i < param.pinned_blob_size(); ++i) {
+    const string& blob_name = param.pinned_blob(i);
+    CHECK(has_blob(blob_name)) << "Unknown pinned blob " << blob_name;
+    planned[blob_names_index_[blob_name]] = false;
+  }
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    if (bottom_id_vecs_[layer_id].empty()) {
+      for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+        planned[top_id_vecs_[layer_id][top_id]] = false;
+      }
+    }
+  }
+  // The last layer reading or writing each blob. Blobs which are not planned
+  // must stay valid after the last layer.
+  vector<int> last_use(num_blobs, -1);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      last_use[bottom_id_vecs_[layer_id][i]] = layer_id;
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      last_use[top_id_vecs_[layer_id][i]] = layer_id;
+    }
+  }
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (!planned[blob_id]) { last_use[blob_id] = num_layers; }
+  }
+  // These layers may point their tops at the memory of their bottoms in
+  // Forward. Their tops keep their own (then unused) memory, and the bottoms
+  // live as long as any of the tops. Going backwards propagates the lifetime
+  // through chains of such layers.
+  for (int layer_id = num_layers - 1; layer_id >= 0; --layer_id) {
+    if (!MayAliasBottoms(layers_[layer_id]->type())) { continue; }
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    for (int i = 0; i < top_ids.size(); ++i) {
+      if (std::find(bottom_ids.begin(), bottom_ids.end(), top_ids[i]) !=
+          bottom_ids.end()) {
+        continue;
+      }
+      planned[top_ids[i]] = false;
+      for (int j = 0; j < bottom_ids.size(); ++j) {
+        last_use[bottom_ids[j]] =
+            std::max(last_use[bottom_ids[j]], last_use[top_ids[i]]);
+      }
+    }
+  }
+  // Greedily give each top a free region as it is produced, preferring the
+  // smallest region that fits, and return the regions of the blobs whose last
+  // use was the current layer.
+  vector<size_t> region_bytes;
+  vector<int> free_regions;
+  vector<int> blob_region(num_blobs, -1);
+  vector<bool> released(num_blobs, false);
+  size_t unplanned_bytes = 0;
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    for (int i = 0; i < top_ids.size(); ++i) {
+      const int blob_id = top_ids[i];
+      if (!planned[blob_id] || blob_region[blob_id] >= 0 ||
+          blobs_[blob_id]->count() == 0) {
+        continue;
+      }
+      const size_t bytes = blobs_[blob_id]->data()->size();
+      unplanned_bytes += bytes;
+      int best = -1;
+      for (int j = 0; j < free_regions.size(); ++j) {
+        if (best < 0) {
+          best = j;
+          continue;
+        }
+        const size_t candidate = region_bytes[free_regions[j]];
+        const size_t current = region_bytes[free_regions[best]];
+        const bool fits = candidate >= bytes;
+        const bool current_fits = current >= bytes;
+        // Otherwise grow the largest free region.
+        if ((fits && (!current_fits || candidate < current)) ||
+            (!fits && !current_fits && candidate > current)) {
+          best = j;
+        }
+      }
+      if (best < 0) {
+        blob_region[blob_id] = region_bytes.size();
+        region_bytes.push_back(bytes);
+      } else {
+        const int region = free_regions[best];
+        free_regions.erase(free_regions.begin() + best);
+        blob_region[blob_id] = region;
+        region_bytes[region] = std::max(region_bytes[region], bytes);
+      }
+    }
+    for (int k = 0; k < 2; ++k) {
+      const vector<int>& blob_ids =
+          (k == 0) ? bottom_id_vecs_[layer_id] : top_ids;
+      for (int i = 0; i < blob_ids.size(); ++i) {
+        const int blob_id = blob_ids[i];
+        if (blob_region[blob_id] >= 0 && !released[blob_id] &&
+            last_use[blob_id] == layer_id) {
+          released[blob_id] = true;
+          free_regions.push_back(blob_region[blob_id]);
+        }
+      }
+    }
+  }
+  vector<shared_ptr<SyncedMemory> > regions(region_bytes.size());
+  size_t planned_bytes = 0;
+  for (int i = 0; i < regions.size(); ++i) {
+    regions[i].reset(new SyncedMemory(region_bytes[i]));
+    planned_bytes += region_bytes[i];
+  }
+  int num_shared = 0;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (blob_region[blob_id] >= 0) {
+      blobs_[blob_id]->ShareDataMemory(regions[blob_region[blob_id]]);
+      ++num_shared;
+    }
+  }
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Memory planning placed " << num_shared << " blobs of net " << name_
+      << " in " << regions.size() << " shared regions: " << planned_bytes
+      << " bytes instead of " << unplanned_bytes;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanHalfTops() {
+  const int num_layers = layers_.size();
+  const int num_blobs = blobs_.size();
+  // The last layer reading or writing each blob, counting the readers of the
+  // tops that may alias it, as in PlanMemory.
+  vector<int> last_use(num_blobs, -1);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      last_use[bottom_id_vecs_[layer_id][i]] = layer_id;
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      last_use[top_id_vecs_[layer_id][i]] = layer_id;
+    }
+  }
+  for (int layer_id = num_layers - 1; layer_id >= 0; --layer_id) {
+    if (!MayAliasBottoms(layers_[layer_id]->type())) { continue; }
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    for (int i = 0; i < top_ids.size(); ++i) {
+      for (int j = 0; j < bottom_ids.size(); ++j) {
+        last_use[bottom_ids[j]] =
+            std::max(last_use[bottom_ids[j]], last_use[top_ids[i]]);
+      }
+    }
+  }
+  // The outputs are left for the caller to read.
+  vector<bool> half(num_blobs, false);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    if (!layers_[layer_id]->layer_param().half_top()) { continue; }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      half[top_id_vecs_[layer_id][i]] = true;
+    }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    half[net_output_blob_indices_[i]] = false;
+  }
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (half[blob_id]) {
+      half_top_ids_[last_use[blob_id]].push_back(blob_id);
+    }
+  }
+  // The next Forward overwrites what is left in half precision, except for
+  // the inputs, which the caller writes, and the tops that layers compute in
+  // place or alias to their bottoms.
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    half[net_input_blob_indices_[i]] = false;
+  }
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    if (MayAliasBottoms(layers_[layer_id]->type())) { continue; }
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    for (int i = 0; i < top_ids.size(); ++i) {
+      if (half[top_ids[i]] && std::find(bottom_ids.begin(), bottom_ids.end(),
+          top_ids[i]) == bottom_ids.end()) {
+        half_discard_ids_[layer_id].push_back(top_ids[i]);
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::FuseActivations() {
+  const int num_layers = layers_.size();
+  int num_fused = 0;
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const vector<int>& bottom_ids = bottom_id_vecs_[layer_id];
+    const vector<int>& top_ids = top_id_vecs_[layer_id];
+    if (!Epilogue<Dtype>::CanFuse(*layers_[layer_id]) ||
+        bottom_ids.size() != 1 || top_ids.size() != 1 ||
+        bottom_ids[0] != top_ids[0] || layers_[layer_id]->loss(0)) {
+      continue;
+    }
+    // The producer of the blob must be the last layer to touch it.
+    const int blob_id = top_ids[0];
+    int producer_id = layer_id - 1;
+    for (; producer_id >= 0; --producer_id) {
+      const vector<int>& bottoms = bottom_id_vecs_[producer_id];
+      const vector<int>& tops = top_id_vecs_[producer_id];
+      if (std::find(tops.begin(), tops.end(), blob_id) != tops.end() ||
+          std::find(bottoms.begin(), bottoms.end(), blob_id) !=
+          bottoms.end()) {
+        break;
+      }
+    }
+    if (producer_id < 0) { continue; }
+    const shared_ptr<Layer<Dtype> >& producer = layers_[producer_id];
+    const LayerParameter& producer_param = producer->layer_param();
+    if (!producer->AllowEpilogue() || producer->epilogue() ||
+        top_id_vecs_[producer_id][0] != blob_id ||
+        (producer_param.type() == "Convolution" &&
+         producer_param.convolution_param().axis() != 1) ||
+        (producer_param.type() == "InnerProduct" &&
+         producer_param.inner_product_param().axis() != 1)) {
+      continue;
+    }
+    producer->set_epilogue(shared_ptr<Epilogue<Dtype> >(
+        new Epilogue<Dtype>(layers_[layer_id].get())));
+    layer_fused_[layer_id] = true;
+    ++num_fused;
+    DLOG_IF(INFO, Caffe::root_solver()) << "Fused " << layer_names_[layer_id]
+        << " into " << layer_names_[producer_id];
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Fused " << num_fused
+      << " activation layers of net " << name_;
+}
+
+template <typename Dtype>
+void Net<Dtype>::QuantizeLayers(NetParameter* param) {
+  int num_quantized = 0;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    if (layer_param->type() == "Convolution") {
+      ConvolutionParameter* conv_param =
+          layer_param->mutable_convolution_param();
+      // Grouped convolutions are memory bound and keep their engine.
+      if (conv_param->engine() != ConvolutionParameter_Engine_DEFAULT ||
+          conv_param->group() > 1) {
+        continue;
+      }
+      conv_param->set_engine(ConvolutionParameter_Engine_INT8);
+    } else if (layer_param->type() == "InnerProduct") {
+      InnerProductParameter* inner_product_param =
+          layer_param->mutable_inner_product_param();
+      if (inner_product_param->engine() !=
+          InnerProductParameter_Engine_DEFAULT) {
+        continue;
+      }
+      inner_product_param->set_engine(InnerProductParameter_Engine_INT8);
+    } else {
+      continue;
+    }
+    if (layer_param->quantization_param().bottom_range_size() == 0) {
+      LOG(WARNING) << "Layer " << layer_param->name() << " has no calibrated "
+          << "range and will quantize each input with its own range.";
+    }
+    ++num_quantized;
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Quantized " << num_quantized
+      << " layers of net " << param->name();
+}
+
 // Helper for Net::Init: add a new top blob to the net.
 template <typename Dtype>
 void Net<Dtype>::AppendTop(const NetParameter& param, const int layer_id,
@@ -590,9 +992,18 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   Dtype loss = 0;
 
   for (int i = start; i <= end; ++i) {
-    Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
-    loss += layer_loss;
-    if (debug_info_) { ForwardDebugInfo(i); }
+    for (int j = 0; j < half_discard_ids_[i].size(); ++j) {
+      blobs_[half_discard_ids_[i][j]]->DiscardHalfData();
+    }
+    // The layer producing its input has applied it on the CPU.
+    if (!layer_fused_[i] || Caffe::mode() != Caffe::CPU) {
+      Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      loss += layer_loss;
+      if (debug_info_) { ForwardDebugInfo(i); }
+    }
+    for (int j = 0; j < half_top_ids_[i].size(); ++j) {
+      blobs_[half_top_ids_[i][j]]->CompactDataToHalf();
+    }
   }
   return loss;
 }
@@ -639,6 +1050,11 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
     }
+    for (int c = 0; c < callbacks_.size(); ++c) {
+      for (int j = 0; j < diff_ready_params_[i].size(); ++j) {
+        callbacks_[c]->on_diff_ready(diff_ready_params_[i][j]);
+      }
+    }
   }
 }
 
@@ -723,36 +1139,86 @@ void Net<Dtype>::UpdateDebugInfo(const int param_id) {
 
 template <typename Dtype>
 void Net<Dtype>::ShareTrainedLayersWith(const Net* other) {
+  ShareOrCopyTrainedLayersFrom(other, true);
+}
+
+template <typename Dtype>
+void Net<Dtype>::ShareOrCopyTrainedLayersFrom(const Net* other,
+    bool share) {
+  set<string> fold_targets, folded_names;
+  for (int i = 0; i < folded_layers_.size(); ++i) {
+    fold_targets.insert(folded_layers_[i].first);
+    folded_names.insert(folded_layers_[i].second.name());
+  }
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
+  set<string> copied_layers;
   int num_source_layers = other->layers().size();
   for (int i = 0; i < num_source_layers; ++i) {
     Layer<Dtype>* source_layer = other->layers()[i].get();
     const string& source_layer_name = other->layer_names()[i];
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
-    }
-    if (target_layer_id == layer_names_.size()) {
-      LOG(INFO) << "Ignoring source layer " << source_layer_name;
+    if (!layer_names_index_.count(source_layer_name)) {
+      if (folded_names.count(source_layer_name)) {
+        // Only read while folding, so no copy is needed.
+        folded_blobs[source_layer_name] = source_layer->blobs();
+        continue;
+      }
+      DLOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
+    const int target_layer_id = layer_names_index_[source_layer_name];
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer->blobs().size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
-      Blob<Dtype>* source_blob = source_layer->blobs()[j].get();
+    const vector<shared_ptr<Blob<Dtype> > >& source_blobs =
+        source_layer->blobs();
+    // The weights folding changes must stay private to this net, and a
+    // fold target may have gained a bias term its source does not have.
+    const bool fold_target = fold_targets.count(source_layer_name) > 0;
+    const bool missing_bias = fold_target && source_blobs.size() == 1 &&
+        target_blobs.size() == 2;
+    if (!missing_bias) {
+      CHECK_EQ(target_blobs.size(), source_blobs.size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
+    for (int j = 0; j < source_blobs.size(); ++j) {
+      const Blob<Dtype>* source_blob = source_blobs[j].get();
       CHECK(target_blobs[j]->shape() == source_blob->shape())
-          << "Cannot share param " << j << " weights from layer '"
-          << source_layer_name << "'; shape mismatch.  Source param shape is "
+          << "Cannot " << (share ? "share" : "copy") << " param " << j
+          << " weights from layer '" << source_layer_name
+          << "'; shape mismatch.  Source param shape is "
           << source_blob->shape_string() << "; target param shape is "
           << target_blobs[j]->shape_string();
-      target_blobs[j]->ShareData(*source_blob);
+      if (share && !fold_target) {
+        target_blobs[j]->ShareData(*source_blob);
+      } else {
+        target_blobs[j]->CopyFrom(*source_blob);
+      }
+    }
+    if (missing_bias) {
+      caffe_set(target_blobs[1]->count(), Dtype(0),
+          target_blobs[1]->mutable_cpu_data());
+    }
+    copied_layers.insert(source_layer_name);
+  }
+  FoldTrainedLayers(folded_blobs, copied_layers);
+}
+
+template <typename Dtype>
+void Net<Dtype>::CompactHalfWeights() {
+  if (!half_weights_) { return; }
+  for (int i = 0; i < layers_.size(); ++i) {
+    if (layers_[i]->ReadsHalfWeights() && layers_[i]->blobs().size() > 0) {
+      layers_[i]->blobs()[0]->CompactDataToHalf();
     }
   }
 }
 
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFrom(const Net* other) {
+  ShareOrCopyTrainedLayersFrom(other, false);
+  CompactHalfWeights();
+}
+
 template <typename Dtype>
 void Net<Dtype>::BackwardFrom(int start) {
   BackwardFromTo(start, 0);
@@ -797,25 +1263,43 @@ void Net<Dtype>::CopyTrainedLayersFrom(const string trained_name,  string &train
 }
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
+  set<string> fold_targets, folded_names;
+  for (int i = 0; i < folded_layers_.size(); ++i) {
+    fold_targets.insert(folded_layers_[i].first);
+    folded_names.insert(folded_layers_[i].second.name());
+  }
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
+  set<string> copied_layers;
   int num_source_layers = param.layer_size();
   for (int i = 0; i < num_source_layers; ++i) {
     const LayerParameter& source_layer = param.layer(i);
     const string& source_layer_name = source_layer.name();
-    int target_layer_id = 0;
-    while (target_layer_id != layer_names_.size() &&
-        layer_names_[target_layer_id] != source_layer_name) {
-      ++target_layer_id;
-    }
-    if (target_layer_id == layer_names_.size()) {
+    if (!layer_names_index_.count(source_layer_name)) {
+      if (folded_names.count(source_layer_name)) {
+        vector<shared_ptr<Blob<Dtype> > >& blobs =
+            folded_blobs[source_layer_name];
+        blobs.clear();
+        for (int j = 0; j < source_layer.blobs_size(); ++j) {
+          blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          blobs.back()->FromProto(source_layer.blobs(j));
+        }
+        continue;
+      }
       DLOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
+    const int target_layer_id = layer_names_index_[source_layer_name];
     DLOG(INFO) << "Copying source layer " << source_layer_name;
     vector<shared_ptr<Blob<Dtype> > >& target_blobs =
         layers_[target_layer_id]->blobs();
-    CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
-        << "Incompatible number of blobs for layer " << source_layer_name;
-    for (int j = 0; j < target_blobs.size(); ++j) {
+    // A fold target may have gained a bias term its source does not have.
+    const bool missing_bias = fold_targets.count(source_layer_name) &&
+        source_layer.blobs_size() == 1 && target_blobs.size() == 2;
+    if (!missing_bias) {
+      CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
+    for (int j = 0; j < source_layer.blobs_size(); ++j) {
       if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
         Blob<Dtype> source_blob;
         const bool kReshape = true;
@@ -830,14 +1314,104 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
       const bool kReshape = false;
       target_blobs[j]->FromProto(source_layer.blobs(j), kReshape);
     }
+    if (missing_bias) {
+      caffe_set(target_blobs[1]->count(), Dtype(0),
+          target_blobs[1]->mutable_cpu_data());
+    }
+    copied_layers.insert(source_layer_name);
   }
+  FoldTrainedLayers(folded_blobs, copied_layers);
+  CompactHalfWeights();
 }
 
+template <typename Dtype>
+void Net<Dtype>::FoldTrainedLayers(
+    const map<string, vector<shared_ptr<Blob<Dtype> > > >& folded_blobs,
+    const set<string>& copied_layers) {
+  for (int i = 0; i < folded_layers_.size(); ++i) {
+    const string& target_name = folded_layers_[i].first;
+    const LayerParameter& folded_param = folded_layers_[i].second;
+    typename map<string, vector<shared_ptr<Blob<Dtype> > > >::const_iterator
+        it = folded_blobs.find(folded_param.name());
+    if (!copied_layers.count(target_name)) {
+      LOG_IF(WARNING, it != folded_blobs.end()) << "Ignoring source layer "
+          << folded_param.name() << ", as the weights of " << target_name
+          << ", which it is folded into, come from another source";
+      continue;
+    }
+    if (it == folded_blobs.end()) {
+      LOG(WARNING) << "No weights for layer " << folded_param.name()
+          << " to fold into " << target_name;
+      continue;
+    }
+    DLOG(INFO) << "Folding source layer " << folded_param.name() << " into "
+        << target_name;
+    vector<Dtype> scale, shift;
+    GetFoldedTransform(folded_param, it->second, &scale, &shift);
+    FoldTransformIntoLayer(scale, shift,
+        layers_[layer_names_index_[target_name]].get());
+  }
+}
+
+namespace {
+
+// A mapped weights file starts with the magic and the size of the header,
+// a serialized NetParameter. The data section follows at the next multiple
+// of the alignment, and every blob in it starts at such a multiple as well.
+const char kMappedWeightsMagic[8] = {'C', 'A', 'F', 'F', 'E', 'M', 'A', 'P'};
+const uint64_t kMappedHeaderStart = sizeof(kMappedWeightsMagic) +
+    sizeof(uint64_t);
+const uint64_t kMappedAlignment = 64;
+
+uint64_t AlignMapped(uint64_t offset) {
+  return (offset + kMappedAlignment - 1) / kMappedAlignment *
+      kMappedAlignment;
+}
+
+// Only regular files are probed, as reading a pipe would consume it.
+bool IsMappedWeightsFile(const string& filename) {
+  struct stat file_stat;
+  if (stat(filename.c_str(), &file_stat) != 0 ||
+      !S_ISREG(file_stat.st_mode)) {
+    return false;
+  }
+  char magic[sizeof(kMappedWeightsMagic)];
+  std::ifstream input(filename.c_str(), std::ios::binary);
+  return input.read(magic, sizeof(magic)) &&
+      memcmp(magic, kMappedWeightsMagic, sizeof(magic)) == 0;
+}
+
+// Copies the data of blob from the data section of a mapped weights file.
+template <typename Dtype>
+void CopyMappedBlob(const char* data, uint64_t data_size,
+    const BlobProto& proto, Blob<Dtype>* blob) {
+  const size_t value_size =
+      proto.mapped_double() ? sizeof(double) : sizeof(float);
+  const uint64_t bytes = blob->count() * value_size;
+  CHECK_LE(proto.mapped_offset() + bytes, data_size)
+      << "Blob data past the end of the mapped weights file";
+  const char* source = data + proto.mapped_offset();
+  Dtype* target = blob->mutable_cpu_data();
+  if (value_size == sizeof(Dtype)) {
+    ParallelMemcpy(target, source, bytes);
+  } else if (proto.mapped_double()) {
+    const double* values = reinterpret_cast<const double*>(source);
+    std::copy(values, values + blob->count(), target);
+  } else {
+    const float* values = reinterpret_cast<const float*>(source);
+    std::copy(values, values + blob->count(), target);
+  }
+}
+
+}  // namespace
+
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
   if (trained_filename.size() >= 3 &&
       trained_filename.compare(trained_filename.size() - 3, 3, ".h5") == 0) {
     CopyTrainedLayersFromHDF5(trained_filename);
+  } else if (IsMappedWeightsFile(trained_filename)) {
+    CopyTrainedLayersFromMapped(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
   }
@@ -858,10 +1432,36 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
   hid_t data_hid = H5Gopen2(file_hid, "data", H5P_DEFAULT);
   CHECK_GE(data_hid, 0) << "Error reading weights from " << trained_filename;
+  set<string> fold_targets, folded_names;
+  for (int i = 0; i < folded_layers_.size(); ++i) {
+    fold_targets.insert(folded_layers_[i].first);
+    folded_names.insert(folded_layers_[i].second.name());
+  }
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
+  set<string> copied_layers;
   int num_layers = hdf5_get_num_links(data_hid);
   for (int i = 0; i < num_layers; ++i) {
     string source_layer_name = hdf5_get_name_by_idx(data_hid, i);
     if (!layer_names_index_.count(source_layer_name)) {
+      if (folded_names.count(source_layer_name)) {
+        hid_t layer_hid = H5Gopen2(data_hid, source_layer_name.c_str(),
+            H5P_DEFAULT);
+        CHECK_GE(layer_hid, 0)
+            << "Error reading weights from " << trained_filename;
+        vector<shared_ptr<Blob<Dtype> > >& blobs =
+            folded_blobs[source_layer_name];
+        blobs.clear();
+        int num_source_params = hdf5_get_num_links(layer_hid);
+        for (int j = 0; j < num_source_params; ++j) {
+          ostringstream oss;
+          oss << j;
+          blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          hdf5_load_nd_dataset(layer_hid, oss.str().c_str(), 0, kMaxBlobAxes,
+              blobs.back().get());
+        }
+        H5Gclose(layer_hid);
+        continue;
+      }
       DLOG(INFO) << "Ignoring source layer " << source_layer_name;
       continue;
     }
@@ -887,6 +1487,11 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
         if (param_owners_[target_net_param_id] != -1) {
           // ...but it's weight-shared in target, so that's fine.
           continue;
+        } else if (j == 1 && fold_targets.count(source_layer_name)) {
+          // ...but it's the bias term a fold target gained.
+          caffe_set(target_blobs[j]->count(), Dtype(0),
+              target_blobs[j]->mutable_cpu_data());
+          continue;
         } else {
           LOG(FATAL) << "Incompatible number of blobs for layer "
               << source_layer_name;
@@ -896,9 +1501,92 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
           target_blobs[j].get());
     }
     H5Gclose(layer_hid);
+    copied_layers.insert(source_layer_name);
   }
   H5Gclose(data_hid);
   H5Fclose(file_hid);
+  FoldTrainedLayers(folded_blobs, copied_layers);
+  CompactHalfWeights();
+}
+
+template <typename Dtype>
+void Net<Dtype>::CopyTrainedLayersFromMapped(const string trained_filename) {
+  MappedFile file(trained_filename);
+  CHECK(file.size() >= kMappedHeaderStart && memcmp(file.data(),
+      kMappedWeightsMagic, sizeof(kMappedWeightsMagic)) == 0)
+      << trained_filename << " is not a mapped weights file";
+  uint64_t header_size;
+  memcpy(&header_size, file.data() + sizeof(kMappedWeightsMagic),
+      sizeof(header_size));
+  CHECK_LE(kMappedHeaderStart + header_size, file.size())
+      << "Truncated mapped weights file " << trained_filename;
+  NetParameter header;
+  CHECK(header.ParseFromArray(file.data() + kMappedHeaderStart, header_size))
+      << "Failed to parse the header of " << trained_filename;
+  const uint64_t data_start = AlignMapped(kMappedHeaderStart + header_size);
+  const char* data = file.data() + data_start;
+  const uint64_t data_size =
+      file.size() > data_start ? file.size() - data_start : 0;
+
+  set<string> fold_targets, folded_names;
+  for (int i = 0; i < folded_layers_.size(); ++i) {
+    fold_targets.insert(folded_layers_[i].first);
+    folded_names.insert(folded_layers_[i].second.name());
+  }
+  map<string, vector<shared_ptr<Blob<Dtype> > > > folded_blobs;
+  set<string> copied_layers;
+  for (int i = 0; i < header.layer_size(); ++i) {
+    const LayerParameter& source_layer = header.layer(i);
+    const string& source_layer_name = source_layer.name();
+    if (!layer_names_index_.count(source_layer_name)) {
+      if (folded_names.count(source_layer_name)) {
+        vector<shared_ptr<Blob<Dtype> > >& blobs =
+            folded_blobs[source_layer_name];
+        blobs.clear();
+        for (int j = 0; j < source_layer.blobs_size(); ++j) {
+          blobs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          blobs.back()->Reshape(source_layer.blobs(j).shape());
+          CopyMappedBlob(data, data_size, source_layer.blobs(j),
+              blobs.back().get());
+        }
+        continue;
+      }
+      DLOG(INFO) << "Ignoring source layer " << source_layer_name;
+      continue;
+    }
+    const int target_layer_id = layer_names_index_[source_layer_name];
+    DLOG(INFO) << "Copying source layer " << source_layer_name;
+    vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+        layers_[target_layer_id]->blobs();
+    // A fold target may have gained a bias term its source does not have.
+    const bool missing_bias = fold_targets.count(source_layer_name) &&
+        source_layer.blobs_size() == 1 && target_blobs.size() == 2;
+    if (!missing_bias) {
+      CHECK_EQ(target_blobs.size(), source_layer.blobs_size())
+          << "Incompatible number of blobs for layer " << source_layer_name;
+    }
+    for (int j = 0; j < source_layer.blobs_size(); ++j) {
+      if (!target_blobs[j]->ShapeEquals(source_layer.blobs(j))) {
+        Blob<Dtype> source_blob;
+        source_blob.Reshape(source_layer.blobs(j).shape());
+        LOG(FATAL) << "Cannot copy param " << j << " weights from layer '"
+            << source_layer_name << "'; shape mismatch.  Source param shape is "
+            << source_blob.shape_string() << "; target param shape is "
+            << target_blobs[j]->shape_string() << ". "
+            << "To learn this layer's parameters from scratch rather than "
+            << "copying from a saved net, rename the layer.";
+      }
+      CopyMappedBlob(data, data_size, source_layer.blobs(j),
+          target_blobs[j].get());
+    }
+    if (missing_bias) {
+      caffe_set(target_blobs[1]->count(), Dtype(0),
+          target_blobs[1]->mutable_cpu_data());
+    }
+    copied_layers.insert(source_layer_name);
+  }
+  FoldTrainedLayers(folded_blobs, copied_layers);
+  CompactHalfWeights();
 }
 
 template <typename Dtype>
@@ -970,6 +1658,59 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
   H5Fclose(file_hid);
 }
 
+template <typename Dtype>
+void Net<Dtype>::ToMapped(const string& filename) const {
+  NetParameter header;
+  header.set_name(name_);
+  vector<const Blob<Dtype>*> data_blobs;
+  vector<uint64_t> param_offsets(params_.size());
+  uint64_t data_size = 0;
+  for (int i = 0; i < layers_.size(); ++i) {
+    LayerParameter* layer_param = header.add_layer();
+    layer_param->CopyFrom(layers_[i]->layer_param());
+    layer_param->clear_blobs();
+    for (int j = 0; j < layers_[i]->blobs().size(); ++j) {
+      const Blob<Dtype>& blob = *layers_[i]->blobs()[j];
+      BlobProto* blob_proto = layer_param->add_blobs();
+      for (int k = 0; k < blob.num_axes(); ++k) {
+        blob_proto->mutable_shape()->add_dim(blob.shape(k));
+      }
+      blob_proto->set_mapped_double(sizeof(Dtype) == sizeof(double));
+      const int net_param_id = param_id_vecs_[i][j];
+      const int owner_id = param_owners_[net_param_id];
+      if (owner_id != -1) {
+        // Shared params point at the data of their owner.
+        param_offsets[net_param_id] = param_offsets[owner_id];
+      } else {
+        param_offsets[net_param_id] = data_size;
+        data_blobs.push_back(&blob);
+        data_size = AlignMapped(data_size + blob.count() * sizeof(Dtype));
+      }
+      blob_proto->set_mapped_offset(param_offsets[net_param_id]);
+    }
+  }
+  string header_bytes;
+  CHECK(header.SerializeToString(&header_bytes));
+  const uint64_t header_size = header_bytes.size();
+  std::ofstream output(filename.c_str(),
+      std::ios::out | std::ios::trunc | std::ios::binary);
+  CHECK(output.is_open()) << "Failed to open " << filename;
+  const vector<char> padding(kMappedAlignment, 0);
+  output.write(kMappedWeightsMagic, sizeof(kMappedWeightsMagic));
+  output.write(reinterpret_cast<const char*>(&header_size),
+      sizeof(header_size));
+  output.write(header_bytes.data(), header_size);
+  const uint64_t header_end = kMappedHeaderStart + header_size;
+  output.write(padding.data(), AlignMapped(header_end) - header_end);
+  for (int i = 0; i < data_blobs.size(); ++i) {
+    const uint64_t bytes = data_blobs[i]->count() * sizeof(Dtype);
+    output.write(reinterpret_cast<const char*>(data_blobs[i]->cpu_data()),
+        bytes);
+    output.write(padding.data(), AlignMapped(bytes) - bytes);
+  }
+  CHECK(output.good()) << "Failed to write " << filename;
+}
+
 template <typename Dtype>
 void Net<Dtype>::Update() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
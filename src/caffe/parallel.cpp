@@ -73,6 +73,38 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
       diff_() {
 }
 
+template<typename Dtype>
+Params<Dtype>::Params(const vector<Blob<Dtype>*>& params)
+    : size_(total_size<Dtype>(params)),
+      data_(),
+      diff_() {
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(const vector<Blob<Dtype>*>& params)
+    : Params<Dtype>(params) {
+  CaffeMallocHost(reinterpret_cast<void**>(&data_), size_ * sizeof(Dtype),
+      &use_cuda_);
+  // Copy blob values
+  apply_buffers(params, data_, size_, copy);
+
+  CaffeMallocHost(reinterpret_cast<void**>(&diff_), size_ * sizeof(Dtype),
+      &use_cuda_);
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  CaffeFreeHost(data_, use_cuda_);
+  CaffeFreeHost(diff_, use_cuda_);
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::configure(const vector<Blob<Dtype>*>& params) const {
+  apply_buffers(params, data_, size_, replace_cpu);
+  apply_buffers(params, diff_, size_, replace_cpu_diff);
+}
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
     : Params<Dtype>(root_solver) {
@@ -436,8 +468,121 @@ void P2PSync<Dtype>::Run(const vector<int>& gpus) {
   }
 }
 
+template<typename Dtype>
+CPUSync<Dtype>::CPUSync(shared_ptr<Solver<Dtype> > root_solver,
+                        CPUSync<Dtype>* root, int rank)
+    : CPUParams<Dtype>(root_solver->net()->learnable_params()),
+      root_(root),
+      rank_(rank),
+      initial_iter_(root_solver->iter()),
+      solver_() {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU) << "CPUSync runs on the CPU only.";
+  if (root == NULL) {
+    solver_ = root_solver;
+  } else {
+    Caffe::set_root_solver(false);
+    solver_.reset(new WorkerSolver<Dtype>(root_solver->param(),
+        root_solver.get()));
+    Caffe::set_root_solver(true);
+  }
+  this->configure(solver_->net()->learnable_params());
+  solver_->add_callback(this);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::InternalThreadEntry() {
+  CHECK(Caffe::root_solver());
+  Caffe::set_root_solver(false);
+  // Offset the seed by the rank, so that the replicas do not all draw the
+  // same numbers, e.g. for dropout, but every run draws the same ones.
+  if (solver_->param().random_seed() >= 0) {
+    Caffe::set_random_seed(solver_->param().random_seed() + rank_);
+  }
+  solver_->Step(solver_->param().max_iter() - initial_iter_);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_start() {
+  CPUSync<Dtype>* root = root_ ? root_ : this;
+  // Wait for the root to apply the last update, then hold it back until the
+  // replicas have their copy: its forward pass may write to the parameters,
+  // e.g. the statistics of BatchNorm.
+  root->barrier_->wait();
+  if (root_) {
+    caffe_copy(size_, root_->data_, data_);
+  }
+  root->barrier_->wait();
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_diff_ready(int param_id) {
+  CPUSync<Dtype>* root = root_ ? root_ : this;
+  {
+    boost::mutex::scoped_lock lock(*root->mutex_);
+    if (++root->diff_ready_counts_[param_id] < root->replicas_.size()) {
+      return;
+    }
+    root->diff_ready_counts_[param_id] = 0;
+  }
+  // The last replica to complete the diff sums those of all the others into
+  // the root, always in rank order, while they go on with their backward pass.
+  const vector<CPUSync<Dtype>*>& replicas = root->replicas_;
+  const int begin = root->offsets_[param_id];
+  const int size = root->offsets_[param_id + 1] - begin;
+  Dtype* dst = root->diff_ + begin;
+  for (int i = 1; i < replicas.size(); ++i) {
+    caffe_axpy(size, Dtype(1), replicas[i]->diff_ + begin, dst);
+  }
+  // Loss functions divide gradients by the batch size, so to compensate
+  // for split batch, divide by number of solvers.
+  caffe_scal(size, Dtype(1) / replicas.size(), dst);
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_gradients_ready() {
+  // Every diff has been reduced by the time all the replicas get here, so the
+  // root can update.
+  CPUSync<Dtype>* root = root_ ? root_ : this;
+  root->barrier_->wait();
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Run(int threads) {
+  CHECK(root_ == NULL) << "Run the root replica.";
+  CHECK_EQ(Caffe::solver_count(), threads);
+  barrier_.reset(new boost::barrier(threads));
+  mutex_.reset(new boost::mutex());
+  const vector<Blob<Dtype>*>& params = solver_->net()->learnable_params();
+  offsets_.assign(1, 0);
+  for (int i = 0; i < params.size(); ++i) {
+    offsets_.push_back(offsets_.back() + params[i]->count());
+  }
+  diff_ready_counts_.assign(params.size(), 0);
+  vector<shared_ptr<CPUSync<Dtype> > > syncs(threads);
+  replicas_.assign(1, this);
+  for (int i = 1; i < threads; ++i) {
+    syncs[i].reset(new CPUSync<Dtype>(solver_, this, i));
+    replicas_.push_back(syncs[i].get());
+  }
+
+  LOG(INFO)<< "Starting Optimization on " << threads << " threads";
+
+  for (int i = 1; i < syncs.size(); ++i) {
+    syncs[i]->StartInternalThread();
+  }
+
+  // Run root solver on current thread
+  solver_->Solve();
+
+  for (int i = 1; i < syncs.size(); ++i) {
+    syncs[i]->StopInternalThread();
+  }
+}
+
 INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
+INSTANTIATE_CLASS(CPUParams);
 INSTANTIATE_CLASS(P2PSync);
+INSTANTIATE_CLASS(CPUSync);
 
 }  // namespace caffe
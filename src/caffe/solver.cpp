@@ -1,3 +1,5 @@
+#include <boost/thread.hpp>
+
 #include <cstdio>
 
 #include <map>
@@ -7,6 +9,7 @@
 
 #include "caffe/solver.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -14,6 +17,32 @@
 
 namespace caffe {
 
+namespace {
+
+// Writes proto to a temporary file renamed to filename once complete, so that
+// no reader sees a partial file.
+void WriteProtoAtomically(const Message& proto, const string& filename) {
+  const string temp_filename = filename + ".tmp";
+  WriteProtoToBinaryFile(proto, temp_filename);
+  CHECK_EQ(std::rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Failed to rename " << temp_filename << " to " << filename;
+}
+
+// Writes a snapshot staged by Solver::SnapshotAsync: the state last, as it
+// points to the net.
+void WriteSnapshot(shared_ptr<NetParameter> net_param,
+    const string& model_filename, shared_ptr<SolverState> state,
+    const string& state_filename) {
+  CPUTimer timer;
+  timer.Start();
+  WriteProtoAtomically(*net_param, model_filename);
+  WriteProtoAtomically(*state, state_filename);
+  LOG(INFO) << "Wrote snapshot " << model_filename << " and "
+      << state_filename << " in " << timer.MilliSeconds() << " ms";
+}
+
+}  // namespace
+
 template<typename Dtype>
 void Solver<Dtype>::SetActionFunction(ActionCallback func) {
   action_request_function_ = func;
@@ -30,15 +59,17 @@ SolverAction::Enum Solver<Dtype>::GetRequestedAction() {
 
 template <typename Dtype>
 Solver<Dtype>::Solver(const SolverParameter& param, const Solver* root_solver)
-    : net_(), callbacks_(), root_solver_(root_solver),
-      requested_early_exit_(false) {
+    : net_(), callbacks_(), relay_diff_ready_(false),
+      root_solver_(root_solver),
+      requested_early_exit_(false), testing_async_(false), tested_iter_(0) {
   Init(param);
 }
 
 template <typename Dtype>
 Solver<Dtype>::Solver(const string& param_file, const Solver* root_solver)
-    : net_(), callbacks_(), root_solver_(root_solver),
-      requested_early_exit_(false) {
+    : net_(), callbacks_(), relay_diff_ready_(false),
+      root_solver_(root_solver),
+      requested_early_exit_(false), testing_async_(false), tested_iter_(0) {
   SolverParameter param;
   ReadSolverParamsFromTextFileOrDie(param_file, &param);
   Init(param);
@@ -193,6 +224,14 @@ void Solver<Dtype>::InitTestNets() {
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::on_diff_ready(int param_id) {
+  if (!relay_diff_ready_) { return; }
+  for (int i = 0; i < callbacks_.size(); ++i) {
+    callbacks_[i]->on_diff_ready(param_id);
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Step(int iters) {
   const int start_iter = iter_;
@@ -207,7 +246,11 @@ void Solver<Dtype>::Step(int iters) {
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())
         && Caffe::root_solver()) {
-      TestAll();
+      if (param_.test_async()) {
+        TestAllAsync();
+      } else {
+        TestAll();
+      }
       if (requested_early_exit_) {
         // Break out of the while loop because stop was requested while testing.
         break;
@@ -222,8 +265,10 @@ void Solver<Dtype>::Step(int iters) {
     // accumulate the loss and gradient
     Dtype loss = 0;
     for (int i = 0; i < param_.iter_size(); ++i) {
+      relay_diff_ready_ = i == param_.iter_size() - 1;
       loss += net_->ForwardBackward();
     }
+    relay_diff_ready_ = false;
     loss /= param_.iter_size();
     // average the loss across iterations for smoothed reporting
     UpdateSmoothedLoss(loss, start_iter, average_loss);
@@ -300,6 +345,8 @@ void Solver<Dtype>::Solve(const char* resume_file) {
       && (!param_.snapshot() || iter_ % param_.snapshot() != 0)) {
     Snapshot();
   }
+  WaitForTest(requested_early_exit_);
+  WaitForSnapshot();
   if (requested_early_exit_) {
     LOG(INFO) << "Optimization stopped early.";
     return;
@@ -327,43 +374,109 @@ void Solver<Dtype>::Solve(const char* resume_file) {
 
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
+  tested_iter_ = iter_;
   for (int test_net_id = 0;
        test_net_id < test_nets_.size() && !requested_early_exit_;
        ++test_net_id) {
-    if (param_.eval_type() == "classification") {
-      TestClassification(test_net_id);
-    } else if (param_.eval_type() == "detection") {
-      TestDetection(test_net_id);
-    } else {
-      LOG(FATAL) << "Unknown evaluation type: " << param_.eval_type();
-    }
+    CHECK_NOTNULL(test_nets_[test_net_id].get())->
+        ShareTrainedLayersWith(net_.get());
+    Test(test_net_id);
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::TestAllAsync() {
+  CHECK(Caffe::root_solver());
+  // Never let two test passes overlap, as they share the test nets.
+  WaitForTest();
+  for (int test_net_id = 0; test_net_id < test_nets_.size(); ++test_net_id) {
+    CHECK_NOTNULL(test_nets_[test_net_id].get())->
+        CopyTrainedLayersFrom(net_.get());
+  }
+  tested_iter_ = iter_;
+  testing_async_ = true;
+  test_thread_.reset(new boost::thread(&Solver<Dtype>::TestAllEntry, this,
+      Caffe::mode(), param_.device_id()));
+}
+
+template <typename Dtype>
+void Solver<Dtype>::TestAllEntry(Caffe::Brew mode, int device) {
+  Caffe::set_mode(mode);
+  if (mode == Caffe::GPU) {
+    Caffe::SetDevice(device);
+  }
+  CPUTimer timer;
+  timer.Start();
+  for (int test_net_id = 0; test_net_id < test_nets_.size() &&
+       !boost::this_thread::interruption_requested(); ++test_net_id) {
+    Test(test_net_id);
+  }
+  LOG(INFO) << "Iteration " << tested_iter_ << ", tested in the background in "
+      << timer.MilliSeconds() << " ms";
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForTest(bool interrupt) {
+  if (!test_thread_) { return; }
+  if (interrupt) {
+    test_thread_->interrupt();
+  }
+  CPUTimer timer;
+  timer.Start();
+  test_thread_->join();
+  test_thread_.reset();
+  testing_async_ = false;
+  const float waited_ms = timer.MilliSeconds();
+  if (waited_ms >= 1) {
+    LOG(INFO) << "Waited " << waited_ms << " ms for the last test pass";
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::Test(const int test_net_id) {
+  if (param_.eval_type() == "classification") {
+    TestClassification(test_net_id);
+  } else if (param_.eval_type() == "detection") {
+    TestDetection(test_net_id);
+  } else {
+    LOG(FATAL) << "Unknown evaluation type: " << param_.eval_type();
+  }
+}
+
+template <typename Dtype>
+bool Solver<Dtype>::TestInterrupted() {
+  if (testing_async_) {
+    // The training thread handles the requests, and interrupts the test pass
+    // to stop it.
+    return boost::this_thread::interruption_requested();
+  }
+  SolverAction::Enum request = GetRequestedAction();
+  // Check to see if stoppage of testing/training has been requested.
+  while (request != SolverAction::NONE) {
+      if (SolverAction::SNAPSHOT == request) {
+        Snapshot();
+      } else if (SolverAction::STOP == request) {
+        requested_early_exit_ = true;
+      }
+      request = GetRequestedAction();
+  }
+  return requested_early_exit_;
+}
+
 template <typename Dtype>
 void Solver<Dtype>::TestClassification(const int test_net_id) {
   CHECK(Caffe::root_solver());
-  LOG(INFO) << "Iteration " << iter_
+  LOG(INFO) << "Iteration " << tested_iter_
             << ", Testing net (#" << test_net_id << ")";
-  CHECK_NOTNULL(test_nets_[test_net_id].get())->
-      ShareTrainedLayersWith(net_.get());
   vector<Dtype> test_score;
   vector<int> test_score_output_id;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
+  bool interrupted = false;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
-    SolverAction::Enum request = GetRequestedAction();
-    // Check to see if stoppage of testing/training has been requested.
-    while (request != SolverAction::NONE) {
-        if (SolverAction::SNAPSHOT == request) {
-          Snapshot();
-        } else if (SolverAction::STOP == request) {
-          requested_early_exit_ = true;
-        }
-        request = GetRequestedAction();
-    }
-    if (requested_early_exit_) {
+    if (TestInterrupted()) {
       // break out of test loop.
+      interrupted = true;
       break;
     }
 
@@ -391,7 +504,7 @@ void Solver<Dtype>::TestClassification(const int test_net_id) {
       }
     }
   }
-  if (requested_early_exit_) {
+  if (interrupted) {
     LOG(INFO)     << "Test interrupted.";
     return;
   }
@@ -418,28 +531,18 @@ void Solver<Dtype>::TestClassification(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::TestDetection(const int test_net_id) {
   CHECK(Caffe::root_solver());
-  LOG(INFO) << "Iteration " << iter_
+  LOG(INFO) << "Iteration " << tested_iter_
             << ", Testing net (#" << test_net_id << ")";
-  CHECK_NOTNULL(test_nets_[test_net_id].get())->
-      ShareTrainedLayersWith(net_.get());
   map<int, map<int, vector<pair<float, int> > > > all_true_pos;
   map<int, map<int, vector<pair<float, int> > > > all_false_pos;
   map<int, map<int, int> > all_num_pos;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
   Dtype loss = 0;
+  bool interrupted = false;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
-    SolverAction::Enum request = GetRequestedAction();
-    // Check to see if stoppage of testing/training has been requested.
-    while (request != SolverAction::NONE) {
-        if (SolverAction::SNAPSHOT == request) {
-          Snapshot();
-        } else if (SolverAction::STOP == request) {
-          requested_early_exit_ = true;
-        }
-        request = GetRequestedAction();
-    }
-    if (requested_early_exit_) {
+    if (TestInterrupted()) {
       // break out of test loop.
+      interrupted = true;
       break;
     }
 
@@ -478,7 +581,7 @@ void Solver<Dtype>::TestDetection(const int test_net_id) {
       }
     }
   }
-  if (requested_early_exit_) {
+  if (interrupted) {
     LOG(INFO)     << "Test interrupted.";
     return;
   }
@@ -536,6 +639,15 @@ void Solver<Dtype>::TestDetection(const int test_net_id) {
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
+  if (param_.snapshot_async()) {
+    if (param_.snapshot_format() ==
+        caffe::SolverParameter_SnapshotFormat_BINARYPROTO) {
+      SnapshotAsync();
+      return;
+    }
+    LOG_FIRST_N(WARNING, 1) << "Writing snapshots on the training thread, "
+        << "as snapshot_async only applies to the BINARYPROTO format.";
+  }
   string model_filename;
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
@@ -544,6 +656,9 @@ void Solver<Dtype>::Snapshot() {
   case caffe::SolverParameter_SnapshotFormat_HDF5:
     model_filename = SnapshotToHDF5();
     break;
+  case caffe::SolverParameter_SnapshotFormat_MAPPED:
+    model_filename = SnapshotToMapped();
+    break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
@@ -551,6 +666,43 @@ void Solver<Dtype>::Snapshot() {
   SnapshotSolverState(model_filename);
 }
 
+template <typename Dtype>
+void Solver<Dtype>::SnapshotAsync() {
+  // Never let two snapshots overlap.
+  WaitForSnapshot();
+  CPUTimer timer;
+  timer.Start();
+  shared_ptr<NetParameter> net_param(new NetParameter());
+  net_->ToProto(net_param.get(), param_.snapshot_diff());
+  const string model_filename = SnapshotFilename(".caffemodel");
+  shared_ptr<SolverState> state(new SolverState());
+  SnapshotSolverStateToProto(model_filename, state.get());
+  const string state_filename = SnapshotFilename(".solverstate");
+  LOG(INFO) << "Snapshotting to binary proto file " << model_filename
+      << " in the background, staged in " << timer.MilliSeconds() << " ms";
+  snapshot_thread_.reset(new boost::thread(&WriteSnapshot, net_param,
+      model_filename, state, state_filename));
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshot() {
+  if (!snapshot_thread_) { return; }
+  CPUTimer timer;
+  timer.Start();
+  snapshot_thread_->join();
+  snapshot_thread_.reset();
+  const float waited_ms = timer.MilliSeconds();
+  if (waited_ms >= 1) {
+    LOG(INFO) << "Waited " << waited_ms << " ms for the last snapshot";
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SnapshotSolverStateToProto(const string& model_filename,
+    SolverState* state) {
+  LOG(FATAL) << "Solver " << type() << " does not support snapshot_async.";
+}
+
 template <typename Dtype>
 void Solver<Dtype>::CheckSnapshotWritePermissions() {
   if (Caffe::root_solver() && param_.snapshot()) {
@@ -593,6 +745,14 @@ string Solver<Dtype>::SnapshotToHDF5() {
   return model_filename;
 }
 
+template <typename Dtype>
+string Solver<Dtype>::SnapshotToMapped() {
+  string model_filename = SnapshotFilename(".caffemodel");
+  LOG(INFO) << "Snapshotting to mapped weights file " << model_filename;
+  net_->ToMapped(model_filename);
+  return model_filename;
+}
+
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   CHECK(Caffe::root_solver());
@@ -106,6 +106,29 @@ void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::FusedUpdate(int param_id, int begin, int end) {
+  const typename SGDSolver<Dtype>::FusedParam& param =
+      this->fused_params_[param_id];
+  const Dtype delta = this->param_.delta();
+  const Dtype momentum = this->param_.momentum();
+  // history of gradients, then history of updates
+  Dtype* history = this->fused_history_[param_id];
+  Dtype* update_history =
+      this->fused_history_[this->fused_params_.size() + param_id];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = param.gradient(i);
+    history[i] = (Dtype(1) - momentum) * gradient * gradient +
+        momentum * history[i];
+    const Dtype update = gradient *
+        std::sqrt((update_history[i] + delta) / (history[i] + delta));
+    update_history[i] = (Dtype(1) - momentum) * update * update +
+        momentum * update_history[i];
+    param.diff[i] = param.rate * update;
+    param.data[i] -= param.diff[i];
+  }
+}
+
 INSTANTIATE_CLASS(AdaDeltaSolver);
 REGISTER_SOLVER_CLASS(AdaDelta);
 
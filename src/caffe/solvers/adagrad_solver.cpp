@@ -64,6 +64,22 @@ void AdaGradSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdaGradSolver<Dtype>::FusedUpdate(int param_id, int begin, int end) {
+  const typename SGDSolver<Dtype>::FusedParam& param =
+      this->fused_params_[param_id];
+  const Dtype delta = this->param_.delta();
+  Dtype* history = this->fused_history_[param_id];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = param.gradient(i);
+    history[i] += gradient * gradient;
+    const Dtype update = param.rate *
+        (gradient / (std::sqrt(history[i]) + delta));
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(AdaGradSolver);
 REGISTER_SOLVER_CLASS(AdaGrad);
 
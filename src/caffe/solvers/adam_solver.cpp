@@ -88,6 +88,29 @@ void AdamSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void AdamSolver<Dtype>::FusedUpdate(int param_id, int begin, int end) {
+  const typename SGDSolver<Dtype>::FusedParam& param =
+      this->fused_params_[param_id];
+  const Dtype beta1 = this->param_.momentum();
+  const Dtype beta2 = this->param_.momentum2();
+  const Dtype eps_hat = this->param_.delta();
+  const int t = this->iter_ + 1;
+  const Dtype correction = std::sqrt(Dtype(1) - pow(beta2, t)) /
+      (Dtype(1.) - pow(beta1, t));
+  const Dtype rate = param.rate * correction;
+  Dtype* val_m = this->fused_history_[param_id];
+  Dtype* val_v = this->fused_history_[this->fused_params_.size() + param_id];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = param.gradient(i);
+    val_m[i] = (Dtype(1) - beta1) * gradient + beta1 * val_m[i];
+    val_v[i] = (Dtype(1) - beta2) * gradient * gradient + beta2 * val_v[i];
+    const Dtype update = rate * (val_m[i] / (std::sqrt(val_v[i]) + eps_hat));
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(AdamSolver);
 REGISTER_SOLVER_CLASS(Adam);
 
@@ -56,6 +56,23 @@ void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void NesterovSolver<Dtype>::FusedUpdate(int param_id, int begin, int end) {
+  const typename SGDSolver<Dtype>::FusedParam& param =
+      this->fused_params_[param_id];
+  const Dtype momentum = this->param_.momentum();
+  Dtype* history = this->fused_history_[param_id];
+  for (int i = begin; i < end; ++i) {
+    const Dtype last_history = history[i];
+    history[i] = param.rate * param.gradient(i) + momentum * last_history;
+    // step back then over step
+    const Dtype update = (Dtype(1) + momentum) * history[i] -
+        momentum * last_history;
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(NesterovSolver);
 REGISTER_SOLVER_CLASS(Nesterov);
 
@@ -64,6 +64,24 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   }
 }
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::FusedUpdate(int param_id, int begin, int end) {
+  const typename SGDSolver<Dtype>::FusedParam& param =
+      this->fused_params_[param_id];
+  const Dtype delta = this->param_.delta();
+  const Dtype rms_decay = this->param_.rms_decay();
+  Dtype* history = this->fused_history_[param_id];
+  for (int i = begin; i < end; ++i) {
+    const Dtype gradient = param.gradient(i);
+    history[i] = Dtype(1 - rms_decay) * gradient * gradient +
+        rms_decay * history[i];
+    const Dtype update = param.rate *
+        (gradient / (std::sqrt(history[i]) + delta));
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 INSTANTIATE_CLASS(RMSPropSolver);
 REGISTER_SOLVER_CLASS(RMSProp);
 
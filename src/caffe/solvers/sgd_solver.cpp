@@ -1,10 +1,14 @@
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <string>
 #include <vector>
 
+#include "caffe/parallel.hpp"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
-#include "caffe/util/upgrade_proto.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -75,6 +79,25 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  if (!this->param_.fused_update()) { return; }
+  // Lay the params out in one arena, unless a CPUSync is about to move them
+  // to its own buffers, and cut them into chunks that are large enough to
+  // stream but leave work for every thread.
+  if (Caffe::solver_count() == 1) {
+    arena_.reset(new CPUParams<Dtype>(net_params));
+    arena_->configure(net_params);
+  }
+  const int kChunkSize = 1 << 15;
+  fused_chunks_.clear();
+  for (int i = 0; i < net_params.size(); ++i) {
+    for (int begin = 0; begin < net_params[i]->count(); begin += kChunkSize) {
+      FusedChunk chunk;
+      chunk.param_id = i;
+      chunk.begin = begin;
+      chunk.end = std::min(begin + kChunkSize, net_params[i]->count());
+      fused_chunks_.push_back(chunk);
+    }
+  }
 }
 
 template <typename Dtype>
@@ -82,9 +105,18 @@ void SGDSolver<Dtype>::ClipGradients() {
   const Dtype clip_gradients = this->param_.clip_gradients();
   if (clip_gradients < 0) { return; }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  // The diffs in the arena take one pass each, whatever their number, as
+  // long as a CPUSync did not move the params to its own buffers.
+  const bool arena = arena_ && Caffe::mode() == Caffe::CPU &&
+      net_params.size() > 0 && net_params[0]->cpu_diff() == arena_->diff();
   Dtype sumsq_diff = 0;
-  for (int i = 0; i < net_params.size(); ++i) {
-    sumsq_diff += net_params[i]->sumsq_diff();
+  if (arena) {
+    sumsq_diff = caffe_cpu_dot(static_cast<int>(arena_->size()),
+        arena_->diff(), arena_->diff());
+  } else {
+    for (int i = 0; i < net_params.size(); ++i) {
+      sumsq_diff += net_params[i]->sumsq_diff();
+    }
   }
   const Dtype l2norm_diff = std::sqrt(sumsq_diff);
   if (l2norm_diff > clip_gradients) {
@@ -92,6 +124,11 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
+    if (arena) {
+      caffe_scal(static_cast<int>(arena_->size()), scale_factor,
+          arena_->diff());
+      return;
+    }
     for (int i = 0; i < net_params.size(); ++i) {
       net_params[i]->scale_diff(scale_factor);
     }
@@ -106,6 +143,10 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG(INFO) << "Iteration " << this->iter_ << ", lr = " << rate;
   }
   ClipGradients();
+  if (this->param_.fused_update() && Caffe::mode() == Caffe::CPU) {
+    FusedApplyUpdate(rate);
+    return;
+  }
   for (int param_id = 0; param_id < this->net_->learnable_params().size();
        ++param_id) {
     Normalize(param_id);
@@ -115,6 +156,56 @@ void SGDSolver<Dtype>::ApplyUpdate() {
   this->net_->Update();
 }
 
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedApplyUpdate(Dtype rate) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_lr = this->net_->params_lr();
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  const string& regularization_type = this->param_.regularization_type();
+  CHECK(regularization_type == "L2" || regularization_type == "L1")
+      << "Unknown regularization type: " << regularization_type;
+  // Fetch the buffers here, as the tasks must not change the heads of the
+  // SyncedMemory they share.
+  fused_params_.resize(net_params.size());
+  for (int i = 0; i < net_params.size(); ++i) {
+    FusedParam& param = fused_params_[i];
+    param.data = net_params[i]->mutable_cpu_data();
+    param.diff = net_params[i]->mutable_cpu_diff();
+    param.scale = Dtype(1.) / this->param_.iter_size();
+    const Dtype local_decay =
+        this->param_.weight_decay() * net_params_weight_decay[i];
+    param.l2 = regularization_type == "L2" ? local_decay : Dtype(0);
+    param.l1 = regularization_type == "L1" ? local_decay : Dtype(0);
+    param.rate = rate * net_params_lr[i];
+  }
+  fused_history_.resize(history_.size());
+  for (int i = 0; i < history_.size(); ++i) {
+    fused_history_[i] = history_[i]->mutable_cpu_data();
+  }
+  ThreadPool::Global().Run(fused_chunks_.size(),
+      boost::bind(&SGDSolver<Dtype>::FusedUpdateTask, this, _1, _2));
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdateTask(int task_id, int thread_id) {
+  const FusedChunk& chunk = fused_chunks_[task_id];
+  FusedUpdate(chunk.param_id, chunk.begin, chunk.end);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::FusedUpdate(int param_id, int begin, int end) {
+  const FusedParam& param = fused_params_[param_id];
+  const Dtype momentum = this->param_.momentum();
+  Dtype* history = fused_history_[param_id];
+  for (int i = begin; i < end; ++i) {
+    const Dtype update = history[i] =
+        param.rate * param.gradient(i) + momentum * history[i];
+    param.diff[i] = update;
+    param.data[i] -= update;
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -246,6 +337,7 @@ template <typename Dtype>
 void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
   switch (this->param_.snapshot_format()) {
     case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+    case caffe::SolverParameter_SnapshotFormat_MAPPED:
       SnapshotSolverStateToBinaryProto(model_filename);
       break;
     case caffe::SolverParameter_SnapshotFormat_HDF5:
@@ -257,18 +349,24 @@ void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
-    const string& model_filename) {
-  SolverState state;
-  state.set_iter(this->iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.clear_history();
+void SGDSolver<Dtype>::SnapshotSolverStateToProto(
+    const string& model_filename, SolverState* state) {
+  state->set_iter(this->iter_);
+  state->set_learned_net(model_filename);
+  state->set_current_step(this->current_step_);
+  state->clear_history();
   for (int i = 0; i < history_.size(); ++i) {
     // Add history
-    BlobProto* history_blob = state.add_history();
+    BlobProto* history_blob = state->add_history();
     history_[i]->ToProto(history_blob);
   }
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
+    const string& model_filename) {
+  SolverState state;
+  SnapshotSolverStateToProto(model_filename, &state);
   string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
   LOG(INFO)
     << "Snapshotting solver state to binary proto file " << snapshot_filename;
@@ -308,9 +406,8 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
   ReadProtoFromBinaryFile(state_file, &state);
   this->iter_ = state.iter();
   if (state.has_learned_net()) {
-    NetParameter net_param;
-    ReadNetParamsFromBinaryFileOrDie(state.learned_net().c_str(), &net_param);
-    this->net_->CopyTrainedLayersFrom(net_param);
+    // Either a binary proto or a mapped weights file.
+    this->net_->CopyTrainedLayersFrom(state.learned_net());
   }
   this->current_step_ = state.current_step();
   CHECK_EQ(state.history_size(), history_.size())
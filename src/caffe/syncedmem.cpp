@@ -1,5 +1,6 @@
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -8,6 +9,7 @@ SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
   }
+  free(half_ptr_);
 
 #ifndef CPU_ONLY
   if (gpu_ptr_ && own_gpu_data_) {
@@ -42,6 +44,16 @@ inline void SyncedMemory::to_cpu() {
     NO_GPU;
 #endif
     break;
+  case HEAD_AT_HALF:
+    CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+    own_cpu_data_ = true;
+    caffe_cpu_half2float(size_ / sizeof(float), half_ptr_,
+        static_cast<float*>(cpu_ptr_));
+    // Keeping both copies would take more memory than not compacting.
+    free(half_ptr_);
+    half_ptr_ = NULL;
+    head_ = HEAD_AT_CPU;
+    break;
   case HEAD_AT_CPU:
   case SYNCED:
     break;
@@ -67,6 +79,10 @@ inline void SyncedMemory::to_gpu() {
     caffe_gpu_memcpy(size_, cpu_ptr_, gpu_ptr_);
     head_ = SYNCED;
     break;
+  case HEAD_AT_HALF:
+    to_cpu();
+    to_gpu();
+    break;
   case HEAD_AT_GPU:
   case SYNCED:
     break;
@@ -89,6 +105,7 @@ void SyncedMemory::set_cpu_data(void* data) {
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  ++version_;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -116,6 +133,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  ++version_;
 #else
   NO_GPU;
 #endif
@@ -124,6 +142,7 @@ void SyncedMemory::set_gpu_data(void* data) {
 void* SyncedMemory::mutable_cpu_data() {
   to_cpu();
   head_ = HEAD_AT_CPU;
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -131,6 +150,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -138,6 +158,41 @@ void* SyncedMemory::mutable_gpu_data() {
 #endif
 }
 
+const uint16_t* SyncedMemory::half_data() {
+  if (head_ != HEAD_AT_HALF &&
+      (half_ptr_ == NULL || half_version_ != version_)) {
+    to_cpu();
+    if (half_ptr_ == NULL) {
+      half_ptr_ = static_cast<uint16_t*>(malloc(size_ / 2));
+      CHECK(half_ptr_) << "host allocation of size " << size_ / 2
+          << " failed";
+    }
+    caffe_cpu_float2half(size_ / sizeof(float),
+        static_cast<const float*>(cpu_ptr_), half_ptr_);
+    half_version_ = version_;
+  }
+  return half_ptr_;
+}
+
+void SyncedMemory::compact_to_half() {
+  if (head_ == HEAD_AT_HALF) { return; }
+  half_data();
+  // Data set from outside stays where it is.
+  if (!own_cpu_data_) { return; }
+  CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+  cpu_ptr_ = NULL;
+  own_cpu_data_ = false;
+  head_ = HEAD_AT_HALF;
+}
+
+void SyncedMemory::discard_half() {
+  if (head_ != HEAD_AT_HALF) { return; }
+  free(half_ptr_);
+  half_ptr_ = NULL;
+  head_ = gpu_ptr_ == NULL ? UNINITIALIZED : HEAD_AT_GPU;
+  ++version_;
+}
+
 #ifndef CPU_ONLY
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   CHECK(head_ == HEAD_AT_CPU);
@@ -479,6 +479,46 @@ class AnnotatedDataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // With several transform threads, every item draws from a random stream of
+  // its own: the crops are the same for any number of threads.
+  void TestTransformThreads() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(num_);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(1);
+    transform_param->set_mirror(true);
+
+    vector<vector<Dtype> > crop_sequence;
+    for (int threads = 2; threads <= 3; ++threads) {
+      data_param->set_transform_threads(threads);
+      Caffe::set_random_seed(seed_);
+      AnnotatedDataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      for (int iter = 0; iter < 2; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < num_; ++i) {
+          EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        }
+        const Dtype* data = blob_top_data_->cpu_data();
+        if (threads == 2) {
+          crop_sequence.push_back(
+              vector<Dtype>(data, data + num_ * channels_));
+          continue;
+        }
+        for (int i = 0; i < num_ * channels_; ++i) {
+          EXPECT_EQ(crop_sequence[iter][i], data[i])
+              << "debug: iter " << iter << " i " << i;
+        }
+      }
+    }
+  }
+
   void TestReadCropTrainSequenceUnseeded() {
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -624,6 +664,16 @@ TYPED_TEST(AnnotatedDataLayerTest, TestReadCropTrainSequenceSeededLevelDB) {
   this->TestReadCropTrainSequenceSeeded();
 }
 
+TYPED_TEST(AnnotatedDataLayerTest, TestTransformThreadsLevelDB) {
+  const bool unique_pixel = true;  // all pixels the same; images different
+  const bool unique_annotation = false;  // all anno the same; groups different
+  const bool use_rich_annotation = false;
+  AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
+  this->Fill(DataParameter_DB_LEVELDB, unique_pixel, unique_annotation,
+             use_rich_annotation, type);
+  this->TestTransformThreads();
+}
+
 // Test that the sequence of random crops differs across iterations when
 // Caffe::set_random_seed isn't called (and seeds from srand are ignored).
 TYPED_TEST(AnnotatedDataLayerTest, TestReadCropTrainSequenceUnseededLevelDB) {
@@ -707,6 +757,16 @@ TYPED_TEST(AnnotatedDataLayerTest, TestReadCropTrainSequenceSeededLMDB) {
   this->TestReadCropTrainSequenceSeeded();
 }
 
+TYPED_TEST(AnnotatedDataLayerTest, TestTransformThreadsLMDB) {
+  const bool unique_pixel = true;  // all pixels the same; images different
+  const bool unique_annotation = false;  // all anno the same; groups different
+  const bool use_rich_annotation = false;
+  AnnotatedDatum_AnnotationType type = AnnotatedDatum_AnnotationType_BBOX;
+  this->Fill(DataParameter_DB_LMDB, unique_pixel, unique_annotation,
+             use_rich_annotation, type);
+  this->TestTransformThreads();
+}
+
 // Test that the sequence of random crops differs across iterations when
 // Caffe::set_random_seed isn't called (and seeds from srand are ignored).
 TYPED_TEST(AnnotatedDataLayerTest, TestReadCropTrainSequenceUnseededLMDB) {
@@ -0,0 +1,189 @@
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Loads batches filled with their index, one batch per Allow()ed load, so
+// that a test controls how far the prefetch thread gets ahead.
+template <typename Dtype>
+class CountingDataLayer : public BasePrefetchingDataLayer<Dtype> {
+ public:
+  explicit CountingDataLayer(const LayerParameter& param)
+      : BasePrefetchingDataLayer<Dtype>(param), allowed_(0), loaded_(0) {}
+  virtual ~CountingDataLayer() { this->StopInternalThread(); }
+
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    const int batch_size = this->layer_param_.data_param().batch_size();
+    top[0]->Reshape(batch_size, 1, 1, 1);
+    top[1]->Reshape(batch_size, 1, 1, 1);
+    for (int i = 0; i < this->prefetch_.size(); ++i) {
+      this->prefetch_[i]->data_.Reshape(batch_size, 1, 1, 1);
+      this->prefetch_[i]->label_.Reshape(batch_size, 1, 1, 1);
+    }
+  }
+
+  virtual inline const char* type() const { return "CountingData"; }
+
+  int ring_depth() const { return this->prefetch_.size(); }
+  int ready() const { return this->prefetch_full_.size(); }
+  int loaded() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return loaded_;
+  }
+  void Allow(int batches) {
+    boost::mutex::scoped_lock lock(mutex_);
+    allowed_ += batches;
+    condition_.notify_all();
+  }
+  void WaitReady(int batches) {
+    while (ready() < batches) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+  }
+
+ protected:
+  virtual void load_batch(Batch<Dtype>* batch) {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (allowed_ == 0) {
+      condition_.wait(lock);
+    }
+    --allowed_;
+    caffe_set(batch->data_.count(), Dtype(loaded_),
+        batch->data_.mutable_cpu_data());
+    caffe_set(batch->label_.count(), Dtype(-loaded_),
+        batch->label_.mutable_cpu_data());
+    ++loaded_;
+  }
+
+  boost::mutex mutex_;
+  boost::condition_variable condition_;
+  int allowed_;
+  int loaded_;
+};
+
+template <typename Dtype>
+void AllowLater(CountingDataLayer<Dtype>* layer) {
+  boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+  layer->Allow(1);
+}
+
+template <typename Dtype>
+class BasePrefetchingDataLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  BasePrefetchingDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    layer_param_.mutable_data_param()->set_batch_size(3);
+  }
+  virtual ~BasePrefetchingDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  // Runs Forward and checks that the tops hold the batch of the given index.
+  void ForwardBatch(CountingDataLayer<Dtype>* layer, int index) {
+    layer->Forward(blob_bottom_vec_, blob_top_vec_);
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(index, blob_top_data_->cpu_data()[i]);
+      EXPECT_EQ(-index, blob_top_label_->cpu_data()[i]);
+    }
+  }
+
+  // Gives the prefetch thread time to load more than it should.
+  static void Settle() {
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+  }
+
+  LayerParameter layer_param_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(BasePrefetchingDataLayerTest, TestDtypes);
+
+TYPED_TEST(BasePrefetchingDataLayerTest, TestRingDepth) {
+  // Unset, the ring keeps its historical depth rather than the default of
+  // prefetch, which sizes the reader queues.
+  CountingDataLayer<TypeParam> default_layer(this->layer_param_);
+  EXPECT_EQ(3, default_layer.ring_depth());
+  this->layer_param_.mutable_data_param()->set_prefetch(5);
+  CountingDataLayer<TypeParam> layer(this->layer_param_);
+  EXPECT_EQ(5, layer.ring_depth());
+}
+
+TYPED_TEST(BasePrefetchingDataLayerTest, TestOrderAndCounters) {
+  this->layer_param_.mutable_data_param()->set_prefetch(2);
+  CountingDataLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The ring bounds how far the thread loads ahead.
+  layer.Allow(5);
+  layer.WaitReady(2);
+  this->Settle();
+  EXPECT_EQ(2, layer.ready());
+  EXPECT_EQ(2, layer.loaded());
+  for (int i = 0; i < 3; ++i) {
+    layer.WaitReady(2);
+    this->ForwardBatch(&layer, i);
+  }
+  layer.WaitReady(2);
+  this->ForwardBatch(&layer, 3);
+  this->ForwardBatch(&layer, 4);
+  PrefetchStats stats = layer.prefetch_stats();
+  EXPECT_EQ(5, stats.batches);
+  EXPECT_EQ(0, stats.stalls);
+  EXPECT_EQ(3 * 2 + 2 + 1, stats.occupancy);
+  // Nothing is left to load, so the next Forward waits for the thread.
+  EXPECT_EQ(0, layer.ready());
+  boost::thread allow(AllowLater<TypeParam>, &layer);
+  this->ForwardBatch(&layer, 5);
+  allow.join();
+  stats = layer.prefetch_stats();
+  EXPECT_EQ(6, stats.batches);
+  EXPECT_EQ(1, stats.stalls);
+  EXPECT_GT(stats.stall_ms, 0);
+  EXPECT_EQ(9, stats.occupancy);
+}
+
+TYPED_TEST(BasePrefetchingDataLayerTest, TestZeroCopy) {
+  this->layer_param_.mutable_data_param()->set_prefetch(2);
+  this->layer_param_.mutable_data_param()->set_zero_copy(true);
+  CountingDataLayer<TypeParam> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Allow(100);
+  layer.WaitReady(2);
+  this->ForwardBatch(&layer, 0);
+  const TypeParam* first_data = this->blob_top_data_->cpu_data();
+  // The tops hold the first batch, so the thread cannot refill it.
+  this->Settle();
+  EXPECT_EQ(1, layer.ready());
+  EXPECT_EQ(2, layer.loaded());
+  this->ForwardBatch(&layer, 1);
+  EXPECT_NE(first_data, this->blob_top_data_->cpu_data());
+  layer.WaitReady(1);
+  this->Settle();
+  EXPECT_EQ(1, layer.ready());
+  EXPECT_EQ(3, layer.loaded());
+  // The two batches of the ring take turns under the tops.
+  this->ForwardBatch(&layer, 2);
+  EXPECT_EQ(first_data, this->blob_top_data_->cpu_data());
+  const PrefetchStats& stats = layer.prefetch_stats();
+  EXPECT_EQ(3, stats.batches);
+  EXPECT_EQ(0, stats.stalls);
+  EXPECT_EQ(2 + 1 + 1, stats.occupancy);
+}
+
+}  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <map>
 #include <utility>
 #include <vector>
@@ -6,6 +7,7 @@
 
 #include "caffe/common.hpp"
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -951,7 +953,6 @@ TEST_F(CPUBBoxUtilTest, TestGetConfidenceScores) {
     }
   }
 }
-cmake
 //TEST_F(CPUBBoxUtilTest, TestGetMaxConfidenceScores) {
 //  const int num = 2;
 //  const int num_preds_per_class = 2;
@@ -1203,6 +1204,73 @@ TEST_F(CPUBBoxUtilTest, TestApplyNMS) {
   }
 }
 
+TEST_F(CPUBBoxUtilTest, TestApplyNMSFast) {
+  const int num = 200;
+  vector<float> coords(num * 4);
+  vector<float> scores(num);
+  caffe_rng_uniform(num * 4, 0.f, 1.f, &coords[0]);
+  caffe_rng_uniform(num, 0.f, 1.f, &scores[0]);
+  vector<NormalizedBBox> bboxes(num);
+  for (int i = 0; i < num; ++i) {
+    // Small boxes at random positions, some of them degenerate.
+    const float* c = &coords[i * 4];
+    bboxes[i].set_xmin(c[0]);
+    bboxes[i].set_ymin(c[1]);
+    bboxes[i].set_xmax(c[0] + 0.3 * c[2] - 0.02);
+    bboxes[i].set_ymax(c[1] + 0.3 * c[3] - 0.02);
+    // Ties are broken by index.
+    if (i % 9 == 0) {
+      scores[i] = scores[i / 2];
+    }
+  }
+
+  const float etas[] = {1., 0.8};
+  const int top_ks[] = {-1, 50};
+  for (int e = 0; e < 2; ++e) {
+    for (int t = 0; t < 2; ++t) {
+      const float score_threshold = 0.1;
+      const float eta = etas[e];
+      const int top_k = top_ks[t];
+      float adaptive_threshold = 0.6;
+      vector<int> indices;
+      ApplyNMSFast(bboxes, scores, score_threshold, adaptive_threshold, eta,
+                   top_k, &indices);
+
+      // Brute force greedy nms with JaccardOverlap.
+      vector<pair<float, int> > score_index;
+      for (int i = 0; i < num; ++i) {
+        if (scores[i] > score_threshold) {
+          score_index.push_back(std::make_pair(scores[i], -i));
+        }
+      }
+      std::sort(score_index.rbegin(), score_index.rend());
+      if (top_k > -1 && top_k < score_index.size()) {
+        score_index.resize(top_k);
+      }
+      vector<int> expected;
+      for (int i = 0; i < score_index.size(); ++i) {
+        const int idx = -score_index[i].second;
+        bool keep = true;
+        for (int k = 0; k < expected.size(); ++k) {
+          keep &= JaccardOverlap(bboxes[idx], bboxes[expected[k]]) <=
+              adaptive_threshold;
+        }
+        if (keep) {
+          expected.push_back(idx);
+          if (eta < 1 && adaptive_threshold > 0.5) {
+            adaptive_threshold *= eta;
+          }
+        }
+      }
+      ASSERT_GT(expected.size(), 1);
+      ASSERT_EQ(expected.size(), indices.size());
+      for (int i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], indices[i]);
+      }
+    }
+  }
+}
+
 TEST_F(CPUBBoxUtilTest, TestCumSum) {
   vector<pair<float, int> > pairs;
   vector<int> cumsum;
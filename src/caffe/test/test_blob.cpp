@@ -1,3 +1,4 @@
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -59,6 +61,25 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestShapeVersion) {
+  // Reshaping an unshaped blob to a scalar still changes its count.
+  this->blob_->Reshape(vector<int>());
+  EXPECT_EQ(this->blob_->count(), 1);
+  const size_t version = this->blob_preshaped_->shape_version();
+  this->blob_preshaped_->Reshape(2, 3, 4, 5);
+  EXPECT_EQ(this->blob_preshaped_->shape_version(), version);
+  this->blob_preshaped_->Reshape(2, 3, 5, 4);
+  EXPECT_NE(this->blob_preshaped_->shape_version(), version);
+  EXPECT_EQ(this->blob_preshaped_->width(), 4);
+  const size_t reshaped_version = this->blob_preshaped_->shape_version();
+  this->blob_->Reshape(2, 3, 5, 4);
+  this->blob_preshaped_->ShareData(*this->blob_);
+  EXPECT_NE(this->blob_preshaped_->shape_version(), reshaped_version);
+  const size_t shared_version = this->blob_preshaped_->shape_version();
+  this->blob_preshaped_->ShareData(*this->blob_);
+  EXPECT_EQ(this->blob_preshaped_->shape_version(), shared_version);
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
@@ -112,6 +133,28 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestHalfDataProto) {
+  FillerParameter filler_param;
+  filler_param.set_std(10);
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  NetParameter net_param;
+  this->blob_preshaped_->ToProto(net_param.add_layer()->add_blobs());
+  ConvertBlobsToHalf(&net_param);
+  const BlobProto& blob_proto = net_param.layer(0).blobs(0);
+  EXPECT_EQ(blob_proto.data_size(), 0);
+  EXPECT_EQ(blob_proto.double_data_size(), 0);
+  EXPECT_EQ(blob_proto.half_data().size(), 2 * 120);
+  this->blob_->FromProto(blob_proto);
+  EXPECT_TRUE(this->blob_->ShapeEquals(blob_proto));
+  // Half precision keeps 11 significant bits.
+  for (int i = 0; i < 120; ++i) {
+    const TypeParam expected = this->blob_preshaped_->cpu_data()[i];
+    EXPECT_NEAR(this->blob_->cpu_data()[i], expected,
+        std::abs(expected) / 2048);
+  }
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
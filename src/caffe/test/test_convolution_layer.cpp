@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -5,7 +6,15 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layer_factory.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/depthwise_conv_layer.hpp"
+#include "caffe/layers/implicit_gemm_conv_layer.hpp"
+#include "caffe/layers/int8_conv_layer.hpp"
+#include "caffe/layers/parallel_conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -811,6 +820,601 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+template <typename Dtype>
+class ParallelConvolutionLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  ParallelConvolutionLayerTest()
+      : blob_bottom_(new Blob<Dtype>(5, 6, 6, 4)),
+        blob_bottom_2_(new Blob<Dtype>(5, 6, 6, 4)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_2_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    // Use more threads than cores so the tasks really interleave.
+    global_threads_ = ThreadPool::Global().num_threads();
+    ThreadPool::SetGlobalThreads(3);
+    FillerParameter filler_param;
+    filler_param.set_value(1.);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    filler.Fill(this->blob_bottom_2_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+
+  virtual void TearDown() {
+    ThreadPool::SetGlobalThreads(global_threads_);
+  }
+
+  virtual ~ParallelConvolutionLayerTest() {
+    delete blob_bottom_;
+    delete blob_bottom_2_;
+    delete blob_top_;
+    delete blob_top_2_;
+  }
+
+  void CheckAgainstReference(ConvolutionParameter* convolution_param,
+      const vector<shared_ptr<Blob<Dtype> > >& weights) {
+    for (int i = 0; i < blob_top_vec_.size(); ++i) {
+      Blob<Dtype> ref_top;
+      ref_top.ReshapeLike(*blob_top_vec_[i]);
+      caffe_conv(blob_bottom_vec_[i], convolution_param, weights, &ref_top);
+      const Dtype* top_data = blob_top_vec_[i]->cpu_data();
+      const Dtype* ref_top_data = ref_top.cpu_data();
+      for (int j = 0; j < ref_top.count(); ++j) {
+        EXPECT_NEAR(top_data[j], ref_top_data[j], 1e-4);
+      }
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_bottom_2_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_2_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  int global_threads_;
+};
+
+TYPED_TEST_CASE(ParallelConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(ParallelConvolutionLayerTest, TestSimpleConvolution) {
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  ParallelConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(ParallelConvolutionLayerTest, TestSimpleConvolutionGroup) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_dilation(2);
+  convolution_param->add_pad(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ParallelConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(ParallelConvolutionLayerTest, Test1x1ConvolutionGroup) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ParallelConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(ParallelConvolutionLayerTest, TestNDConvolutionGroup) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->set_force_nd_im2col(true);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ParallelConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(ParallelConvolutionLayerTest, TestGradient) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(2);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ParallelConvolutionLayer<TypeParam> layer(layer_param);
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+template <typename Dtype>
+class ImplicitGemmConvolutionLayerTest
+    : public ParallelConvolutionLayerTest<Dtype> {};
+
+TYPED_TEST_CASE(ImplicitGemmConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(ImplicitGemmConvolutionLayerTest, TestSimpleConvolution) {
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  ImplicitGemmConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(ImplicitGemmConvolutionLayerTest, TestDilatedConvolutionGroup) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_dilation(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ImplicitGemmConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(ImplicitGemmConvolutionLayerTest, TestConvolutionManyTiles) {
+  // Enough input channels that every image is split into several tiles,
+  // with tile boundaries falling in the middle of output rows.
+  this->blob_bottom_->Reshape(2, 128, 13, 11);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(5);
+  convolution_param->add_pad(2);
+  convolution_param->set_num_output(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_weight_filler()->set_std(0.01);
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  ImplicitGemmConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+template <typename Dtype>
+class WinogradConvolutionLayerTest
+    : public ParallelConvolutionLayerTest<Dtype> {};
+
+TYPED_TEST_CASE(WinogradConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestSimpleConvolution) {
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestOddOutputConvolutionGroup) {
+  // 7x5 outputs leave partial tiles at the bottom and right borders.
+  this->blob_bottom_->Reshape(2, 6, 9, 7);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(7, this->blob_top_->height());
+  EXPECT_EQ(5, this->blob_top_->width());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestConvolutionManyBlocks) {
+  this->blob_bottom_->Reshape(1, 256, 23, 19);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_weight_filler()->set_std(0.01);
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestWeightUpdate) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The cached filter transform must follow changes to the weights.
+  caffe_scal(layer.blobs()[0]->count(), TypeParam(-2),
+      layer.blobs()[0]->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+  // And filters whose memory is replaced.
+  Blob<TypeParam> shared(layer.blobs()[0]->shape());
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(&shared);
+  layer.blobs()[0]->ShareData(shared);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestStridedFallback) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(WinogradConvolutionLayerTest, TestGradient) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  WinogradConvolutionLayer<TypeParam> layer(layer_param);
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+template <typename Dtype>
+class DepthwiseConvolutionLayerTest
+    : public ParallelConvolutionLayerTest<Dtype> {};
+
+TYPED_TEST_CASE(DepthwiseConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(DepthwiseConvolutionLayerTest, TestSimpleConvolution) {
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(6);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  DepthwiseConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(DepthwiseConvolutionLayerTest, TestStridedConvolution) {
+  // 5x5 filters with stride 2 over an odd sized input, so that the filter
+  // taps hang over different borders in different output columns.
+  this->blob_bottom_->Reshape(2, 6, 11, 9);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(5);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(2);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(6);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  DepthwiseConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(6, this->blob_top_->height());
+  EXPECT_EQ(5, this->blob_top_->width());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(DepthwiseConvolutionLayerTest, TestDilatedConvolutionMultiplier) {
+  // Two filters per input channel, rectangular padding and no bias.
+  this->blob_bottom_->Reshape(2, 6, 10, 12);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_dilation(2);
+  convolution_param->set_pad_h(1);
+  convolution_param->set_pad_w(3);
+  convolution_param->set_num_output(12);
+  convolution_param->set_group(6);
+  convolution_param->set_bias_term(false);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  DepthwiseConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(DepthwiseConvolutionLayerTest, TestGroupFallback) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  DepthwiseConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckAgainstReference(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(DepthwiseConvolutionLayerTest, TestDefaultEngine) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(6);
+  shared_ptr<Layer<TypeParam> > layer =
+      LayerRegistry<TypeParam>::CreateLayer(layer_param);
+#ifndef USE_CUDNN
+  EXPECT_TRUE(dynamic_cast<DepthwiseConvolutionLayer<TypeParam>*>(
+      layer.get()) != NULL);
+#endif
+  convolution_param->set_group(1);
+  layer = LayerRegistry<TypeParam>::CreateLayer(layer_param);
+  EXPECT_TRUE(dynamic_cast<DepthwiseConvolutionLayer<TypeParam>*>(
+      layer.get()) == NULL);
+}
+
+TYPED_TEST(DepthwiseConvolutionLayerTest, TestGradient) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(6);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  DepthwiseConvolutionLayer<TypeParam> layer(layer_param);
+  GradientChecker<TypeParam> checker(1e-2, 1e-3);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+template <typename Dtype>
+class Int8ConvolutionLayerTest : public ParallelConvolutionLayerTest<Dtype> {
+ protected:
+  // The quantized outputs may only be off by a small fraction of the output
+  // range.
+  void CheckQuantized(ConvolutionParameter* convolution_param,
+      const vector<shared_ptr<Blob<Dtype> > >& weights) {
+    for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+      Blob<Dtype> ref_top;
+      ref_top.ReshapeLike(*this->blob_top_vec_[i]);
+      caffe_conv(this->blob_bottom_vec_[i], convolution_param, weights,
+          &ref_top);
+      const Dtype* top_data = this->blob_top_vec_[i]->cpu_data();
+      const Dtype* ref_top_data = ref_top.cpu_data();
+      const Dtype tolerance =
+          0.02 * caffe_cpu_amax(ref_top.count(), ref_top_data);
+      for (int j = 0; j < ref_top.count(); ++j) {
+        EXPECT_NEAR(top_data[j], ref_top_data[j], tolerance);
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(Int8ConvolutionLayerTest, TestDtypes);
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestSimpleConvolution) {
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  Int8ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckQuantized(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestDilatedConvolutionGroup) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_dilation(2);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  Int8ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckQuantized(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestConvolutionManyTiles) {
+  this->blob_bottom_->Reshape(2, 256, 13, 11);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(5);
+  convolution_param->add_pad(2);
+  convolution_param->set_num_output(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_weight_filler()->set_std(0.01);
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  Int8ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckQuantized(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestCalibratedRange) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // A range that is stored exactly in quantization_param.
+  this->blob_bottom_->mutable_cpu_data()[0] = 8;
+  Int8ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<TypeParam> dynamic_top;
+  dynamic_top.CopyFrom(*this->blob_top_, false, true);
+  // Calibrating with the range of the input itself changes nothing.
+  layer_param.mutable_quantization_param()->add_bottom_range(
+      caffe_cpu_amax(this->blob_bottom_->count(),
+          this->blob_bottom_->cpu_data()));
+  Int8ConvolutionLayer<TypeParam> calibrated_layer(layer_param);
+  calibrated_layer.blobs() = layer.blobs();
+  calibrated_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  calibrated_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < dynamic_top.count(); ++i) {
+    EXPECT_EQ(dynamic_top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+  // Inputs beyond a smaller range saturate.
+  layer_param.mutable_quantization_param()->set_bottom_range(0, 0.5);
+  Int8ConvolutionLayer<TypeParam> saturated_layer(layer_param);
+  saturated_layer.blobs() = layer.blobs();
+  saturated_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  saturated_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<TypeParam> clipped_bottom;
+  clipped_bottom.CopyFrom(*this->blob_bottom_, false, true);
+  TypeParam* clipped_data = clipped_bottom.mutable_cpu_data();
+  for (int i = 0; i < clipped_bottom.count(); ++i) {
+    clipped_data[i] = std::min(std::max(clipped_data[i], TypeParam(-0.5)),
+        TypeParam(0.5));
+  }
+  this->blob_bottom_vec_[0] = &clipped_bottom;
+  this->CheckQuantized(convolution_param, layer.blobs());
+}
+
+TYPED_TEST(Int8ConvolutionLayerTest, TestWeightUpdate) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  Int8ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  // The quantized filters must follow changes to the weights.
+  caffe_scal(layer.blobs()[0]->count(), TypeParam(-2),
+      layer.blobs()[0]->mutable_cpu_data());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  this->CheckQuantized(convolution_param, layer.blobs());
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <iterator>
+#include <map>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -11,6 +12,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/detection_output_layer.hpp"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -336,4 +339,166 @@ TYPED_TEST(DetectionOutputLayerTest, TestForwardNoShareLocationNeg0TopK) {
   this->CheckEqual(*(this->blob_top_), 2, "1 1 0.6 0.40 0.40 0.70 0.70");
 }
 
+// Computes the detections of the layer with the NormalizedBBox based helpers
+// of bbox_util, as rows of [image_id, label, confidence, bbox].
+template <typename Dtype>
+void ReferenceDetections(const DetectionOutputParameter& param,
+    const vector<Blob<Dtype>*>& bottom, vector<vector<float> >* rows) {
+  const int num = bottom[0]->num();
+  const int num_classes = param.num_classes();
+  const bool share_location = param.share_location();
+  const int num_loc_classes = share_location ? 1 : num_classes;
+  const int num_priors = bottom[2]->height() / 4;
+  vector<LabelBBox> all_loc_preds;
+  GetLocPredictions(bottom[0]->cpu_data(), num, num_priors, num_loc_classes,
+                    share_location, &all_loc_preds);
+  vector<map<int, vector<float> > > all_conf_scores;
+  GetConfidenceScores(bottom[1]->cpu_data(), num, num_priors, num_classes,
+                      &all_conf_scores);
+  vector<NormalizedBBox> prior_bboxes;
+  vector<vector<float> > prior_variances;
+  GetPriorBBoxes(bottom[2]->cpu_data(), num_priors, &prior_bboxes,
+                 &prior_variances);
+  vector<LabelBBox> all_decode_bboxes;
+  DecodeBBoxesAll(all_loc_preds, prior_bboxes, prior_variances, num,
+                  share_location, num_loc_classes, param.background_label_id(),
+                  param.code_type(), param.variance_encoded_in_target(), false,
+                  &all_decode_bboxes);
+  rows->clear();
+  for (int i = 0; i < num; ++i) {
+    map<int, vector<int> > indices;
+    int num_det = 0;
+    for (int c = 0; c < num_classes; ++c) {
+      if (c == param.background_label_id()) {
+        continue;
+      }
+      ApplyNMSFast(all_decode_bboxes[i][share_location ? -1 : c],
+          all_conf_scores[i][c], param.confidence_threshold(),
+          param.nms_param().nms_threshold(), param.nms_param().eta(),
+          param.nms_param().top_k(), &indices[c]);
+      num_det += indices[c].size();
+    }
+    if (param.keep_top_k() > -1 && num_det > param.keep_top_k()) {
+      vector<pair<float, pair<int, int> > > score_index_pairs;
+      for (map<int, vector<int> >::iterator it = indices.begin();
+           it != indices.end(); ++it) {
+        for (int j = 0; j < it->second.size(); ++j) {
+          int idx = it->second[j];
+          score_index_pairs.push_back(std::make_pair(
+              all_conf_scores[i][it->first][idx],
+              std::make_pair(it->first, idx)));
+        }
+      }
+      std::sort(score_index_pairs.begin(), score_index_pairs.end(),
+                SortScorePairDescend<pair<int, int> >);
+      score_index_pairs.resize(param.keep_top_k());
+      indices.clear();
+      for (int j = 0; j < score_index_pairs.size(); ++j) {
+        indices[score_index_pairs[j].second.first].push_back(
+            score_index_pairs[j].second.second);
+      }
+    }
+    for (map<int, vector<int> >::iterator it = indices.begin();
+         it != indices.end(); ++it) {
+      const int label = it->first;
+      for (int j = 0; j < it->second.size(); ++j) {
+        const int idx = it->second[j];
+        const NormalizedBBox& bbox =
+            all_decode_bboxes[i][share_location ? -1 : label][idx];
+        vector<float> row;
+        row.push_back(i);
+        row.push_back(label);
+        row.push_back(all_conf_scores[i][label][idx]);
+        row.push_back(bbox.xmin());
+        row.push_back(bbox.ymin());
+        row.push_back(bbox.xmax());
+        row.push_back(bbox.ymax());
+        rows->push_back(row);
+      }
+    }
+  }
+}
+
+TYPED_TEST(DetectionOutputLayerTest, TestForwardMatchesReference) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() == Caffe::GPU) {
+    // The reference is the CPU path.
+    return;
+  }
+  const int num = 3;
+  const int num_priors = 60;
+  const int num_classes = 5;
+  Caffe::set_random_seed(1701);
+  Blob<Dtype> prior(1, 2, num_priors * 4, 1);
+  Dtype* prior_data = prior.mutable_cpu_data();
+  caffe_rng_uniform<Dtype>(num_priors * 4, 0, 1, prior_data);
+  for (int i = 0; i < num_priors; ++i) {
+    // Make every prior a valid box.
+    Dtype* bbox = prior_data + i * 4;
+    bbox[2] = bbox[0] + 0.05 + bbox[2] * 0.3;
+    bbox[3] = bbox[1] + 0.05 + bbox[3] * 0.3;
+    for (int j = 0; j < 4; ++j) {
+      prior_data[(num_priors + i) * 4 + j] = j < 2 ? 0.1 : 0.2;
+    }
+  }
+  Blob<Dtype> conf(num, num_priors * num_classes, 1, 1);
+  caffe_rng_uniform<Dtype>(conf.count(), 0, 1, conf.mutable_cpu_data());
+  // Duplicate some scores to exercise the ordering of ties.
+  for (int i = 0; i < conf.count(); i += 7) {
+    conf.mutable_cpu_data()[i] = 0.5;
+  }
+  FillerParameter filler_param;
+  filler_param.set_std(0.5);
+  GaussianFiller<Dtype> filler(filler_param);
+
+  for (int config = 0; config < 8; ++config) {
+    const bool share_location = config % 2;
+    LayerParameter layer_param;
+    DetectionOutputParameter* detection_output_param =
+        layer_param.mutable_detection_output_param();
+    detection_output_param->set_num_classes(num_classes);
+    detection_output_param->set_share_location(share_location);
+    detection_output_param->set_background_label_id(config < 4 ? 0 : 2);
+    detection_output_param->set_code_type(config / 2 % 2 ?
+        PriorBoxParameter_CodeType_CENTER_SIZE :
+        PriorBoxParameter_CodeType_CORNER);
+    detection_output_param->set_confidence_threshold(0.2);
+    detection_output_param->set_keep_top_k(config < 4 ? 20 : -1);
+    NonMaximumSuppressionParameter* nms_param =
+        detection_output_param->mutable_nms_param();
+    nms_param->set_nms_threshold(0.45);
+    nms_param->set_top_k(30);
+    nms_param->set_eta(config < 4 ? 1. : 0.9);
+
+    // The result must not depend on how the work is spread over threads.
+    const int global_threads = ThreadPool::Global().num_threads();
+    ThreadPool::SetGlobalThreads(config / 2 % 2 ? 3 : 1);
+
+    const int num_loc_classes = share_location ? 1 : num_classes;
+    Blob<Dtype> loc(num, num_priors * num_loc_classes * 4, 1, 1);
+    filler.Fill(&loc);
+    vector<Blob<Dtype>*> bottom;
+    bottom.push_back(&loc);
+    bottom.push_back(&conf);
+    bottom.push_back(&prior);
+    DetectionOutputLayer<Dtype> layer(layer_param);
+    layer.SetUp(bottom, this->blob_top_vec_);
+    // Run twice to also cover the reuse of the scratch space.
+    for (int iter = 0; iter < 2; ++iter) {
+      layer.Forward(bottom, this->blob_top_vec_);
+    }
+    ThreadPool::SetGlobalThreads(global_threads);
+    vector<vector<float> > rows;
+    ReferenceDetections(*detection_output_param, bottom, &rows);
+    ASSERT_GT(rows.size(), 0);
+    ASSERT_EQ(this->blob_top_->height(), rows.size());
+    const Dtype* top_data = this->blob_top_->cpu_data();
+    for (int i = 0; i < rows.size(); ++i) {
+      for (int j = 0; j < 7; ++j) {
+        EXPECT_EQ(static_cast<Dtype>(rows[i][j]), top_data[i * 7 + j]);
+      }
+    }
+  }
+}
+
 }  // namespace caffe
@@ -112,6 +112,22 @@ TYPED_TEST(FilterLayerTest, TestForward) {
     EXPECT_EQ(top_data[n], bottom_data[n]);
 }
 
+TYPED_TEST(FilterLayerTest, TestForwardFollowsSelector) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  FilterLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_labels_->shape(0), 2);
+  // The bottom shapes stay the same, but Forward must still reshape.
+  this->blob_bottom_selector_->mutable_cpu_data()[0] = 1;
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_labels_->shape(0), 3);
+  EXPECT_EQ(this->blob_top_data_->shape(0), 3);
+  EXPECT_EQ(this->blob_top_labels_->data_at(0, 0, 0, 0),
+      this->blob_bottom_labels_->data_at(0, 0, 0, 0));
+}
+
 TYPED_TEST(FilterLayerTest, TestGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -0,0 +1,126 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/blob.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class HalfTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(HalfTest, TestDtypes);
+
+TYPED_TEST(HalfTest, TestFloat2Half) {
+  const TypeParam inf = std::numeric_limits<TypeParam>::infinity();
+  const TypeParam values[] = {0, 1, -2, 0.1, 65504, 65519, 65520, -1e10,
+      std::ldexp(TypeParam(1), -14), std::ldexp(TypeParam(1), -24),
+      std::ldexp(TypeParam(1), -25), std::ldexp(TypeParam(3), -25),
+      1 + std::ldexp(TypeParam(1), -11), 1 + std::ldexp(TypeParam(3), -11),
+      inf, -inf};
+  const uint16_t expected[] = {0x0000, 0x3c00, 0xc000, 0x2e66, 0x7bff,
+      0x7bff, 0x7c00, 0xfc00, 0x0400, 0x0001, 0x0000, 0x0002, 0x3c00, 0x3c02,
+      0x7c00, 0xfc00};
+  const int n = sizeof(values) / sizeof(values[0]);
+  // Convert the values twice in a row, so that both the vectorized and the
+  // scalar code see each of them.
+  vector<TypeParam> x(values, values + n);
+  x.insert(x.end(), values, values + n);
+  vector<uint16_t> y(2 * n);
+  caffe_cpu_float2half(2 * n, &x[0], &y[0]);
+  for (int i = 0; i < 2 * n; ++i) {
+    EXPECT_EQ(y[i], expected[i % n]) << "value " << x[i];
+  }
+}
+
+TYPED_TEST(HalfTest, TestNaN) {
+  vector<TypeParam> x(9, std::numeric_limits<TypeParam>::quiet_NaN());
+  vector<uint16_t> y(x.size());
+  caffe_cpu_float2half(x.size(), &x[0], &y[0]);
+  caffe_cpu_half2float(y.size(), &y[0], &x[0]);
+  for (int i = 0; i < x.size(); ++i) {
+    EXPECT_TRUE(std::isnan(x[i]));
+  }
+}
+
+TYPED_TEST(HalfTest, TestRoundTrip) {
+  // Every half precision value but NaN survives a round trip.
+  vector<uint16_t> half;
+  for (int h = 0; h < 65536; ++h) {
+    if ((h & 0x7c00) != 0x7c00 || (h & 0x3ff) == 0) {
+      half.push_back(h);
+    }
+  }
+  vector<TypeParam> x(half.size());
+  caffe_cpu_half2float(half.size(), &half[0], &x[0]);
+  EXPECT_EQ(x[0x3c00], 1);
+  EXPECT_EQ(x[0x0001], std::ldexp(TypeParam(1), -24));
+  vector<uint16_t> y(half.size());
+  caffe_cpu_float2half(x.size(), &x[0], &y[0]);
+  for (int i = 0; i < half.size(); ++i) {
+    EXPECT_EQ(y[i], half[i]) << "value " << x[i];
+  }
+}
+
+// Multiplies by half precision weights large enough to take several tiles,
+// against caffe_cpu_gemm with the widened weights.
+TYPED_TEST(HalfTest, TestGemmHalf) {
+  const int M = 3;
+  const int N = 40;
+  const int K = 1000;
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  Blob<TypeParam> left(1, 1, M, K);
+  Blob<TypeParam> right(1, 1, K, M);
+  Blob<TypeParam> weights(1, 1, N, K);
+  filler.Fill(&left);
+  filler.Fill(&right);
+  filler.Fill(&weights);
+  vector<uint16_t> half(weights.count());
+  caffe_cpu_float2half(weights.count(), weights.cpu_data(), &half[0]);
+  caffe_cpu_half2float(weights.count(), &half[0],
+      weights.mutable_cpu_data());
+  Blob<TypeParam> result(1, 1, M, N);
+  Blob<TypeParam> expected(1, 1, M, N);
+  filler.Fill(&result);
+  caffe_copy(result.count(), result.cpu_data(), expected.mutable_cpu_data());
+  const TypeParam tolerance = 1e-4;
+  // The weights as the N x K matrix op(B) transposes.
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasTrans, M, N, K, 1,
+      left.cpu_data(), weights.cpu_data(), 0.5, expected.mutable_cpu_data());
+  caffe_cpu_gemm_half_b<TypeParam>(CblasTrans, M, N, K, 1, left.cpu_data(),
+      &half[0], 0.5, result.mutable_cpu_data());
+  for (int i = 0; i < result.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], result.cpu_data()[i], tolerance);
+  }
+  // The weights as a K x N matrix B.
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K, 1,
+      left.cpu_data(), weights.cpu_data(), 0.5, expected.mutable_cpu_data());
+  caffe_cpu_gemm_half_b<TypeParam>(CblasNoTrans, M, N, K, 1, left.cpu_data(),
+      &half[0], 0.5, result.mutable_cpu_data());
+  for (int i = 0; i < result.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], result.cpu_data()[i], tolerance);
+  }
+  // The weights as the N x K matrix A.
+  Blob<TypeParam> product(1, 1, N, M);
+  Blob<TypeParam> expected_product(1, 1, N, M);
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, N, M, K, 1,
+      weights.cpu_data(), right.cpu_data(), 0,
+      expected_product.mutable_cpu_data());
+  caffe_cpu_gemm_half_a<TypeParam>(N, M, K, 1, &half[0], right.cpu_data(), 0,
+      product.mutable_cpu_data());
+  for (int i = 0; i < product.count(); ++i) {
+    EXPECT_NEAR(expected_product.cpu_data()[i], product.cpu_data()[i],
+        tolerance);
+  }
+}
+
+}  // namespace caffe
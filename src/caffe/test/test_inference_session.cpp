@@ -0,0 +1,273 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/inference_session.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class InferenceSessionTest : public ::testing::Test {
+ protected:
+  InferenceSessionTest() {
+    Caffe::set_mode(Caffe::CPU);
+    Caffe::set_random_seed(1701);
+    const string& proto =
+        "name: 'SessionNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 3 dim: 6 dim: 6 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv' "
+        "  convolution_param { "
+        "    num_output: 3 "
+        "    kernel_size: 3 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv' "
+        "  top: 'conv' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param_));
+    session_.reset(new InferenceSession<Dtype>(param_));
+  }
+
+ public:
+  // Runs a few forward passes of context on input and keeps the last output.
+  static void RunContext(Net<Dtype>* context, const Blob<Dtype>* input,
+      Blob<Dtype>* output) {
+    Caffe::set_mode(Caffe::CPU);
+    for (int iter = 0; iter < 5; ++iter) {
+      caffe_copy(input->count(), input->cpu_data(),
+          context->input_blobs()[0]->mutable_cpu_data());
+      context->Forward();
+    }
+    output->CopyFrom(*context->output_blobs()[0], false, true);
+  }
+
+ protected:
+  // Runs every context on its own thread and checks the outputs against
+  // those of the first context run serially.
+  void CheckConcurrentForward(
+      const vector<shared_ptr<Net<Dtype> > >& contexts) {
+    const int num_threads = contexts.size();
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    vector<shared_ptr<Blob<Dtype> > > inputs(num_threads);
+    vector<shared_ptr<Blob<Dtype> > > expected(num_threads);
+    vector<shared_ptr<Blob<Dtype> > > outputs(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      inputs[i].reset(new Blob<Dtype>(2, 3, 6, 6));
+      filler.Fill(inputs[i].get());
+      expected[i].reset(new Blob<Dtype>());
+      outputs[i].reset(new Blob<Dtype>());
+      // Compute the reference serially on a single context.
+      RunContext(contexts[0].get(), inputs[i].get(), expected[i].get());
+    }
+    vector<shared_ptr<boost::thread> > threads(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      threads[i].reset(new boost::thread(
+          boost::bind(&InferenceSessionTest<Dtype>::RunContext,
+              contexts[i].get(), inputs[i].get(), outputs[i].get())));
+    }
+    for (int i = 0; i < num_threads; ++i) {
+      threads[i]->join();
+    }
+    for (int i = 0; i < num_threads; ++i) {
+      ASSERT_EQ(expected[i]->count(), outputs[i]->count());
+      for (int j = 0; j < expected[i]->count(); ++j) {
+        EXPECT_EQ(expected[i]->cpu_data()[j], outputs[i]->cpu_data()[j]);
+      }
+    }
+  }
+
+  NetParameter param_;
+  shared_ptr<InferenceSession<Dtype> > session_;
+};
+
+TYPED_TEST_CASE(InferenceSessionTest, TestDtypes);
+
+TYPED_TEST(InferenceSessionTest, TestContextsShareParams) {
+  shared_ptr<Net<TypeParam> > context1 = this->session_->CreateContext();
+  shared_ptr<Net<TypeParam> > context2 = this->session_->CreateContext();
+  const vector<shared_ptr<Blob<TypeParam> > >& params =
+      this->session_->net().params();
+  ASSERT_EQ(params.size(), context1->params().size());
+  ASSERT_EQ(params.size(), context2->params().size());
+  // The contexts use the blobs of the session rather than their own.
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(params[i].get(), context1->params()[i].get());
+    EXPECT_EQ(params[i].get(), context2->params()[i].get());
+  }
+  EXPECT_NE(context1->blob_by_name("conv").get(),
+            context2->blob_by_name("conv").get());
+  EXPECT_NE(context1->blob_by_name("conv")->cpu_data(),
+            context2->blob_by_name("conv")->cpu_data());
+}
+
+TYPED_TEST(InferenceSessionTest, TestConcurrentForward) {
+  vector<shared_ptr<Net<TypeParam> > > contexts(4);
+  for (int i = 0; i < contexts.size(); ++i) {
+    contexts[i] = this->session_->CreateContext();
+  }
+  this->CheckConcurrentForward(contexts);
+}
+
+TYPED_TEST(InferenceSessionTest, TestConcurrentForwardDerivedWeights) {
+  // Winograd transformed and INT8 quantized weights, which the contexts
+  // share with the session.
+  this->param_.mutable_layer(1)->mutable_convolution_param()->set_engine(
+      ConvolutionParameter_Engine_WINOGRAD);
+  this->param_.set_quantize(true);
+  this->session_.reset(new InferenceSession<TypeParam>(this->param_));
+  vector<shared_ptr<Net<TypeParam> > > contexts(4);
+  for (int i = 0; i < contexts.size(); ++i) {
+    contexts[i] = this->session_->CreateContext();
+  }
+  this->CheckConcurrentForward(contexts);
+}
+
+TYPED_TEST(InferenceSessionTest, TestCreateContextWhileRunningFolded) {
+  typedef TypeParam Dtype;
+  const string& proto =
+      "name: 'FoldSessionNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "    shape: { dim: 2 dim: 3 dim: 6 dim: 6 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'conv' "
+      "  type: 'Convolution' "
+      "  bottom: 'data' "
+      "  top: 'conv' "
+      "  convolution_param { "
+      "    num_output: 3 "
+      "    kernel_size: 3 "
+      "    bias_term: false "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'bn' "
+      "  type: 'BatchNorm' "
+      "  bottom: 'conv' "
+      "  top: 'conv' "
+      "} "
+      "layer { "
+      "  name: 'scale' "
+      "  type: 'Scale' "
+      "  bottom: 'conv' "
+      "  top: 'conv' "
+      "  scale_param { bias_term: true } "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'conv' "
+      "  top: 'ip' "
+      "  inner_product_param { "
+      "    num_output: 4 "
+      "    weight_filler { type: 'gaussian' std: 0.1 } "
+      "  } "
+      "} ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  param.mutable_state()->set_phase(TEST);
+  // Embed trained statistics, so that every Net built from the definition
+  // folds them into the weights.
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> positive_filler(filler_param);
+  NetParameter trained_param;
+  {
+    Net<Dtype> net(param);
+    const vector<shared_ptr<Blob<Dtype> > >& bn =
+        net.layer_by_name("bn")->blobs();
+    filler.Fill(bn[0].get());
+    positive_filler.Fill(bn[1].get());
+    bn[2]->mutable_cpu_data()[0] = 1;
+    filler.Fill(net.layer_by_name("scale")->blobs()[0].get());
+    filler.Fill(net.layer_by_name("scale")->blobs()[1].get());
+    net.ToProto(&trained_param);
+  }
+  trained_param.set_fold_batch_norm(true);
+  this->session_.reset(new InferenceSession<Dtype>(trained_param));
+  const vector<shared_ptr<Blob<Dtype> > >& params =
+      this->session_->net().params();
+  shared_ptr<Net<Dtype> > running = this->session_->CreateContext();
+  vector<int> versions(params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    versions[i] = params[i]->data()->version();
+  }
+  Blob<Dtype> input(2, 3, 6, 6);
+  filler.Fill(&input);
+  Blob<Dtype> expected;
+  this->RunContext(running.get(), &input, &expected);
+  // Another context is created while the first one runs.
+  Blob<Dtype> output;
+  boost::thread thread(boost::bind(&InferenceSessionTest<Dtype>::RunContext,
+      running.get(), &input, &output));
+  shared_ptr<Net<Dtype> > created = this->session_->CreateContext();
+  thread.join();
+  // Neither context wrote to the weights of the session.
+  for (int i = 0; i < params.size(); ++i) {
+    EXPECT_EQ(versions[i], params[i]->data()->version());
+  }
+  ASSERT_EQ(expected.count(), output.count());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], output.cpu_data()[i]);
+  }
+  Blob<Dtype> created_output;
+  this->RunContext(created.get(), &input, &created_output);
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], created_output.cpu_data()[i]);
+  }
+}
+
+}  // namespace caffe
@@ -6,6 +6,8 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/int8_inner_product_layer.hpp"
+#include "caffe/util/quantize.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -388,4 +390,117 @@ TYPED_TEST(InnerProductLayerTest, TestBackwardTranspose) {
   }
 }
 
+template <typename Dtype>
+class Int8InnerProductLayerTest : public CPUDeviceTest<Dtype> {
+ protected:
+  Int8InnerProductLayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_top_(new Blob<Dtype>()),
+        blob_ref_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~Int8InnerProductLayerTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+    delete blob_ref_top_;
+  }
+
+  // Runs the INT8 and the CAFFE engine with the same weights; the quantized
+  // outputs may only be off by a small fraction of the output range.
+  void CheckQuantized(const LayerParameter& layer_param) {
+    InnerProductLayer<Dtype> ref_layer(layer_param);
+    vector<Blob<Dtype>*> ref_top_vec(1, blob_ref_top_);
+    ref_layer.SetUp(blob_bottom_vec_, ref_top_vec);
+    ref_layer.Forward(blob_bottom_vec_, ref_top_vec);
+    Int8InnerProductLayer<Dtype> layer(layer_param);
+    layer.blobs() = ref_layer.blobs();
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, blob_top_vec_);
+    ASSERT_EQ(blob_ref_top_->count(), blob_top_->count());
+    const Dtype* top_data = blob_top_->cpu_data();
+    const Dtype* ref_top_data = blob_ref_top_->cpu_data();
+    const Dtype tolerance =
+        0.02 * caffe_cpu_amax(blob_ref_top_->count(), ref_top_data);
+    for (int i = 0; i < blob_top_->count(); ++i) {
+      EXPECT_NEAR(top_data[i], ref_top_data[i], tolerance);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_ref_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(Int8InnerProductLayerTest, TestDtypes);
+
+TYPED_TEST(Int8InnerProductLayerTest, TestForward) {
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckQuantized(layer_param);
+}
+
+TYPED_TEST(Int8InnerProductLayerTest, TestForwardTranspose) {
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->set_transpose(true);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->set_bias_term(false);
+  this->CheckQuantized(layer_param);
+}
+
+TYPED_TEST(Int8InnerProductLayerTest, TestForwardManyBlocks) {
+  // Long enough rows that the outputs are split into several blocks, the
+  // last of which is partial.
+  this->blob_bottom_->Reshape(3, 64, 8, 8);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(37);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  this->CheckQuantized(layer_param);
+}
+
+TYPED_TEST(Int8InnerProductLayerTest, TestCalibratedRange) {
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->mutable_weight_filler()->set_type("gaussian");
+  inner_product_param->mutable_bias_filler()->set_type("gaussian");
+  // A range that is stored exactly in quantization_param.
+  this->blob_bottom_->mutable_cpu_data()[0] = 8;
+  Int8InnerProductLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<TypeParam> dynamic_top;
+  dynamic_top.CopyFrom(*this->blob_top_, false, true);
+  // Calibrating with the range of the input itself changes nothing.
+  layer_param.mutable_quantization_param()->add_bottom_range(
+      caffe_cpu_amax(this->blob_bottom_->count(),
+          this->blob_bottom_->cpu_data()));
+  Int8InnerProductLayer<TypeParam> calibrated_layer(layer_param);
+  calibrated_layer.blobs() = layer.blobs();
+  calibrated_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  calibrated_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < dynamic_top.count(); ++i) {
+    EXPECT_EQ(dynamic_top.cpu_data()[i], this->blob_top_->cpu_data()[i]);
+  }
+}
+
 }  // namespace caffe
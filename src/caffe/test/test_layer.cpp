@@ -0,0 +1,122 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/neuron_layer.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Copies its bottom and counts the calls to Reshape.
+template <typename Dtype>
+class ReshapeCountingLayer : public NeuronLayer<Dtype> {
+ public:
+  ReshapeCountingLayer(const LayerParameter& param, bool allow_skip)
+      : NeuronLayer<Dtype>(param), allow_skip_(allow_skip), reshapes_(0) {}
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    NeuronLayer<Dtype>::Reshape(bottom, top);
+    ++reshapes_;
+  }
+  virtual inline const char* type() const { return "ReshapeCounting"; }
+  virtual inline bool AllowSkipReshape() const { return allow_skip_; }
+
+  int reshapes() const { return reshapes_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+    caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(),
+        top[0]->mutable_cpu_data());
+  }
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+
+  bool allow_skip_;
+  int reshapes_;
+};
+
+template <typename TypeParam>
+class LayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  LayerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 4, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~LayerTest() { delete blob_bottom_; delete blob_top_; }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(LayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(LayerTest, TestForwardSkipsReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReshapeCountingLayer<Dtype> layer(layer_param, true);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(1, layer.reshapes());
+  // SetUp already reshaped for these blobs.
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(1, layer.reshapes());
+  // Reshaping a blob to its current shape changes nothing.
+  this->blob_bottom_->Reshape(2, 3, 4, 5);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(1, layer.reshapes());
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    EXPECT_EQ(this->blob_bottom_->cpu_data()[i],
+        this->blob_top_->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(LayerTest, TestForwardReshapesOnChange) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReshapeCountingLayer<Dtype> layer(layer_param, true);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // A new bottom shape.
+  this->blob_bottom_->Reshape(3, 3, 4, 5);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, layer.reshapes());
+  EXPECT_EQ(3, this->blob_top_->num());
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(2, layer.reshapes());
+  // A top that was reshaped from outside.
+  this->blob_top_->Reshape(1, 1, 1, 1);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(3, layer.reshapes());
+  EXPECT_TRUE(this->blob_top_->shape() == this->blob_bottom_->shape());
+  // A different top blob.
+  Blob<Dtype> other_top;
+  vector<Blob<Dtype>*> other_top_vec(1, &other_top);
+  layer.Forward(this->blob_bottom_vec_, other_top_vec);
+  EXPECT_EQ(4, layer.reshapes());
+  EXPECT_TRUE(other_top.shape() == this->blob_bottom_->shape());
+}
+
+TYPED_TEST(LayerTest, TestForwardAlwaysReshapesUnlessAllowed) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  ReshapeCountingLayer<Dtype> layer(layer_param, false);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(3, layer.reshapes());
+}
+
+}  // namespace caffe
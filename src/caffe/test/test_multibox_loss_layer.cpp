@@ -19,6 +19,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -441,4 +442,54 @@ TYPED_TEST(MultiBoxLossLayerTest, TestConfGradient) {
   }
 }
 
+TYPED_TEST(MultiBoxLossLayerTest, TestForwardThreadCount) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  MultiBoxLossParameter* multibox_loss_param =
+      layer_param.mutable_multibox_loss_param();
+  multibox_loss_param->set_num_classes(this->num_classes_);
+  multibox_loss_param->set_background_label_id(0);
+  const int global_threads = ThreadPool::Global().num_threads();
+  for (int i = 0; i < 2; ++i) {
+    bool share_location = kBoolChoices[i];
+    this->Fill(share_location);
+    for (int k = 0; k < 2; ++k) {
+      bool use_prior = kBoolChoices[k];
+      multibox_loss_param->set_share_location(share_location);
+      multibox_loss_param->set_use_prior_for_matching(use_prior);
+      multibox_loss_param->set_mining_type(share_location ?
+          MultiBoxLossParameter_MiningType_MAX_NEGATIVE :
+          MultiBoxLossParameter_MiningType_NONE);
+      // Matching and mining run per image on the global pool; the loss and
+      // its gradients must not depend on the number of threads.
+      vector<Dtype> losses;
+      vector<shared_ptr<Blob<Dtype> > > diffs;
+      for (int t = 0; t < 2; ++t) {
+        ThreadPool::SetGlobalThreads(t == 0 ? 1 : 3);
+        MultiBoxLossLayer<Dtype> layer(layer_param);
+        layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+        losses.push_back(
+            layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_));
+        this->blob_top_loss_->mutable_cpu_diff()[0] = 1;
+        vector<bool> propagate_down(4, false);
+        propagate_down[0] = true;
+        propagate_down[1] = true;
+        layer.Backward(this->blob_top_vec_, propagate_down,
+                       this->blob_bottom_vec_);
+        for (int b = 0; b < 2; ++b) {
+          diffs.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+          diffs.back()->CopyFrom(*this->blob_bottom_vec_[b], true, true);
+        }
+      }
+      EXPECT_EQ(losses[0], losses[1]);
+      for (int b = 0; b < 2; ++b) {
+        for (int j = 0; j < diffs[b]->count(); ++j) {
+          EXPECT_EQ(diffs[b]->cpu_diff()[j], diffs[b + 2]->cpu_diff()[j]);
+        }
+      }
+    }
+  }
+  ThreadPool::SetGlobalThreads(global_threads);
+}
+
 }  // namespace caffe
@@ -1,16 +1,26 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "boost/thread.hpp"
 #include "google/protobuf/text_format.h"
 
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/layers/int8_conv_layer.hpp"
+#include "caffe/layers/int8_inner_product_layer.hpp"
 #include "caffe/net.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/quantize.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 #include "caffe/test/test_gradient_check_util.hpp"
@@ -839,6 +849,309 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoFileWithState(proto, phase, level, stages);
   }
 
+  virtual void InitBranchingNet(const string& memory_options) {
+    const string& proto =
+        "name: 'BranchingNetwork' " + memory_options +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 3 dim: 8 dim: 8 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'pool1' "
+        "  type: 'Pooling' "
+        "  bottom: 'conv1' "
+        "  top: 'pool1' "
+        "  pooling_param { pool: MAX kernel_size: 2 stride: 2 } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'pool1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv3a' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv2' "
+        "  top: 'conv3a' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv3b' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv2' "
+        "  top: 'conv3b' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv3a' "
+        "  bottom: 'conv3b' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'flat' "
+        "  type: 'Flatten' "
+        "  bottom: 'sum' "
+        "  top: 'flat' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'flat' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prob' "
+        "  type: 'Softmax' "
+        "  bottom: 'ip' "
+        "  top: 'prob' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitFoldNet(const string& fold_options) {
+    const string& proto =
+        "name: 'FoldNetwork' " + fold_options +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 3 dim: 6 dim: 6 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    bias_term: false "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bn1' "
+        "  type: 'BatchNorm' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'scale1' "
+        "  type: 'Scale' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "  scale_param { bias_term: true } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'conv1' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.1 } "
+        "    bias_filler { type: 'gaussian' std: 0.1 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'bn2' "
+        "  type: 'BN' "
+        "  bottom: 'ip' "
+        "  top: 'ip_bn' "
+        "} "
+        "layer { "
+        "  name: 'bias2' "
+        "  type: 'Bias' "
+        "  bottom: 'ip_bn' "
+        "  top: 'out' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitActivationNet(const string& fuse_options) {
+    const string& proto =
+        "name: 'ActivationNetwork' " + fuse_options +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 3 dim: 8 dim: 8 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'conv1' "
+        "  type: 'Convolution' "
+        "  bottom: 'data' "
+        "  top: 'conv1' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU6' "
+        "  bottom: 'conv1' "
+        "  top: 'conv1' "
+        "  relu6_param { threshold: 1 } "
+        "} "
+        "layer { "
+        "  name: 'conv2' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv1' "
+        "  top: 'conv2' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 1 "
+        "    group: 2 "
+        "    bias_term: false "
+        "    engine: PARALLEL "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prelu2' "
+        "  type: 'PReLU' "
+        "  bottom: 'conv2' "
+        "  top: 'conv2' "
+        "  prelu_param { filler { type: 'gaussian' std: 0.5 } } "
+        "} "
+        "layer { "
+        "  name: 'conv3' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv2' "
+        "  top: 'conv3' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    engine: IMPLICIT_GEMM "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'hswish3' "
+        "  type: 'HardSwish' "
+        "  bottom: 'conv3' "
+        "  top: 'conv3' "
+        "} "
+        "layer { "
+        "  name: 'conv4' "
+        "  type: 'Convolution' "
+        "  bottom: 'conv3' "
+        "  top: 'conv4' "
+        "  convolution_param { "
+        "    num_output: 4 "
+        "    kernel_size: 3 "
+        "    pad: 1 "
+        "    engine: WINOGRAD "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu4' "
+        "  type: 'ReLU' "
+        "  bottom: 'conv4' "
+        "  top: 'conv4' "
+        "  relu_param { negative_slope: 0.1 } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'conv4' "
+        "  bottom: 'conv1' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'hsigmoid' "
+        "  type: 'HardSigmoid' "
+        "  bottom: 'sum' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sum' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 5 "
+        "    weight_filler { type: 'gaussian' std: 0.5 } "
+        "    bias_filler { type: 'gaussian' std: 0.5 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'prelu_ip' "
+        "  type: 'PReLU' "
+        "  bottom: 'ip' "
+        "  top: 'ip' "
+        "  prelu_param { filler { type: 'gaussian' std: 0.5 } } "
+        "} "
+        "layer { "
+        "  name: 'relu_out' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip' "
+        "  top: 'out' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -1342,6 +1655,211 @@ TYPED_TEST(NetTest, TestSharedWeightsResume) {
   }
 }
 
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromBinaryFile) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string filename;
+  MakeTempFilename(&filename);
+  WriteProtoToBinaryFile(net_param, filename);
+  const vector<Blob<Dtype>*> trained_params =
+      this->net_->learnable_params();
+  shared_ptr<Net<Dtype> > trained_net = this->net_;
+
+  // A differently seeded net gets the weights of the file.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet();
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  ASSERT_EQ(trained_params.size(), params.size());
+  EXPECT_NE(trained_params[0]->cpu_data()[0], params[0]->cpu_data()[0]);
+  this->net_->CopyTrainedLayersFrom(filename);
+  for (int i = 0; i < params.size(); ++i) {
+    ASSERT_EQ(trained_params[i]->count(), params[i]->count());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(trained_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+}
+
+template <typename Dtype>
+void WriteNetToPipe(const NetParameter* net_param, const string* filename) {
+  WriteProtoToBinaryFile(*net_param, *filename);
+}
+
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromPipe) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet();
+  NetParameter net_param;
+  this->net_->ToProto(&net_param);
+  string dirname;
+  MakeTempDir(&dirname);
+  const string filename = dirname + "/weights.fifo";
+  ASSERT_EQ(0, mkfifo(filename.c_str(), 0600));
+  const vector<Blob<Dtype>*> trained_params =
+      this->net_->learnable_params();
+  shared_ptr<Net<Dtype> > trained_net = this->net_;
+
+  // A pipe has no size to map, so the weights are streamed instead.
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet();
+  boost::thread writer(WriteNetToPipe<Dtype>, &net_param, &filename);
+  this->net_->CopyTrainedLayersFrom(filename);
+  writer.join();
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  ASSERT_EQ(trained_params.size(), params.size());
+  for (int i = 0; i < params.size(); ++i) {
+    ASSERT_EQ(trained_params[i]->count(), params[i]->count());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(trained_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+  unlink(filename.c_str());
+}
+
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromMapped) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitUnsharedWeightsNet();
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToMapped(filename);
+  const vector<Blob<Dtype>*> trained_params =
+      this->net_->learnable_params();
+  shared_ptr<Net<Dtype> > trained_net = this->net_;
+
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitUnsharedWeightsNet();
+  const vector<Blob<Dtype>*>& params = this->net_->learnable_params();
+  ASSERT_EQ(trained_params.size(), params.size());
+  EXPECT_NE(trained_params[0]->cpu_data()[0], params[0]->cpu_data()[0]);
+  // The file is recognized by its magic rather than its name.
+  this->net_->CopyTrainedLayersFrom(filename);
+  for (int i = 0; i < params.size(); ++i) {
+    ASSERT_EQ(trained_params[i]->count(), params[i]->count());
+    for (int j = 0; j < params[i]->count(); ++j) {
+      EXPECT_EQ(trained_params[i]->cpu_data()[j], params[i]->cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestCopyTrainedLayersFromMappedShared) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  string filename;
+  MakeTempFilename(&filename);
+  this->net_->ToMapped(filename);
+  const Blob<Dtype>& trained_weights =
+      *this->net_->layer_by_name("innerproduct1")->blobs()[0];
+  // The header points both layers at the same data.
+  std::ifstream input(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[8];
+  uint64_t header_size;
+  input.read(magic, sizeof(magic));
+  input.read(reinterpret_cast<char*>(&header_size), sizeof(header_size));
+  string header_bytes(header_size, 0);
+  input.read(&header_bytes[0], header_size);
+  ASSERT_TRUE(input.good());
+  NetParameter header;
+  ASSERT_TRUE(header.ParseFromString(header_bytes));
+  vector<uint64_t> offsets;
+  for (int i = 0; i < header.layer_size(); ++i) {
+    if (header.layer(i).blobs_size() > 0) {
+      offsets.push_back(header.layer(i).blobs(0).mapped_offset());
+    }
+  }
+  ASSERT_EQ(2, offsets.size());
+  EXPECT_EQ(offsets[0], offsets[1]);
+  // And the data section holds a single copy, aligned to 64 bytes.
+  const uint64_t header_end = sizeof(magic) + sizeof(header_size) +
+      header_size;
+  const uint64_t data_bytes = trained_weights.count() * sizeof(Dtype);
+  struct stat file_stat;
+  ASSERT_EQ(0, stat(filename.c_str(), &file_stat));
+  EXPECT_EQ((header_end + 63) / 64 * 64 + (data_bytes + 63) / 64 * 64,
+      file_stat.st_size);
+
+  Blob<Dtype> expected;
+  expected.CopyFrom(trained_weights, false, true);
+  Caffe::set_random_seed(this->seed_ + 1);
+  this->InitDiffDataSharedWeightsNet();
+  this->net_->CopyTrainedLayersFromMapped(filename);
+  const Blob<Dtype>* weights =
+      this->net_->layer_by_name("innerproduct1")->blobs()[0].get();
+  ASSERT_EQ(expected.count(), weights->count());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], weights->cpu_data()[i]);
+  }
+}
+
+// Records the diffs of the learnable params as they are announced complete.
+template <typename Dtype>
+class DiffReadyRecorder : public Net<Dtype>::Callback {
+ public:
+  explicit DiffReadyRecorder(const Net<Dtype>& net) : net_(net) {}
+
+  vector<int> param_ids_;
+  vector<vector<Dtype> > diffs_;
+
+ protected:
+  void on_diff_ready(int param_id) {
+    const Blob<Dtype>* param = net_.learnable_params()[param_id];
+    param_ids_.push_back(param_id);
+    diffs_.push_back(vector<Dtype>(param->cpu_diff(),
+        param->cpu_diff() + param->count()));
+  }
+
+  const Net<Dtype>& net_;
+};
+
+TYPED_TEST(NetTest, TestDiffReadyCallbacks) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitUnsharedWeightsNet();
+  Net<Dtype>* net = this->net_.get();
+  ASSERT_EQ(net->learnable_params().size(), 2);
+  DiffReadyRecorder<Dtype> recorder(*net);
+  net->add_callback(&recorder);
+  net->Forward();
+  net->Backward();
+  // The weights of innerproduct2 are complete first, and the diffs are final
+  // when announced.
+  ASSERT_EQ(recorder.param_ids_.size(), 2);
+  EXPECT_EQ(recorder.param_ids_[0], 1);
+  EXPECT_EQ(recorder.param_ids_[1], 0);
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>* param =
+        net->learnable_params()[recorder.param_ids_[i]];
+    ASSERT_EQ(recorder.diffs_[i].size(), param->count());
+    for (int j = 0; j < param->count(); ++j) {
+      EXPECT_EQ(recorder.diffs_[i][j], param->cpu_diff()[j]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestDiffReadyCallbacksSharedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitDiffDataSharedWeightsNet();
+  Net<Dtype>* net = this->net_.get();
+  ASSERT_EQ(net->learnable_params().size(), 1);
+  // The shared weights are only complete after the lower of their layers.
+  EXPECT_EQ(net->diff_ready_params()[1].size(), 1);
+  EXPECT_EQ(net->diff_ready_params()[2].size(), 0);
+  DiffReadyRecorder<Dtype> recorder(*net);
+  net->add_callback(&recorder);
+  net->Forward();
+  net->Backward();
+  ASSERT_EQ(recorder.param_ids_.size(), 1);
+  EXPECT_EQ(recorder.param_ids_[0], 0);
+  const Blob<Dtype>* param = net->learnable_params()[0];
+  for (int j = 0; j < param->count(); ++j) {
+    EXPECT_EQ(recorder.diffs_[0][j], param->cpu_diff()[j]);
+  }
+}
+
 TYPED_TEST(NetTest, TestParamPropagateDown) {
   typedef typename TypeParam::Dtype Dtype;
   const bool kBiasTerm = true, kForceBackward = false;
@@ -2446,6 +2964,57 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestForwardReshapesAfterFilter) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Filter reshapes on every Forward; the layers after it reshape whenever
+  // its top changes and only then.
+  const string& proto =
+      "name: 'FilterNet' "
+      "layer { "
+      "  name: 'input' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'selector' "
+      "  input_param { "
+      "    shape: { dim: 4 dim: 3 } "
+      "    shape: { dim: 4 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'filter' "
+      "  type: 'Filter' "
+      "  bottom: 'data' "
+      "  bottom: 'selector' "
+      "  top: 'filtered' "
+      "} "
+      "layer { "
+      "  name: 'innerproduct' "
+      "  type: 'InnerProduct' "
+      "  inner_product_param { "
+      "    num_output: 2 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "    } "
+      "  } "
+      "  bottom: 'filtered' "
+      "  top: 'output' "
+      "} ";
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto);
+  Blob<Dtype>* selector = this->net_->input_blobs()[1];
+  Blob<Dtype>* output = this->net_->output_blobs()[0];
+  caffe_set(4, Dtype(1), selector->mutable_cpu_data());
+  this->net_->Forward();
+  EXPECT_EQ(4, output->num());
+  const size_t version = output->shape_version();
+  this->net_->Forward();
+  EXPECT_EQ(version, output->shape_version());
+  selector->mutable_cpu_data()[2] = 0;
+  this->net_->Forward();
+  EXPECT_EQ(3, output->num());
+  EXPECT_EQ(2, output->channels());
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
@@ -2583,6 +3152,300 @@ TYPED_TEST(NetTest, TestAllInOneNetVal) {
   ASSERT_TRUE(found_loss);
 }
 
+TYPED_TEST(NetTest, TestOptimizeMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 8, 8);
+  filler.Fill(&input);
+  // Run the net without memory planning for reference.
+  Caffe::set_random_seed(this->seed_);
+  this->InitBranchingNet("");
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->input_blobs()[0]->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->net_->output_blobs()[0], false, true);
+  // conv1 is dead once pool1 has run, so conv2 can reuse its memory.
+  Caffe::set_random_seed(this->seed_);
+  this->InitBranchingNet("optimize_memory: true ");
+  EXPECT_EQ(this->net_->blob_by_name("conv1")->data().get(),
+            this->net_->blob_by_name("conv2")->data().get());
+  EXPECT_NE(this->net_->blob_by_name("conv2")->data().get(),
+            this->net_->blob_by_name("conv3a")->data().get());
+  EXPECT_NE(this->net_->blob_by_name("conv2")->data().get(),
+            this->net_->blob_by_name("conv3b")->data().get());
+  EXPECT_NE(this->net_->blob_by_name("data")->data().get(),
+            this->net_->blob_by_name("pool1")->data().get());
+  for (int iter = 0; iter < 2; ++iter) {
+    caffe_copy(input.count(), input.cpu_data(),
+        this->net_->input_blobs()[0]->mutable_cpu_data());
+    this->net_->Forward();
+    const Blob<Dtype>* output = this->net_->output_blobs()[0];
+    ASSERT_EQ(expected.count(), output->count());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], output->cpu_data()[i]);
+    }
+  }
+  // Pinned blobs keep their own memory.
+  Caffe::set_random_seed(this->seed_);
+  this->InitBranchingNet("optimize_memory: true pinned_blob: 'conv1' ");
+  EXPECT_NE(this->net_->blob_by_name("conv1")->data().get(),
+            this->net_->blob_by_name("conv2")->data().get());
+}
+
+TYPED_TEST(NetTest, TestFoldBatchNorm) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler_param.set_min(0.5);
+  filler_param.set_max(2);
+  UniformFiller<Dtype> positive_filler(filler_param);
+  Blob<Dtype> input(2, 3, 6, 6);
+  filler.Fill(&input);
+  // Run the net with trained statistics for reference.
+  Caffe::set_random_seed(this->seed_);
+  this->InitFoldNet("");
+  const vector<shared_ptr<Blob<Dtype> > >& bn1 =
+      this->net_->layer_by_name("bn1")->blobs();
+  filler.Fill(bn1[0].get());
+  positive_filler.Fill(bn1[1].get());
+  bn1[2]->mutable_cpu_data()[0] = 0.5;
+  filler.Fill(this->net_->layer_by_name("scale1")->blobs()[0].get());
+  filler.Fill(this->net_->layer_by_name("scale1")->blobs()[1].get());
+  const vector<shared_ptr<Blob<Dtype> > >& bn2 =
+      this->net_->layer_by_name("bn2")->blobs();
+  filler.Fill(bn2[0].get());
+  filler.Fill(bn2[1].get());
+  filler.Fill(bn2[2].get());
+  positive_filler.Fill(bn2[3].get());
+  filler.Fill(this->net_->layer_by_name("bias2")->blobs()[0].get());
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->input_blobs()[0]->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->net_->blob_by_name("out"), false, true);
+  NetParameter trained_param;
+  this->net_->ToProto(&trained_param);
+  const Dtype kEps = 1e-4;
+  for (int i = 0; i < 2; ++i) {
+    if (i == 0) {
+      // Weights copied into a folded net.
+      this->InitFoldNet("fold_batch_norm: true ");
+      this->net_->CopyTrainedLayersFrom(trained_param);
+    } else {
+      // Weights embedded in the definition of a folded net.
+      NetParameter param(trained_param);
+      param.set_fold_batch_norm(true);
+      param.mutable_state()->set_phase(caffe::TEST);
+      this->net_.reset(new Net<Dtype>(param));
+    }
+    EXPECT_TRUE(this->net_->has_layer("conv1"));
+    EXPECT_TRUE(this->net_->has_layer("ip"));
+    EXPECT_FALSE(this->net_->has_layer("bn1"));
+    EXPECT_FALSE(this->net_->has_layer("scale1"));
+    EXPECT_FALSE(this->net_->has_layer("bn2"));
+    EXPECT_FALSE(this->net_->has_layer("bias2"));
+    EXPECT_FALSE(this->net_->has_blob("ip"));
+    EXPECT_FALSE(this->net_->has_blob("ip_bn"));
+    caffe_copy(input.count(), input.cpu_data(),
+        this->net_->input_blobs()[0]->mutable_cpu_data());
+    this->net_->Forward();
+    const Blob<Dtype>* output = this->net_->output_blobs()[0];
+    ASSERT_EQ(expected.count(), output->count());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected.cpu_data()[j], output->cpu_data()[j], kEps);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestFuseActivations) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 8, 8);
+  filler.Fill(&input);
+  Caffe::set_random_seed(this->seed_);
+  this->InitActivationNet("");
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->input_blobs()[0]->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->net_->output_blobs()[0], false, true);
+  Caffe::set_random_seed(this->seed_);
+  this->InitActivationNet("fuse_activations: true ");
+  // Out-of-place activations stay layers of their own.
+  set<string> fused_names;
+  fused_names.insert("relu1");
+  fused_names.insert("prelu2");
+  fused_names.insert("hswish3");
+  fused_names.insert("relu4");
+  fused_names.insert("hsigmoid");
+  fused_names.insert("prelu_ip");
+  const vector<string>& layer_names = this->net_->layer_names();
+  for (int i = 0; i < layer_names.size(); ++i) {
+    EXPECT_EQ(fused_names.count(layer_names[i]) > 0,
+        this->net_->layer_fused()[i]) << layer_names[i];
+  }
+  for (int iter = 0; iter < 2; ++iter) {
+    caffe_copy(input.count(), input.cpu_data(),
+        this->net_->input_blobs()[0]->mutable_cpu_data());
+    this->net_->Forward();
+    const Blob<Dtype>* output = this->net_->output_blobs()[0];
+    ASSERT_EQ(expected.count(), output->count());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], output->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestQuantize) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 8, 8);
+  filler.Fill(&input);
+  Caffe::set_random_seed(this->seed_);
+  this->InitActivationNet("");
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->input_blobs()[0]->mutable_cpu_data());
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->net_->output_blobs()[0], false, true);
+  NetParameter param;
+  this->net_->ToProto(&param);
+  CalibrateQuantization(this->net_.get(), 1, &param);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    const LayerParameter& layer_param = param.layer(i);
+    const bool calibrated = layer_param.type() == "Convolution" ||
+        layer_param.type() == "InnerProduct";
+    ASSERT_EQ(calibrated ? 1 : 0,
+        layer_param.quantization_param().bottom_range_size())
+        << layer_param.name();
+    if (layer_param.name() == "conv1") {
+      EXPECT_FLOAT_EQ(caffe_cpu_amax(input.count(), input.cpu_data()),
+          layer_param.quantization_param().bottom_range(0));
+    }
+  }
+  // Only the layers left to the DEFAULT engine, but for grouped
+  // convolutions, are quantized.
+  param.set_quantize(true);
+  this->net_.reset(new Net<Dtype>(param));
+  const vector<string>& layer_names = this->net_->layer_names();
+  for (int i = 0; i < layer_names.size(); ++i) {
+    const Layer<Dtype>* layer = this->net_->layers()[i].get();
+    EXPECT_EQ(layer_names[i] == "conv1",
+        dynamic_cast<const Int8ConvolutionLayer<Dtype>*>(layer) != NULL);
+    EXPECT_EQ(layer_names[i] == "ip",
+        dynamic_cast<const Int8InnerProductLayer<Dtype>*>(layer) != NULL);
+  }
+  caffe_copy(input.count(), input.cpu_data(),
+      this->net_->input_blobs()[0]->mutable_cpu_data());
+  this->net_->Forward();
+  const Blob<Dtype>* output = this->net_->output_blobs()[0];
+  ASSERT_EQ(expected.count(), output->count());
+  const Dtype tolerance =
+      0.05 * caffe_cpu_amax(expected.count(), expected.cpu_data());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], output->cpu_data()[i], tolerance);
+  }
+}
+
+// Half precision storage holds float data only.
+class HalfNetTest : public NetTest<CPUDevice<float> > {
+ protected:
+  // Runs the activation net on a fixed input, which the constructor draws.
+  void ForwardActivationNet(Blob<float>* output) {
+    caffe_copy(input_.count(), input_.cpu_data(),
+        this->net_->input_blobs()[0]->mutable_cpu_data());
+    this->net_->Forward();
+    output->CopyFrom(*this->net_->output_blobs()[0], false, true);
+  }
+
+  HalfNetTest() : input_(2, 3, 8, 8) {
+    FillerParameter filler_param;
+    GaussianFiller<float> filler(filler_param);
+    filler.Fill(&input_);
+  }
+
+  Blob<float> input_;
+};
+
+TEST_F(HalfNetTest, TestHalfWeights) {
+  Caffe::set_random_seed(this->seed_);
+  this->InitActivationNet("");
+  Blob<float> expected;
+  this->ForwardActivationNet(&expected);
+  NetParameter param;
+  this->net_->ToProto(&param);
+  param.set_half_weights(true);
+  this->net_.reset(new Net<float>(param));
+  // Only the layers that compute from half precision weights keep them so.
+  const vector<string>& layer_names = this->net_->layer_names();
+  for (int i = 0; i < layer_names.size(); ++i) {
+    Layer<float>* layer = this->net_->layers()[i].get();
+    if (layer->blobs().empty()) { continue; }
+    EXPECT_EQ(layer_names[i] == "conv1" || layer_names[i] == "ip",
+        layer->blobs()[0]->data_at_half()) << layer_names[i];
+  }
+  Blob<float> output;
+  this->ForwardActivationNet(&output);
+  ASSERT_EQ(expected.count(), output.count());
+  const float tolerance =
+      0.01 * caffe_cpu_amax(expected.count(), expected.cpu_data());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], output.cpu_data()[i], tolerance);
+  }
+  // Forward did not widen them.
+  EXPECT_TRUE(this->net_->layer_by_name("conv1")->blobs()[0]->data_at_half());
+  EXPECT_TRUE(this->net_->layer_by_name("ip")->blobs()[0]->data_at_half());
+  // Loading weights keeps them in half precision again.
+  this->net_->CopyTrainedLayersFrom(param);
+  EXPECT_TRUE(this->net_->layer_by_name("ip")->blobs()[0]->data_at_half());
+  Blob<float> reloaded_output;
+  this->ForwardActivationNet(&reloaded_output);
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_EQ(output.cpu_data()[i], reloaded_output.cpu_data()[i]);
+  }
+}
+
+TEST_F(HalfNetTest, TestHalfTop) {
+  Caffe::set_random_seed(this->seed_);
+  this->InitActivationNet("");
+  Blob<float> expected;
+  this->ForwardActivationNet(&expected);
+  NetParameter param;
+  this->net_->ToProto(&param);
+  for (int i = 0; i < param.layer_size(); ++i) {
+    if (param.layer(i).name() == "conv1") {
+      param.mutable_layer(i)->set_half_top(true);
+    }
+  }
+  this->net_.reset(new Net<float>(param));
+  // conv1 is read up to the Eltwise layer, through a split.
+  const Blob<float>* conv1 = this->net_->blob_by_name("conv1").get();
+  const vector<string>& layer_names = this->net_->layer_names();
+  const int sum_id =
+      std::find(layer_names.begin(), layer_names.end(), "sum") -
+      layer_names.begin();
+  for (int pass = 0; pass < 2; ++pass) {
+    this->net_->ForwardTo(sum_id - 1);
+    EXPECT_FALSE(conv1->data_at_half());
+    Blob<float> output;
+    this->ForwardActivationNet(&output);
+    EXPECT_TRUE(conv1->data_at_half());
+    EXPECT_FALSE(this->net_->blob_by_name("conv4")->data_at_half());
+    ASSERT_EQ(expected.count(), output.count());
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], output.cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(NetTest, TestAllInOneNetDeploy) {
   vector<string> stages;
   stages.push_back("deploy");
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/nms.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class NMSTest : public ::testing::Test {
+ protected:
+  NMSTest() : num_boxes_(150), boxes_(num_boxes_ * 5) {
+    Caffe::set_random_seed(1701);
+    vector<Dtype> coords(num_boxes_ * 4);
+    caffe_rng_uniform(num_boxes_ * 4, Dtype(0), Dtype(100), &coords[0]);
+    for (int i = 0; i < num_boxes_; ++i) {
+      // [x1, y1, x2, y2, score] in pixels, sorted by decreasing score.
+      // Some boxes get a negative extent.
+      const Dtype* c = &coords[i * 4];
+      Dtype* box = &boxes_[i * 5];
+      box[0] = c[0] * 4;
+      box[1] = c[1] * 4;
+      box[2] = box[0] + c[2] - 5;
+      box[3] = box[1] + c[3] - 5;
+      box[4] = num_boxes_ - i;
+    }
+  }
+
+  // Overlap of two boxes as computed by the original scalar nms_cpu.
+  static Dtype ReferenceIoU(const Dtype A[], const Dtype B[]) {
+    if (A[0] > B[2] || A[1] > B[3] || A[2] < B[0] || A[3] < B[1]) {
+      return 0;
+    }
+    const Dtype width = std::max(Dtype(0),
+        std::min(A[2], B[2]) - std::max(A[0], B[0]) + Dtype(1));
+    const Dtype height = std::max(Dtype(0),
+        std::min(A[3], B[3]) - std::max(A[1], B[1]) + Dtype(1));
+    const Dtype area = width * height;
+    const Dtype A_area = (A[2] - A[0] + Dtype(1)) * (A[3] - A[1] + Dtype(1));
+    const Dtype B_area = (B[2] - B[0] + Dtype(1)) * (B[3] - B[1] + Dtype(1));
+    return area / (A_area + B_area - area);
+  }
+
+  void ReferenceNMS(const Dtype nms_thresh, const int max_num_out,
+      vector<int>* index_out) {
+    vector<bool> is_dead(num_boxes_, false);
+    index_out->clear();
+    for (int i = 0; i < num_boxes_; ++i) {
+      if (is_dead[i]) {
+        continue;
+      }
+      index_out->push_back(i);
+      if (index_out->size() == max_num_out) {
+        break;
+      }
+      for (int j = i + 1; j < num_boxes_; ++j) {
+        if (!is_dead[j] &&
+            ReferenceIoU(&boxes_[i * 5], &boxes_[j * 5]) > nms_thresh) {
+          is_dead[j] = true;
+        }
+      }
+    }
+  }
+
+  const int num_boxes_;
+  vector<Dtype> boxes_;
+};
+
+TYPED_TEST_CASE(NMSTest, TestDtypes);
+
+TYPED_TEST(NMSTest, TestIoUBlock) {
+  typedef TypeParam Dtype;
+  const int n = this->num_boxes_ - 1;
+  vector<Dtype> x1(n), y1(n), x2(n), y2(n), areas(n), ious(n);
+  for (int j = 0; j < n; ++j) {
+    const Dtype* box = &this->boxes_[(j + 1) * 5];
+    x1[j] = box[0];
+    y1[j] = box[1];
+    x2[j] = box[2];
+    y2[j] = box[3];
+    areas[j] = (x2[j] - x1[j] + 1) * (y2[j] - y1[j] + 1);
+  }
+  const Dtype* box = &this->boxes_[0];
+  const Dtype box_area = (box[2] - box[0] + 1) * (box[3] - box[1] + 1);
+  iou_block(box, box_area, n, &x1[0], &y1[0], &x2[0], &y2[0], &areas[0],
+            Dtype(1), &ious[0]);
+  for (int j = 0; j < n; ++j) {
+    EXPECT_EQ(this->ReferenceIoU(box, &this->boxes_[(j + 1) * 5]), ious[j]);
+  }
+}
+
+TYPED_TEST(NMSTest, TestNMSMatchesReference) {
+  typedef TypeParam Dtype;
+  const Dtype thresholds[] = {0.1, 0.3, 0.7};
+  const int max_num_outs[] = {this->num_boxes_, 20};
+  for (int t = 0; t < 3; ++t) {
+    for (int m = 0; m < 2; ++m) {
+      vector<int> expected;
+      this->ReferenceNMS(thresholds[t], max_num_outs[m], &expected);
+      vector<int> index_out(this->num_boxes_);
+      int num_out = -1;
+      nms_cpu(this->num_boxes_, &this->boxes_[0], &index_out[0], &num_out, 0,
+              thresholds[t], max_num_outs[m]);
+      ASSERT_EQ(expected.size(), num_out);
+      for (int i = 0; i < num_out; ++i) {
+        EXPECT_EQ(expected[i], index_out[i]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(NMSTest, TestNMSEmpty) {
+  typedef TypeParam Dtype;
+  int index_out[1];
+  int num_out = -1;
+  nms_cpu(0, static_cast<const Dtype*>(NULL), index_out, &num_out, 0,
+          Dtype(0.5), 10);
+  EXPECT_EQ(0, num_out);
+}
+
+}  // namespace caffe
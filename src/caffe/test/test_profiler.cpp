@@ -0,0 +1,152 @@
+#include <boost/thread.hpp>
+
+#include <fstream>  // NOLINT(readability/streams)
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/split_layer.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/profiler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class ProfilerTest : public ::testing::Test {
+ protected:
+  ProfilerTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 6, 4)),
+        blob_top_(new Blob<Dtype>()) {
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~ProfilerTest() { delete blob_bottom_; delete blob_top_; }
+
+  static string ReadFile(const string& filename) {
+    std::ifstream input(filename.c_str());
+    std::stringstream contents;
+    contents << input.rdbuf();
+    return contents.str();
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(ProfilerTest, TestDtypes);
+
+TYPED_TEST(ProfilerTest, TestConvolutionCost) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  // 2 x 4 x 4 x 2 outputs of 3 x 3 x 3 multiply-adds and a bias each.
+  const LayerCost cost = EstimateForwardCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(cost.flops, 64 * (2 * 27 + 1));
+  EXPECT_EQ(cost.bytes_read, (144 + 4 * 27 + 4) * sizeof(TypeParam));
+  EXPECT_EQ(cost.bytes_written, 64 * sizeof(TypeParam));
+  EXPECT_EQ(cost.intensity(), cost.flops / (320 * sizeof(TypeParam)));
+}
+
+TYPED_TEST(ProfilerTest, TestInnerProductCost) {
+  LayerParameter layer_param;
+  InnerProductParameter* inner_product_param =
+      layer_param.mutable_inner_product_param();
+  inner_product_param->set_num_output(10);
+  inner_product_param->set_bias_term(false);
+  InnerProductLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const LayerCost cost = EstimateForwardCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(cost.flops, 2 * 20 * 72);
+  EXPECT_EQ(cost.bytes_read, (144 + 720) * sizeof(TypeParam));
+  EXPECT_EQ(cost.bytes_written, 20 * sizeof(TypeParam));
+}
+
+TYPED_TEST(ProfilerTest, TestSplitCost) {
+  LayerParameter layer_param;
+  SplitLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  const LayerCost cost = EstimateForwardCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+  EXPECT_EQ(cost.flops, 0);
+  EXPECT_EQ(cost.bytes(), 0);
+}
+
+void RecordEvent(const string& name) {
+  Profiler::Global().SetThreadName(name + " thread");
+  ProfileScope scope(name, "test");
+}
+
+TYPED_TEST(ProfilerTest, TestChromeTrace) {
+  Profiler& profiler = Profiler::Global();
+  profiler.Clear();
+  RecordEvent("dropped");
+  EXPECT_EQ(profiler.num_events(), 0);
+  profiler.Enable(true);
+  RecordEvent("main");
+  boost::thread thread(RecordEvent, "worker");
+  thread.join();
+  profiler.AddEvent("quoted \"name\"", "test", profiler.Now(), 1);
+  profiler.Enable(false);
+  EXPECT_EQ(profiler.num_events(), 3);
+  string filename;
+  MakeTempFilename(&filename);
+  profiler.WriteChromeTrace(filename);
+  profiler.Clear();
+  const string trace = this->ReadFile(filename);
+  EXPECT_NE(trace.find("\"traceEvents\""), string::npos);
+  EXPECT_NE(trace.find("{\"name\": \"main\", \"cat\": \"test\", "
+      "\"ph\": \"X\""), string::npos);
+  EXPECT_NE(trace.find("{\"name\": \"worker\""), string::npos);
+  EXPECT_NE(trace.find("\"args\": {\"name\": \"worker thread\"}"),
+      string::npos);
+  EXPECT_NE(trace.find("\"quoted \\\"name\\\"\""), string::npos);
+  EXPECT_EQ(trace.find("dropped\""), string::npos);
+}
+
+TYPED_TEST(ProfilerTest, TestLayerProfiles) {
+  vector<LayerProfile> layers(2);
+  layers[0].name = "fast";
+  layers[0].forward_ms = 1;
+  layers[0].cost.flops = 1e6;
+  layers[0].cost.bytes_read = 1e6;
+  layers[1].name = "slow";
+  layers[1].forward_ms = 2;
+  layers[1].cost.flops = 1e9;
+  layers[1].cost.bytes_read = 1e6;
+  EXPECT_EQ(layers[1].gflops_per_second(), 500);
+  string filename;
+  MakeTempFilename(&filename);
+  WriteLayerProfiles(layers, 100, 10, filename);
+  const string report = this->ReadFile(filename);
+  // The slow layer comes first; it is compute bound at 1000 FLOP/byte,
+  // while 1 FLOP/byte at 10 GB/s bounds the fast one to 10 GFLOP/s.
+  const size_t slow = report.find("{\"name\": \"slow\"");
+  const size_t fast = report.find("{\"name\": \"fast\"");
+  ASSERT_NE(slow, string::npos);
+  ASSERT_NE(fast, string::npos);
+  EXPECT_LT(slow, fast);
+  EXPECT_NE(report.find("\"roofline_gflops\": 100, \"bound\": \"compute\""),
+      string::npos);
+  EXPECT_NE(report.find("\"roofline_gflops\": 10, \"bound\": \"memory\""),
+      string::npos);
+  EXPECT_NE(report.find("\"forward_ms\": 3,"), string::npos);
+}
+
+}  // namespace caffe
@@ -0,0 +1,157 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/psroi_pooling_layer.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class PSROIPoolingLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  PSROIPoolingLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(2, 8, 6, 6)),
+        blob_bottom_rois_(new Blob<Dtype>(4, 5, 1, 1)),
+        blob_top_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    filler_param.set_std(1);
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_bottom_data_);
+    // [batch_index x1 y1 x2 y2]
+    const Dtype rois[] = {
+      0, 0, 0, 3, 3,     // 4x4 window: 2x2 bins of 2x2
+      1, 0, 0, 5, 5,     // the whole map: 2x2 bins of 3x3
+      1, 1.2, 2, 4, 3,   // rounded to [1, 4] x [2, 3]
+      0, 10, 10, 12, 12  // outside of the map: empty bins
+    };
+    caffe_copy(blob_bottom_rois_->count(), rois,
+        blob_bottom_rois_->mutable_cpu_data());
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_rois_);
+    blob_top_vec_.push_back(blob_top_);
+    layer_param_.mutable_psroi_pooling_param()->set_spatial_scale(1);
+    layer_param_.mutable_psroi_pooling_param()->set_output_dim(2);
+    layer_param_.mutable_psroi_pooling_param()->set_group_size(2);
+  }
+  virtual ~PSROIPoolingLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_rois_;
+    delete blob_top_;
+  }
+
+  // Average of channel c of image n over [hstart, hend) x [wstart, wend).
+  Dtype Average(int n, int c, int hstart, int hend, int wstart, int wend) {
+    Dtype sum = 0;
+    for (int h = hstart; h < hend; ++h) {
+      for (int w = wstart; w < wend; ++w) {
+        sum += blob_bottom_data_->data_at(n, c, h, w);
+      }
+    }
+    return sum / ((hend - hstart) * (wend - wstart));
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_rois_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  LayerParameter layer_param_;
+};
+
+TYPED_TEST_CASE(PSROIPoolingLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(PSROIPoolingLayerTest, TestSetup) {
+  typedef typename TypeParam::Dtype Dtype;
+  PSROIPoolingLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->num(), 4);
+  EXPECT_EQ(this->blob_top_->channels(), 2);
+  EXPECT_EQ(this->blob_top_->height(), 2);
+  EXPECT_EQ(this->blob_top_->width(), 2);
+}
+
+TYPED_TEST(PSROIPoolingLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  PSROIPoolingLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  const Dtype kEps = 1e-5;
+  for (int ctop = 0; ctop < 2; ++ctop) {
+    for (int ph = 0; ph < 2; ++ph) {
+      for (int pw = 0; pw < 2; ++pw) {
+        // Bin (ph, pw) of output channel ctop reads its own input channel.
+        const int c = (ctop * 2 + ph) * 2 + pw;
+        EXPECT_NEAR(this->blob_top_->data_at(0, ctop, ph, pw),
+            this->Average(0, c, 2 * ph, 2 * ph + 2, 2 * pw, 2 * pw + 2),
+            kEps);
+        EXPECT_NEAR(this->blob_top_->data_at(1, ctop, ph, pw),
+            this->Average(1, c, 3 * ph, 3 * ph + 3, 3 * pw, 3 * pw + 3),
+            kEps);
+        // A 4x2 window split in 2x1 bins.
+        EXPECT_NEAR(this->blob_top_->data_at(2, ctop, ph, pw),
+            this->Average(1, c, 2 + ph, 3 + ph, 1 + 2 * pw, 3 + 2 * pw),
+            kEps);
+        EXPECT_EQ(this->blob_top_->data_at(3, ctop, ph, pw), 0);
+      }
+    }
+  }
+}
+
+TYPED_TEST(PSROIPoolingLayerTest, TestGradient) {
+  typedef typename TypeParam::Dtype Dtype;
+  PSROIPoolingLayer<Dtype> layer(this->layer_param_);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, 0);
+}
+
+TYPED_TEST(PSROIPoolingLayerTest, TestThreadCount) {
+  typedef typename TypeParam::Dtype Dtype;
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  // Overlapping ROIs accumulate into the same bottom diff.
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> top_diff(4, 2, 2, 2);
+  filler.Fill(&top_diff);
+  vector<bool> propagate_down(2, false);
+  propagate_down[0] = true;
+  vector<shared_ptr<Blob<Dtype> > > top(2), bottom_diff(2);
+  const int global_threads = ThreadPool::Global().num_threads();
+  for (int i = 0; i < 2; ++i) {
+    ThreadPool::SetGlobalThreads(i ? 3 : 1);
+    PSROIPoolingLayer<Dtype> layer(this->layer_param_);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_copy(top_diff.count(), top_diff.cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    top[i].reset(new Blob<Dtype>());
+    top[i]->CopyFrom(*this->blob_top_, false, true);
+    bottom_diff[i].reset(new Blob<Dtype>());
+    bottom_diff[i]->CopyFrom(*this->blob_bottom_data_, true, true);
+  }
+  ThreadPool::SetGlobalThreads(global_threads);
+  for (int j = 0; j < top[0]->count(); ++j) {
+    EXPECT_EQ(top[0]->cpu_data()[j], top[1]->cpu_data()[j]);
+  }
+  for (int j = 0; j < bottom_diff[0]->count(); ++j) {
+    EXPECT_EQ(bottom_diff[0]->cpu_data()[j], bottom_diff[1]->cpu_data()[j]);
+  }
+}
+
+}  // namespace caffe
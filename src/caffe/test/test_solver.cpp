@@ -6,6 +6,7 @@
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
+#include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/solver.hpp"
@@ -38,6 +39,116 @@ class SolverTest : public MultiDeviceTest<TypeParam> {
     solver_.reset(new SGDSolver<Dtype>(param));
   }
 
+  // Tests a folding test net on the weights of the net being trained, and
+  // checks it against an unfolded net sharing them.
+  void CheckFoldedTestNet(const string& test_options) {
+    const string& proto =
+       "base_lr: 0 "
+       "lr_policy: 'fixed' "
+       "test_interval: 1 "
+       "test_iter: 1 " + test_options +
+       "net_param { "
+       "  name: 'TestNetwork' "
+       "  fold_batch_norm: true "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'DummyData' "
+       "    dummy_data_param { "
+       "      shape { "
+       "        dim: 5 "
+       "        dim: 2 "
+       "        dim: 3 "
+       "        dim: 4 "
+       "      } "
+       "      shape { "
+       "        dim: 5 "
+       "      } "
+       "      data_filler { "
+       "        type: 'gaussian' "
+       "      } "
+       "      data_filler { "
+       "        type: 'constant' "
+       "      } "
+       "    } "
+       "    top: 'data' "
+       "    top: 'label' "
+       "  } "
+       "  layer { "
+       "    name: 'innerprod' "
+       "    type: 'InnerProduct' "
+       "    inner_product_param { "
+       "      num_output: 10 "
+       "      bias_term: false "
+       "      weight_filler { "
+       "        type: 'gaussian' "
+       "      } "
+       "    } "
+       "    bottom: 'data' "
+       "    top: 'innerprod' "
+       "  } "
+       "  layer { "
+       "    name: 'bn' "
+       "    type: 'BatchNorm' "
+       "    batch_norm_param { "
+       "      use_global_stats: true "
+       "    } "
+       "    bottom: 'innerprod' "
+       "    top: 'innerprod' "
+       "  } "
+       "  layer { "
+       "    name: 'scale' "
+       "    type: 'Scale' "
+       "    scale_param { "
+       "      bias_term: true "
+       "    } "
+       "    bottom: 'innerprod' "
+       "    top: 'innerprod' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'SoftmaxWithLoss' "
+       "    bottom: 'innerprod' "
+       "    bottom: 'label' "
+       "  } "
+       "} ";
+    this->InitSolverFromProtoString(proto);
+    Net<Dtype>* train_net = this->solver_->net().get();
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<Dtype> positive_filler(filler_param);
+    const vector<shared_ptr<Blob<Dtype> > >& bn =
+        train_net->layer_by_name("bn")->blobs();
+    filler.Fill(bn[0].get());
+    positive_filler.Fill(bn[1].get());
+    bn[2]->mutable_cpu_data()[0] = 1;
+    filler.Fill(train_net->layer_by_name("scale")->blobs()[0].get());
+    filler.Fill(train_net->layer_by_name("scale")->blobs()[1].get());
+    this->solver_->Step(1);
+    this->solver_->WaitForTest();
+    Net<Dtype>* test_net = this->solver_->test_nets()[0].get();
+    EXPECT_FALSE(test_net->has_layer("bn"));
+    EXPECT_FALSE(test_net->has_layer("scale"));
+    NetParameter reference_param(this->solver_->param().net_param());
+    reference_param.set_fold_batch_norm(false);
+    reference_param.mutable_state()->set_phase(TEST);
+    Net<Dtype> reference(reference_param);
+    reference.ShareTrainedLayersWith(train_net);
+    Blob<Dtype> data(5, 2, 3, 4);
+    filler.Fill(&data);
+    test_net->blob_by_name("data")->CopyFrom(data);
+    test_net->ForwardFrom(1);
+    reference.blob_by_name("data")->CopyFrom(data);
+    reference.ForwardFrom(1);
+    const Blob<Dtype>* output = test_net->blob_by_name("innerprod").get();
+    const Blob<Dtype>* expected = reference.blob_by_name("innerprod").get();
+    ASSERT_EQ(expected->count(), output->count());
+    for (int i = 0; i < expected->count(); ++i) {
+      EXPECT_NEAR(expected->cpu_data()[i], output->cpu_data()[i], 1e-4);
+    }
+  }
+
   shared_ptr<Solver<Dtype> > solver_;
 };
 
@@ -106,4 +217,84 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestAsyncTestingCopiesWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "base_lr: 0.1 "
+     "lr_policy: 'fixed' "
+     "test_interval: 1 "
+     "test_iter: 2 "
+     "test_async: true "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { "
+     "        dim: 5 "
+     "        dim: 2 "
+     "        dim: 3 "
+     "        dim: 4 "
+     "      } "
+     "      shape { "
+     "        dim: 5 "
+     "      } "
+     "      data_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "      data_filler { "
+     "        type: 'constant' "
+     "      } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 10 "
+     "      weight_filler { "
+     "        type: 'gaussian' "
+     "      } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  const Blob<Dtype>* train_weights =
+      this->solver_->net()->layer_by_name("innerprod")->blobs()[0].get();
+  // The test pass at iteration 0 runs on these weights while the solver
+  // updates them.
+  Blob<Dtype> weights;
+  weights.CopyFrom(*train_weights, false, true);
+  this->solver_->Step(1);
+  this->solver_->WaitForTest();
+  const Blob<Dtype>* test_weights = this->solver_->test_nets()[0]->
+      layer_by_name("innerprod")->blobs()[0].get();
+  EXPECT_NE(train_weights->cpu_data(), test_weights->cpu_data());
+  bool updated = false;
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_EQ(weights.cpu_data()[i], test_weights->cpu_data()[i]);
+    updated |= weights.cpu_data()[i] != train_weights->cpu_data()[i];
+  }
+  EXPECT_TRUE(updated);
+}
+
+TYPED_TEST(SolverTest, TestFoldedTestNet) {
+  this->CheckFoldedTestNet("");
+}
+
+TYPED_TEST(SolverTest, TestFoldedTestNetAsync) {
+  this->CheckFoldedTestNet("test_async: true ");
+}
+
 }  // namespace caffe
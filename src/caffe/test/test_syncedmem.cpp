@@ -67,6 +67,66 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestVersion) {
+  SyncedMemory mem(10);
+  const int version = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), version);
+  mem.mutable_cpu_data();
+  EXPECT_GT(mem.version(), version);
+  const int written_version = mem.version();
+  mem.cpu_data();
+  EXPECT_EQ(mem.version(), written_version);
+  char data[10];
+  mem.set_cpu_data(data);
+  EXPECT_GT(mem.version(), written_version);
+}
+
+TEST_F(SyncedMemoryTest, TestCompactToHalf) {
+  SyncedMemory mem(4 * sizeof(float));
+  float* cpu_data = static_cast<float*>(mem.mutable_cpu_data());
+  for (int i = 0; i < 4; ++i) {
+    cpu_data[i] = 1 + i * 0.25;
+  }
+  mem.compact_to_half();
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_HALF);
+  const uint16_t* half_data = mem.half_data();
+  EXPECT_EQ(half_data[0], 0x3c00);
+  EXPECT_EQ(half_data[1], 0x3d00);
+  // Reading widens the data again and frees the half precision copy.
+  const float* widened = static_cast<const float*>(mem.cpu_data());
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_CPU);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(widened[i], 1 + i * 0.25);
+  }
+  half_data = mem.half_data();
+  EXPECT_EQ(half_data[1], 0x3d00);
+  // Which is kept while the data is only read.
+  mem.cpu_data();
+  EXPECT_EQ(mem.half_data(), half_data);
+  // Writing makes the next half_data() convert again.
+  static_cast<float*>(mem.mutable_cpu_data())[0] = 2;
+  EXPECT_EQ(mem.half_data()[0], 0x4000);
+}
+
+TEST_F(SyncedMemoryTest, TestDiscardHalf) {
+  SyncedMemory mem(4 * sizeof(float));
+  caffe_set(4, 1.f, static_cast<float*>(mem.mutable_cpu_data()));
+  // Data at full precision is kept.
+  mem.discard_half();
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_CPU);
+  mem.compact_to_half();
+  const int version = mem.version();
+  mem.discard_half();
+  EXPECT_EQ(mem.head(), SyncedMemory::UNINITIALIZED);
+  EXPECT_NE(version, mem.version());
+  // The next access allocates the memory anew.
+  float* cpu_data = static_cast<float*>(mem.mutable_cpu_data());
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_CPU);
+  cpu_data[0] = 2;
+  EXPECT_EQ(mem.half_data()[0], 0x4000);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,52 @@
+#include <boost/bind.hpp>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ public:
+  ThreadPoolTest() : pool_(4), counts_(100, 0), threads_(100, -1) {}
+
+  void Count(int offset, int task_id, int thread_id) {
+    ++counts_[offset + task_id];
+    threads_[offset + task_id] = thread_id;
+  }
+
+  void CountNested(int task_id, int thread_id) {
+    pool_.Run(10, boost::bind(&ThreadPoolTest::Count, this, task_id * 10,
+        _1, _2));
+  }
+
+ protected:
+  ThreadPool pool_;
+  vector<int> counts_;
+  vector<int> threads_;
+};
+
+TEST_F(ThreadPoolTest, TestRunsEveryTaskOnce) {
+  EXPECT_EQ(4, pool_.num_threads());
+  for (int iter = 0; iter < 3; ++iter) {
+    pool_.Run(100, boost::bind(&ThreadPoolTest::Count, this, 0, _1, _2));
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(3, counts_[i]);
+    EXPECT_GE(threads_[i], 0);
+    EXPECT_LT(threads_[i], pool_.num_threads());
+  }
+}
+
+TEST_F(ThreadPoolTest, TestNestedRun) {
+  pool_.Run(10, boost::bind(&ThreadPoolTest::CountNested, this, _1, _2));
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(1, counts_[i]);
+  }
+}
+
+}  // namespace caffe
@@ -8,9 +8,12 @@
 #include <utility>
 #include <vector>
 
+#include "boost/bind.hpp"
 #include "boost/iterator/counting_iterator.hpp"
 
 #include "caffe/util/bbox_util.hpp"
+#include "caffe/util/nms.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -723,19 +726,16 @@ void MatchBBox(const vector<NormalizedBBox>& gt_bboxes,
   return;
 }
 
-void FindMatches(const vector<LabelBBox>& all_loc_preds,
+// Finds the matches of image i, as one task of FindMatches.
+static void FindImageMatches(const vector<LabelBBox>& all_loc_preds,
       const map<int, vector<NormalizedBBox> >& all_gt_bboxes,
       const vector<NormalizedBBox>& prior_bboxes,
       const vector<vector<float> >& prior_variances,
       const MultiBoxLossParameter& multibox_loss_param,
-      vector<map<int, vector<float> > >* all_match_overlaps,
-      vector<map<int, vector<int> > >* all_match_indices) {
-  // all_match_overlaps->clear();
-  // all_match_indices->clear();
+      map<int, vector<float> >* all_match_overlaps,
+      map<int, vector<int> >* all_match_indices, int i) {
   // Get parameters.
-  CHECK(multibox_loss_param.has_num_classes()) << "Must provide num_classes.";
   const int num_classes = multibox_loss_param.num_classes();
-  CHECK_GE(num_classes, 1) << "num_classes should not be less than 1.";
   const bool share_location = multibox_loss_param.share_location();
   const int loc_classes = share_location ? 1 : num_classes;
   const MatchType match_type = multibox_loss_param.match_type();
@@ -748,79 +748,101 @@ void FindMatches(const vector<LabelBBox>& all_loc_preds,
       multibox_loss_param.encode_variance_in_target();
   const bool ignore_cross_boundary_bbox =
       multibox_loss_param.ignore_cross_boundary_bbox();
-  // Find the matches.
-  int num = all_loc_preds.size();
-  for (int i = 0; i < num; ++i) {
-    map<int, vector<int> > match_indices;
-    map<int, vector<float> > match_overlaps;
-    // Check if there is ground truth for current image.
-    if (all_gt_bboxes.find(i) == all_gt_bboxes.end()) {
-      // There is no gt for current image. All predictions are negative.
-      all_match_indices->push_back(match_indices);
-      all_match_overlaps->push_back(match_overlaps);
-      continue;
+  map<int, vector<int> >& match_indices = all_match_indices[i];
+  map<int, vector<float> >& match_overlaps = all_match_overlaps[i];
+  // Check if there is ground truth for current image.
+  if (all_gt_bboxes.find(i) == all_gt_bboxes.end()) {
+    // There is no gt for current image. All predictions are negative.
+    return;
+  }
+  // Find match between predictions and ground truth.
+  const vector<NormalizedBBox>& gt_bboxes = all_gt_bboxes.find(i)->second;
+  if (!use_prior_for_matching) {
+    for (int c = 0; c < loc_classes; ++c) {
+      int label = share_location ? -1 : c;
+      if (!share_location && label == background_label_id) {
+        // Ignore background loc predictions.
+        continue;
+      }
+      // Decode the prediction into bbox first.
+      vector<NormalizedBBox> loc_bboxes;
+      bool clip_bbox = false;
+      DecodeBBoxes(prior_bboxes, prior_variances,
+                   code_type, encode_variance_in_target, clip_bbox,
+                   all_loc_preds[i].find(label)->second, &loc_bboxes);
+      MatchBBox(gt_bboxes, loc_bboxes, label, match_type,
+                overlap_threshold, ignore_cross_boundary_bbox,
+                &match_indices[label], &match_overlaps[label]);
     }
-    // Find match between predictions and ground truth.
-    const vector<NormalizedBBox>& gt_bboxes = all_gt_bboxes.find(i)->second;
-    if (!use_prior_for_matching) {
+  } else {
+    // Use prior bboxes to match against all ground truth.
+    vector<int> temp_match_indices;
+    vector<float> temp_match_overlaps;
+    const int label = -1;
+    MatchBBox(gt_bboxes, prior_bboxes, label, match_type, overlap_threshold,
+              ignore_cross_boundary_bbox, &temp_match_indices,
+              &temp_match_overlaps);
+    if (share_location) {
+      match_indices[label] = temp_match_indices;
+      match_overlaps[label] = temp_match_overlaps;
+    } else {
+      // Get ground truth label for each ground truth bbox.
+      vector<int> gt_labels;
+      for (int g = 0; g < gt_bboxes.size(); ++g) {
+        gt_labels.push_back(gt_bboxes[g].label());
+      }
+      // Distribute the matching results to different loc_class.
       for (int c = 0; c < loc_classes; ++c) {
-        int label = share_location ? -1 : c;
-        if (!share_location && label == background_label_id) {
+        if (c == background_label_id) {
           // Ignore background loc predictions.
           continue;
         }
-        // Decode the prediction into bbox first.
-        vector<NormalizedBBox> loc_bboxes;
-        bool clip_bbox = false;
-        DecodeBBoxes(prior_bboxes, prior_variances,
-                     code_type, encode_variance_in_target, clip_bbox,
-                     all_loc_preds[i].find(label)->second, &loc_bboxes);
-        MatchBBox(gt_bboxes, loc_bboxes, label, match_type,
-                  overlap_threshold, ignore_cross_boundary_bbox,
-                  &match_indices[label], &match_overlaps[label]);
-      }
-    } else {
-      // Use prior bboxes to match against all ground truth.
-      vector<int> temp_match_indices;
-      vector<float> temp_match_overlaps;
-      const int label = -1;
-      MatchBBox(gt_bboxes, prior_bboxes, label, match_type, overlap_threshold,
-                ignore_cross_boundary_bbox, &temp_match_indices,
-                &temp_match_overlaps);
-      if (share_location) {
-        match_indices[label] = temp_match_indices;
-        match_overlaps[label] = temp_match_overlaps;
-      } else {
-        // Get ground truth label for each ground truth bbox.
-        vector<int> gt_labels;
-        for (int g = 0; g < gt_bboxes.size(); ++g) {
-          gt_labels.push_back(gt_bboxes[g].label());
-        }
-        // Distribute the matching results to different loc_class.
-        for (int c = 0; c < loc_classes; ++c) {
-          if (c == background_label_id) {
-            // Ignore background loc predictions.
-            continue;
-          }
-          match_indices[c].resize(temp_match_indices.size(), -1);
-          match_overlaps[c] = temp_match_overlaps;
-          for (int m = 0; m < temp_match_indices.size(); ++m) {
-            if (temp_match_indices[m] > -1) {
-              const int gt_idx = temp_match_indices[m];
-              CHECK_LT(gt_idx, gt_labels.size());
-              if (c == gt_labels[gt_idx]) {
-                match_indices[c][m] = gt_idx;
-              }
+        match_indices[c].resize(temp_match_indices.size(), -1);
+        match_overlaps[c] = temp_match_overlaps;
+        for (int m = 0; m < temp_match_indices.size(); ++m) {
+          if (temp_match_indices[m] > -1) {
+            const int gt_idx = temp_match_indices[m];
+            CHECK_LT(gt_idx, gt_labels.size());
+            if (c == gt_labels[gt_idx]) {
+              match_indices[c][m] = gt_idx;
             }
           }
         }
       }
     }
-    all_match_indices->push_back(match_indices);
-    all_match_overlaps->push_back(match_overlaps);
   }
 }
 
+void FindMatches(const vector<LabelBBox>& all_loc_preds,
+      const map<int, vector<NormalizedBBox> >& all_gt_bboxes,
+      const vector<NormalizedBBox>& prior_bboxes,
+      const vector<vector<float> >& prior_variances,
+      const MultiBoxLossParameter& multibox_loss_param,
+      vector<map<int, vector<float> > >* all_match_overlaps,
+      vector<map<int, vector<int> > >* all_match_indices) {
+  // all_match_overlaps->clear();
+  // all_match_indices->clear();
+  CHECK(multibox_loss_param.has_num_classes()) << "Must provide num_classes.";
+  const int num_classes = multibox_loss_param.num_classes();
+  CHECK_GE(num_classes, 1) << "num_classes should not be less than 1.";
+  // Find the matches. Images are matched in parallel, each one into its own
+  // slot, so the results keep the image order.
+  int num = all_loc_preds.size();
+  const int overlaps_offset = all_match_overlaps->size();
+  const int indices_offset = all_match_indices->size();
+  all_match_overlaps->resize(overlaps_offset + num);
+  all_match_indices->resize(indices_offset + num);
+  if (num == 0) {
+    return;
+  }
+  ThreadPool::Global().Run(num, boost::bind(&FindImageMatches,
+      boost::cref(all_loc_preds), boost::cref(all_gt_bboxes),
+      boost::cref(prior_bboxes), boost::cref(prior_variances),
+      boost::cref(multibox_loss_param),
+      &(*all_match_overlaps)[overlaps_offset],
+      &(*all_match_indices)[indices_offset], _1));
+}
+
 int CountNumMatches(const vector<map<int, vector<int> > >& all_match_indices,
                     const int num) {
   int num_matches = 0;
@@ -850,6 +872,127 @@ inline bool IsEligibleMining(const MiningType mining_type, const int match_idx,
   }
 }
 
+// Selects the negatives (and hard positives) of image i, as one task of
+// MineHardExamples.
+static void MineImageHardExamples(
+    const MultiBoxLossParameter& multibox_loss_param,
+    const vector<LabelBBox>& all_loc_preds,
+    const vector<NormalizedBBox>& prior_bboxes,
+    const vector<vector<float> >& prior_variances,
+    const vector<map<int, vector<float> > >& all_match_overlaps,
+    const vector<vector<float> >& all_loss,
+    vector<map<int, vector<int> > >* all_match_indices,
+    vector<int>* all_neg_indices, int i) {
+  // Get parameters.
+  const bool use_prior_for_nms = multibox_loss_param.use_prior_for_nms();
+  const MiningType mining_type = multibox_loss_param.mining_type();
+  const float neg_pos_ratio = multibox_loss_param.neg_pos_ratio();
+  const float neg_overlap = multibox_loss_param.neg_overlap();
+  const CodeType code_type = multibox_loss_param.code_type();
+  const bool encode_variance_in_target =
+      multibox_loss_param.encode_variance_in_target();
+  const bool has_nms_param = multibox_loss_param.has_nms_param();
+  float nms_threshold = 0;
+  int top_k = -1;
+  if (has_nms_param) {
+    nms_threshold = multibox_loss_param.nms_param().nms_threshold();
+    top_k = multibox_loss_param.nms_param().top_k();
+  }
+  const int sample_size = multibox_loss_param.sample_size();
+  map<int, vector<int> >& match_indices = (*all_match_indices)[i];
+  const map<int, vector<float> >& match_overlaps = all_match_overlaps[i];
+  const vector<float>& loss = all_loss[i];
+  // Pick negatives or hard examples based on loss.
+  set<int> sel_indices;
+  vector<int>& neg_indices = all_neg_indices[i];
+  for (map<int, vector<int> >::iterator it = match_indices.begin();
+       it != match_indices.end(); ++it) {
+    const int label = it->first;
+    int num_sel = 0;
+    // Get potential indices and loss pairs.
+    vector<pair<float, int> > loss_indices;
+    for (int m = 0; m < match_indices[label].size(); ++m) {
+      if (IsEligibleMining(mining_type, match_indices[label][m],
+          match_overlaps.find(label)->second[m], neg_overlap)) {
+        loss_indices.push_back(std::make_pair(loss[m], m));
+        ++num_sel;
+      }
+    }
+    if (mining_type == MultiBoxLossParameter_MiningType_MAX_NEGATIVE) {
+      int num_pos = 0;
+      for (int m = 0; m < match_indices[label].size(); ++m) {
+        if (match_indices[label][m] > -1) {
+          ++num_pos;
+        }
+      }
+      num_sel = std::min(static_cast<int>(num_pos * neg_pos_ratio), num_sel);
+    } else if (mining_type == MultiBoxLossParameter_MiningType_HARD_EXAMPLE) {
+      CHECK_GT(sample_size, 0);
+      num_sel = std::min(sample_size, num_sel);
+    }
+    // Select samples.
+    if (has_nms_param && nms_threshold > 0) {
+      // Do nms before selecting samples.
+      vector<float> sel_loss;
+      vector<NormalizedBBox> sel_bboxes;
+      if (use_prior_for_nms) {
+        for (int m = 0; m < match_indices[label].size(); ++m) {
+          if (IsEligibleMining(mining_type, match_indices[label][m],
+              match_overlaps.find(label)->second[m], neg_overlap)) {
+            sel_loss.push_back(loss[m]);
+            sel_bboxes.push_back(prior_bboxes[m]);
+          }
+        }
+      } else {
+        // Decode the prediction into bbox first.
+        vector<NormalizedBBox> loc_bboxes;
+        bool clip_bbox = false;
+        DecodeBBoxes(prior_bboxes, prior_variances,
+                     code_type, encode_variance_in_target, clip_bbox,
+                     all_loc_preds[i].find(label)->second, &loc_bboxes);
+        for (int m = 0; m < match_indices[label].size(); ++m) {
+          if (IsEligibleMining(mining_type, match_indices[label][m],
+              match_overlaps.find(label)->second[m], neg_overlap)) {
+            sel_loss.push_back(loss[m]);
+            sel_bboxes.push_back(loc_bboxes[m]);
+          }
+        }
+      }
+      // Do non-maximum suppression based on the loss.
+      vector<int> nms_indices;
+      ApplyNMS(sel_bboxes, sel_loss, nms_threshold, top_k, &nms_indices);
+      if (nms_indices.size() < num_sel) {
+        LOG(INFO) << "not enough sample after nms: " << nms_indices.size();
+      }
+      // Pick top example indices after nms.
+      num_sel = std::min(static_cast<int>(nms_indices.size()), num_sel);
+      for (int n = 0; n < num_sel; ++n) {
+        sel_indices.insert(loss_indices[nms_indices[n]].second);
+      }
+    } else {
+      // Pick top example indices based on loss.
+      std::sort(loss_indices.begin(), loss_indices.end(),
+                SortScorePairDescend<int>);
+      for (int n = 0; n < num_sel; ++n) {
+        sel_indices.insert(loss_indices[n].second);
+      }
+    }
+    // Update the match_indices and select neg_indices.
+    for (int m = 0; m < match_indices[label].size(); ++m) {
+      if (match_indices[label][m] > -1) {
+        if (mining_type == MultiBoxLossParameter_MiningType_HARD_EXAMPLE &&
+            sel_indices.find(m) == sel_indices.end()) {
+          match_indices[label][m] = -1;
+        }
+      } else if (match_indices[label][m] == -1) {
+        if (sel_indices.find(m) != sel_indices.end()) {
+          neg_indices.push_back(m);
+        }
+      }
+    }
+  }
+}
+
 template <typename Dtype>
 void MineHardExamples(const Blob<Dtype>& conf_blob,
     const vector<LabelBBox>& all_loc_preds,
@@ -874,26 +1017,12 @@ void MineHardExamples(const Blob<Dtype>& conf_blob,
   const int num_classes = multibox_loss_param.num_classes();
   CHECK_GE(num_classes, 1) << "num_classes should not be less than 1.";
   const int background_label_id = multibox_loss_param.background_label_id();
-  const bool use_prior_for_nms = multibox_loss_param.use_prior_for_nms();
   const ConfLossType conf_loss_type = multibox_loss_param.conf_loss_type();
   const MiningType mining_type = multibox_loss_param.mining_type();
   if (mining_type == MultiBoxLossParameter_MiningType_NONE) {
     return;
   }
   const LocLossType loc_loss_type = multibox_loss_param.loc_loss_type();
-  const float neg_pos_ratio = multibox_loss_param.neg_pos_ratio();
-  const float neg_overlap = multibox_loss_param.neg_overlap();
-  const CodeType code_type = multibox_loss_param.code_type();
-  const bool encode_variance_in_target =
-      multibox_loss_param.encode_variance_in_target();
-  const bool has_nms_param = multibox_loss_param.has_nms_param();
-  float nms_threshold = 0;
-  int top_k = -1;
-  if (has_nms_param) {
-    nms_threshold = multibox_loss_param.nms_param().nms_threshold();
-    top_k = multibox_loss_param.nms_param().top_k();
-  }
-  const int sample_size = multibox_loss_param.sample_size();
   // Compute confidence losses based on matching results.
   vector<vector<float> > all_conf_loss;
 #ifdef CPU_ONLY
@@ -929,107 +1058,28 @@ void MineHardExamples(const Blob<Dtype>& conf_blob,
       all_loc_loss.push_back(loc_loss);
     }
   }
+  // Pick the examples of every image in parallel. Each image only updates
+  // its own matches and negatives, so the counts are summed afterwards.
+  vector<vector<float> > all_loss(num);
   for (int i = 0; i < num; ++i) {
-    map<int, vector<int> >& match_indices = (*all_match_indices)[i];
-    const map<int, vector<float> >& match_overlaps = all_match_overlaps[i];
     // loc + conf loss.
-    const vector<float>& conf_loss = all_conf_loss[i];
-    const vector<float>& loc_loss = all_loc_loss[i];
-    vector<float> loss;
-    std::transform(conf_loss.begin(), conf_loss.end(), loc_loss.begin(),
-                   std::back_inserter(loss), std::plus<float>());
-    // Pick negatives or hard examples based on loss.
-    set<int> sel_indices;
-    vector<int> neg_indices;
-    for (map<int, vector<int> >::iterator it = match_indices.begin();
-         it != match_indices.end(); ++it) {
-      const int label = it->first;
-      int num_sel = 0;
-      // Get potential indices and loss pairs.
-      vector<pair<float, int> > loss_indices;
-      for (int m = 0; m < match_indices[label].size(); ++m) {
-        if (IsEligibleMining(mining_type, match_indices[label][m],
-            match_overlaps.find(label)->second[m], neg_overlap)) {
-          loss_indices.push_back(std::make_pair(loss[m], m));
-          ++num_sel;
-        }
-      }
-      if (mining_type == MultiBoxLossParameter_MiningType_MAX_NEGATIVE) {
-        int num_pos = 0;
-        for (int m = 0; m < match_indices[label].size(); ++m) {
-          if (match_indices[label][m] > -1) {
-            ++num_pos;
-          }
-        }
-        num_sel = std::min(static_cast<int>(num_pos * neg_pos_ratio), num_sel);
-      } else if (mining_type == MultiBoxLossParameter_MiningType_HARD_EXAMPLE) {
-        CHECK_GT(sample_size, 0);
-        num_sel = std::min(sample_size, num_sel);
-      }
-      // Select samples.
-      if (has_nms_param && nms_threshold > 0) {
-        // Do nms before selecting samples.
-        vector<float> sel_loss;
-        vector<NormalizedBBox> sel_bboxes;
-        if (use_prior_for_nms) {
-          for (int m = 0; m < match_indices[label].size(); ++m) {
-            if (IsEligibleMining(mining_type, match_indices[label][m],
-                match_overlaps.find(label)->second[m], neg_overlap)) {
-              sel_loss.push_back(loss[m]);
-              sel_bboxes.push_back(prior_bboxes[m]);
-            }
-          }
-        } else {
-          // Decode the prediction into bbox first.
-          vector<NormalizedBBox> loc_bboxes;
-          bool clip_bbox = false;
-          DecodeBBoxes(prior_bboxes, prior_variances,
-                       code_type, encode_variance_in_target, clip_bbox,
-                       all_loc_preds[i].find(label)->second, &loc_bboxes);
-          for (int m = 0; m < match_indices[label].size(); ++m) {
-            if (IsEligibleMining(mining_type, match_indices[label][m],
-                match_overlaps.find(label)->second[m], neg_overlap)) {
-              sel_loss.push_back(loss[m]);
-              sel_bboxes.push_back(loc_bboxes[m]);
-            }
-          }
-        }
-        // Do non-maximum suppression based on the loss.
-        vector<int> nms_indices;
-        ApplyNMS(sel_bboxes, sel_loss, nms_threshold, top_k, &nms_indices);
-        if (nms_indices.size() < num_sel) {
-          LOG(INFO) << "not enough sample after nms: " << nms_indices.size();
-        }
-        // Pick top example indices after nms.
-        num_sel = std::min(static_cast<int>(nms_indices.size()), num_sel);
-        for (int n = 0; n < num_sel; ++n) {
-          sel_indices.insert(loss_indices[nms_indices[n]].second);
-        }
-      } else {
-        // Pick top example indices based on loss.
-        std::sort(loss_indices.begin(), loss_indices.end(),
-                  SortScorePairDescend<int>);
-        for (int n = 0; n < num_sel; ++n) {
-          sel_indices.insert(loss_indices[n].second);
-        }
-      }
-      // Update the match_indices and select neg_indices.
-      for (int m = 0; m < match_indices[label].size(); ++m) {
-        if (match_indices[label][m] > -1) {
-          if (mining_type == MultiBoxLossParameter_MiningType_HARD_EXAMPLE &&
-              sel_indices.find(m) == sel_indices.end()) {
-            match_indices[label][m] = -1;
-            *num_matches -= 1;
-          }
-        } else if (match_indices[label][m] == -1) {
-          if (sel_indices.find(m) != sel_indices.end()) {
-            neg_indices.push_back(m);
-            *num_negs += 1;
-          }
-        }
-      }
-    }
-    all_neg_indices->push_back(neg_indices);
+    std::transform(all_conf_loss[i].begin(), all_conf_loss[i].end(),
+                   all_loc_loss[i].begin(), std::back_inserter(all_loss[i]),
+                   std::plus<float>());
+  }
+  const int neg_offset = all_neg_indices->size();
+  all_neg_indices->resize(neg_offset + num);
+  if (num == 0) {
+    return;
+  }
+  ThreadPool::Global().Run(num, boost::bind(&MineImageHardExamples,
+      boost::cref(multibox_loss_param), boost::cref(all_loc_preds),
+      boost::cref(prior_bboxes), boost::cref(prior_variances),
+      boost::cref(all_match_overlaps), boost::cref(all_loss),
+      all_match_indices, &(*all_neg_indices)[neg_offset], _1));
+  *num_matches = CountNumMatches(*all_match_indices, num);
+  for (int i = 0; i < num; ++i) {
+    *num_negs += (*all_neg_indices)[neg_offset + i].size();
   }
 }
 
@@ -1909,34 +1959,27 @@ void ApplyNMSFast(const vector<NormalizedBBox>& bboxes,
   // Sanity check.
   CHECK_EQ(bboxes.size(), scores.size())
       << "bboxes and scores have different size.";
-
-  // Get top_k scores (with corresponding indices).
-  vector<pair<float, int> > score_index_vec;
-  GetMaxScoreIndex(scores, score_threshold, top_k, &score_index_vec);
-
-  // Do nms.
-  float adaptive_threshold = nms_threshold;
   indices->clear();
-  while (score_index_vec.size() != 0) {
-    const int idx = score_index_vec.front().second;
-    bool keep = true;
-    for (int k = 0; k < indices->size(); ++k) {
-      if (keep) {
-        const int kept_idx = (*indices)[k];
-        float overlap = JaccardOverlap(bboxes[idx], bboxes[kept_idx]);
-        keep = overlap <= adaptive_threshold;
-      } else {
-        break;
-      }
-    }
-    if (keep) {
-      indices->push_back(idx);
-    }
-    score_index_vec.erase(score_index_vec.begin());
-    if (keep && eta < 1 && adaptive_threshold > 0.5) {
-      adaptive_threshold *= eta;
-    }
+  const int num = bboxes.size();
+  if (num == 0) {
+    return;
   }
+
+  // Do nms on the flat boxes, with the sizes JaccardOverlap would use.
+  vector<float> flat_bboxes(num * 4);
+  vector<float> sizes(num);
+  for (int i = 0; i < num; ++i) {
+    flat_bboxes[i * 4] = bboxes[i].xmin();
+    flat_bboxes[i * 4 + 1] = bboxes[i].ymin();
+    flat_bboxes[i * 4 + 2] = bboxes[i].xmax();
+    flat_bboxes[i * 4 + 3] = bboxes[i].ymax();
+    sizes[i] = BBoxSize(bboxes[i]);
+  }
+  vector<pair<float, int> > score_index_vec;
+  vector<float> kept_bboxes;
+  ApplyNMSFastFlat(&flat_bboxes[0], &sizes[0], &scores[0], num,
+                   score_threshold, nms_threshold, eta, top_k,
+                   &score_index_vec, &kept_bboxes, indices);
 }
 
 template <typename Dtype>
@@ -1981,6 +2024,195 @@ void ApplyNMSFast(const double* bboxes, const double* scores, const int num,
       const float score_threshold, const float nms_threshold,
       const float eta, const int top_k, vector<int>* indices);
 
+// The arithmetic below mirrors DecodeBBox, BBoxSize and ClipBBox step by step,
+// including the float/double promotions, so that the results stay identical.
+template <typename Dtype>
+void DecodeBBoxesFlat(const Dtype* loc_data, const int loc_step,
+    const float* prior_bboxes, const float* prior_variances,
+    const int num_priors, const CodeType code_type,
+    const bool variance_encoded_in_target, const bool clip_bbox,
+    float* decode_bboxes, float* decode_sizes) {
+  for (int i = 0; i < num_priors; ++i) {
+    const float* prior_bbox = prior_bboxes + i * 4;
+    const float* prior_variance = prior_variances + i * 4;
+    const float bbox_xmin = loc_data[0];
+    const float bbox_ymin = loc_data[1];
+    const float bbox_xmax = loc_data[2];
+    const float bbox_ymax = loc_data[3];
+    loc_data += loc_step;
+    float* decode_bbox = decode_bboxes + i * 4;
+    if (code_type == PriorBoxParameter_CodeType_CORNER) {
+      if (variance_encoded_in_target) {
+        decode_bbox[0] = prior_bbox[0] + bbox_xmin;
+        decode_bbox[1] = prior_bbox[1] + bbox_ymin;
+        decode_bbox[2] = prior_bbox[2] + bbox_xmax;
+        decode_bbox[3] = prior_bbox[3] + bbox_ymax;
+      } else {
+        decode_bbox[0] = prior_bbox[0] + prior_variance[0] * bbox_xmin;
+        decode_bbox[1] = prior_bbox[1] + prior_variance[1] * bbox_ymin;
+        decode_bbox[2] = prior_bbox[2] + prior_variance[2] * bbox_xmax;
+        decode_bbox[3] = prior_bbox[3] + prior_variance[3] * bbox_ymax;
+      }
+    } else if (code_type == PriorBoxParameter_CodeType_CENTER_SIZE) {
+      float prior_width = prior_bbox[2] - prior_bbox[0];
+      CHECK_GT(prior_width, 0);
+      float prior_height = prior_bbox[3] - prior_bbox[1];
+      CHECK_GT(prior_height, 0);
+      float prior_center_x = (prior_bbox[0] + prior_bbox[2]) / 2.;
+      float prior_center_y = (prior_bbox[1] + prior_bbox[3]) / 2.;
+
+      float decode_bbox_center_x, decode_bbox_center_y;
+      float decode_bbox_width, decode_bbox_height;
+      if (variance_encoded_in_target) {
+        decode_bbox_center_x = bbox_xmin * prior_width + prior_center_x;
+        decode_bbox_center_y = bbox_ymin * prior_height + prior_center_y;
+        decode_bbox_width = exp(bbox_xmax) * prior_width;
+        decode_bbox_height = exp(bbox_ymax) * prior_height;
+      } else {
+        decode_bbox_center_x =
+            prior_variance[0] * bbox_xmin * prior_width + prior_center_x;
+        decode_bbox_center_y =
+            prior_variance[1] * bbox_ymin * prior_height + prior_center_y;
+        decode_bbox_width =
+            exp(prior_variance[2] * bbox_xmax) * prior_width;
+        decode_bbox_height =
+            exp(prior_variance[3] * bbox_ymax) * prior_height;
+      }
+      decode_bbox[0] = decode_bbox_center_x - decode_bbox_width / 2.;
+      decode_bbox[1] = decode_bbox_center_y - decode_bbox_height / 2.;
+      decode_bbox[2] = decode_bbox_center_x + decode_bbox_width / 2.;
+      decode_bbox[3] = decode_bbox_center_y + decode_bbox_height / 2.;
+    } else if (code_type == PriorBoxParameter_CodeType_CORNER_SIZE) {
+      float prior_width = prior_bbox[2] - prior_bbox[0];
+      CHECK_GT(prior_width, 0);
+      float prior_height = prior_bbox[3] - prior_bbox[1];
+      CHECK_GT(prior_height, 0);
+      if (variance_encoded_in_target) {
+        decode_bbox[0] = prior_bbox[0] + bbox_xmin * prior_width;
+        decode_bbox[1] = prior_bbox[1] + bbox_ymin * prior_height;
+        decode_bbox[2] = prior_bbox[2] + bbox_xmax * prior_width;
+        decode_bbox[3] = prior_bbox[3] + bbox_ymax * prior_height;
+      } else {
+        decode_bbox[0] =
+            prior_bbox[0] + prior_variance[0] * bbox_xmin * prior_width;
+        decode_bbox[1] =
+            prior_bbox[1] + prior_variance[1] * bbox_ymin * prior_height;
+        decode_bbox[2] =
+            prior_bbox[2] + prior_variance[2] * bbox_xmax * prior_width;
+        decode_bbox[3] =
+            prior_bbox[3] + prior_variance[3] * bbox_ymax * prior_height;
+      }
+    } else {
+      LOG(FATAL) << "Unknown LocLossType.";
+    }
+    if (clip_bbox) {
+      for (int j = 0; j < 4; ++j) {
+        decode_bbox[j] = std::max(std::min(decode_bbox[j], 1.f), 0.f);
+      }
+    }
+    if (decode_bbox[2] < decode_bbox[0] || decode_bbox[3] < decode_bbox[1]) {
+      decode_sizes[i] = 0;
+    } else {
+      float width = decode_bbox[2] - decode_bbox[0];
+      float height = decode_bbox[3] - decode_bbox[1];
+      decode_sizes[i] = width * height;
+    }
+  }
+}
+
+template void DecodeBBoxesFlat(const float* loc_data, const int loc_step,
+    const float* prior_bboxes, const float* prior_variances,
+    const int num_priors, const CodeType code_type,
+    const bool variance_encoded_in_target, const bool clip_bbox,
+    float* decode_bboxes, float* decode_sizes);
+template void DecodeBBoxesFlat(const double* loc_data, const int loc_step,
+    const float* prior_bboxes, const float* prior_variances,
+    const int num_priors, const CodeType code_type,
+    const bool variance_encoded_in_target, const bool clip_bbox,
+    float* decode_bboxes, float* decode_sizes);
+
+float JaccardOverlapFlat(const float* bbox1, const float bbox1_size,
+    const float* bbox2, const float bbox2_size) {
+  if (bbox2[0] > bbox1[2] || bbox2[2] < bbox1[0] ||
+      bbox2[1] > bbox1[3] || bbox2[3] < bbox1[1]) {
+    return 0.;
+  }
+  const float intersect_width =
+      std::min(bbox1[2], bbox2[2]) - std::max(bbox1[0], bbox2[0]);
+  const float intersect_height =
+      std::min(bbox1[3], bbox2[3]) - std::max(bbox1[1], bbox2[1]);
+  if (intersect_width > 0 && intersect_height > 0) {
+    float intersect_size = intersect_width * intersect_height;
+    return intersect_size / (bbox1_size + bbox2_size - intersect_size);
+  } else {
+    return 0.;
+  }
+}
+
+// Orders candidates as the stable sort by descending score in
+// GetMaxScoreIndex does, without its temporary buffer.
+static bool SortScoreIndexDescend(const pair<float, int>& pair1,
+                                  const pair<float, int>& pair2) {
+  return pair1.first > pair2.first ||
+      (pair1.first == pair2.first && pair1.second < pair2.second);
+}
+
+void ApplyNMSFastFlat(const float* bboxes, const float* sizes,
+      const float* scores, const int num, const float score_threshold,
+      const float nms_threshold, const float eta, const int top_k,
+      vector<pair<float, int> >* score_index_vec, vector<float>* kept_bboxes,
+      vector<int>* indices) {
+  score_index_vec->clear();
+  for (int i = 0; i < num; ++i) {
+    if (scores[i] > score_threshold) {
+      score_index_vec->push_back(std::make_pair(scores[i], i));
+    }
+  }
+  std::sort(score_index_vec->begin(), score_index_vec->end(),
+            SortScoreIndexDescend);
+  int num_candidates = score_index_vec->size();
+  if (top_k > -1 && top_k < num_candidates) {
+    num_candidates = top_k;
+  }
+  indices->clear();
+  if (num_candidates == 0) {
+    return;
+  }
+
+  // The kept boxes as separate coordinate arrays, followed by the overlaps
+  // of the current candidate with them, which iou_block computes at once.
+  kept_bboxes->resize(num_candidates * 6);
+  float* kept_xmin = &(*kept_bboxes)[0];
+  float* kept_ymin = kept_xmin + num_candidates;
+  float* kept_xmax = kept_ymin + num_candidates;
+  float* kept_ymax = kept_xmax + num_candidates;
+  float* kept_sizes = kept_ymax + num_candidates;
+  float* overlaps = kept_sizes + num_candidates;
+  float adaptive_threshold = nms_threshold;
+  for (int i = 0; i < num_candidates; ++i) {
+    const int idx = (*score_index_vec)[i].second;
+    const float* bbox = bboxes + idx * 4;
+    const int num_kept = indices->size();
+    iou_block(bbox, sizes[idx], num_kept, kept_xmin, kept_ymin, kept_xmax,
+              kept_ymax, kept_sizes, 0.f, overlaps);
+    bool keep = true;
+    for (int k = 0; k < num_kept; ++k) {
+      keep &= overlaps[k] <= adaptive_threshold;
+    }
+    if (keep) {
+      indices->push_back(idx);
+      kept_xmin[num_kept] = bbox[0];
+      kept_ymin[num_kept] = bbox[1];
+      kept_xmax[num_kept] = bbox[2];
+      kept_ymax[num_kept] = bbox[3];
+      kept_sizes[num_kept] = sizes[idx];
+    }
+    if (keep && eta < 1 && adaptive_threshold > 0.5) {
+      adaptive_threshold *= eta;
+    }
+  }
+}
+
 void CumSum(const vector<pair<float, int> >& pairs, vector<int>* cumsum) {
   // Sort the pairs based on first item of the pair.
   vector<pair<float, int> > sort_pairs = pairs;
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cstring>
+
+#include "caffe/util/epilogue.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+bool Epilogue<Dtype>::CanFuse(const Layer<Dtype>& layer) {
+  const char* type = layer.type();
+  return strcmp(type, "ReLU") == 0 || strcmp(type, "ReLU6") == 0 ||
+      strcmp(type, "HardSwish") == 0 || strcmp(type, "HardSigmoid") == 0 ||
+      strcmp(type, "PReLU") == 0;
+}
+
+template <typename Dtype>
+Epilogue<Dtype>::Epilogue(Layer<Dtype>* layer)
+    : layer_type_(layer->type()), negative_slope_(0), threshold_(0),
+      alpha_(0), beta_(0), channel_shared_(false) {
+  CHECK(CanFuse(*layer)) << "Cannot fuse layer " << layer->layer_param().name()
+      << " of type " << layer_type_;
+  const LayerParameter& param = layer->layer_param();
+  const string type(layer_type_);
+  if (type == "ReLU") {
+    type_ = RELU;
+    negative_slope_ = param.relu_param().negative_slope();
+  } else if (type == "ReLU6") {
+    type_ = RELU6;
+    negative_slope_ = param.relu6_param().negative_slope();
+    threshold_ = param.relu6_param().threshold();
+  } else if (type == "HardSwish") {
+    type_ = HARDSWISH;
+  } else if (type == "HardSigmoid") {
+    type_ = HARDSIGMOID;
+    alpha_ = param.hardsigmoid_param().alpha();
+    beta_ = param.hardsigmoid_param().beta();
+  } else {
+    type_ = PRELU;
+    CHECK_EQ(layer->blobs().size(), 1);
+    slope_ = layer->blobs()[0];
+    channel_shared_ = param.prelu_param().channel_shared();
+  }
+}
+
+template <typename Dtype>
+void Epilogue<Dtype>::Apply(Dtype* data, const int begin, const int end,
+    const int channels, const int dim) const {
+  // One loop per activation, so that each of them vectorizes.
+  switch (type_) {
+  case RELU: {
+    const Dtype negative_slope = negative_slope_;
+    for (int i = begin; i < end; ++i) {
+      data[i] = std::max(data[i], Dtype(0))
+          + negative_slope * std::min(data[i], Dtype(0));
+    }
+    break;
+  }
+  case RELU6: {
+    const Dtype negative_slope = negative_slope_;
+    const Dtype threshold = threshold_;
+    for (int i = begin; i < end; ++i) {
+      data[i] = std::min(std::max(data[i], Dtype(0))
+          + negative_slope * std::min(data[i], Dtype(0)), threshold);
+    }
+    break;
+  }
+  case HARDSWISH:
+    for (int i = begin; i < end; ++i) {
+      data[i] = data[i] * (std::max(Dtype(0),
+          std::min(Dtype(1), data[i] / Dtype(6.0) + Dtype(0.5))));
+    }
+    break;
+  case HARDSIGMOID: {
+    const float alpha = alpha_;
+    const float beta = beta_;
+    for (int i = begin; i < end; ++i) {
+      data[i] = std::max(Dtype(0),
+          std::min(Dtype(1), (data[i] * alpha + beta)));
+    }
+    break;
+  }
+  case PRELU: {
+    const Dtype* slope_data = slope_->cpu_data();
+    // Runs of dim values share their slope.
+    for (int i = begin; i < end;) {
+      const int c = channel_shared_ ? 0 : (i / dim) % channels;
+      const int run_end = std::min(end, (i / dim + 1) * dim);
+      const Dtype slope = slope_data[c];
+      for (; i < run_end; ++i) {
+        data[i] = std::max(data[i], Dtype(0))
+            + slope * std::min(data[i], Dtype(0));
+      }
+    }
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown epilogue type.";
+  }
+}
+
+INSTANTIATE_CLASS(Epilogue);
+
+}  // namespace caffe
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+bool HasBlob(const google::protobuf::RepeatedPtrField<string>& blob_names,
+    const string& blob_name) {
+  return std::find(blob_names.begin(), blob_names.end(), blob_name) !=
+      blob_names.end();
+}
+
+// Convolution and InnerProduct layers with a single, unshared output along
+// axis 1, whose weights can absorb a per-channel transform of that output.
+bool IsFoldTarget(const LayerParameter& layer_param) {
+  if (layer_param.bottom_size() != 1 || layer_param.top_size() != 1) {
+    return false;
+  }
+  for (int i = 0; i < layer_param.param_size(); ++i) {
+    if (layer_param.param(i).has_name()) {
+      return false;
+    }
+  }
+  if (layer_param.type() == "Convolution") {
+    return layer_param.convolution_param().axis() == 1;
+  } else if (layer_param.type() == "InnerProduct") {
+    return layer_param.inner_product_param().axis() == 1;
+  }
+  return false;
+}
+
+// Layers applying a per-channel transform along axis 1 in the TEST phase.
+bool IsFoldable(const LayerParameter& layer_param) {
+  if (layer_param.bottom_size() != 1 || layer_param.top_size() != 1) {
+    return false;
+  }
+  const string& type = layer_param.type();
+  if (type == "BatchNorm" || type == "BatchNormKyle") {
+    const BatchNormParameter& param = layer_param.batch_norm_param();
+    return !param.has_use_global_stats() || param.use_global_stats();
+  } else if (type == "BN") {
+    return true;
+  } else if (type == "Scale") {
+    return layer_param.scale_param().axis() == 1 &&
+        layer_param.scale_param().num_axes() == 1;
+  } else if (type == "Bias") {
+    return layer_param.bias_param().axis() == 1 &&
+        layer_param.bias_param().num_axes() == 1;
+  }
+  return false;
+}
+
+// Turns on the bias term of a fold target, adding a zero bias to the weights
+// it comes with.
+void AddBiasTerm(LayerParameter* layer_param) {
+  int num_output;
+  if (layer_param->type() == "Convolution") {
+    if (layer_param->convolution_param().bias_term()) {
+      return;
+    }
+    layer_param->mutable_convolution_param()->set_bias_term(true);
+    num_output = layer_param->convolution_param().num_output();
+  } else {
+    if (layer_param->inner_product_param().bias_term()) {
+      return;
+    }
+    layer_param->mutable_inner_product_param()->set_bias_term(true);
+    num_output = layer_param->inner_product_param().num_output();
+  }
+  if (layer_param->blobs_size() > 0) {
+    BlobProto* bias = layer_param->add_blobs();
+    bias->mutable_shape()->add_dim(num_output);
+    for (int i = 0; i < num_output; ++i) {
+      bias->add_data(0);
+    }
+  }
+}
+
+}  // namespace
+
+void FoldBatchNormLayers(const NetParameter& param,
+    NetParameter* param_folded,
+    vector<pair<string, LayerParameter> >* folded_layers) {
+  const int num_layers = param.layer_size();
+  const set<string> pinned_blobs(param.pinned_blob().begin(),
+      param.pinned_blob().end());
+  vector<LayerParameter> layers(param.layer().begin(), param.layer().end());
+  vector<bool> removed(num_layers, false);
+  folded_layers->clear();
+  for (int i = 0; i < num_layers; ++i) {
+    if (!IsFoldTarget(layers[i])) {
+      continue;
+    }
+    // Follow the output of the target through the foldable layers that
+    // consume it next.
+    string blob_name = layers[i].top(0);
+    for (int j = i + 1; j < num_layers; ++j) {
+      const LayerParameter& layer_param = param.layer(j);
+      if (!HasBlob(layer_param.bottom(), blob_name)) {
+        if (HasBlob(layer_param.top(), blob_name)) {
+          break;
+        }
+        continue;
+      }
+      if (!IsFoldable(layer_param)) {
+        break;
+      }
+      const string& top_name = layer_param.top(0);
+      if (top_name != blob_name) {
+        // The target will write top_name directly, so nothing else may look
+        // at blob_name.
+        bool used = pinned_blobs.count(blob_name) > 0;
+        for (int k = j + 1; k < num_layers && !used; ++k) {
+          used = HasBlob(param.layer(k).bottom(), blob_name) ||
+              HasBlob(param.layer(k).top(), blob_name);
+        }
+        if (used) {
+          break;
+        }
+        layers[i].set_top(0, top_name);
+        blob_name = top_name;
+      }
+      AddBiasTerm(&layers[i]);
+      folded_layers->push_back(make_pair(layers[i].name(), layer_param));
+      removed[j] = true;
+    }
+  }
+  param_folded->CopyFrom(param);
+  param_folded->clear_layer();
+  for (int i = 0; i < num_layers; ++i) {
+    if (!removed[i]) {
+      param_folded->add_layer()->CopyFrom(layers[i]);
+    }
+  }
+}
+
+template <typename Dtype>
+void GetFoldedTransform(const LayerParameter& param,
+    const vector<shared_ptr<Blob<Dtype> > >& blobs,
+    vector<Dtype>* scale, vector<Dtype>* shift) {
+  const string& type = param.type();
+  if (type == "BatchNorm" || type == "BatchNormKyle") {
+    // mean, variance, moving average factor and, with use_alpha_beta, the
+    // scale and shift of BatchNormKyle.
+    const bool use_alpha_beta = type == "BatchNormKyle" &&
+        param.batch_norm_param().use_alpha_beta();
+    CHECK_EQ(blobs.size(), use_alpha_beta ? 5 : 3)
+        << "Incompatible number of blobs for layer " << param.name();
+    const int channels = blobs[0]->count();
+    const Dtype* mean = blobs[0]->cpu_data();
+    const Dtype* variance = blobs[1]->cpu_data();
+    const Dtype scale_factor = blobs[2]->cpu_data()[0] == 0 ?
+        0 : 1 / blobs[2]->cpu_data()[0];
+    const Dtype eps = param.batch_norm_param().eps();
+    scale->resize(channels);
+    shift->resize(channels);
+    for (int c = 0; c < channels; ++c) {
+      const Dtype inv_std = 1 / std::sqrt(scale_factor * variance[c] + eps);
+      (*scale)[c] = inv_std;
+      (*shift)[c] = -scale_factor * mean[c] * inv_std;
+    }
+    if (use_alpha_beta) {
+      const Dtype* alpha = blobs[3]->cpu_data();
+      const Dtype* beta = blobs[4]->cpu_data();
+      for (int c = 0; c < channels; ++c) {
+        (*scale)[c] *= alpha[c];
+        (*shift)[c] = (*shift)[c] * alpha[c] + beta[c];
+      }
+    }
+  } else if (type == "BN") {
+    // slope, bias, moving average mean and inverse standard deviation.
+    CHECK_EQ(blobs.size(), 4)
+        << "Incompatible number of blobs for layer " << param.name();
+    const int channels = blobs[0]->count();
+    const Dtype* slope = blobs[0]->cpu_data();
+    const Dtype* bias = blobs[1]->cpu_data();
+    const Dtype* mean = blobs[2]->cpu_data();
+    const Dtype* inv_std = blobs[3]->cpu_data();
+    scale->resize(channels);
+    shift->resize(channels);
+    for (int c = 0; c < channels; ++c) {
+      (*scale)[c] = slope[c] * inv_std[c];
+      (*shift)[c] = bias[c] - mean[c] * (*scale)[c];
+    }
+  } else if (type == "Scale") {
+    const bool bias_term = param.scale_param().bias_term();
+    CHECK_EQ(blobs.size(), bias_term ? 2 : 1)
+        << "Incompatible number of blobs for layer " << param.name();
+    const int channels = blobs[0]->count();
+    scale->assign(blobs[0]->cpu_data(), blobs[0]->cpu_data() + channels);
+    if (bias_term) {
+      shift->assign(blobs[1]->cpu_data(), blobs[1]->cpu_data() + channels);
+    } else {
+      shift->assign(channels, Dtype(0));
+    }
+  } else if (type == "Bias") {
+    CHECK_EQ(blobs.size(), 1)
+        << "Incompatible number of blobs for layer " << param.name();
+    const int channels = blobs[0]->count();
+    scale->assign(channels, Dtype(1));
+    shift->assign(blobs[0]->cpu_data(), blobs[0]->cpu_data() + channels);
+  } else {
+    LOG(FATAL) << "Cannot fold layer " << param.name() << " of type " << type;
+  }
+}
+
+template <typename Dtype>
+void FoldTransformIntoLayer(const vector<Dtype>& scale,
+    const vector<Dtype>& shift, Layer<Dtype>* layer) {
+  const LayerParameter& param = layer->layer_param();
+  vector<shared_ptr<Blob<Dtype> > >& blobs = layer->blobs();
+  CHECK_EQ(blobs.size(), 2) << "Layer " << param.name()
+      << " needs a bias term to fold a transform into";
+  const int channels = blobs[1]->count();
+  CHECK_EQ(scale.size(), channels) << "Cannot fold " << scale.size()
+      << " channels into the " << channels << " outputs of " << param.name();
+  CHECK_EQ(shift.size(), channels);
+  Dtype* weights = blobs[0]->mutable_cpu_data();
+  const int dim = blobs[0]->count() / channels;
+  if (param.type() == "InnerProduct" &&
+      param.inner_product_param().transpose()) {
+    // K x N weights
+    for (int i = 0; i < dim; ++i) {
+      for (int c = 0; c < channels; ++c) {
+        weights[i * channels + c] *= scale[c];
+      }
+    }
+  } else {
+    for (int c = 0; c < channels; ++c) {
+      caffe_scal(dim, scale[c], weights + c * dim);
+    }
+  }
+  Dtype* bias = blobs[1]->mutable_cpu_data();
+  for (int c = 0; c < channels; ++c) {
+    bias[c] = bias[c] * scale[c] + shift[c];
+  }
+}
+
+template void GetFoldedTransform<float>(const LayerParameter& param,
+    const vector<shared_ptr<Blob<float> > >& blobs,
+    vector<float>* scale, vector<float>* shift);
+template void GetFoldedTransform<double>(const LayerParameter& param,
+    const vector<shared_ptr<Blob<double> > >& blobs,
+    vector<double>* scale, vector<double>* shift);
+template void FoldTransformIntoLayer<float>(const vector<float>& scale,
+    const vector<float>& shift, Layer<float>* layer);
+template void FoldTransformIntoLayer<double>(const vector<double>& scale,
+    const vector<double>& shift, Layer<double>* layer);
+
+}  // namespace caffe
@@ -0,0 +1,211 @@
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/half.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+uint16_t FloatToHalf(const float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  const uint16_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x >= 0x7f800000) {
+    // Infinity, or NaN with a quiet bit and the top of the payload.
+    return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 | ((x >> 13) & 0x3ff) : 0);
+  }
+  if (x >= 0x477ff000) {
+    // Rounds to 65520 or more.
+    return sign | 0x7c00;
+  }
+  if (x < 0x38800000) {
+    // Below 2^-14: a multiple of 2^-24, with 0x400 the smallest normal.
+    float magnitude;
+    memcpy(&magnitude, &x, sizeof(x));
+    return sign | static_cast<uint16_t>(lrintf(magnitude * 16777216.f));
+  }
+  // Rebias the exponent from 127 to 15 and round the mantissa to nearest
+  // even; a carry out of the mantissa correctly bumps the exponent.
+  x += 0xc8000fff + ((x >> 13) & 1);
+  return sign | (x >> 13);
+}
+
+float HalfToFloat(const uint16_t h) {
+  const uint32_t exponent = (h >> 10) & 0x1f;
+  const uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0) {
+    const float magnitude = mantissa * (1.f / 16777216.f);
+    return (h & 0x8000) ? -magnitude : magnitude;
+  }
+  uint32_t x = static_cast<uint32_t>(h & 0x8000) << 16 | mantissa << 13 |
+      (exponent == 0x1f ? 0x7f800000 : (exponent + 112) << 23);
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+// The number of widened values a GEMM on half precision data works on at a
+// time, small enough to stay in cache.
+const int kHalfGemmTile = 1 << 14;
+
+// caffe_cpu_gemm with explicit leading dimensions, to work on the tiles.
+void Gemm(const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const int lda, const float* B,
+    const int ldb, const float beta, float* C, const int ldc) {
+  cblas_sgemm(CblasRowMajor, CblasNoTrans, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+void Gemm(const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const int lda, const double* B,
+    const int ldb, const double beta, double* C, const int ldc) {
+  cblas_dgemm(CblasRowMajor, CblasNoTrans, TransB, M, N, K, alpha, A, lda, B,
+      ldb, beta, C, ldc);
+}
+
+}  // namespace
+
+template <>
+void caffe_cpu_float2half<float>(const int n, const float* x, uint16_t* y) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+#endif
+  for (; i < n; ++i) {
+    y[i] = FloatToHalf(x[i]);
+  }
+}
+
+template <>
+void caffe_cpu_float2half<double>(const int n, const double* x,
+    uint16_t* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = FloatToHalf(static_cast<float>(x[i]));
+  }
+}
+
+template <>
+void caffe_cpu_half2float<float>(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+  }
+#endif
+  for (; i < n; ++i) {
+    y[i] = HalfToFloat(x[i]);
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_half2float(const int n, const uint16_t* x, Dtype* y) {
+  for (int i = 0; i < n; ++i) {
+    y[i] = HalfToFloat(x[i]);
+  }
+}
+
+// The integer blobs load half_data too, like they load data.
+template void caffe_cpu_half2float<double>(const int n, const uint16_t* x,
+    double* y);
+template void caffe_cpu_half2float<int>(const int n, const uint16_t* x,
+    int* y);
+template void caffe_cpu_half2float<unsigned int>(const int n,
+    const uint16_t* x, unsigned int* y);
+template void caffe_cpu_half2float<bool>(const int n, const uint16_t* x,
+    bool* y);
+
+template <typename Dtype>
+void caffe_cpu_gemm_half_a(const int M, const int N, const int K,
+    const Dtype alpha, const uint16_t* A, const Dtype* B, const Dtype beta,
+    Dtype* C) {
+  const int rows = std::max(1, std::min(M, kHalfGemmTile / std::max(K, 1)));
+  vector<Dtype> tile(rows * K);
+  for (int m = 0; m < M; m += rows) {
+    const int tile_rows = std::min(rows, M - m);
+    caffe_cpu_half2float(tile_rows * K, A + m * K, tile.data());
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, tile_rows, N, K, alpha,
+        tile.data(), B, beta, C + m * N);
+  }
+}
+
+template void caffe_cpu_gemm_half_a<float>(const int M, const int N,
+    const int K, const float alpha, const uint16_t* A, const float* B,
+    const float beta, float* C);
+template void caffe_cpu_gemm_half_a<double>(const int M, const int N,
+    const int K, const double alpha, const uint16_t* A, const double* B,
+    const double beta, double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemm_half_b(const CBLAS_TRANSPOSE TransB, const int M,
+    const int N, const int K, const Dtype alpha, const Dtype* A,
+    const uint16_t* B, const Dtype beta, Dtype* C) {
+  if (TransB == CblasNoTrans) {
+    // B is K x N: widen a few of its rows and add up their products, which
+    // pair with as many columns of A.
+    const int rows = std::max(1, std::min(K, kHalfGemmTile / std::max(N, 1)));
+    vector<Dtype> tile(rows * N);
+    for (int k = 0; k < K; k += rows) {
+      const int tile_rows = std::min(rows, K - k);
+      caffe_cpu_half2float(tile_rows * N, B + k * N, tile.data());
+      Gemm(CblasNoTrans, M, N, tile_rows, alpha, A + k, K, tile.data(), N,
+          k == 0 ? beta : Dtype(1), C, N);
+    }
+  } else {
+    // B is N x K: widen a few of its rows, which give as many columns of C.
+    const int rows = std::max(1, std::min(N, kHalfGemmTile / std::max(K, 1)));
+    vector<Dtype> tile(rows * K);
+    for (int n = 0; n < N; n += rows) {
+      const int tile_rows = std::min(rows, N - n);
+      caffe_cpu_half2float(tile_rows * K, B + n * K, tile.data());
+      Gemm(CblasTrans, M, tile_rows, K, alpha, A, K, tile.data(), K, beta,
+          C + n, N);
+    }
+  }
+}
+
+template void caffe_cpu_gemm_half_b<float>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const float alpha, const float* A,
+    const uint16_t* B, const float beta, float* C);
+template void caffe_cpu_gemm_half_b<double>(const CBLAS_TRANSPOSE TransB,
+    const int M, const int N, const int K, const double alpha,
+    const double* A, const uint16_t* B, const double beta, double* C);
+
+void ConvertBlobsToHalf(NetParameter* param) {
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    for (int j = 0; j < layer_param->blobs_size(); ++j) {
+      BlobProto* blob = layer_param->mutable_blobs(j);
+      vector<uint16_t> half;
+      if (blob->double_data_size() > 0) {
+        half.resize(blob->double_data_size());
+        caffe_cpu_float2half(half.size(), blob->double_data().data(),
+            half.data());
+      } else if (blob->data_size() > 0) {
+        half.resize(blob->data_size());
+        caffe_cpu_float2half(half.size(), blob->data().data(), half.data());
+      } else {
+        continue;
+      }
+      // Little endian, like the hosts Caffe runs on.
+      blob->set_half_data(half.data(), half.size() * sizeof(uint16_t));
+      blob->clear_data();
+      blob->clear_double_data();
+    }
+  }
+}
+
+}  // namespace caffe
@@ -102,6 +102,59 @@ template void im2col_cpu<double>(const double* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     double* data_col);
 
+template <typename Dtype>
+void im2col_range_cpu(const Dtype* data_im, const int channels,
+    const int height, const int width, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w,
+    const int col_begin, const int col_count,
+    Dtype* data_col) {
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int channel_size = height * width;
+  const int first_row = col_begin / output_w;
+  const int first_col = col_begin % output_w;
+  for (int channel = channels; channel--; data_im += channel_size) {
+    for (int kernel_row = 0; kernel_row < kernel_h; kernel_row++) {
+      for (int kernel_col = 0; kernel_col < kernel_w; kernel_col++) {
+        int output_col = first_col;
+        int input_row = -pad_h + kernel_row * dilation_h +
+            first_row * stride_h;
+        int input_col = -pad_w + kernel_col * dilation_w +
+            first_col * stride_w;
+        for (int count = col_count; count; count--) {
+          if (is_a_ge_zero_and_a_lt_b(input_row, height) &&
+              is_a_ge_zero_and_a_lt_b(input_col, width)) {
+            *(data_col++) = data_im[input_row * width + input_col];
+          } else {
+            *(data_col++) = 0;
+          }
+          input_col += stride_w;
+          if (++output_col == output_w) {
+            output_col = 0;
+            input_row += stride_h;
+            input_col = -pad_w + kernel_col * dilation_w;
+          }
+        }
+      }
+    }
+  }
+}
+
+template void im2col_range_cpu<float>(const float* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int col_begin, const int col_count,
+    float* data_col);
+template void im2col_range_cpu<double>(const double* data_im,
+    const int channels, const int height, const int width,
+    const int kernel_h, const int kernel_w, const int pad_h, const int pad_w,
+    const int stride_h, const int stride_w, const int dilation_h,
+    const int dilation_w, const int col_begin, const int col_count,
+    double* data_col);
+
 
 
 template <typename Dtype>
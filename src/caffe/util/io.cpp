@@ -16,8 +16,11 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <algorithm>
+#include <climits>
 #include <fstream>  // NOLINT(readability/streams)
 #include <map>
 #include <string>
@@ -29,6 +32,8 @@
 
 namespace caffe {
 
+const int kProtoReadBytesLimit = INT_MAX;  // Max size of 2 GB minus 1 byte.
+
 using namespace boost::property_tree;  // NOLINT(build/namespaces)
 using google::protobuf::io::FileInputStream;
 using google::protobuf::io::FileOutputStream;
@@ -60,18 +65,58 @@ void WriteProtoToTextFile(const Message& proto, const char* filename) {
 bool ReadProtoFromBinaryFile(const char* filename, Message* proto) {
   int fd = open(filename, O_RDONLY);
   CHECK_NE(fd, -1) << "File not found: " << filename;
-  ZeroCopyInputStream* raw_input = new FileInputStream(fd);
-  CodedInputStream* coded_input = new CodedInputStream(raw_input);
-  coded_input->SetTotalBytesLimit(536870912);
-
-  bool success = proto->ParseFromCodedStream(coded_input);
-
-  delete coded_input;
-  delete raw_input;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Failed to stat " << filename;
+  // Parse regular files straight from the page cache rather than through
+  // the copies of a stream; pipes and the like can only be streamed.
+  void* mapping = MAP_FAILED;
+  if (S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+    CHECK_LE(file_stat.st_size, kProtoReadBytesLimit) << filename
+        << " is larger than the protocol buffers limit of 2 GB";
+    mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  bool success;
+  if (mapping != MAP_FAILED) {
+    madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+    CodedInputStream coded_input(static_cast<const uint8_t*>(mapping),
+        file_stat.st_size);
+    coded_input.SetTotalBytesLimit(kProtoReadBytesLimit);
+    success = proto->ParseFromCodedStream(&coded_input);
+    munmap(mapping, file_stat.st_size);
+  } else {
+    FileInputStream raw_input(fd);
+    CodedInputStream coded_input(&raw_input);
+    coded_input.SetTotalBytesLimit(kProtoReadBytesLimit);
+    success = proto->ParseFromCodedStream(&coded_input);
+  }
   close(fd);
   return success;
 }
 
+MappedFile::MappedFile(const string& filename) : data_(NULL), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_NE(fd, -1) << "File not found: " << filename;
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd, &file_stat), 0) << "Failed to stat " << filename;
+  CHECK(S_ISREG(file_stat.st_mode)) << "Cannot map " << filename
+      << ", which is not a regular file";
+  size_ = file_stat.st_size;
+  if (size_ > 0) {
+    void* mapping = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    CHECK(mapping != MAP_FAILED) << "Failed to map " << filename;
+    // Start reading the whole file in ahead of the first accesses.
+    madvise(mapping, size_, MADV_WILLNEED);
+    data_ = static_cast<const char*>(mapping);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
 void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   fstream output(filename, ios::out | ios::trunc | ios::binary);
   CHECK(proto.SerializeToOstream(&output));
@@ -84,7 +129,7 @@ bool ReadProtoFromTextMemory(const string & input, Message* proto) {
 bool ReadProtoFromBinaryMemory(unsigned char* buffer, int len, Message* proto) {
   ZeroCopyInputStream* raw_input = new ArrayInputStream(buffer, len);
   CodedInputStream* coded_input = new CodedInputStream(raw_input);
-  coded_input->SetTotalBytesLimit(536870912);
+  coded_input->SetTotalBytesLimit(kProtoReadBytesLimit);
 
   bool success = proto->ParseFromCodedStream(coded_input);
 
@@ -1,3 +1,8 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
 #include "caffe/util/nms.hpp"
 
 using std::max;
@@ -6,34 +11,49 @@ using std::min;
 namespace caffe {
 
 template <typename Dtype>
-static
-Dtype iou(const Dtype A[], const Dtype B[])
+void iou_block(const Dtype box[], const Dtype box_area, const int n,
+               const Dtype x1[], const Dtype y1[],
+               const Dtype x2[], const Dtype y2[],
+               const Dtype areas[], const Dtype offset,
+               Dtype ious[])
 {
-  if (A[0] > B[2] || A[1] > B[3] || A[2] < B[0] || A[3] < B[1]) {
-    return 0;
-  }
-
-  // overlapped region (= box)
-  const Dtype x1 = std::max(A[0],  B[0]);
-  const Dtype y1 = std::max(A[1],  B[1]);
-  const Dtype x2 = std::min(A[2],  B[2]);
-  const Dtype y2 = std::min(A[3],  B[3]);
+  const Dtype bx1 = box[0];
+  const Dtype by1 = box[1];
+  const Dtype bx2 = box[2];
+  const Dtype by2 = box[3];
 
-  // intersection area
-  const Dtype width = std::max((Dtype)0,  x2 - x1 + (Dtype)1);
-  const Dtype height = std::max((Dtype)0,  y2 - y1 + (Dtype)1);
-  const Dtype area = width * height;
-
-  // area of A, B
-  const Dtype A_area = (A[2] - A[0] + (Dtype)1) * (A[3] - A[1] + (Dtype)1);
-  const Dtype B_area = (B[2] - B[0] + (Dtype)1) * (B[3] - B[1] + (Dtype)1);
-
-  // IoU
-  return area / (A_area + B_area - area);
+  // Both loops are free of branches, so that they vectorize: the first one
+  // computes the ratio for every box as if they all intersected, and the
+  // second one clears it for the boxes that do not (note the non
+  // short-circuit &).
+  for (int j = 0; j < n; ++j) {
+    const Dtype width = std::min(bx2, x2[j]) - std::max(bx1, x1[j]) + offset;
+    const Dtype height = std::min(by2, y2[j]) - std::max(by1, y1[j]) + offset;
+    const Dtype area = width * height;
+    ious[j] = area / (box_area + areas[j] - area);
+  }
+  for (int j = 0; j < n; ++j) {
+    const Dtype width = std::min(bx2, x2[j]) - std::max(bx1, x1[j]) + offset;
+    const Dtype height = std::min(by2, y2[j]) - std::max(by1, y1[j]) + offset;
+    const bool overlap = !(bx1 > x2[j]) & !(by1 > y2[j]) &
+                         !(bx2 < x1[j]) & !(by2 < y1[j]) &
+                         (width > 0) & (height > 0);
+    ious[j] = overlap ? ious[j] : (Dtype)0;
+  }
 }
 
-template static float iou(const float A[], const float B[]);
-template static double iou(const double A[], const double B[]);
+template
+void iou_block(const float box[], const float box_area, const int n,
+               const float x1[], const float y1[],
+               const float x2[], const float y2[],
+               const float areas[], const float offset,
+               float ious[]);
+template
+void iou_block(const double box[], const double box_area, const int n,
+               const double x1[], const double y1[],
+               const double x2[], const double y2[],
+               const double areas[], const double offset,
+               double ious[]);
 
 template <typename Dtype>
 void nms_cpu(const int num_boxes,
@@ -44,13 +64,33 @@ void nms_cpu(const int num_boxes,
              const Dtype nms_thresh, const int max_num_out)
 {
   int count = 0;
-  std::vector<char> is_dead(num_boxes);
+  if (num_boxes == 0) {
+    *num_out = count;
+    return;
+  }
+
+  // box coordinates and areas in separate arrays,
+  // followed by the overlaps with the current box
+  std::vector<Dtype> buffer(6 * num_boxes);
+  Dtype* const x1 = &buffer[0];
+  Dtype* const y1 = x1 + num_boxes;
+  Dtype* const x2 = y1 + num_boxes;
+  Dtype* const y2 = x2 + num_boxes;
+  Dtype* const areas = y2 + num_boxes;
+  Dtype* const ious = areas + num_boxes;
   for (int i = 0; i < num_boxes; ++i) {
-    is_dead[i] = 0;
+    x1[i] = boxes[i * 5];
+    y1[i] = boxes[i * 5 + 1];
+    x2[i] = boxes[i * 5 + 2];
+    y2[i] = boxes[i * 5 + 3];
+    areas[i] = (x2[i] - x1[i] + (Dtype)1) * (y2[i] - y1[i] + (Dtype)1);
   }
 
+  // one bit per box, set once the box is suppressed
+  std::vector<uint64_t> is_dead((num_boxes + 63) / 64, 0);
+
   for (int i = 0; i < num_boxes; ++i) {
-    if (is_dead[i]) {
+    if (is_dead[i / 64] & ((uint64_t)1 << (i % 64))) {
       continue;
     }
 
@@ -59,15 +99,16 @@ void nms_cpu(const int num_boxes,
       break;
     }
 
-    for (int j = i + 1; j < num_boxes; ++j) {
-      if (!is_dead[j] && iou(&boxes[i * 5], &boxes[j * 5]) > nms_thresh) {
-        is_dead[j] = 1;
-      }
+    const Dtype box[4] = { x1[i], y1[i], x2[i], y2[i] };
+    const int j0 = i + 1;
+    iou_block(box, areas[i], num_boxes - j0, x1 + j0, y1 + j0, x2 + j0,
+              y2 + j0, areas + j0, (Dtype)1, ious + j0);
+    for (int j = j0; j < num_boxes; ++j) {
+      is_dead[j / 64] |= (uint64_t)(ious[j] > nms_thresh) << (j % 64);
     }
   }
 
   *num_out = count;
-  is_dead.clear();
 }
 
 template
@@ -0,0 +1,306 @@
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/profiler.hpp"
+
+namespace caffe {
+
+namespace {
+
+// Quotes s as a JSON string.
+string JsonString(const string& s) {
+  std::ostringstream out;
+  out << '"';
+  for (int i = 0; i < s.size(); ++i) {
+    const unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (c < 0x20) {
+      out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+          << static_cast<int>(c) << std::dec;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+// The indices of layers in decreasing order of forward time.
+vector<int> RankByForwardTime(const vector<LayerProfile>& layers) {
+  vector<std::pair<double, int> > times;
+  for (int i = 0; i < layers.size(); ++i) {
+    times.push_back(std::make_pair(-layers[i].forward_ms, i));
+  }
+  std::stable_sort(times.begin(), times.end());
+  vector<int> ranking;
+  for (int i = 0; i < times.size(); ++i) {
+    ranking.push_back(times[i].second);
+  }
+  return ranking;
+}
+
+// The GFLOP/s a machine with the given peaks attains at intensity.
+double RooflineGflops(const double intensity, const double peak_gflops,
+    const double peak_gbps) {
+  return std::min(peak_gflops, intensity * peak_gbps);
+}
+
+}  // namespace
+
+Profiler& Profiler::Global() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler()
+    : enabled_(false),
+      origin_(std::chrono::steady_clock::now()),
+      mutex_(new boost::mutex()) {
+}
+
+void Profiler::Enable(bool enabled) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::Clear() {
+  boost::mutex::scoped_lock lock(*mutex_);
+  events_.clear();
+}
+
+double Profiler::Now() const {
+  return std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - origin_).count();
+}
+
+int Profiler::ThreadIndex() {
+  std::ostringstream id;
+  id << boost::this_thread::get_id();
+  std::map<string, int>::const_iterator it = thread_indices_.find(id.str());
+  if (it != thread_indices_.end()) {
+    return it->second;
+  }
+  const int index = thread_names_.size();
+  thread_indices_[id.str()] = index;
+  thread_names_.push_back("");
+  return index;
+}
+
+void Profiler::AddEvent(const string& name, const string& category,
+    double start_us, double duration_us) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  if (!enabled()) {
+    return;
+  }
+  Event event;
+  event.name = name;
+  event.category = category;
+  event.start_us = start_us;
+  event.duration_us = duration_us;
+  event.thread = ThreadIndex();
+  events_.push_back(event);
+}
+
+void Profiler::SetThreadName(const string& name) {
+  boost::mutex::scoped_lock lock(*mutex_);
+  thread_names_[ThreadIndex()] = name;
+}
+
+void Profiler::WriteChromeTrace(const string& filename) const {
+  boost::mutex::scoped_lock lock(*mutex_);
+  std::ofstream output(filename.c_str());
+  CHECK(output.is_open()) << "Failed to open " << filename;
+  output << std::fixed << std::setprecision(1);
+  output << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  bool first = true;
+  for (int i = 0; i < thread_names_.size(); ++i) {
+    if (thread_names_[i].empty()) {
+      continue;
+    }
+    output << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", "
+        << "\"ph\": \"M\", \"pid\": 0, \"tid\": " << i
+        << ", \"args\": {\"name\": " << JsonString(thread_names_[i]) << "}}";
+    first = false;
+  }
+  for (int i = 0; i < events_.size(); ++i) {
+    const Event& event = events_[i];
+    output << (first ? "\n" : ",\n") << "{\"name\": "
+        << JsonString(event.name) << ", \"cat\": "
+        << JsonString(event.category) << ", \"ph\": \"X\", \"ts\": "
+        << event.start_us << ", \"dur\": " << event.duration_us
+        << ", \"pid\": 0, \"tid\": " << event.thread << "}";
+    first = false;
+  }
+  output << "\n]}\n";
+  CHECK(output.good()) << "Failed to write " << filename;
+}
+
+ProfileScope::ProfileScope(const string& name, const string& category)
+    : enabled_(Profiler::Global().enabled()), start_us_(0) {
+  if (enabled_) {
+    name_ = name;
+    category_ = category;
+    start_us_ = Profiler::Global().Now();
+  }
+}
+
+ProfileScope::~ProfileScope() {
+  if (enabled_) {
+    Profiler& profiler = Profiler::Global();
+    profiler.AddEvent(name_, category_, start_us_,
+        profiler.Now() - start_us_);
+  }
+}
+
+template <typename Dtype>
+LayerCost EstimateForwardCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  LayerCost cost;
+  const string type = layer->type();
+  if (type == "Split" || type == "Flatten" || type == "Reshape" ||
+      type == "Silence") {
+    return cost;
+  }
+  double bottom_count = 0;
+  for (int i = 0; i < bottom.size(); ++i) {
+    bottom_count += bottom[i]->count();
+  }
+  double top_count = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    top_count += top[i]->count();
+  }
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = layer->blobs();
+  double param_count = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    param_count += blobs[i]->count();
+  }
+  cost.bytes_read = (bottom_count + param_count) * sizeof(Dtype);
+  cost.bytes_written = top_count * sizeof(Dtype);
+
+  if (type == "Convolution" && blobs.size() > 0) {
+    // Every output is a dot product with a row of the weights.
+    cost.flops = 2 * top_count * blobs[0]->count(1);
+  } else if (type == "Deconvolution" && blobs.size() > 0) {
+    // Every input is scattered with a row of the weights.
+    cost.flops = 2 * bottom_count * blobs[0]->count(1);
+  } else if (type == "InnerProduct" && blobs.size() > 0) {
+    const int num_output = layer->layer_param().inner_product_param()
+        .num_output();
+    cost.flops = 2 * top_count * (blobs[0]->count() / num_output);
+  } else if (type == "Pooling") {
+    const PoolingParameter& pool_param =
+        layer->layer_param().pooling_param();
+    double window;
+    if (pool_param.global_pooling()) {
+      window = bottom[0]->count(2);
+    } else if (pool_param.has_kernel_size()) {
+      window = pool_param.kernel_size() * pool_param.kernel_size();
+    } else {
+      window = pool_param.kernel_h() * pool_param.kernel_w();
+    }
+    cost.flops = top_count * window;
+  } else if (type == "Eltwise") {
+    cost.flops = top_count * (bottom.size() - 1);
+  } else if (bottom.size() > 0) {
+    // Element-wise layers: about one operation per output.
+    cost.flops = top_count;
+  }
+  if ((type == "Convolution" || type == "Deconvolution" ||
+       type == "InnerProduct") && blobs.size() > 1) {
+    cost.flops += top_count;
+  }
+  return cost;
+}
+
+template LayerCost EstimateForwardCost<float>(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top);
+template LayerCost EstimateForwardCost<double>(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top);
+
+void WriteLayerProfiles(const vector<LayerProfile>& layers,
+    const double peak_gflops, const double peak_gbps,
+    const string& filename) {
+  const bool roofline = peak_gflops > 0 && peak_gbps > 0;
+  double forward_ms = 0;
+  double backward_ms = 0;
+  double flops = 0;
+  for (int i = 0; i < layers.size(); ++i) {
+    forward_ms += layers[i].forward_ms;
+    backward_ms += layers[i].backward_ms;
+    flops += layers[i].cost.flops;
+  }
+  std::ofstream output(filename.c_str());
+  CHECK(output.is_open()) << "Failed to open " << filename;
+  output << "{\n  \"forward_ms\": " << forward_ms
+      << ",\n  \"backward_ms\": " << backward_ms
+      << ",\n  \"forward_flops\": " << flops
+      << ",\n  \"forward_gflops_per_second\": "
+      << (forward_ms > 0 ? flops / forward_ms / 1e6 : 0);
+  if (roofline) {
+    output << ",\n  \"peak_gflops\": " << peak_gflops
+        << ",\n  \"peak_gbps\": " << peak_gbps;
+  }
+  output << ",\n  \"layers\": [";
+  const vector<int> ranking = RankByForwardTime(layers);
+  for (int i = 0; i < ranking.size(); ++i) {
+    const LayerProfile& layer = layers[ranking[i]];
+    output << (i ? ",\n" : "\n") << "    {\"name\": "
+        << JsonString(layer.name) << ", \"type\": " << JsonString(layer.type)
+        << ", \"index\": " << ranking[i]
+        << ", \"fused\": " << (layer.fused ? "true" : "false")
+        << ", \"forward_ms\": " << layer.forward_ms
+        << ", \"backward_ms\": " << layer.backward_ms
+        << ", \"flops\": " << layer.cost.flops
+        << ", \"bytes_read\": " << layer.cost.bytes_read
+        << ", \"bytes_written\": " << layer.cost.bytes_written
+        << ", \"gflops_per_second\": " << layer.gflops_per_second()
+        << ", \"intensity\": " << layer.cost.intensity();
+    if (roofline && layer.cost.flops > 0) {
+      const double bound = RooflineGflops(layer.cost.intensity(),
+          peak_gflops, peak_gbps);
+      output << ", \"roofline_gflops\": " << bound
+          << ", \"bound\": "
+          << (bound < peak_gflops ? "\"memory\"" : "\"compute\"");
+    }
+    output << "}";
+  }
+  output << "\n  ]\n}\n";
+  CHECK(output.good()) << "Failed to write " << filename;
+}
+
+void LogLayerProfiles(const vector<LayerProfile>& layers,
+    const double peak_gflops, const double peak_gbps, const int max_layers) {
+  const bool roofline = peak_gflops > 0 && peak_gbps > 0;
+  double forward_ms = 0;
+  for (int i = 0; i < layers.size(); ++i) {
+    forward_ms += layers[i].forward_ms;
+  }
+  const vector<int> ranking = RankByForwardTime(layers);
+  LOG(INFO) << "Layers by forward time:";
+  for (int i = 0; i < ranking.size() && i < max_layers; ++i) {
+    const LayerProfile& layer = layers[ranking[i]];
+    std::ostringstream line;
+    line << std::setfill(' ') << std::setw(10) << layer.name << "\t"
+        << layer.forward_ms << " ms ("
+        << std::setprecision(3)
+        << (forward_ms > 0 ? 100 * layer.forward_ms / forward_ms : 0)
+        << "%), " << layer.gflops_per_second() << " GFLOP/s, "
+        << layer.cost.intensity() << " FLOP/byte";
+    if (roofline && layer.cost.flops > 0) {
+      const double bound = RooflineGflops(layer.cost.intensity(),
+          peak_gflops, peak_gbps);
+      line << ", " << 100 * layer.gflops_per_second() / bound << "% of the "
+          << (bound < peak_gflops ? "memory" : "compute") << " roofline";
+    }
+    LOG(INFO) << line.str();
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/util/quantize.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+Dtype caffe_cpu_amax(const int n, const Dtype* x) {
+  Dtype amax = 0;
+  for (int i = 0; i < n; ++i) {
+    amax = std::max(amax, std::abs(x[i]));
+  }
+  return amax;
+}
+
+template float caffe_cpu_amax<float>(const int n, const float* x);
+template double caffe_cpu_amax<double>(const int n, const double* x);
+
+template <typename Dtype>
+void caffe_cpu_quantize(const int n, const Dtype scale, const Dtype* x,
+    int16_t* y) {
+  for (int i = 0; i < n; ++i) {
+    const Dtype v = std::min(std::max(x[i] * scale, Dtype(-127)), Dtype(127));
+    // Round half away from zero; the cast truncates.
+    y[i] = static_cast<int16_t>(v < 0 ? v - Dtype(0.5) : v + Dtype(0.5));
+  }
+}
+
+template void caffe_cpu_quantize<float>(const int n, const float scale,
+    const float* x, int16_t* y);
+template void caffe_cpu_quantize<double>(const int n, const double scale,
+    const double* x, int16_t* y);
+
+void caffe_cpu_gemm_s16(const int M, const int N, const int K,
+    const int16_t* A, const int16_t* B, int32_t* C) {
+  int i = 0;
+  for (; i + 4 <= M; i += 4) {
+    const int16_t* a0 = A + i * K;
+    const int16_t* a1 = a0 + K;
+    const int16_t* a2 = a1 + K;
+    const int16_t* a3 = a2 + K;
+    int32_t* c0 = C + i * N;
+    int32_t* c1 = c0 + N;
+    int32_t* c2 = c1 + N;
+    int32_t* c3 = c2 + N;
+    int j = 0;
+    for (; j + 2 <= N; j += 2) {
+      const int16_t* b0 = B + j * K;
+      const int16_t* b1 = b0 + K;
+      int32_t sum00 = 0, sum10 = 0, sum20 = 0, sum30 = 0;
+      int32_t sum01 = 0, sum11 = 0, sum21 = 0, sum31 = 0;
+      for (int k = 0; k < K; ++k) {
+        sum00 += a0[k] * b0[k];
+        sum10 += a1[k] * b0[k];
+        sum20 += a2[k] * b0[k];
+        sum30 += a3[k] * b0[k];
+        sum01 += a0[k] * b1[k];
+        sum11 += a1[k] * b1[k];
+        sum21 += a2[k] * b1[k];
+        sum31 += a3[k] * b1[k];
+      }
+      c0[j] = sum00;
+      c1[j] = sum10;
+      c2[j] = sum20;
+      c3[j] = sum30;
+      c0[j + 1] = sum01;
+      c1[j + 1] = sum11;
+      c2[j + 1] = sum21;
+      c3[j + 1] = sum31;
+    }
+    for (; j < N; ++j) {
+      const int16_t* b = B + j * K;
+      int32_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+      for (int k = 0; k < K; ++k) {
+        sum0 += a0[k] * b[k];
+        sum1 += a1[k] * b[k];
+        sum2 += a2[k] * b[k];
+        sum3 += a3[k] * b[k];
+      }
+      c0[j] = sum0;
+      c1[j] = sum1;
+      c2[j] = sum2;
+      c3[j] = sum3;
+    }
+  }
+  for (; i < M; ++i) {
+    const int16_t* a = A + i * K;
+    for (int j = 0; j < N; ++j) {
+      const int16_t* b = B + j * K;
+      int32_t sum = 0;
+      for (int k = 0; k < K; ++k) {
+        sum += a[k] * b[k];
+      }
+      C[i * N + j] = sum;
+    }
+  }
+}
+
+template <typename Dtype>
+void QuantizedWeights<Dtype>::Update(const Blob<Dtype>& weights,
+    const int rows, const bool transpose) {
+  if (cached_memory_ == weights.data() &&
+      cached_version_ == weights.data()->version()) {
+    return;
+  }
+  const int cols = weights.count() / rows;
+  CHECK_EQ(rows * cols, weights.count());
+  const Dtype* w = weights.cpu_data();
+  vector<Dtype> transposed;
+  if (transpose) {
+    transposed.resize(weights.count());
+    for (int i = 0; i < cols; ++i) {
+      for (int j = 0; j < rows; ++j) {
+        transposed[j * cols + i] = w[i * rows + j];
+      }
+    }
+    w = &transposed[0];
+  }
+  data_.resize(weights.count());
+  scales_.resize(rows);
+  for (int i = 0; i < rows; ++i) {
+    const Dtype scale = QuantizationScale(caffe_cpu_amax(cols, w + i * cols));
+    caffe_cpu_quantize(cols, scale, w + i * cols, &data_[i * cols]);
+    scales_[i] = 1 / scale;
+  }
+  cached_memory_ = weights.data();
+  cached_version_ = cached_memory_->version();
+}
+
+INSTANTIATE_CLASS(QuantizedWeights);
+
+template <typename Dtype>
+void CalibrateQuantization(Net<Dtype>* net, const int iterations,
+    NetParameter* param) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net->layers();
+  const vector<vector<Blob<Dtype>*> >& bottom_vecs = net->bottom_vecs();
+  map<int, vector<Dtype> > ranges;
+  for (int i = 0; i < layers.size(); ++i) {
+    const string type = layers[i]->type();
+    if (type == "Convolution" || type == "InnerProduct") {
+      ranges[i].assign(bottom_vecs[i].size(), Dtype(0));
+    }
+  }
+  for (int iter = 0; iter < iterations; ++iter) {
+    // Look at every bottom right before its layer runs, as later in-place
+    // layers or shared memory may overwrite it.
+    for (int i = 0; i < layers.size(); ++i) {
+      if (ranges.count(i)) {
+        vector<Dtype>& layer_ranges = ranges[i];
+        for (int j = 0; j < bottom_vecs[i].size(); ++j) {
+          const Blob<Dtype>* bottom = bottom_vecs[i][j];
+          layer_ranges[j] = std::max(layer_ranges[j],
+              caffe_cpu_amax(bottom->count(), bottom->cpu_data()));
+        }
+      }
+      net->ForwardFromTo(i, i);
+    }
+  }
+  map<string, int> layer_ids;
+  for (typename map<int, vector<Dtype> >::const_iterator it = ranges.begin();
+       it != ranges.end(); ++it) {
+    layer_ids[net->layer_names()[it->first]] = it->first;
+  }
+  int num_calibrated = 0;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer_param = param->mutable_layer(i);
+    map<string, int>::const_iterator it = layer_ids.find(layer_param->name());
+    if (it == layer_ids.end()) {
+      continue;
+    }
+    const vector<Dtype>& layer_ranges = ranges[it->second];
+    QuantizationParameter* quantization_param =
+        layer_param->mutable_quantization_param();
+    quantization_param->clear_bottom_range();
+    for (int j = 0; j < layer_ranges.size(); ++j) {
+      quantization_param->add_bottom_range(layer_ranges[j]);
+      LOG(INFO) << "Layer " << layer_param->name() << ", bottom " << j
+          << ": range " << layer_ranges[j];
+    }
+    ++num_calibrated;
+  }
+  LOG(INFO) << "Calibrated " << num_calibrated << " of " << layer_ids.size()
+      << " Convolution and InnerProduct layers over " << iterations
+      << " iterations.";
+}
+
+template void CalibrateQuantization<float>(Net<float>* net,
+    const int iterations, NetParameter* param);
+template void CalibrateQuantization<double>(Net<double>* net,
+    const int iterations, NetParameter* param);
+
+}  // namespace caffe
@@ -0,0 +1,187 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::sync {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable work_condition_;
+  boost::condition_variable done_condition_;
+  // Serializes Run() calls coming from different threads.
+  boost::mutex run_mutex_;
+};
+
+namespace {
+
+// The pool and thread index the current thread is executing tasks for, used
+// to run nested parallel loops inline instead of deadlocking on the pool.
+struct WorkerContext {
+  const ThreadPool* pool;
+  int thread_id;
+};
+
+boost::thread_specific_ptr<WorkerContext> worker_context_;
+
+boost::mutex global_mutex_;
+shared_ptr<ThreadPool> global_pool_;
+
+int ResolveNumThreads(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = boost::thread::hardware_concurrency();
+  }
+  return std::max(num_threads, 1);
+}
+
+// Smaller copies are not worth waking the pool for.
+const size_t kMinParallelCopyBytes = 1 << 21;
+
+void CopyChunk(char* dst, const char* src, size_t bytes, size_t chunk_bytes,
+    int task_id, int thread_id) {
+  const size_t begin = task_id * chunk_bytes;
+  memcpy(dst + begin, src + begin, std::min(chunk_bytes, bytes - begin));
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(ResolveNumThreads(num_threads)), sync_(new sync()),
+      task_(NULL), num_tasks_(0), next_task_(0), done_tasks_(0),
+      generation_(0), stop_(false) {
+  // The calling thread of Run() takes part as thread 0.
+  for (int i = 1; i < num_threads_; ++i) {
+    try {
+      workers_.push_back(shared_ptr<boost::thread>(
+          new boost::thread(&ThreadPool::WorkerEntry, this, i)));
+    } catch (std::exception& e) {
+      LOG(FATAL) << "Thread exception: " << e.what();
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    stop_ = true;
+  }
+  sync_->work_condition_.notify_all();
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->join();
+  }
+}
+
+void ThreadPool::Run(int num_tasks, const Task& task) {
+  if (num_tasks <= 0) {
+    return;
+  }
+  WorkerContext* context = worker_context_.get();
+  if (context && context->pool == this) {
+    // Nested call from one of our own tasks: run serially on this thread.
+    for (int i = 0; i < num_tasks; ++i) {
+      task(i, context->thread_id);
+    }
+    return;
+  }
+  // Without workers to share, concurrent callers need not wait for each
+  // other.
+  if (num_threads_ == 1 || num_tasks == 1) {
+    for (int i = 0; i < num_tasks; ++i) {
+      task(i, 0);
+    }
+    return;
+  }
+  boost::mutex::scoped_lock run_lock(sync_->run_mutex_);
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    task_ = &task;
+    num_tasks_ = num_tasks;
+    next_task_ = 0;
+    done_tasks_ = 0;
+    ++generation_;
+  }
+  sync_->work_condition_.notify_all();
+  WorkerContext* previous = worker_context_.release();
+  worker_context_.reset(new WorkerContext());
+  worker_context_->pool = this;
+  worker_context_->thread_id = 0;
+  Drain(0);
+  worker_context_.reset(previous);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (done_tasks_ < num_tasks_) {
+    sync_->done_condition_.wait(lock);
+  }
+  task_ = NULL;
+}
+
+void ThreadPool::Drain(int thread_id) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (next_task_ < num_tasks_) {
+    const int task_id = next_task_++;
+    const Task* task = task_;
+    lock.unlock();
+    (*task)(task_id, thread_id);
+    lock.lock();
+    if (++done_tasks_ == num_tasks_) {
+      sync_->done_condition_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::WorkerEntry(int thread_id) {
+  worker_context_.reset(new WorkerContext());
+  worker_context_->pool = this;
+  worker_context_->thread_id = thread_id;
+  int seen_generation = 0;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (!stop_ && generation_ == seen_generation) {
+        sync_->work_condition_.wait(lock);
+      }
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+    }
+    Drain(thread_id);
+  }
+}
+
+ThreadPool& ThreadPool::Global() {
+  boost::mutex::scoped_lock lock(global_mutex_);
+  if (!global_pool_) {
+    global_pool_.reset(new ThreadPool(0));
+  }
+  return *global_pool_;
+}
+
+void ParallelMemcpy(void* dst, const void* src, size_t bytes) {
+  ThreadPool& pool = ThreadPool::Global();
+  const size_t max_chunks = std::max<size_t>(bytes / kMinParallelCopyBytes, 1);
+  const int num_chunks = std::min<size_t>(pool.num_threads(), max_chunks);
+  if (num_chunks == 1) {
+    memcpy(dst, src, bytes);
+    return;
+  }
+  // Chunks of whole cache lines.
+  const size_t chunk_bytes = (bytes / num_chunks + 63) / 64 * 64;
+  pool.Run((bytes + chunk_bytes - 1) / chunk_bytes, boost::bind(&CopyChunk,
+      static_cast<char*>(dst), static_cast<const char*>(src), bytes,
+      chunk_bytes, _1, _2));
+}
+
+void ThreadPool::SetGlobalThreads(int num_threads) {
+  boost::mutex::scoped_lock lock(global_mutex_);
+  if (global_pool_ &&
+      global_pool_->num_threads() == ResolveNumThreads(num_threads)) {
+    return;
+  }
+  global_pool_.reset(new ThreadPool(num_threads));
+}
+
+}  // namespace caffe
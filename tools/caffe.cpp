@@ -13,7 +13,11 @@ namespace bp = boost::python;
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/fold_batch_norm.hpp"
+#include "caffe/util/profiler.hpp"
 #include "caffe/util/signal_handler.h"
+#include "caffe/util/thread_pool.hpp"
 
 using caffe::Blob;
 using caffe::Caffe;
@@ -30,6 +34,11 @@ DEFINE_string(gpu, "",
     "Optional; run in GPU mode on given device IDs separated by ','."
     "Use '-gpu all' to run on all available GPUs. The effective training "
     "batch size is multiplied by the number of devices.");
+DEFINE_int32(threads, 1,
+    "Optional; train on the CPU with a solver and net on each of this many "
+    "threads. The effective training batch size is multiplied by the number "
+    "of threads. The solvers share the pool of cpu_threads, which runs the "
+    "parallel loops of one solver at a time.");
 DEFINE_string(solver, "",
     "The solver definition protocol buffer text file.");
 DEFINE_string(model, "",
@@ -48,6 +57,29 @@ DEFINE_string(weights, "",
     "separated by ','. Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_bool(fold_batch_norm, false,
+    "Optional; fold the normalization layers following Convolution and "
+    "InnerProduct layers into their weights. Only used in the TEST phase.");
+DEFINE_bool(quantize, false,
+    "Optional; run the Convolution and InnerProduct layers on the INT8 "
+    "engine, with the ranges calibrated by calibrate_quantization. Only used "
+    "in the TEST phase.");
+DEFINE_string(output, "",
+    "The prefix of the .prototxt and .caffemodel files written by 'fold'.");
+DEFINE_string(profile, "",
+    "Optional; the prefix of the files written by 'time': PREFIX.json, the "
+    "per-layer time, FLOPs and bytes moved, and PREFIX.trace.json, a trace "
+    "of the last iteration and the data prefetch threads for "
+    "chrome://tracing.");
+DEFINE_double(peak_gflops, 0,
+    "Optional; the peak GFLOP/s of the device, to place the layers profiled "
+    "by 'time' on a roofline. Needs peak_gbps.");
+DEFINE_double(peak_gbps, 0,
+    "Optional; the peak memory bandwidth of the device in GB/s, to place "
+    "the layers profiled by 'time' on a roofline. Needs peak_gflops.");
+DEFINE_int32(cpu_threads, 0,
+    "Optional; size of the thread pool used by the parallel CPU engines. "
+    "Defaults to the number of hardware threads.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -127,6 +159,24 @@ vector<string> get_stages_from_flags() {
   return stages;
 }
 
+// Read the model definition and set its state from flags
+void get_net_param_from_flags(caffe::Phase phase,
+    caffe::NetParameter* param) {
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, param);
+  param->mutable_state()->set_phase(phase);
+  vector<string> stages = get_stages_from_flags();
+  for (int i = 0; i < stages.size(); ++i) {
+    param->mutable_state()->add_stage(stages[i]);
+  }
+  param->mutable_state()->set_level(FLAGS_level);
+  if (FLAGS_fold_batch_norm) {
+    param->set_fold_batch_norm(true);
+  }
+  if (FLAGS_quantize) {
+    param->set_quantize(true);
+  }
+}
+
 // caffe commands to call by
 //     caffe <command> <args>
 //
@@ -193,10 +243,14 @@ int train() {
 
   vector<int> gpus;
   get_gpus(&gpus);
+  CHECK_GE(FLAGS_threads, 1) << "Need at least one thread to train.";
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(FLAGS_threads);
   } else {
+    CHECK_EQ(FLAGS_threads, 1) << "Train on several GPUs or threads, "
+        "not both.";
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
       s << (i ? ", " : "") << gpus[i];
@@ -237,6 +291,9 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (FLAGS_threads > 1) {
+    caffe::CPUSync<float> sync(solver, NULL, 0);
+    sync.Run(FLAGS_threads);
   } else {
     solver->Solve();
   }
@@ -250,7 +307,6 @@ RegisterBrewFunction(train);
 int test() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to score.";
   CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to score.";
-  vector<string> stages = get_stages_from_flags();
 
   // Set device id and mode
   vector<int> gpus;
@@ -269,7 +325,9 @@ int test() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
+  caffe::NetParameter net_param;
+  get_net_param_from_flags(caffe::TEST, &net_param);
+  Net<float> caffe_net(net_param);
   caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
   LOG(INFO) << "Running for " << FLAGS_iterations << " iterations.";
 
@@ -323,7 +381,6 @@ RegisterBrewFunction(test);
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
   caffe::Phase phase = get_phase_from_flags(caffe::TRAIN);
-  vector<string> stages = get_stages_from_flags();
 
   // Set device id and mode
   vector<int> gpus;
@@ -337,7 +394,9 @@ int time() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  caffe::NetParameter net_param;
+  get_net_param_from_flags(phase, &net_param);
+  Net<float> caffe_net(net_param);
 
   // Do a clean forward and backward pass, so that memory allocation are done
   // and future iterations will be more stable.
@@ -355,6 +414,7 @@ int time() {
   const vector<vector<Blob<float>*> >& top_vecs = caffe_net.top_vecs();
   const vector<vector<bool> >& bottom_need_backward =
       caffe_net.bottom_need_backward();
+  const vector<bool>& layer_fused = caffe_net.layer_fused();
   LOG(INFO) << "*** Benchmark begins ***";
   LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
   Timer total_timer;
@@ -366,24 +426,53 @@ int time() {
   std::vector<double> backward_time_per_layer(layers.size(), 0.0);
   double forward_time = 0.0;
   double backward_time = 0.0;
+  // The last iteration is traced, together with whatever the data prefetch
+  // threads do meanwhile. Layer events take their duration from the timer,
+  // which waits for the device in GPU mode.
+  caffe::Profiler& profiler = caffe::Profiler::Global();
+  const bool profile = !FLAGS_profile.empty();
+  if (profile) {
+    profiler.SetThreadName("caffe time");
+  }
   for (int j = 0; j < FLAGS_iterations; ++j) {
+    const bool trace = profile && j == FLAGS_iterations - 1;
+    if (trace) {
+      profiler.Clear();
+      profiler.Enable(true);
+    }
     Timer iter_timer;
     iter_timer.Start();
     forward_timer.Start();
     for (int i = 0; i < layers.size(); ++i) {
+      if (layer_fused[i] && Caffe::mode() == Caffe::CPU) { continue; }
+      const double start_us = trace ? profiler.Now() : 0;
       timer.Start();
       layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
+      const float layer_time = timer.MicroSeconds();
+      forward_time_per_layer[i] += layer_time;
+      if (trace) {
+        profiler.AddEvent(layers[i]->layer_param().name(), "forward",
+            start_us, layer_time);
+      }
     }
     forward_time += forward_timer.MicroSeconds();
     backward_timer.Start();
     for (int i = layers.size() - 1; i >= 0; --i) {
+      const double start_us = trace ? profiler.Now() : 0;
       timer.Start();
       layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
                           bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
+      const float layer_time = timer.MicroSeconds();
+      backward_time_per_layer[i] += layer_time;
+      if (trace) {
+        profiler.AddEvent(layers[i]->layer_param().name(), "backward",
+            start_us, layer_time);
+      }
     }
     backward_time += backward_timer.MicroSeconds();
+    if (trace) {
+      profiler.Enable(false);
+    }
     LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
       << iter_timer.MilliSeconds() << " ms.";
   }
@@ -406,10 +495,80 @@ int time() {
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+
+  vector<caffe::LayerProfile> profiles(layers.size());
+  for (int i = 0; i < layers.size(); ++i) {
+    caffe::LayerProfile& layer_profile = profiles[i];
+    layer_profile.name = layers[i]->layer_param().name();
+    layer_profile.type = layers[i]->type();
+    layer_profile.forward_ms = forward_time_per_layer[i] / 1000 /
+        FLAGS_iterations;
+    layer_profile.backward_ms = backward_time_per_layer[i] / 1000 /
+        FLAGS_iterations;
+    layer_profile.fused = layer_fused[i] && Caffe::mode() == Caffe::CPU;
+    layer_profile.cost = caffe::EstimateForwardCost(layers[i].get(),
+        bottom_vecs[i], top_vecs[i]);
+  }
+  caffe::LogLayerProfiles(profiles, FLAGS_peak_gflops, FLAGS_peak_gbps, 10);
+  for (int i = 0; i < layers.size(); ++i) {
+    const caffe::BasePrefetchingDataLayer<float>* data_layer =
+        dynamic_cast<caffe::BasePrefetchingDataLayer<float>*>(
+            layers[i].get());
+    if (!data_layer) { continue; }
+    const caffe::PrefetchStats& stats = data_layer->prefetch_stats();
+    LOG(INFO) << layers[i]->layer_param().name() << " prefetch: "
+        << stats.stalls << " of " << stats.batches << " batches waited for, "
+        << stats.stall_ms << " ms in all; " << stats.mean_occupancy()
+        << " batches ready on average.";
+  }
+  if (profile) {
+    const string report_filename = FLAGS_profile + ".json";
+    LOG(INFO) << "Writing " << report_filename;
+    caffe::WriteLayerProfiles(profiles, FLAGS_peak_gflops, FLAGS_peak_gbps,
+        report_filename);
+    const string trace_filename = FLAGS_profile + ".trace.json";
+    LOG(INFO) << "Writing " << trace_filename;
+    profiler.WriteChromeTrace(trace_filename);
+  }
   return 0;
 }
 RegisterBrewFunction(time);
 
+
+// Fold: write a TEST-phase model with its normalization layers folded into
+// the weights of the layers they follow.
+int fold() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to fold.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to fold.";
+  CHECK_GT(FLAGS_output.size(), 0) << "Need an output prefix to write to.";
+  Caffe::set_mode(Caffe::CPU);
+  caffe::NetParameter net_param;
+  get_net_param_from_flags(caffe::TEST, &net_param);
+  net_param.set_fold_batch_norm(true);
+  Net<float> caffe_net(net_param);
+  caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+
+  // The definition of the folded net, for the given state.
+  caffe::NetParameter filtered_param, folded_param;
+  Net<float>::FilterNet(net_param, &filtered_param);
+  vector<std::pair<string, caffe::LayerParameter> > folded_layers;
+  caffe::FoldBatchNormLayers(filtered_param, &folded_param, &folded_layers);
+  folded_param.clear_fold_batch_norm();
+  folded_param.clear_state();
+  const string model_filename = FLAGS_output + ".prototxt";
+  LOG(INFO) << "Folded " << folded_layers.size() << " layers; writing "
+      << model_filename;
+  caffe::WriteProtoToTextFile(folded_param, model_filename);
+
+  caffe::NetParameter weights_param;
+  caffe_net.ToProto(&weights_param, false);
+  const string weights_filename = FLAGS_output + ".caffemodel";
+  LOG(INFO) << "Writing " << weights_filename;
+  caffe::WriteProtoToBinaryFile(weights_param, weights_filename);
+  return 0;
+}
+RegisterBrewFunction(fold);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -422,9 +581,13 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  fold            fold normalization layers into the weights");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  if (FLAGS_cpu_threads > 0) {
+    caffe::ThreadPool::SetGlobalThreads(FLAGS_cpu_threads);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
@@ -0,0 +1,492 @@
+// Micro-benchmarks of the hot CPU kernels: im2col, GEMM shapes from real
+// nets, the Pooling, LRN, Softmax, PixelShuffle and Upsample layers, data
+// transformation, box decoding, NMS and blob resizing.
+//
+// Every benchmark prepares its inputs once, then runs its kernel for
+// growing iteration counts until one batch takes at least --min_time
+// seconds, and reports the best time per iteration over --repetitions such
+// batches. The JSON written by --output uses the field names of Google
+// Benchmark, so tools/extra/compare_bench.py and similar tools can compare
+// two runs.
+// Usage:
+//    caffe_bench [--filter=REGEX] [--min_time=S] [--output=FILE.json]
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/regex.hpp"
+#include "google/protobuf/text_format.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/layer_factory.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/bbox_util.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/im2col.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+#include "caffe/util/util_img.hpp"
+
+using caffe::Blob;
+using caffe::Caffe;
+using caffe::CPUTimer;
+using caffe::Layer;
+using caffe::LayerParameter;
+using caffe::NormalizedBBox;
+using caffe::shared_ptr;
+using caffe::string;
+using caffe::vector;
+
+DEFINE_string(filter, "",
+    "Optional; only run the benchmarks whose name matches this regex.");
+DEFINE_double(min_time, 0.2,
+    "The minimum time in seconds of each timed batch of iterations.");
+DEFINE_int32(repetitions, 3,
+    "The number of timed batches per benchmark; the fastest is reported.");
+DEFINE_string(output, "",
+    "Optional; the JSON file to write the results to.");
+DEFINE_int32(cpu_threads, 0,
+    "Optional; size of the thread pool used by the parallel CPU engines. "
+    "Defaults to the number of hardware threads.");
+
+// A kernel to time. The constructor prepares the inputs, outside of the
+// timing; Run() executes one iteration.
+class Benchmark {
+ public:
+  explicit Benchmark(const string& name) : name_(name), items_(0),
+      bytes_(0) {}
+  virtual ~Benchmark() {}
+  virtual void Run() = 0;
+
+  inline const string& name() const { return name_; }
+  // The items processed and the bytes read and written by one iteration,
+  // for throughput figures; 0 if unknown.
+  inline double items() const { return items_; }
+  inline double bytes() const { return bytes_; }
+
+ protected:
+  string name_;
+  double items_;
+  double bytes_;
+};
+
+static void FillGaussian(Blob<float>* blob) {
+  caffe::FillerParameter filler_param;
+  caffe::GaussianFiller<float> filler(filler_param);
+  filler.Fill(blob);
+}
+
+static vector<int> Shape(const int num, const int channels, const int height,
+    const int width) {
+  vector<int> shape(4);
+  shape[0] = num;
+  shape[1] = channels;
+  shape[2] = height;
+  shape[3] = width;
+  return shape;
+}
+
+class Im2colBenchmark : public Benchmark {
+ public:
+  Im2colBenchmark(const string& name, const int channels, const int size,
+      const int kernel, const int pad, const int stride)
+      : Benchmark("im2col/" + name), channels_(channels), size_(size),
+        kernel_(kernel), pad_(pad), stride_(stride),
+        image_(Shape(1, channels, size, size)) {
+    FillGaussian(&image_);
+    const int output_size = (size + 2 * pad - kernel) / stride + 1;
+    col_.resize(channels * kernel * kernel * output_size * output_size);
+    items_ = col_.size();
+    bytes_ = (image_.count() + col_.size()) * sizeof(float);
+  }
+  virtual void Run() {
+    caffe::im2col_cpu(image_.cpu_data(), channels_, size_, size_, kernel_,
+        kernel_, pad_, pad_, stride_, stride_, 1, 1, &col_[0]);
+  }
+
+ protected:
+  int channels_, size_, kernel_, pad_, stride_;
+  Blob<float> image_;
+  vector<float> col_;
+};
+
+// C = A * B for the M x K matrix A and the K x N matrix B, as a convolution
+// multiplies its weights with the columns of its input, or C = A * B^T as
+// an InnerProduct layer multiplies its input with its weights.
+class GemmBenchmark : public Benchmark {
+ public:
+  GemmBenchmark(const string& name, const int M, const int N, const int K,
+      const bool transpose_b)
+      : Benchmark("gemm/" + name), M_(M), N_(N), K_(K),
+        transpose_b_(transpose_b), a_(M * K), b_(K * N), c_(M * N) {
+    caffe::caffe_rng_gaussian<float>(a_.size(), 0, 1, &a_[0]);
+    caffe::caffe_rng_gaussian<float>(b_.size(), 0, 1, &b_[0]);
+    items_ = 2. * M * N * K;
+    bytes_ = (a_.size() + b_.size() + c_.size()) * sizeof(float);
+  }
+  virtual void Run() {
+    caffe::caffe_cpu_gemm<float>(CblasNoTrans,
+        transpose_b_ ? CblasTrans : CblasNoTrans, M_, N_, K_, 1.f, &a_[0],
+        &b_[0], 0.f, &c_[0]);
+  }
+
+ protected:
+  int M_, N_, K_;
+  bool transpose_b_;
+  vector<float> a_, b_, c_;
+};
+
+// The forward pass of a layer given as a LayerParameter prototxt.
+class LayerBenchmark : public Benchmark {
+ public:
+  LayerBenchmark(const string& name, const string& layer_param_text,
+      const vector<int>& bottom_shape)
+      : Benchmark(name), bottom_(bottom_shape) {
+    LayerParameter layer_param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(layer_param_text,
+        &layer_param)) << "Invalid layer parameter for " << name;
+    layer_param.set_name(name);
+    layer_param.set_phase(caffe::TEST);
+    FillGaussian(&bottom_);
+    bottom_vec_.push_back(&bottom_);
+    top_vec_.push_back(&top_);
+    layer_ = caffe::LayerRegistry<float>::CreateLayer(layer_param);
+    layer_->SetUp(bottom_vec_, top_vec_);
+    items_ = top_.count();
+    bytes_ = (bottom_.count() + top_.count()) * sizeof(float);
+  }
+  virtual void Run() {
+    layer_->Forward(bottom_vec_, top_vec_);
+  }
+
+ protected:
+  Blob<float> bottom_, top_;
+  vector<Blob<float>*> bottom_vec_, top_vec_;
+  shared_ptr<Layer<float> > layer_;
+};
+
+// Mean subtraction, scaling, random cropping and mirroring of an 8-bit
+// image, as the data layers do for every training image.
+class TransformBenchmark : public Benchmark {
+ public:
+  TransformBenchmark(const string& name, const int size, const int crop_size)
+      : Benchmark("transform/" + name),
+        transformed_(Shape(1, 3, crop_size, crop_size)) {
+    caffe::TransformationParameter transform_param;
+    transform_param.set_crop_size(crop_size);
+    transform_param.set_mirror(true);
+    transform_param.set_scale(1. / 255);
+    transform_param.add_mean_value(104);
+    transform_param.add_mean_value(117);
+    transform_param.add_mean_value(123);
+    transformer_.reset(new caffe::DataTransformer<float>(transform_param,
+        caffe::TRAIN));
+    transformer_->InitRand();
+    datum_.set_channels(3);
+    datum_.set_height(size);
+    datum_.set_width(size);
+    string data(3 * size * size, 0);
+    for (int i = 0; i < data.size(); ++i) {
+      data[i] = static_cast<char>(caffe::caffe_rng_rand() % 256);
+    }
+    datum_.set_data(data);
+    items_ = transformed_.count();
+    bytes_ = data.size() + transformed_.count() * sizeof(float);
+  }
+  virtual void Run() {
+    transformer_->Transform(datum_, &transformed_);
+  }
+
+ protected:
+  caffe::Datum datum_;
+  Blob<float> transformed_;
+  shared_ptr<caffe::DataTransformer<float> > transformer_;
+};
+
+// Random boxes of up to a quarter of the image, each side in [0, 1].
+static void RandomBBoxes(const int num, vector<NormalizedBBox>* bboxes) {
+  vector<float> coords(4 * num);
+  caffe::caffe_rng_uniform<float>(coords.size(), 0, 1, &coords[0]);
+  bboxes->resize(num);
+  for (int i = 0; i < num; ++i) {
+    NormalizedBBox& bbox = (*bboxes)[i];
+    bbox.set_xmin(coords[4 * i] * 0.75);
+    bbox.set_ymin(coords[4 * i + 1] * 0.75);
+    bbox.set_xmax(bbox.xmin() + 0.05 + coords[4 * i + 2] * 0.2);
+    bbox.set_ymax(bbox.ymin() + 0.05 + coords[4 * i + 3] * 0.2);
+  }
+}
+
+// The location predictions of an SSD head decoded against its priors.
+class DecodeBBoxesBenchmark : public Benchmark {
+ public:
+  DecodeBBoxesBenchmark(const string& name, const int num_priors)
+      : Benchmark("decode_bboxes/" + name),
+        prior_variances_(num_priors, vector<float>(4)) {
+    RandomBBoxes(num_priors, &prior_bboxes_);
+    for (int i = 0; i < num_priors; ++i) {
+      prior_variances_[i][0] = prior_variances_[i][1] = 0.1;
+      prior_variances_[i][2] = prior_variances_[i][3] = 0.2;
+    }
+    vector<float> offsets(4 * num_priors);
+    caffe::caffe_rng_gaussian<float>(offsets.size(), 0, 1, &offsets[0]);
+    bboxes_.resize(num_priors);
+    for (int i = 0; i < num_priors; ++i) {
+      bboxes_[i].set_xmin(offsets[4 * i]);
+      bboxes_[i].set_ymin(offsets[4 * i + 1]);
+      bboxes_[i].set_xmax(offsets[4 * i + 2]);
+      bboxes_[i].set_ymax(offsets[4 * i + 3]);
+    }
+    items_ = num_priors;
+  }
+  virtual void Run() {
+    caffe::DecodeBBoxes(prior_bboxes_, prior_variances_,
+        caffe::PriorBoxParameter_CodeType_CENTER_SIZE, false, false,
+        bboxes_, &decode_bboxes_);
+  }
+
+ protected:
+  vector<NormalizedBBox> prior_bboxes_, bboxes_, decode_bboxes_;
+  vector<vector<float> > prior_variances_;
+};
+
+// Non maximum suppression of the detections of one class, with the
+// thresholds of the SSD deploy nets.
+class NMSBenchmark : public Benchmark {
+ public:
+  NMSBenchmark(const string& name, const int num)
+      : Benchmark("nms/" + name), scores_(num) {
+    RandomBBoxes(num, &bboxes_);
+    caffe::caffe_rng_uniform<float>(num, 0, 1, &scores_[0]);
+    items_ = num;
+  }
+  virtual void Run() {
+    indices_.clear();
+    caffe::ApplyNMSFast(bboxes_, scores_, 0.01, 0.45, 1, 400, &indices_);
+  }
+
+ protected:
+  vector<NormalizedBBox> bboxes_;
+  vector<float> scores_;
+  vector<int> indices_;
+};
+
+// Bilinear resizing of a blob to the shape of another.
+class ResizeBenchmark : public Benchmark {
+ public:
+  ResizeBenchmark(const string& name, const vector<int>& src_shape,
+      const vector<int>& dst_shape)
+      : Benchmark("resize_blob/" + name), src_(src_shape), dst_(dst_shape) {
+    FillGaussian(&src_);
+    items_ = dst_.count();
+    bytes_ = (src_.count() + dst_.count()) * sizeof(float);
+  }
+  virtual void Run() {
+    caffe::ResizeBlob_cpu(&src_, &dst_);
+  }
+
+ protected:
+  Blob<float> src_, dst_;
+};
+
+static vector<shared_ptr<Benchmark> > CreateBenchmarks() {
+  vector<shared_ptr<Benchmark> > benchmarks;
+  // The column buffers of AlexNet conv1, a 3x3 ResNet convolution and a
+  // small 3x3 convolution late in a net.
+  benchmarks.push_back(shared_ptr<Benchmark>(new Im2colBenchmark(
+      "3x227x227_k11_s4", 3, 227, 11, 0, 4)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new Im2colBenchmark(
+      "64x56x56_k3_p1", 64, 56, 3, 1, 1)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new Im2colBenchmark(
+      "256x13x13_k3_p1", 256, 13, 3, 1, 1)));
+  // M x N x K of the convolutions of VGG-16 conv3_2, ResNet-50 res3a_branch2a
+  // and a MobileNet pointwise layer, and of AlexNet fc6 at batch 1 and 32.
+  benchmarks.push_back(shared_ptr<Benchmark>(new GemmBenchmark(
+      "vgg16_conv3_2_256x3136x2304", 256, 3136, 2304, false)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new GemmBenchmark(
+      "resnet50_res3a_128x784x512", 128, 784, 512, false)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new GemmBenchmark(
+      "mobilenet_pw_512x196x512", 512, 196, 512, false)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new GemmBenchmark(
+      "alexnet_fc6_1x4096x9216", 1, 4096, 9216, true)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new GemmBenchmark(
+      "alexnet_fc6_32x4096x9216", 32, 4096, 9216, true)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new LayerBenchmark(
+      "pooling/max_3x3_s2_64x112x112",
+      "type: 'Pooling' pooling_param { pool: MAX kernel_size: 3 stride: 2 }",
+      Shape(1, 64, 112, 112))));
+  benchmarks.push_back(shared_ptr<Benchmark>(new LayerBenchmark(
+      "pooling/ave_global_2048x7x7",
+      "type: 'Pooling' pooling_param { pool: AVE global_pooling: true }",
+      Shape(1, 2048, 7, 7))));
+  benchmarks.push_back(shared_ptr<Benchmark>(new LayerBenchmark(
+      "lrn/across_5_96x55x55",
+      "type: 'LRN' lrn_param { local_size: 5 alpha: 0.0001 beta: 0.75 }",
+      Shape(1, 96, 55, 55))));
+  benchmarks.push_back(shared_ptr<Benchmark>(new LayerBenchmark(
+      "lrn/within_3_32x56x56",
+      "type: 'LRN' lrn_param { local_size: 3 alpha: 0.00005 beta: 0.75 "
+      "norm_region: WITHIN_CHANNEL }",
+      Shape(1, 32, 56, 56))));
+  benchmarks.push_back(shared_ptr<Benchmark>(new LayerBenchmark(
+      "softmax/classifier_32x1000",
+      "type: 'Softmax'", Shape(32, 1000, 1, 1))));
+  // The confidences of SSD300: 21 classes at each of 8732 priors.
+  benchmarks.push_back(shared_ptr<Benchmark>(new LayerBenchmark(
+      "softmax/ssd300_8732x21",
+      "type: 'Softmax' softmax_param { axis: 2 }", Shape(1, 8732, 21, 1))));
+  benchmarks.push_back(shared_ptr<Benchmark>(new LayerBenchmark(
+      "pixelshuffle/x2_64x56x56",
+      "type: 'PixelShuffle' pixelshuffle_param { upscale_factor: 2 }",
+      Shape(1, 64, 56, 56))));
+  benchmarks.push_back(shared_ptr<Benchmark>(new LayerBenchmark(
+      "upsample/x2_128x38x38",
+      "type: 'Upsample' upsample_param { scale: 2 }",
+      Shape(1, 128, 38, 38))));
+  benchmarks.push_back(shared_ptr<Benchmark>(new TransformBenchmark(
+      "256_crop_224", 256, 224)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new DecodeBBoxesBenchmark(
+      "ssd300_8732", 8732)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new NMSBenchmark(
+      "ssd300_8732", 8732)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new NMSBenchmark(
+      "top_1000", 1000)));
+  benchmarks.push_back(shared_ptr<Benchmark>(new ResizeBenchmark(
+      "3x300x300_to_600x600", Shape(1, 3, 300, 300), Shape(1, 3, 600, 600))));
+  benchmarks.push_back(shared_ptr<Benchmark>(new ResizeBenchmark(
+      "21x75x75_to_300x300", Shape(1, 21, 75, 75), Shape(1, 21, 300, 300))));
+  return benchmarks;
+}
+
+struct BenchmarkResult {
+  string name;
+  int iterations;
+  // The best of the repetitions.
+  double nanoseconds;
+  double items_per_second;
+  double bytes_per_second;
+};
+
+static BenchmarkResult RunBenchmark(Benchmark* benchmark) {
+  BenchmarkResult result;
+  result.name = benchmark->name();
+  // Warm up, then find an iteration count that takes min_time.
+  benchmark->Run();
+  CPUTimer timer;
+  int iterations = 1;
+  double seconds;
+  while (true) {
+    timer.Start();
+    for (int i = 0; i < iterations; ++i) {
+      benchmark->Run();
+    }
+    seconds = timer.Seconds();
+    if (seconds >= FLAGS_min_time || iterations >= (1 << 30)) {
+      break;
+    }
+    // Aim for 1.4 min_time, and grow at most tenfold at a time.
+    const double target = 1.4 * FLAGS_min_time;
+    iterations = seconds > 0 ? std::min(10. * iterations,
+        iterations * target / seconds + 1) : 10 * iterations;
+  }
+  double best = seconds;
+  for (int r = 1; r < FLAGS_repetitions; ++r) {
+    timer.Start();
+    for (int i = 0; i < iterations; ++i) {
+      benchmark->Run();
+    }
+    best = std::min(best, static_cast<double>(timer.Seconds()));
+  }
+  result.iterations = iterations;
+  const double iteration_seconds = best / iterations;
+  result.nanoseconds = iteration_seconds * 1e9;
+  result.items_per_second = benchmark->items() / iteration_seconds;
+  result.bytes_per_second = benchmark->bytes() / iteration_seconds;
+  return result;
+}
+
+static void WriteResults(const vector<BenchmarkResult>& results,
+    const string& filename) {
+  std::ofstream output(filename.c_str());
+  CHECK(output.is_open()) << "Failed to open " << filename;
+  char date[64];
+  const time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+  output << "{\n  \"context\": {\"date\": \"" << date
+      << "\", \"executable\": \"caffe_bench\", \"num_threads\": "
+      << caffe::ThreadPool::Global().num_threads()
+      << ", \"min_time\": " << FLAGS_min_time
+      << ", \"repetitions\": " << FLAGS_repetitions << "},\n"
+      << "  \"benchmarks\": [";
+  for (int i = 0; i < results.size(); ++i) {
+    const BenchmarkResult& result = results[i];
+    output << (i ? ",\n" : "\n") << "    {\"name\": \"" << result.name
+        << "\", \"iterations\": " << result.iterations
+        << ", \"real_time\": " << result.nanoseconds
+        << ", \"cpu_time\": " << result.nanoseconds
+        << ", \"time_unit\": \"ns\"";
+    if (result.items_per_second > 0) {
+      output << ", \"items_per_second\": " << result.items_per_second;
+    }
+    if (result.bytes_per_second > 0) {
+      output << ", \"bytes_per_second\": " << result.bytes_per_second;
+    }
+    output << "}";
+  }
+  output << "\n  ]\n}\n";
+  CHECK(output.good()) << "Failed to write " << filename;
+}
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Time the hot CPU kernels of Caffe\n"
+        "Usage:\n"
+        "    caffe_bench [FLAGS]\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_min_time, 0);
+  CHECK_GT(FLAGS_repetitions, 0);
+  if (FLAGS_cpu_threads > 0) {
+    caffe::ThreadPool::SetGlobalThreads(FLAGS_cpu_threads);
+  }
+  Caffe::set_mode(Caffe::CPU);
+  Caffe::set_random_seed(1701);
+
+  const boost::regex filter(FLAGS_filter.empty() ? ".*" : FLAGS_filter);
+  const vector<shared_ptr<Benchmark> > benchmarks = CreateBenchmarks();
+  vector<BenchmarkResult> results;
+  printf("%-44s %14s %12s %12s %8s\n", "Benchmark", "Time", "Iterations",
+      "Items/s", "GB/s");
+  for (int i = 0; i < benchmarks.size(); ++i) {
+    if (!boost::regex_search(benchmarks[i]->name(), filter)) {
+      continue;
+    }
+    const BenchmarkResult result = RunBenchmark(benchmarks[i].get());
+    printf("%-44s %11.0f ns %12d %12.4g %8.2f\n", result.name.c_str(),
+        result.nanoseconds, result.iterations, result.items_per_second,
+        result.bytes_per_second / 1e9);
+    fflush(stdout);
+    results.push_back(result);
+  }
+  if (!FLAGS_output.empty()) {
+    LOG(INFO) << "Writing " << FLAGS_output;
+    WriteResults(results, FLAGS_output);
+  }
+  return 0;
+}
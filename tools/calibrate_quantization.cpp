@@ -0,0 +1,74 @@
+// This program runs a trained net over its data layer and records the range
+// of the inputs of its Convolution and InnerProduct layers, which the INT8
+// engines use to quantize them.
+// Usage:
+//   calibrate_quantization [FLAGS] MODEL WEIGHTS OUTPUT
+//
+// where MODEL is a net definition whose data layer (e.g. Data over an LMDB,
+// or ImageData) reads calibration images, WEIGHTS the trained .caffemodel and
+// OUTPUT the .prototxt written with the ranges. OUTPUT is a copy of --deploy,
+// or of MODEL if no deploy definition is given. Run the calibrated net with
+// `caffe test -quantize` or `caffe time -quantize`, or set quantize: true in
+// the definition.
+
+#include <string>
+
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/common.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+#include "caffe/util/quantize.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using caffe::Caffe;
+using caffe::Net;
+using caffe::NetParameter;
+using std::string;
+
+DEFINE_int32(iterations, 50,
+    "The number of batches to calibrate on.");
+DEFINE_string(deploy, "",
+    "Optional; the net definition to write the ranges into. "
+    "Defaults to MODEL.");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Record the input ranges of the Convolution and\n"
+        "InnerProduct layers of a trained net for int8 inference.\n"
+        "Usage:\n"
+        "    calibrate_quantization [FLAGS] MODEL WEIGHTS OUTPUT\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 4) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0],
+        "tools/calibrate_quantization");
+    return 1;
+  }
+
+  Caffe::set_mode(Caffe::CPU);
+  // Calibrate in floating point, even if MODEL asks for quantization.
+  NetParameter model_param;
+  caffe::ReadNetParamsFromTextFileOrDie(argv[1], &model_param);
+  model_param.mutable_state()->set_phase(caffe::TEST);
+  model_param.clear_quantize();
+  Net<float> net(model_param);
+  net.CopyTrainedLayersFrom(argv[2]);
+
+  NetParameter param;
+  caffe::ReadNetParamsFromTextFileOrDie(
+      FLAGS_deploy.empty() ? string(argv[1]) : FLAGS_deploy, &param);
+  caffe::CalibrateQuantization(&net, FLAGS_iterations, &param);
+  LOG(INFO) << "Writing " << argv[3];
+  caffe::WriteProtoToTextFile(param, argv[3]);
+  return 0;
+}
@@ -0,0 +1,33 @@
+// This program rewrites the weights of a trained net in half precision,
+// halving the size of the .caffemodel and the time to read it. The weights
+// are converted back to float or double when the model is loaded, so any
+// Caffe build reading half_data runs it unchanged.
+// Usage:
+//    convert_model_half WEIGHTS_IN WEIGHTS_OUT
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 3) {
+    LOG(ERROR) << "Usage: "
+        << "convert_model_half WEIGHTS_IN WEIGHTS_OUT";
+    return 1;
+  }
+
+  NetParameter net_param;
+  ReadNetParamsFromBinaryFileOrDie(string(argv[1]), &net_param);
+  ConvertBlobsToHalf(&net_param);
+  WriteProtoToBinaryFile(net_param, argv[2]);
+
+  LOG(INFO) << "Wrote half precision NetParameter binary proto to " << argv[2];
+  return 0;
+}
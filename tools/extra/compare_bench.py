@@ -0,0 +1,79 @@
+#!/usr/bin/env python
+
+"""
+Compare two runs of caffe_bench
+
+Prints the change in time of every benchmark present in both JSON files and
+exits with status 1 if any benchmark got slower than the threshold, so that
+it can gate a change:
+
+    caffe_bench --output=before.json
+    (rebuild with the change)
+    caffe_bench --output=after.json
+    compare_bench.py before.json after.json
+"""
+
+import argparse
+import json
+import sys
+
+
+def load_times(path):
+    """Return an ordered list of (name, time in ns) of the benchmarks in path
+    """
+
+    scale = {'ns': 1., 'us': 1e3, 'ms': 1e6, 's': 1e9}
+    with open(path) as f:
+        results = json.load(f)
+    times = []
+    for benchmark in results['benchmarks']:
+        unit = benchmark.get('time_unit', 'ns')
+        times.append((benchmark['name'],
+                      benchmark['real_time'] * scale[unit]))
+    return times
+
+
+def format_time(ns):
+    for unit, scale in (('s', 1e9), ('ms', 1e6), ('us', 1e3)):
+        if ns >= scale:
+            return '%.3g %s' % (ns / scale, unit)
+    return '%.3g ns' % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compare the times of two caffe_bench JSON outputs')
+    parser.add_argument('baseline', help='JSON file of the reference run')
+    parser.add_argument('contender', help='JSON file of the run to check')
+    parser.add_argument('--threshold', type=float, default=0.05,
+                        help='relative slowdown that counts as a regression '
+                        '(default: 0.05)')
+    args = parser.parse_args()
+
+    baseline = dict(load_times(args.baseline))
+    regressions = []
+    print('%-44s %12s %12s %8s' % ('Benchmark', 'Baseline', 'Contender',
+                                   'Change'))
+    for name, time in load_times(args.contender):
+        if name not in baseline:
+            print('%-44s %12s %12s %8s' % (name, '-', format_time(time),
+                                           'new'))
+            continue
+        change = time / baseline[name] - 1
+        mark = ''
+        if change > args.threshold:
+            regressions.append(name)
+            mark = '  REGRESSION'
+        print('%-44s %12s %12s %+7.1f%%%s' % (
+            name, format_time(baseline[name]), format_time(time),
+            100 * change, mark))
+
+    if regressions:
+        print('%d of the benchmarks got more than %.0f%% slower.' % (
+            len(regressions), 100 * args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())